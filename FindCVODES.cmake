@@ -7,6 +7,7 @@
 # also defined, but not for general use are
 #  CVODES_LIBRARY, where to find CVODES.
 #  CVODES_NVECTOR_SERIAL_LIBRARY, where to find NVECTOR_SERIAL.
+#  CVODES_NVECTOR_OPENMP_LIBRARY, where to find NVECTOR_OPENMP (optional).
 
 FIND_PATH(CVODES_INCLUDE_DIR cvodes/cvodes.h 
 		${CSIM_DEPENDENCY_DIR}/include
@@ -26,6 +27,12 @@ FIND_LIBRARY(CVODES_NVECTOR_SERIAL_LIBRARY sundials_nvecserial
         /usr/local/lib
 ) 
 
+FIND_LIBRARY(CVODES_NVECTOR_OPENMP_LIBRARY sundials_nvecopenmp
+		${CSIM_DEPENDENCY_DIR}/lib
+        /usr/lib
+        /usr/local/lib
+) 
+
 IF (CVODES_INCLUDE_DIR AND CVODES_LIBRARY AND CVODES_NVECTOR_SERIAL_LIBRARY)
    SET(CVODES_LIBRARIES ${CVODES_LIBRARY} ${CVODES_NVECTOR_SERIAL_LIBRARY})
    SET(CVODES_FOUND TRUE)
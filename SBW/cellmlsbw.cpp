@@ -130,7 +130,13 @@ void CellmlSbw::oneStep(double stepSize)
 // this method brings the model to the next steady state
 void CellmlSbw::steadyState()
 {
-	std::cerr << "CellmlSbw::steadyState: Not implemented." << std::endl;
+	double residualNorm;
+	if (csim->steadyState(residualNorm) != 0)
+	{
+		std::cerr << "CellmlSbw::steadyState: Error finding the steady state." << std::endl;
+		return;
+	}
+	std::cout << "Success in finding the steady state (residual norm: " << residualNorm << ")." << std::endl;
 }
 
 void CellmlSbw::registerNamespace(const string &prefix, const string &uri)
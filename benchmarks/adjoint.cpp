@@ -0,0 +1,165 @@
+/*
+ * Compare the gradient of a least squares objective with respect to many of the model's constants
+ * computed by the adjoint sensitivity analysis against the forward sensitivity analysis. The data
+ * are the model's own outputs, scaled by 1%, at each tabulation point:
+ *
+ *   adjoint-benchmark <simulation.xml> [constant index ...]
+ *
+ * With no constant indices given, all the model's constants are used.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+struct LeastSquaresData
+{
+	int nOutputs;
+	std::vector<double> values;
+};
+
+static double leastSquaresSample(int k, double t, const double* outputs, double* gradient, void* userData)
+{
+	const struct LeastSquaresData* data = (const struct LeastSquaresData*)userData;
+	double value = 0.0;
+	for (int i = 0; i < data->nOutputs; ++i)
+	{
+		gradient[i] = outputs[i] - data->values[k*data->nOutputs + i];
+		value += 0.5*gradient[i]*gradient[i];
+	}
+	return value;
+}
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[constant index ...]") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	std::vector<struct SensitivityParameter> parameters;
+	for (int i = 2; i < argc; ++i)
+	{
+		struct SensitivityParameter parameter;
+		parameter.isState = 0;
+		parameter.index = atoi(argv[i]);
+		parameters.push_back(parameter);
+	}
+	if (parameters.empty())
+	{
+		for (int i = 0; i < em->nConstants; ++i)
+		{
+			struct SensitivityParameter parameter;
+			parameter.isState = 0;
+			parameter.index = i;
+			parameters.push_back(parameter);
+		}
+	}
+	int nParameters = parameters.size(), nOutputs = em->nOutputs;
+	printf("Model has generated adjoint code: %s\n", em->hasAdjoint() ? "yes" : "no");
+	printf("Number of parameters: %d\n", nParameters);
+
+	// the forward sensitivities, also giving the data
+	std::vector<double> initialStates(em->states, em->states + em->nRates);
+	double t0 = simulationGetBvarStart(simulation);
+	double tEnd = simulationGetBvarEnd(simulation);
+	double tabT = simulationGetBvarTabStep(simulation);
+	struct Integrator* integrator = CreateIntegrator(simulation, em);
+	if (!integrator || (integratorEnableSensitivities(integrator, nParameters, &(parameters[0])) != OK))
+	{
+		ERROR("main", "Unable to set up the forward sensitivities\n");
+		return 1;
+	}
+	struct Timer* timer = CreateTimer();
+	startTimer(timer);
+	std::vector<double> times, outputs, sensitivities(nParameters*nOutputs);
+	std::vector<std::vector<double> > outputSensitivities;
+	double tout = t0 + tabT;
+	if (tout > tEnd) tout = tEnd;
+	int code = OK;
+	while (code == OK)
+	{
+		double t;
+		code = integrate(integrator, tout, &t);
+		if (code == OK) code = integratorGetOutputSensitivities(integrator, &(sensitivities[0]));
+		times.push_back(t);
+		outputs.insert(outputs.end(), em->outputs, em->outputs + nOutputs);
+		outputSensitivities.push_back(sensitivities);
+		if (fabs(tEnd - t) < ZERO_TOL) break;
+		tout += tabT;
+		if (tout > tEnd) tout = tEnd;
+	}
+	stopTimer(timer);
+	double forwardTime = getWallTime(timer);
+	DestroyIntegrator(&integrator);
+	if (code != OK)
+	{
+		ERROR("main", "Forward sensitivity simulation failed\n");
+		return 1;
+	}
+	struct LeastSquaresData data;
+	data.nOutputs = nOutputs;
+	for (size_t i = 0; i < outputs.size(); ++i) data.values.push_back(1.01*outputs[i]);
+	std::vector<double> forwardGradient(nParameters, 0.0);
+	for (size_t k = 0; k < times.size(); ++k)
+		for (int p = 0; p < nParameters; ++p)
+			for (int j = 0; j < nOutputs; ++j)
+				forwardGradient[p] += (outputs[k*nOutputs + j] - data.values[k*nOutputs + j])*
+					outputSensitivities[k][p*nOutputs + j];
+
+	// and the adjoint
+	memcpy(em->states, &(initialStates[0]), sizeof(double)*em->nRates);
+	integrator = CreateIntegrator(simulation, em);
+	struct AdjointObjective objective;
+	objective.integrand = NULL;
+	objective.sample = leastSquaresSample;
+	objective.nSamples = times.size();
+	objective.sampleTimes = &(times[0]);
+	objective.userData = &data;
+	std::vector<double> adjointGradient(nParameters);
+	double value;
+	startTimer(timer);
+	code = integrator ? integratorAdjointGradient(integrator, t0, times.back(), &objective, nParameters,
+												  &(parameters[0]), &value, &(adjointGradient[0])) : ERR;
+	stopTimer(timer);
+	double adjointTime = getWallTime(timer);
+	DestroyIntegrator(&integrator);
+	if (code != OK)
+	{
+		ERROR("main", "Adjoint gradient failed\n");
+		return 1;
+	}
+
+	double scale = 0.0, difference = 0.0;
+	for (int p = 0; p < nParameters; ++p)
+	{
+		scale = fmax(scale, fabs(forwardGradient[p]));
+		difference = fmax(difference, fabs(forwardGradient[p] - adjointGradient[p]));
+	}
+	printf("Objective: %12.6e\n", value);
+	printf("%-22s %12s\n", "method", "wall (s)");
+	printf("%-22s %12.6f\n", "forward sensitivities", forwardTime);
+	printf("%-22s %12.6f\n", "adjoint", adjointTime);
+	printf("Largest difference in the gradients, relative to the largest gradient: %12.4e\n",
+		   (scale > 0.0) ? difference/scale : difference);
+	DestroyTimer(&timer);
+	return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * Time the evaluation of a model with algebraic loops (the equations the CCGS flags for
+ * Newton-Raphson) and report the work done by the algebraic loop solver. The rates are evaluated
+ * repeatedly with the bound variable stepped through the simulation, so each solve is warm started
+ * from the previous one as it would be during an integration, and then the whole simulation is
+ * integrated.
+ *
+ *   algebraic-loops-benchmark <simulation.xml> [number of evaluations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "ccgs_required_functions.h"
+#include "integrator.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+static void printStatistics(const char* label, double wallTime, const struct NRStatistics* start)
+{
+	struct NRStatistics stats;
+	NR_getStatistics(&stats);
+	long nSolves = stats.nSolves - start->nSolves;
+	printf("%-12s %12.6f %10ld %12.3f %12.3f %10ld %10ld\n", label, wallTime, nSolves,
+		   nSolves ? (double)(stats.nIterations - start->nIterations)/nSolves : 0.0,
+		   nSolves ? (double)(stats.nFunctionEvals - start->nFunctionEvals)/nSolves : 0.0,
+		   stats.nRestarts - start->nRestarts, stats.nFailures - start->nFailures);
+}
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[number of evaluations]") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	int nEvaluations = (argc > 2) ? atoi(argv[2]) : 10000;
+	double tStart = simulationGetBvarStart(simulation);
+	double tEnd = simulationGetBvarEnd(simulation);
+	struct NRStatistics start;
+	struct Timer* timer = CreateTimer();
+	printf("%-12s %12s %10s %12s %12s %10s %10s\n", "", "wall (s)", "solves", "iters/solve", "evals/solve",
+		   "restarts", "failures");
+
+	NR_getStatistics(&start);
+	startTimer(timer);
+	for (int i = 0; i < nEvaluations; ++i) em->computeRates(tStart + (tEnd - tStart)*i/nEvaluations);
+	stopTimer(timer);
+	printStatistics("rates", getWallTime(timer), &start);
+
+	NR_getStatistics(&start);
+	struct Integrator* integrator = CreateIntegrator(simulation, em);
+	int code = ERR;
+	if (integrator)
+	{
+		double t;
+		startTimer(timer);
+		code = integrate(integrator, tEnd, &t);
+		stopTimer(timer);
+		DestroyIntegrator(&integrator);
+		if (code == OK) printStatistics("integrate", getWallTime(timer), &start);
+		else printf("integration failed at t = %g\n", t);
+	}
+	DestroyTimer(&timer);
+	return (code == OK) ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+/*
+ * Time each of the solver configurations tried by the autotuner over a calibration window (the first
+ * tenth of the simulation by default) and report which one it picks, along with the cost of the
+ * whole simulation with the default and the chosen configurations.
+ *
+ *   autotune-benchmark <simulation.xml> [calibration window]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <vector>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "autotune.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+static void configurationLabel(const struct SolverConfiguration* configuration, char* label)
+{
+	sprintf(label, "%s/%s/%s", multistepMethodToString(configuration->lmm),
+			iterationMethodToString(configuration->iter), linearSolverToString(configuration->solver));
+}
+
+/* Simulate the whole simulation with the given configuration, returning the wall time (or a negative
+   value if the integration failed) */
+static double simulateAll(struct Simulation* simulation, ExecutableModel* em, const std::vector<double>& states,
+						  const struct SolverConfiguration* configuration, long int* nRhsEvals)
+{
+	struct Simulation* sim = simulationClone(simulation);
+	simulationSetIntegrationScheme(sim, CVODE);
+	simulationSetMultistepMethod(sim, configuration->lmm);
+	simulationSetIterationMethod(sim, configuration->iter);
+	simulationSetLinearSolver(sim, configuration->solver);
+	memcpy(em->states, &(states[0]), sizeof(double)*em->nRates);
+	struct Integrator* integrator = CreateIntegrator(sim, em);
+	double wallTime = -1.0;
+	if (integrator)
+	{
+		struct Timer* timer = CreateTimer();
+		double t;
+		startTimer(timer);
+		int code = integrate(integrator, simulationGetBvarEnd(sim), &t);
+		stopTimer(timer);
+		struct IntegratorStatistics stats;
+		integratorGetStatistics(integrator, &stats);
+		*nRhsEvals = stats.nRhsEvals;
+		if (code == OK) wallTime = getWallTime(timer);
+		DestroyTimer(&timer);
+		DestroyIntegrator(&integrator);
+	}
+	DestroySimulation(&sim);
+	return wallTime;
+}
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[calibration window]") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	double tStart = simulationGetBvarStart(simulation);
+	double tEnd = simulationGetBvarEnd(simulation);
+	double window = (argc > 2) ? atof(argv[2]) : 0.1*(tEnd - tStart);
+	std::vector<double> initialStates(em->states, em->states + em->nRates);
+
+	int nConfigurations = autotuneNumConfigurations();
+	std::vector<struct AutotuneResult> results(nConfigurations);
+	struct SolverConfiguration best;
+	struct Timer* timer = CreateTimer();
+	startTimer(timer);
+	int code = autotuneSolver(simulation, em, tStart, window, &best, &(results[0]));
+	stopTimer(timer);
+	if (code != OK)
+	{
+		ERROR("main", "Autotuning failed\n");
+		DestroyTimer(&timer);
+		return 1;
+	}
+	char label[128];
+	printf("calibration window %g, autotuning took %g s\n", window, getWallTime(timer));
+	printf("%-24s %10s %10s %12s %14s %s\n", "configuration", "steps", "f evals", "wall (s)", "error", "");
+	for (int i = 0; i < nConfigurations; ++i)
+	{
+		configurationLabel(&(results[i].configuration), label);
+		if (results[i].error < 0.0) printf("%-24s failed\n", label);
+		else printf("%-24s %10ld %10ld %12.6f %14.6e %s\n", label, results[i].nSteps, results[i].nRhsEvals,
+					results[i].wallTime, results[i].error, results[i].accepted ? "" : "(rejected)");
+	}
+
+	// the whole simulation with the default and chosen configurations
+	long int nRhsEvals = 0;
+	configurationLabel(&(results[0].configuration), label);
+	double defaultTime = simulateAll(simulation, em, initialStates, &(results[0].configuration), &nRhsEvals);
+	printf("full simulation, default %-24s %12.6f s %10ld f evals\n", label, defaultTime, nRhsEvals);
+	configurationLabel(&best, label);
+	double bestTime = simulateAll(simulation, em, initialStates, &best, &nRhsEvals);
+	printf("full simulation, chosen  %-24s %12.6f s %10ld f evals\n", label, bestTime, nRhsEvals);
+	if ((defaultTime > 0.0) && (bestTime > 0.0)) printf("speedup: %g\n", defaultTime/bestTime);
+
+	DestroyTimer(&timer);
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Throughput of an ensemble of simulations with CVODE, one simulation at a time on each thread, and
+ * with the batched Rosenbrock integrator, a batch of simulations in lock-step on each thread. A Latin
+ * hypercube sample of the given number of points (1000 by default) varies the first few constants of
+ * the model by up to 10% either side of their initial values, and both sweeps use the given number
+ * of threads (one by default). The largest difference between the outputs of the two sweeps is
+ * reported relative to the largest output.
+ *
+ *   batched-integrator-benchmark <simulation.xml> [simulations] [threads]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "parameter-sweep.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+/* the number of constants varied in the sweep */
+#define SWEEP_PARAMETERS 4
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[simulations] [threads]") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	int nSimulations = (argc > 2) ? atoi(argv[2]) : 1000;
+	int nThreads = (argc > 3) ? atoi(argv[3]) : 1;
+	if (nSimulations < 1) nSimulations = 1;
+	if (nThreads < 1) nThreads = 1;
+	int nParameters = std::min(SWEEP_PARAMETERS, em->nConstants);
+	std::vector<struct SensitivityParameter> parameters(nParameters);
+	std::vector<double> lower(nParameters), upper(nParameters);
+	for (int j = 0; j < nParameters; ++j)
+	{
+		parameters[j].isState = 0;
+		parameters[j].index = j;
+		lower[j] = 0.9 * em->constants[j];
+		upper[j] = 1.1 * em->constants[j];
+	}
+	std::vector<double> values(nSimulations * nParameters + 1);
+	if (nParameters > 0)
+		parameterSweepLatinHypercube(nParameters, &(lower[0]), &(upper[0]), nSimulations, 1, &(values[0]));
+	int nPoints = parameterSweepNumOutputPoints(simulation);
+	long int nResults = (long int)nSimulations * nPoints * em->nOutputs;
+	std::vector<double> cvodeResults(nResults + 1), batchedResults(nResults + 1);
+	std::vector<int> status(nSimulations);
+
+	printf("%d simulations varying %d constants on %d threads, %d output points each\n", nSimulations,
+		   nParameters, nThreads, nPoints);
+	printf("%-10s %12s %14s %10s %12s %14s\n", "method", "wall (s)", "sims/s", "failures", "steps", "rhs evals");
+	struct ParameterSweepStatistics cvodeStats, batchedStats;
+	parameterSweepRun(simulation, em, nParameters, nParameters ? &(parameters[0]) : NULL, nSimulations,
+					  &(values[0]), nThreads, &(cvodeResults[0]), &(status[0]), &cvodeStats);
+	printf("%-10s %12.6f %14.2f %10d %12ld %14ld\n", "cvode", cvodeStats.wallTime,
+		   nSimulations / cvodeStats.wallTime, cvodeStats.nFailures, cvodeStats.nSteps, cvodeStats.nRhsEvals);
+	parameterSweepRunBatched(simulation, em, nParameters, nParameters ? &(parameters[0]) : NULL, nSimulations,
+							 &(values[0]), nThreads, &(batchedResults[0]), &(status[0]), &batchedStats);
+	printf("%-10s %12.6f %14.2f %10d %12ld %14ld\n", "batched", batchedStats.wallTime,
+		   nSimulations / batchedStats.wallTime, batchedStats.nFailures, batchedStats.nSteps,
+		   batchedStats.nRhsEvals);
+
+	double maxOutput = 0.0, maxDifference = 0.0;
+	for (long int i = 0; i < nResults; ++i)
+	{
+		maxOutput = std::max(maxOutput, fabs(cvodeResults[i]));
+		maxDifference = std::max(maxDifference, fabs(cvodeResults[i] - batchedResults[i]));
+	}
+	printf("speedup %.2f, largest relative difference %g\n", cvodeStats.wallTime / batchedStats.wallTime,
+		   (maxOutput > 0.0) ? maxDifference / maxOutput : maxDifference);
+	return 0;
+}
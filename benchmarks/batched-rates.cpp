@@ -0,0 +1,83 @@
+/*
+ * Rates evaluations per second with the scalar and the batched (SIMD) code, for a batch of instances
+ * of the model which differ in their constants (each varied by up to 1%). Also checks that the two
+ * give the same rates. The rates of each instance are evaluated the given number of times (100000 by
+ * default).
+ *
+ *   batched-rates-benchmark <simulation.xml> [evaluations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "ModelBatch.hpp"
+#include "benchmark-utils.hpp"
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[evaluations]") != OK) return 1;
+	ExecutableModel* em = benchmark.em;
+	int nEvaluations = (argc > 2) ? atoi(argv[2]) : 100000;
+	if (nEvaluations < 1) nEvaluations = 1;
+	ModelBatch batch;
+	batch.initialise(em->compiledModel());
+	std::vector<ExecutableModel*> instances(batch.width);
+	srand(1);
+	for (int lane = 0; lane < batch.width; ++lane)
+	{
+		instances[lane] = em->clone();
+		for (int i = 0; i < em->nConstants; ++i)
+			instances[lane]->constants[i] *= 1.0 + 0.02 * ((double)rand() / RAND_MAX - 0.5);
+		batch.setLane(lane, instances[lane]);
+	}
+	double voi = em->bound[0];
+
+	struct Timer* timer = CreateTimer();
+	startTimer(timer);
+	for (int k = 0; k < nEvaluations; ++k)
+		for (int lane = 0; lane < batch.width; ++lane) instances[lane]->computeRates(voi);
+	stopTimer(timer);
+	double scalarTime = getWallTime(timer);
+	startTimer(timer);
+	for (int k = 0; k < nEvaluations; ++k) batch.computeRates();
+	stopTimer(timer);
+	double batchedTime = getWallTime(timer);
+	DestroyTimer(&timer);
+
+	// the largest difference in any rate, relative to its magnitude
+	double maxDifference = 0.0;
+	for (int lane = 0; lane < batch.width; ++lane)
+	{
+		for (int i = 0; i < em->nRates; ++i)
+		{
+			double scalar = instances[lane]->rates[i], batched = batch.rates[i*batch.width + lane];
+			double difference = fabs(scalar - batched) / fmax(fabs(scalar), 1.0e-300);
+			if ((scalar != batched) && !(difference <= maxDifference)) maxDifference = difference;
+		}
+		delete instances[lane];
+	}
+	double nTotal = (double)nEvaluations * batch.width;
+	printf("batch width %d, %s code\n", batch.width, batch.isBatched() ? "batched" : "no batched");
+	printf("%-10s %12s %16s %10s\n", "code", "wall (s)", "evaluations/s", "speedup");
+	printf("%-10s %12.6f %16.2f %10.2f\n", "scalar", scalarTime, nTotal/scalarTime, 1.0);
+	printf("%-10s %12.6f %16.2f %10.2f\n", "batched", batchedTime, nTotal/batchedTime, scalarTime/batchedTime);
+	printf("largest relative difference in the rates: %g\n", maxDifference);
+	return 0;
+}
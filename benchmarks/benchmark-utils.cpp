@@ -0,0 +1,93 @@
+/*
+ * Helpers shared by the CSim benchmarks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "xpath.hpp"
+#include "CellmlCode.hpp"
+#include "ModelCompiler.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+struct Simulation* loadBenchmarkSimulation(const char* file)
+{
+	char* inputURI = getAbsoluteURI(file);
+	struct Simulation* simulation = getSimulation(inputURI);
+	free(inputURI);
+	if (!(simulation && simulationIsValidDescription(simulation)))
+	{
+		ERROR("loadBenchmarkSimulation", "Invalid simulation description in '%s'\n", file);
+		if (simulation) DestroySimulation(&simulation);
+		return NULL;
+	}
+	return simulation;
+}
+
+ExecutableModel* createBenchmarkModel(const char* executable, struct Simulation* simulation,
+									  CellmlCode* code)
+{
+	ModelCompiler mc(executable, false, false);
+	ExecutableModel* em = new ExecutableModel();
+	if (em->initialise(&mc, code->codeFileName(), simulationGetBvarStart(simulation)) != 0)
+	{
+		ERROR("createBenchmarkModel", "Unable to create the executable model from '%s'\n",
+			  code->codeFileName());
+		delete em;
+		return NULL;
+	}
+	if (simulationApplyVariableATol(simulation, em->nRates) != OK)
+	{
+		delete em;
+		return NULL;
+	}
+	return em;
+}
+
+Benchmark::Benchmark() : simulation(NULL), em(NULL)
+{
+}
+
+Benchmark::~Benchmark()
+{
+	if (em) delete em;
+	if (simulation) DestroySimulation(&simulation);
+}
+
+int Benchmark::initialise(int argc, char* argv[], const char* usage, int minArguments,
+						  int maxArguments, bool createModel)
+{
+	int nArguments = argc - 2;
+	if ((nArguments < minArguments) || ((maxArguments >= 0) && (nArguments > maxArguments)))
+	{
+		printf("Usage: %s <simulation.xml>%s%s\n", argv[0], (usage && usage[0]) ? " " : "",
+			   usage ? usage : "");
+		return ERR;
+	}
+	setQuiet();
+	simulation = loadBenchmarkSimulation(argv[1]);
+	if (!simulation) return ERR;
+	if (code.createCodeForSimulation(simulation) != 0)
+	{
+		ERROR("Benchmark::initialise", "Unable to generate the code for '%s'\n", argv[1]);
+		return ERR;
+	}
+	if (createModel)
+	{
+		em = createBenchmarkModel(argv[0], simulation, &code);
+		if (!em) return ERR;
+	}
+	return OK;
+}
@@ -0,0 +1,46 @@
+/*
+ * Helpers shared by the CSim benchmarks.
+ */
+#ifndef BENCHMARK_UTILS_HPP_
+#define BENCHMARK_UTILS_HPP_
+
+#include "CellmlCode.hpp"
+
+struct Simulation;
+class ExecutableModel;
+
+/* Load the simulation described in the given file, returning NULL if it is not a valid
+   simulation description. */
+struct Simulation* loadBenchmarkSimulation(const char* file);
+
+/* Create a new executable model from the code previously generated for the simulation. Returns
+   NULL on error. */
+ExecutableModel* createBenchmarkModel(const char* executable, struct Simulation* simulation,
+									  CellmlCode* code);
+
+/*
+ * The setup shared by the benchmarks, which are run as
+ *   <benchmark> <simulation.xml> [arguments ...]
+ * The simulation, the code generated for it and the executable model created from that code are
+ * destroyed along with the benchmark.
+ */
+class Benchmark
+{
+public:
+	Benchmark();
+	~Benchmark();
+
+	/* Check the command line, printing the usage (the arguments after the simulation file) if
+	   there are fewer than minArguments or (unless it is negative) more than maxArguments
+	   arguments after the simulation file. Then turn off the CSim messages, load the simulation,
+	   generate its code and, if createModel is true, create the executable model. Returns ERR on
+	   error. */
+	int initialise(int argc, char* argv[], const char* usage, int minArguments = 0,
+				   int maxArguments = -1, bool createModel = true);
+
+	struct Simulation* simulation;
+	CellmlCode code;
+	ExecutableModel* em;
+};
+
+#endif /* BENCHMARK_UTILS_HPP_ */
@@ -0,0 +1,108 @@
+/*
+ * Memory and time of an ensemble kept as its full set of outputs (parameterSweepRun) and as streaming
+ * statistics (parameterSweepRunEnsemble). A Latin hypercube sample of the given number of points (1000
+ * by default) varies the first few constants of the model by up to 10% either side of their initial
+ * values, on the given number of threads (the number of hardware threads by default). The mean and
+ * median from the statistics are checked against those computed from the full outputs.
+ *
+ *   ensemble-statistics-benchmark <simulation.xml> [simulations] [threads]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "ensemble-statistics.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "parameter-sweep.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+/* the number of constants varied in the ensemble */
+#define ENSEMBLE_PARAMETERS 4
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[simulations] [threads]") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	int nSimulations = (argc > 2) ? atoi(argv[2]) : 1000;
+	int nThreads = (argc > 3) ? atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+	if (nSimulations < 1) nSimulations = 1;
+	if (nThreads < 1) nThreads = 1;
+	int nParameters = std::min(ENSEMBLE_PARAMETERS, em->nConstants);
+	std::vector<struct SensitivityParameter> parameters(nParameters);
+	std::vector<double> lower(nParameters), upper(nParameters);
+	for (int j = 0; j < nParameters; ++j)
+	{
+		parameters[j].isState = 0;
+		parameters[j].index = j;
+		lower[j] = 0.9 * em->constants[j];
+		upper[j] = 1.1 * em->constants[j];
+	}
+	std::vector<double> values(nSimulations * nParameters + 1);
+	if (nParameters > 0)
+		parameterSweepLatinHypercube(nParameters, &(lower[0]), &(upper[0]), nSimulations, 1, &(values[0]));
+	int nPoints = parameterSweepNumOutputPoints(simulation);
+	int nValues = nPoints * em->nOutputs;
+	std::vector<int> status(nSimulations);
+	printf("%d simulations varying %d constants on %d threads, %d points of %d outputs each\n", nSimulations,
+		   nParameters, nThreads, nPoints, em->nOutputs);
+
+	struct ParameterSweepStatistics sweepStats, ensembleStats;
+	std::vector<double> results((long int)nSimulations * nValues);
+	parameterSweepRun(simulation, em, nParameters, nParameters ? &(parameters[0]) : NULL, nSimulations,
+					  &(values[0]), nThreads, &(results[0]), &(status[0]), &sweepStats);
+	struct EnsembleStatistics* statistics = CreateEnsembleStatistics(nPoints, em->nOutputs, 0.0);
+	parameterSweepRunEnsemble(simulation, em, nParameters, nParameters ? &(parameters[0]) : NULL, nSimulations,
+							  &(values[0]), nThreads, statistics, &(status[0]), &ensembleStats);
+	// each thread has its own statistics
+	double statisticsBytes = (double)nThreads * nValues * (32.0 * (ensembleStatisticsCompression(statistics) + 2));
+	printf("%-12s %12s %14s %10s\n", "method", "wall (s)", "memory (MB)", "failures");
+	printf("%-12s %12.6f %14.2f %10d\n", "outputs", sweepStats.wallTime,
+		   sizeof(double) * (double)results.size() / 1048576.0, sweepStats.nFailures);
+	printf("%-12s %12.6f %14.2f %10d\n", "statistics", ensembleStats.wallTime, statisticsBytes / 1048576.0,
+		   ensembleStats.nFailures);
+
+	// compare with the statistics of the full set of outputs, leaving out the failed simulations as the ensemble does
+	std::vector<double> mean(nValues), median(nValues), column;
+	ensembleStatisticsMean(statistics, &(mean[0]));
+	ensembleStatisticsQuantile(statistics, 0.5, &(median[0]));
+	double maxMeanError = 0.0, maxMedianError = 0.0, maxValue = 0.0;
+	for (int i = 0; i < nValues; ++i)
+	{
+		column.clear();
+		for (int s = 0; s < nSimulations; ++s)
+			if (!isnan(results[(long int)s * nValues + i])) column.push_back(results[(long int)s * nValues + i]);
+		if (column.empty()) continue;
+		double sum = 0.0;
+		for (size_t s = 0; s < column.size(); ++s) sum += column[s];
+		std::sort(column.begin(), column.end());
+		double exactMedian = (column.size() % 2) ? column[column.size()/2] :
+			0.5 * (column[column.size()/2 - 1] + column[column.size()/2]);
+		maxMeanError = std::max(maxMeanError, fabs(mean[i] - sum / column.size()));
+		maxMedianError = std::max(maxMedianError, fabs(median[i] - exactMedian));
+		maxValue = std::max(maxValue, std::max(fabs(column.front()), fabs(column.back())));
+	}
+	if (maxValue == 0.0) maxValue = 1.0;
+	printf("largest relative differences from the full outputs: mean %g, median %g\n", maxMeanError / maxValue,
+		   maxMedianError / maxValue);
+	DestroyEnsembleStatistics(&statistics);
+	return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * Compare evaluating the residuals of experimental data by simulating the model, storing the
+ * outputs at each tabulation point and then comparing them to the data, against evaluating them
+ * during the integration (experimentalDataResiduals). The data are the model's own outputs, scaled
+ * by 1%, at every second tabulation point:
+ *
+ *   fused-residuals-benchmark <simulation.xml> [repeats]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "experimental-data.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[repeats]") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	int repeats = (argc > 2) ? atoi(argv[2]) : 10;
+	if (repeats < 1) repeats = 1;
+	int nOutputs = em->nOutputs;
+	std::vector<double> initialStates(em->states, em->states + em->nRates);
+	double t0 = simulationGetBvarStart(simulation);
+	double tEnd = simulationGetBvarEnd(simulation);
+	double tabT = simulationGetBvarTabStep(simulation);
+	struct Integrator* integrator = CreateIntegrator(simulation, em);
+	if (!integrator)
+	{
+		ERROR("main", "Unable to create the integrator\n");
+		return 1;
+	}
+
+	// simulate, storing the outputs, and then compare with the data
+	struct ExperimentalData* data = NULL;
+	std::vector<double> values;
+	struct Timer* timer = CreateTimer();
+	double sumOfSquares = 0.0;
+	int code = OK;
+	startTimer(timer);
+	for (int r = 0; (r < repeats) && (code == OK); ++r)
+	{
+		memcpy(em->states, &(initialStates[0]), sizeof(double)*em->nRates);
+		integratorReinitialise(integrator, t0);
+		std::vector<double> times, outputs;
+		double tout = t0 + tabT;
+		if (tout > tEnd) tout = tEnd;
+		while (code == OK)
+		{
+			double t;
+			code = integrate(integrator, tout, &t);
+			times.push_back(t);
+			outputs.insert(outputs.end(), em->outputs, em->outputs + nOutputs);
+			if (fabs(tEnd - t) < ZERO_TOL) break;
+			tout += tabT;
+			if (tout > tEnd) tout = tEnd;
+		}
+		if (!data)
+		{
+			data = CreateExperimentalData();
+			for (size_t k = 1; k < times.size(); k += 2)
+			{
+				for (int i = 0; i < nOutputs; ++i)
+				{
+					char id[32];
+					sprintf(id, "output_%d", i);
+					values.push_back(1.01*outputs[k*nOutputs + i]);
+					experimentalDataAdd(data, times[k], id, values.back(), 1.0);
+					experimentalDataSetOutput(data, experimentalDataNumObservations(data) - 1, i);
+				}
+			}
+		}
+		sumOfSquares = 0.0;
+		size_t j = 0;
+		for (size_t k = 1; k < times.size(); k += 2)
+		{
+			for (int i = 0; i < nOutputs; ++i, ++j)
+			{
+				double residual = outputs[k*nOutputs + i] - values[j];
+				sumOfSquares += residual*residual;
+			}
+		}
+	}
+	stopTimer(timer);
+	double storedTime = getWallTime(timer);
+	if ((code != OK) || (experimentalDataNumObservations(data) == 0))
+	{
+		ERROR("main", "Simulation failed or there are too few tabulation points\n");
+		return 1;
+	}
+
+	// and evaluated during the integration
+	double fusedSumOfSquares = 0.0;
+	startTimer(timer);
+	for (int r = 0; (r < repeats) && (code == OK); ++r)
+	{
+		memcpy(em->states, &(initialStates[0]), sizeof(double)*em->nRates);
+		code = experimentalDataResiduals(data, integrator, em, t0, NULL, &fusedSumOfSquares);
+	}
+	stopTimer(timer);
+	double fusedTime = getWallTime(timer);
+	if (code != OK)
+	{
+		ERROR("main", "Fused residual evaluation failed\n");
+		return 1;
+	}
+
+	printf("Number of observations: %d\n", experimentalDataNumObservations(data));
+	printf("%-22s %12s %16s\n", "method", "wall (s)", "sum of squares");
+	printf("%-22s %12.6f %16.8e\n", "simulate then compare", storedTime, sumOfSquares);
+	printf("%-22s %12.6f %16.8e\n", "fused", fusedTime, fusedSumOfSquares);
+	DestroyExperimentalData(&data);
+	DestroyIntegrator(&integrator);
+	DestroyTimer(&timer);
+	return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * Pacing a model to its limit cycle through the persistent initial condition cache: the first run
+ * paces the model and stores the paced states, later runs with the same model, constants, protocol
+ * and tolerances just look them up. The cache file is created afresh and removed at the end.
+ *
+ *   initial-condition-cache-benchmark <simulation.xml> <period> [tolerance] [max cycles] [repeats]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <vector>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "initial-condition-cache.hpp"
+#include "autotune.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "<period> [tolerance] [max cycles] [repeats]", 1) != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	double period = atof(argv[2]);
+	double tolerance = (argc > 3) ? atof(argv[3]) : 1.0e-6;
+	int maxCycles = (argc > 4) ? atoi(argv[4]) : 10000;
+	int repeats = (argc > 5) ? atoi(argv[5]) : 10;
+	if (repeats < 1) repeats = 1;
+	// the model is identified by its generated code
+	uint64_t modelHash = FNV1A_OFFSET_BASIS;
+	FILE* codeFile = fopen(benchmark.code.codeFileName(), "rb");
+	if (codeFile)
+	{
+		char buffer[4096];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), codeFile)) > 0) modelHash = fnv1aHash(buffer, n, modelHash);
+		fclose(codeFile);
+	}
+	char cacheFile[64];
+	sprintf(cacheFile, "csim-initial-conditions-%d.cache", rand());
+	remove(cacheFile);
+	double tStart = simulationGetBvarStart(simulation);
+	std::vector<double> initialStates(em->states, em->states + em->nRates);
+	std::vector<double> pacedStates;
+	struct Timer* timer = CreateTimer();
+	printf("%-18s %8s %12s %14s\n", "run", "cached", "wall (s)", "state diff");
+	for (int r = 0; r <= repeats; ++r)
+	{
+		memcpy(em->states, &(initialStates[0]), sizeof(double)*em->nRates);
+		double tEnd;
+		int cached;
+		startTimer(timer);
+		int code = initialConditionPace(cacheFile, modelHash, simulation, em, tStart, period, maxCycles, tolerance,
+										0, &tEnd, &cached);
+		stopTimer(timer);
+		if (code != OK)
+		{
+			ERROR("main", "No limit cycle found\n");
+			break;
+		}
+		// the difference between the cached states and those from pacing, relative to the latter
+		double difference = 0.0;
+		if (r > 0)
+		{
+			for (int i = 0; i < em->nRates; ++i)
+				difference = fmax(difference, fabs(em->states[i] - pacedStates[i])/fmax(fabs(pacedStates[i]), 1.0));
+		}
+		else pacedStates.assign(em->states, em->states + em->nRates);
+		printf("%-18s %8s %12.6f %14.6e\n", (r == 0) ? "pace and store" : "lookup", cached ? "yes" : "no",
+			   getWallTime(timer), difference);
+	}
+	remove(cacheFile);
+	DestroyTimer(&timer);
+	return 0;
+}
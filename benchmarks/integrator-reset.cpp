@@ -0,0 +1,73 @@
+/*
+ * Measure the number of integrator resets per second when restarting the integration from a
+ * checkpoint, comparing destroying/creating the integrator with reinitialising it.
+ *
+ *   integrator-reset-benchmark <simulation.xml> [number of resets]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+/* Each reset is followed by a single tabulation step, as in a typical fitting loop */
+static int runBenchmark(struct Simulation* simulation, ExecutableModel* em, int nResets,
+						int reinitialise)
+{
+	double tStart = simulationGetBvarStart(simulation);
+	double tout = tStart + simulationGetBvarTabStep(simulation);
+	double* checkpoint = (double*)malloc(sizeof(double)*em->nRates);
+	memcpy(checkpoint, em->states, sizeof(double)*em->nRates);
+	struct Integrator* integrator = CreateIntegrator(simulation, em);
+	int code = integrator ? OK : ERR;
+	struct Timer* timer = CreateTimer();
+	startTimer(timer);
+	for (int i = 0; (i < nResets) && (code == OK); ++i)
+	{
+		memcpy(em->states, checkpoint, sizeof(double)*em->nRates);
+		if (reinitialise) code = integratorReinitialise(integrator, tStart);
+		else
+		{
+			DestroyIntegrator(&integrator);
+			integrator = CreateIntegrator(simulation, em);
+			code = integrator ? OK : ERR;
+		}
+		double t;
+		if (code == OK) code = integrate(integrator, tout, &t);
+	}
+	stopTimer(timer);
+	double wall = getWallTime(timer);
+	printf("%-14s %10d resets in %10.6f s = %12.1f resets/s %s\n",
+		   reinitialise ? "reinitialise" : "recreate", nResets, wall, nResets / wall,
+		   (code == OK) ? "" : "(failed)");
+	DestroyTimer(&timer);
+	if (integrator) DestroyIntegrator(&integrator);
+	free(checkpoint);
+	return code;
+}
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[number of resets]", 0, 1) != OK) return 1;
+	int nResets = (argc == 3) ? atoi(argv[2]) : 10000;
+	int code = runBenchmark(benchmark.simulation, benchmark.em, nResets, 0);
+	if (code == OK) code = runBenchmark(benchmark.simulation, benchmark.em, nResets, 1);
+	return (code == OK) ? 0 : 1;
+}
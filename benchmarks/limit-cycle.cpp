@@ -0,0 +1,73 @@
+/*
+ * Pacing a model to its limit cycle, comparing plain pacing (simulating cycle after cycle until the
+ * beat-to-beat change is below the tolerance) with pacing accelerated by Newton shooting steps on
+ * the period map.
+ *
+ *   limit-cycle-benchmark <simulation.xml> <period> [tolerance] [max cycles] [shooting interval]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <vector>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "limit-cycle.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "<period> [tolerance] [max cycles] [shooting interval]", 1) != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	double period = atof(argv[2]);
+	double tolerance = (argc > 3) ? atof(argv[3]) : 1.0e-6;
+	int maxCycles = (argc > 4) ? atoi(argv[4]) : 10000;
+	int shootingInterval = (argc > 5) ? atoi(argv[5]) : 10;
+	double tStart = simulationGetBvarStart(simulation);
+	std::vector<double> initialStates(em->states, em->states + em->nRates);
+	std::vector<double> history(maxCycles);
+	std::vector<double> pacedStates;
+	struct Timer* timer = CreateTimer();
+	printf("%-18s %10s %10s %12s %14s\n", "method", "cycles", "shooting", "wall (s)", "state diff");
+	for (int shooting = 0; shooting < 2; ++shooting)
+	{
+		memcpy(em->states, &(initialStates[0]), sizeof(double)*em->nRates);
+		struct LimitCycleStatistics stats;
+		double tEnd;
+		startTimer(timer);
+		int code = limitCycleSolve(simulation, em, tStart, period, maxCycles, tolerance,
+								   shooting ? shootingInterval : 0, &tEnd, &(history[0]), &stats);
+		stopTimer(timer);
+		// the difference between the final states from the two methods, relative to the plain pacing
+		double difference = 0.0;
+		if (shooting)
+		{
+			for (int i = 0; i < em->nRates; ++i)
+				difference = fmax(difference, fabs(em->states[i] - pacedStates[i])/fmax(fabs(pacedStates[i]), 1.0));
+		}
+		else pacedStates.assign(em->states, em->states + em->nRates);
+		printf("%-18s %10d %10d %12.6f %14.6e%s\n", shooting ? "Newton shooting" : "plain pacing", stats.nCycles,
+			   stats.nShootingSteps, getWallTime(timer), difference, (code == OK) ? "" : " (not converged)");
+		printf("  change over the last cycles:");
+		for (int k = (stats.nCycles > 5) ? stats.nCycles - 5 : 0; k < stats.nCycles; ++k) printf(" %.3e", history[k]);
+		printf("\n");
+	}
+	DestroyTimer(&timer);
+	return 0;
+}
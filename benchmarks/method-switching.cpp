@@ -0,0 +1,96 @@
+/*
+ * Compare the cost of integrating a model with the CVODES Adams method (functional iteration), the
+ * BDF method (Newton iteration with the dense solver), and automatically switching between the two
+ * based on the stiffness of the model.
+ *
+ *   method-switching-benchmark <simulation.xml>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <vector>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+/* Integrate over the simulation interval, returning the final outputs */
+static int runMethod(struct Simulation* simulation, ExecutableModel* em, const std::vector<double>& initialStates,
+					 std::vector<double>& outputs, double* wall, struct IntegratorStatistics* stats)
+{
+	memcpy(em->states, &(initialStates[0]), sizeof(double)*em->nRates);
+	struct Integrator* integrator = CreateIntegrator(simulation, em);
+	if (!integrator) return ERR;
+	double tEnd = simulationGetBvarEnd(simulation);
+	double tabT = simulationGetBvarTabStep(simulation);
+	double tout = simulationGetBvarStart(simulation) + tabT;
+	if (tout > tEnd) tout = tEnd;
+	int code = OK;
+	struct Timer* timer = CreateTimer();
+	startTimer(timer);
+	while (code == OK)
+	{
+		double t;
+		code = integrate(integrator, tout, &t);
+		if (fabs(tEnd - t) < ZERO_TOL) break;
+		tout += tabT;
+		if (tout > tEnd) tout = tEnd;
+	}
+	stopTimer(timer);
+	*wall = getWallTime(timer);
+	DestroyTimer(&timer);
+	outputs.assign(em->outputs, em->outputs + em->nOutputs);
+	integratorGetStatistics(integrator, stats);
+	DestroyIntegrator(&integrator);
+	return code;
+}
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	simulationSetIntegrationScheme(simulation, CVODE);
+	std::vector<double> initialStates(em->states, em->states + em->nRates);
+	std::vector<double> reference, outputs;
+	const enum MultistepMethod methods[] = { BDF, ADAMS, ADAMS_BDF };
+	printf("%-12s %10s %10s %10s %10s %12s %14s\n", "method", "steps", "f evals", "setups", "switches",
+		   "wall (s)", "output diff");
+	for (int m = 0; m < 3; ++m)
+	{
+		simulationSetMultistepMethod(simulation, methods[m]);
+		simulationSetIterationMethod(simulation, (methods[m] == ADAMS) ? FUNCTIONAL : NEWTON);
+		simulationSetLinearSolver(simulation, DENSE);
+		struct IntegratorStatistics stats;
+		double wall;
+		if (runMethod(simulation, em, initialStates, outputs, &wall, &stats) != OK)
+		{
+			printf("%-12s failed\n", multistepMethodToString(methods[m]));
+			continue;
+		}
+		// the largest difference in the final outputs, relative to the BDF results
+		if (m == 0) reference = outputs;
+		double difference = 0.0;
+		for (size_t j = 0; j < outputs.size(); ++j)
+			difference = fmax(difference, fabs(outputs[j] - reference[j])/fmax(fabs(reference[j]), 1.0));
+		printf("%-12s %10ld %10ld %10ld %10ld %12.6f %14.6e\n", multistepMethodToString(methods[m]), stats.nSteps,
+			   stats.nRhsEvals, stats.nLinSolvSetups, stats.nMethodSwitches, wall, difference);
+	}
+	return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * The cost of creating model instances from the shared compiled code, compared to compiling the model
+ * for each instance, and the throughput of simulations run concurrently on instances of the same
+ * compiled model. The given number of simulations (100 by default) are run with one thread and with
+ * the given number of threads (the number of hardware threads by default), each thread using its own
+ * instance and integrator.
+ *
+ *   model-instances-benchmark <simulation.xml> [simulations] [threads]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+/* Simulate over the simulation interval from the given initial states */
+static int simulate(struct Simulation* simulation, ExecutableModel* em, const std::vector<double>& initialStates)
+{
+	memcpy(em->states, &(initialStates[0]), sizeof(double)*em->nRates);
+	struct Integrator* integrator = CreateIntegrator(simulation, em);
+	if (!integrator) return ERR;
+	double t;
+	int code = integrate(integrator, simulationGetBvarEnd(simulation), &t);
+	DestroyIntegrator(&integrator);
+	return code;
+}
+
+/* Run the simulations on nThreads threads, each with its own instance of the model, returning the
+   number of failed simulations */
+static int runSimulations(struct Simulation* simulation, ExecutableModel* em, const std::vector<double>& initialStates,
+						  int nSimulations, int nThreads)
+{
+	std::atomic<int> next(0), failures(0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < nThreads; ++i)
+	{
+		ExecutableModel* instance = em->clone();
+		threads.push_back(std::thread([&, instance]() {
+			for (int s = next++; s < nSimulations; s = next++)
+				if (simulate(simulation, instance, initialStates) != OK) failures++;
+			delete instance;
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+	return failures;
+}
+
+int main(int argc, char* argv[])
+{
+	// the model is compiled here so that it can be timed
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[simulations] [threads]", 0, -1, false) != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	int nSimulations = (argc > 2) ? atoi(argv[2]) : 100;
+	int nThreads = (argc > 3) ? atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+	if (nSimulations < 1) nSimulations = 1;
+	if (nThreads < 1) nThreads = 1;
+	struct Timer* timer = CreateTimer();
+	startTimer(timer);
+	benchmark.em = createBenchmarkModel(argv[0], simulation, &(benchmark.code));
+	stopTimer(timer);
+	ExecutableModel* em = benchmark.em;
+	if (!em)
+	{
+		DestroyTimer(&timer);
+		return 1;
+	}
+	double compileTime = getWallTime(timer);
+	std::vector<double> initialStates(em->states, em->states + em->nRates);
+
+	// creating instances
+	int nInstances = 1000;
+	std::vector<ExecutableModel*> instances(nInstances);
+	startTimer(timer);
+	for (int i = 0; i < nInstances; ++i) instances[i] = em->clone();
+	stopTimer(timer);
+	double cloneTime = getWallTime(timer) / nInstances;
+	for (int i = 0; i < nInstances; ++i) delete instances[i];
+	printf("compile: %12.6f s per model\n", compileTime);
+	printf("clone:   %12.6e s per instance (%.0fx faster)\n", cloneTime, compileTime/cloneTime);
+
+	// concurrent simulations
+	printf("%-10s %12s %14s %10s\n", "threads", "wall (s)", "sims/s", "speedup");
+	double serialRate = 0.0;
+	for (int n = 1; n <= nThreads; n = (n == nThreads) ? n + 1 : std::min(2*n, nThreads))
+	{
+		startTimer(timer);
+		int failures = runSimulations(simulation, em, initialStates, nSimulations, n);
+		stopTimer(timer);
+		double rate = nSimulations / getWallTime(timer);
+		if (n == 1) serialRate = rate;
+		printf("%-10d %12.6f %14.2f %10.2f", n, getWallTime(timer), rate, rate/serialRate);
+		if (failures > 0) printf(" (%d failed)", failures);
+		printf("\n");
+	}
+	DestroyTimer(&timer);
+	return 0;
+}
@@ -0,0 +1,144 @@
+/*
+ * Accuracy and cost of the multirate integration scheme compared to CVODES BDF at the simulation's
+ * tolerances, both measured against a tightly converged CVODES BDF reference solution. The multirate
+ * scheme is run with the automatic partition of the state variables, and with the given state
+ * variables (by index into the states array) as the fast states if there are any.
+ *
+ *   multirate-benchmark <simulation.xml> [fast state index ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <vector>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+/* Integrate over the simulation interval, returning the outputs at each tabulation point */
+static int runScheme(struct Simulation* simulation, ExecutableModel* em, const std::vector<double>& initialStates,
+					 std::vector<std::vector<double> >& results, double* wall, struct IntegratorStatistics* stats)
+{
+	memcpy(em->states, &(initialStates[0]), sizeof(double)*em->nRates);
+	struct Integrator* integrator = CreateIntegrator(simulation, em);
+	if (!integrator) return ERR;
+	double tEnd = simulationGetBvarEnd(simulation);
+	double tabT = simulationGetBvarTabStep(simulation);
+	double tout = simulationGetBvarStart(simulation) + tabT;
+	if (tout > tEnd) tout = tEnd;
+	int code = OK;
+	results.clear();
+	struct Timer* timer = CreateTimer();
+	startTimer(timer);
+	while (code == OK)
+	{
+		double t;
+		code = integrate(integrator, tout, &t);
+		results.push_back(std::vector<double>(em->outputs, em->outputs + em->nOutputs));
+		if (fabs(tEnd - t) < ZERO_TOL) break;
+		tout += tabT;
+		if (tout > tEnd) tout = tEnd;
+	}
+	stopTimer(timer);
+	*wall = getWallTime(timer);
+	DestroyTimer(&timer);
+	integratorGetStatistics(integrator, stats);
+	DestroyIntegrator(&integrator);
+	return code;
+}
+
+/* The largest error in any output, relative to the range of that output in the reference */
+static double relativeError(const std::vector<std::vector<double> >& results,
+							const std::vector<std::vector<double> >& reference)
+{
+	double maxError = 0.0;
+	if (reference.empty() || (results.size() != reference.size())) return INFINITY;
+	for (size_t j = 0; j < reference[0].size(); ++j)
+	{
+		double lo = reference[0][j], hi = reference[0][j], error = 0.0;
+		for (size_t i = 0; i < reference.size(); ++i)
+		{
+			lo = fmin(lo, reference[i][j]);
+			hi = fmax(hi, reference[i][j]);
+			error = fmax(error, fabs(results[i][j] - reference[i][j]));
+		}
+		if (hi - lo > 0.0) error /= (hi - lo);
+		maxError = fmax(maxError, error);
+	}
+	return maxError;
+}
+
+static void printResult(const char* label, int code, double error, double wall,
+						const struct IntegratorStatistics* stats)
+{
+	printf("%-20s %12.4e %10ld %10ld %10ld %12.6f %s\n", label, error, stats->nSteps, stats->nFastSteps,
+		   stats->nRhsEvals, wall, (code == OK) ? "" : "(failed)");
+}
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[fast state index ...]") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	std::vector<double> initialStates(em->states, em->states + em->nRates);
+	std::vector<int> fastStates;
+	for (int i = 2; i < argc; ++i) fastStates.push_back(atoi(argv[i]));
+
+	// the reference solution
+	std::vector<std::vector<double> > reference, results;
+	struct IntegratorStatistics stats;
+	double wall, tol = 1.0e-10;
+	struct Simulation* bdf = simulationClone(simulation);
+	simulationSetIntegrationScheme(bdf, CVODE);
+	simulationSetMultistepMethod(bdf, BDF);
+	simulationSetIterationMethod(bdf, NEWTON);
+	simulationSetLinearSolver(bdf, DENSE);
+	struct Simulation* tight = simulationClone(bdf);
+	simulationSetRTol(tight, tol);
+	simulationSetATol(tight, 1, &tol);
+	int code = runScheme(tight, em, initialStates, reference, &wall, &stats);
+	DestroySimulation(&tight);
+	if (code != OK)
+	{
+		ERROR("main", "Unable to compute the reference solution\n");
+		DestroySimulation(&bdf);
+		return 1;
+	}
+	printf("%-20s %12s %10s %10s %10s %12s\n", "scheme", "rel. error", "steps", "substeps", "f evals",
+		   "wall (s)");
+	printResult("BDF (ref)", code, 0.0, wall, &stats);
+
+	code = runScheme(bdf, em, initialStates, results, &wall, &stats);
+	printResult("BDF", code, relativeError(results, reference), wall, &stats);
+	DestroySimulation(&bdf);
+
+	struct Simulation* multirate = simulationClone(simulation);
+	simulationSetIntegrationScheme(multirate, MULTIRATE);
+	simulationSetFastStates(multirate, 0, NULL);
+	code = runScheme(multirate, em, initialStates, results, &wall, &stats);
+	printResult("Multirate (auto)", code, relativeError(results, reference), wall, &stats);
+	if (!fastStates.empty())
+	{
+		simulationSetFastStates(multirate, (int)fastStates.size(), &(fastStates[0]));
+		code = runScheme(multirate, em, initialStates, results, &wall, &stats);
+		printResult("Multirate (given)", code, relativeError(results, reference), wall, &stats);
+	}
+	DestroySimulation(&multirate);
+	return 0;
+}
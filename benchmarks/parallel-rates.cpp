@@ -0,0 +1,87 @@
+/*
+ * Measure the speedup of the parallel rates evaluation. The rates are evaluated the given number of
+ * times (1000 by default) from the model's initial values with the serial code and then with thread
+ * pools of 2 up to the given number of threads (the number of hardware threads by default), and the
+ * time per evaluation and the speedup over the serial code are reported. The parallel rates are only
+ * generated for large models, smaller models are always evaluated serially.
+ *
+ *   parallel-rates-benchmark <simulation.xml> [evaluations] [max threads]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "thread-pool.hpp"
+#include "benchmark-utils.hpp"
+
+/* The time per evaluation of the rates */
+static double timeRates(ExecutableModel* em, double t, int nEvaluations, struct Timer* timer)
+{
+	startTimer(timer);
+	for (int i = 0; i < nEvaluations; ++i) em->computeRates(t);
+	stopTimer(timer);
+	return getWallTime(timer) / nEvaluations;
+}
+
+/* The largest difference between the rates and the reference rates, relative to the size of the
+   reference rates (or absolute for reference rates smaller than one) */
+static double ratesDifference(ExecutableModel* em, const std::vector<double>& reference)
+{
+	double maxDifference = 0.0;
+	for (int i = 0; i < em->nRates; ++i)
+		maxDifference = fmax(maxDifference, fabs(em->rates[i] - reference[i])/fmax(fabs(reference[i]), 1.0));
+	return maxDifference;
+}
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[evaluations] [max threads]") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	int nEvaluations = (argc > 2) ? atoi(argv[2]) : 1000;
+	int maxThreads = (argc > 3) ? atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+	if (nEvaluations < 1) nEvaluations = 1;
+	if (maxThreads < 1) maxThreads = 1;
+	double t = simulationGetBvarStart(simulation);
+	printf("%d state variables, ", em->nRates);
+	if (em->hasParallelRates()) printf("%d rate stages with %d tasks\n", em->nRateStages, em->nRateTasks);
+	else printf("no parallel rates (the model is too small)\n");
+
+	struct Timer* timer = CreateTimer();
+	em->computeRates(t);
+	std::vector<double> reference(em->rates, em->rates + em->nRates);
+	double serialTime = timeRates(em, t, nEvaluations, timer);
+	printf("%-10s %14s %10s %14s\n", "threads", "time (us)", "speedup", "rates diff");
+	printf("%-10s %14.3f %10.2f %14.6e\n", "serial", serialTime*1.0e6, 1.0, ratesDifference(em, reference));
+	for (int n = 2; em->hasParallelRates() && (n <= maxThreads); ++n)
+	{
+		ThreadPool pool(n);
+		em->setThreadPool(&pool);
+		em->computeRates(t);
+		double parallelTime = timeRates(em, t, nEvaluations, timer);
+		printf("%-10d %14.3f %10.2f %14.6e\n", n, parallelTime*1.0e6, serialTime/parallelTime,
+			   ratesDifference(em, reference));
+		em->setThreadPool(NULL);
+	}
+	DestroyTimer(&timer);
+	return 0;
+}
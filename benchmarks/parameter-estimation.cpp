@@ -0,0 +1,145 @@
+/*
+ * Recover some of the model's constants from data generated by the model itself (its outputs at
+ * each tabulation point), starting from values 20% too large, with Levenberg-Marquardt and with
+ * CMA-ES on one thread and on the given number of threads:
+ *
+ *   parameter-estimation-benchmark <simulation.xml> [threads] [constant index ...]
+ *
+ * With no constant indices given, the first two non-zero constants are used. Each parameter is
+ * bounded to within a factor of two of its true value.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "experimental-data.hpp"
+#include "parameter-estimation.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+static void printResult(const char* method, int code, const std::vector<double>& values,
+						const std::vector<double>& trueValues, double sumOfSquares,
+						const struct ParameterEstimationStatistics& stats)
+{
+	double error = 0.0;
+	for (size_t i = 0; i < values.size(); ++i)
+		error = fmax(error, fabs(values[i] - trueValues[i])/fabs(trueValues[i]));
+	printf("%-24s %4s %8d %8d %10ld %10ld %12.4e %12.4e %10.4f\n", method, (code == OK) ? "ok" : "fail",
+		   stats.nThreads, stats.nIterations, stats.nEvaluations, stats.nRejected, sumOfSquares, error,
+		   stats.wallTime);
+}
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[threads] [constant index ...]") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	int nThreads = (argc > 2) ? atoi(argv[2]) : 4;
+	if (nThreads < 1) nThreads = 1;
+	std::vector<struct SensitivityParameter> parameters;
+	for (int i = 3; i < argc; ++i)
+	{
+		struct SensitivityParameter parameter;
+		parameter.isState = 0;
+		parameter.index = atoi(argv[i]);
+		parameters.push_back(parameter);
+	}
+	for (int i = 0; (i < em->nConstants) && (argc < 4) && (parameters.size() < 2); ++i)
+	{
+		if (em->constants[i] == 0.0) continue;
+		struct SensitivityParameter parameter;
+		parameter.isState = 0;
+		parameter.index = i;
+		parameters.push_back(parameter);
+	}
+	int nParameters = parameters.size();
+	if (nParameters == 0)
+	{
+		ERROR("main", "No parameters to estimate\n");
+		return 1;
+	}
+	std::vector<double> trueValues, lower, upper, initialValues;
+	for (int i = 0; i < nParameters; ++i)
+	{
+		double value = em->constants[parameters[i].index];
+		trueValues.push_back(value);
+		lower.push_back(fmin(0.5*value, 2.0*value));
+		upper.push_back(fmax(0.5*value, 2.0*value));
+		initialValues.push_back(1.2*value);
+	}
+
+	// the data, every output at each tabulation point
+	double t0 = simulationGetBvarStart(simulation);
+	double tEnd = simulationGetBvarEnd(simulation);
+	double tabT = simulationGetBvarTabStep(simulation);
+	ExecutableModel* instance = em->clone();
+	struct Integrator* integrator = CreateIntegrator(simulation, instance);
+	if (!integrator)
+	{
+		ERROR("main", "Unable to create the integrator\n");
+		return 1;
+	}
+	struct ExperimentalData* data = CreateExperimentalData();
+	double tout = t0 + tabT;
+	if (tout > tEnd) tout = tEnd;
+	int code = OK;
+	while (code == OK)
+	{
+		double t;
+		code = integrate(integrator, tout, &t);
+		for (int i = 0; (code == OK) && (i < instance->nOutputs); ++i)
+		{
+			char id[32];
+			sprintf(id, "output_%d", i);
+			experimentalDataAdd(data, t, id, instance->outputs[i], 1.0);
+			experimentalDataSetOutput(data, experimentalDataNumObservations(data) - 1, i);
+		}
+		if (fabs(tEnd - t) < ZERO_TOL) break;
+		tout += tabT;
+		if (tout > tEnd) tout = tEnd;
+	}
+	DestroyIntegrator(&integrator);
+	delete instance;
+	if (code != OK)
+	{
+		ERROR("main", "Simulation failed\n");
+		return 1;
+	}
+	printf("Number of observations: %d, parameters: %d\n", experimentalDataNumObservations(data), nParameters);
+	printf("%-24s %4s %8s %8s %10s %10s %12s %12s %10s\n", "method", "", "threads", "iters", "sims",
+		   "rejected", "sum sq", "rel error", "wall (s)");
+
+	struct ParameterEstimationStatistics stats;
+	double sumOfSquares;
+	std::vector<double> values(initialValues);
+	code = parameterEstimationLevenbergMarquardt(simulation, em, data, nParameters, &(parameters[0]), &(lower[0]),
+												 &(upper[0]), 0, &(values[0]), &sumOfSquares, &stats);
+	printResult("Levenberg-Marquardt", code, values, trueValues, sumOfSquares, stats);
+	int threads[2] = {1, nThreads};
+	for (int k = 0; k < ((nThreads > 1) ? 2 : 1); ++k)
+	{
+		values = initialValues;
+		code = parameterEstimationCMAES(simulation, em, data, nParameters, &(parameters[0]), &(lower[0]),
+										&(upper[0]), 0, threads[k], 1, &(values[0]), &sumOfSquares, &stats);
+		printResult("CMA-ES", code, values, trueValues, sumOfSquares, stats);
+	}
+	DestroyExperimentalData(&data);
+	return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Throughput of parameter sweeps with increasing numbers of threads, and of worker processes. A Latin
+ * hypercube sample of the given number of points (1000 by default) varies the first few constants of
+ * the model by up to 10% either side of their initial values, and the sweep is run with one thread
+ * (or process) and then doubling the number up to the given number (the number of hardware threads by
+ * default).
+ *
+ *   parameter-sweep-benchmark <simulation.xml> [simulations] [threads]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "parameter-sweep.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+/* the number of constants varied in the sweep */
+#define SWEEP_PARAMETERS 4
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[simulations] [threads]") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	int nSimulations = (argc > 2) ? atoi(argv[2]) : 1000;
+	int nThreads = (argc > 3) ? atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+	if (nSimulations < 1) nSimulations = 1;
+	if (nThreads < 1) nThreads = 1;
+	int nParameters = std::min(SWEEP_PARAMETERS, em->nConstants);
+	std::vector<struct SensitivityParameter> parameters(nParameters);
+	std::vector<double> lower(nParameters), upper(nParameters);
+	for (int j = 0; j < nParameters; ++j)
+	{
+		parameters[j].isState = 0;
+		parameters[j].index = j;
+		lower[j] = 0.9 * em->constants[j];
+		upper[j] = 1.1 * em->constants[j];
+	}
+	std::vector<double> values(nSimulations * nParameters + 1);
+	if (nParameters > 0)
+		parameterSweepLatinHypercube(nParameters, &(lower[0]), &(upper[0]), nSimulations, 1, &(values[0]));
+	int nPoints = parameterSweepNumOutputPoints(simulation);
+	// the output store is allocated once and reused for each sweep
+	std::vector<double> results((long int)nSimulations * nPoints * em->nOutputs + 1);
+	std::vector<int> status(nSimulations);
+
+	printf("%d simulations varying %d constants, %d output points each\n", nSimulations, nParameters, nPoints);
+	printf("%-10s %-10s %12s %14s %10s %10s %12s\n", "workers", "kind", "wall (s)", "sims/s", "speedup",
+		   "failures", "steps");
+	double serialRate = 0.0;
+	for (int n = 1; n <= nThreads; n = (n == nThreads) ? n + 1 : std::min(2*n, nThreads))
+	{
+		for (int processes = 0; processes < 2; ++processes)
+		{
+			struct ParameterSweepStatistics stats;
+			if (processes)
+				parameterSweepRunProcesses(simulation, em, nParameters, nParameters ? &(parameters[0]) : NULL,
+										   nSimulations, &(values[0]), n, &(results[0]), &(status[0]), &stats);
+			else
+				parameterSweepRun(simulation, em, nParameters, nParameters ? &(parameters[0]) : NULL, nSimulations,
+								  &(values[0]), n, &(results[0]), &(status[0]), &stats);
+			double rate = nSimulations / stats.wallTime;
+			if ((n == 1) && !processes) serialRate = rate;
+			printf("%-10d %-10s %12.6f %14.2f %10.2f %10d %12ld\n", n, processes ? "processes" : "threads",
+				   stats.wallTime, rate, rate/serialRate, stats.nFailures, stats.nSteps);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * Compare the integration of a model with and without the discontinuities being located by the
+ * CVODES root finding. Typically run with a stimulus driven cardiac cell model:
+ *
+ *   root-finding-benchmark <simulation.xml>
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <iostream>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+static int runBenchmark(const char* executable, struct Simulation* simulation, CellmlCode* cellmlCode,
+						int rootFinding)
+{
+	ExecutableModel* em = createBenchmarkModel(executable, simulation, cellmlCode);
+	if (!em) return ERR;
+	simulationSetRootFinding(simulation, rootFinding);
+	struct Integrator* integrator = CreateIntegrator(simulation, em);
+	if (!integrator)
+	{
+		ERROR("runBenchmark", "Error creating integrator\n");
+		delete em;
+		return ERR;
+	}
+	double tEnd = simulationGetBvarEnd(simulation);
+	double tabT = simulationGetBvarTabStep(simulation);
+	double tout = simulationGetBvarStart(simulation) + tabT;
+	if (tout > tEnd) tout = tEnd;
+	int code = OK;
+	struct Timer* timer = CreateTimer();
+	startTimer(timer);
+	while (code == OK)
+	{
+		double t;
+		code = integrate(integrator, tout, &t);
+		if (fabs(tEnd - t) < ZERO_TOL) break;
+		tout += tabT;
+		if (tout > tEnd) tout = tEnd;
+	}
+	stopTimer(timer);
+	struct IntegratorStatistics stats;
+	integratorGetStatistics(integrator, &stats);
+	printf("%-14s %10ld %10ld %10ld %10ld %10ld %12.6f %s\n", rootFinding ? "root finding" : "blind",
+		   stats.nSteps, stats.nRhsEvals, stats.nErrTestFails, stats.nRootEvals,
+		   stats.nDiscontinuities, getWallTime(timer), (code == OK) ? "" : "(failed)");
+	DestroyTimer(&timer);
+	DestroyIntegrator(&integrator);
+	delete em;
+	return code;
+}
+
+int main(int argc, char* argv[])
+{
+	// a new model for each run
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "", 0, 0, false) != OK) return 1;
+	printf("%-14s %10s %10s %10s %10s %10s %12s\n", "", "steps", "f evals", "netf", "g evals",
+		   "switches", "wall (s)");
+	int code = runBenchmark(argv[0], benchmark.simulation, &(benchmark.code), 0);
+	if (code == OK) code = runBenchmark(argv[0], benchmark.simulation, &(benchmark.code), 1);
+	return (code == OK) ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+/*
+ * Accuracy and cost of the Rush-Larsen schemes (and forward Euler) compared to a tightly converged
+ * CVODES BDF reference solution. The simulation's maximum step is used as the CVODES BDF maximum
+ * step, the fixed step schemes are run with each of the given step sizes.
+ *
+ *   rush-larsen-benchmark <simulation.xml> [step size ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <vector>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+/* Integrate over the simulation interval, returning the outputs at each tabulation point */
+static int runScheme(struct Simulation* simulation, ExecutableModel* em, const std::vector<double>& initialStates,
+					 std::vector<std::vector<double> >& results, double* wall, long int* nRhsEvals)
+{
+	memcpy(em->states, &(initialStates[0]), sizeof(double)*em->nRates);
+	struct Integrator* integrator = CreateIntegrator(simulation, em);
+	if (!integrator) return ERR;
+	double tEnd = simulationGetBvarEnd(simulation);
+	double tabT = simulationGetBvarTabStep(simulation);
+	double tout = simulationGetBvarStart(simulation) + tabT;
+	if (tout > tEnd) tout = tEnd;
+	int code = OK;
+	results.clear();
+	struct Timer* timer = CreateTimer();
+	startTimer(timer);
+	while (code == OK)
+	{
+		double t;
+		code = integrate(integrator, tout, &t);
+		results.push_back(std::vector<double>(em->outputs, em->outputs + em->nOutputs));
+		if (fabs(tEnd - t) < ZERO_TOL) break;
+		tout += tabT;
+		if (tout > tEnd) tout = tEnd;
+	}
+	stopTimer(timer);
+	*wall = getWallTime(timer);
+	DestroyTimer(&timer);
+	struct IntegratorStatistics stats;
+	integratorGetStatistics(integrator, &stats);
+	*nRhsEvals = stats.nRhsEvals;
+	DestroyIntegrator(&integrator);
+	return code;
+}
+
+/* The largest error in any output, relative to the range of that output in the reference */
+static double relativeError(const std::vector<std::vector<double> >& results,
+							const std::vector<std::vector<double> >& reference)
+{
+	double maxError = 0.0;
+	if (reference.empty() || (results.size() != reference.size())) return INFINITY;
+	for (size_t j = 0; j < reference[0].size(); ++j)
+	{
+		double lo = reference[0][j], hi = reference[0][j], error = 0.0;
+		for (size_t i = 0; i < reference.size(); ++i)
+		{
+			lo = fmin(lo, reference[i][j]);
+			hi = fmax(hi, reference[i][j]);
+			error = fmax(error, fabs(results[i][j] - reference[i][j]));
+		}
+		if (hi - lo > 0.0) error /= (hi - lo);
+		maxError = fmax(maxError, error);
+	}
+	return maxError;
+}
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[step size ...]") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	printf("Found %d gating variables out of %d state variables\n", em->nGates, em->nRates);
+	std::vector<double> initialStates(em->states, em->states + em->nRates);
+	std::vector<double> stepSizes;
+	for (int i = 2; i < argc; ++i) stepSizes.push_back(atof(argv[i]));
+	if (stepSizes.empty())
+	{
+		double dt = simulationIsBvarMaxStepSet(simulation) ? simulationGetBvarMaxStep(simulation) :
+			simulationGetBvarTabStep(simulation);
+		stepSizes.push_back(dt);
+		stepSizes.push_back(dt*10.0);
+	}
+
+	// CVODES BDF at the simulation's tolerances, to compare against
+	struct Simulation* bdf = simulationClone(simulation);
+	simulationSetIntegrationScheme(bdf, CVODE);
+
+	// the reference solution
+	std::vector<std::vector<double> > reference, results;
+	double wall, tol = 1.0e-10;
+	long int nRhsEvals;
+	simulationSetIntegrationScheme(simulation, CVODE);
+	simulationSetMultistepMethod(simulation, BDF);
+	simulationSetIterationMethod(simulation, NEWTON);
+	simulationSetLinearSolver(simulation, DENSE);
+	simulationSetRTol(simulation, tol);
+	simulationSetATol(simulation, 1, &tol);
+	if (runScheme(simulation, em, initialStates, reference, &wall, &nRhsEvals) != OK)
+	{
+		ERROR("main", "Unable to compute the reference solution\n");
+		DestroySimulation(&bdf);
+		return 1;
+	}
+	printf("%-12s %12s %12s %10s %12s\n", "scheme", "step", "rel. error", "f evals", "wall (s)");
+	printf("%-12s %12s %12.4e %10ld %12.6f\n", "BDF (ref)", "-", 0.0, nRhsEvals, wall);
+
+	int code = runScheme(bdf, em, initialStates, results, &wall, &nRhsEvals);
+	printf("%-12s %12s %12.4e %10ld %12.6f %s\n", "BDF", "-", relativeError(results, reference), nRhsEvals,
+		   wall, (code == OK) ? "" : "(failed)");
+	DestroySimulation(&bdf);
+
+	enum IntegrationScheme schemes[] = { EULER, RUSH_LARSEN, RUSH_LARSEN2 };
+	for (size_t s = 0; s < sizeof(schemes)/sizeof(schemes[0]); ++s)
+	{
+		for (size_t i = 0; i < stepSizes.size(); ++i)
+		{
+			simulationSetIntegrationScheme(simulation, schemes[s]);
+			simulationSetBvarMaxStep(simulation, stepSizes[i]);
+			code = runScheme(simulation, em, initialStates, results, &wall, &nRhsEvals);
+			printf("%-12s %12.4e %12.4e %10ld %12.6f %s\n", integrationSchemeToString(schemes[s]), stepSizes[i],
+				   relativeError(results, reference), nRhsEvals, wall, (code == OK) ? "" : "(failed)");
+		}
+	}
+	return 0;
+}
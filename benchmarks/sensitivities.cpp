@@ -0,0 +1,158 @@
+/*
+ * Compare computing the sensitivities of the outputs to some of the model's constants with the
+ * CVODES forward sensitivity analysis against the finite difference approach of re-running the
+ * simulation once for each perturbed constant:
+ *
+ *   sensitivities-benchmark <simulation.xml> <constant index> [constant index ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+/* Run the simulation from the given initial states, returning the outputs at each tabulation point
+   and optionally the output sensitivities (nParameters*nOutputs values per tabulation point) */
+static int runSimulation(struct Simulation* simulation, ExecutableModel* em, const std::vector<double>& initialStates,
+						 const std::vector<struct SensitivityParameter>& parameters, std::vector<double>& results,
+						 std::vector<double>* sensitivities, long int* nRhsEvals)
+{
+	memcpy(em->states, &(initialStates[0]), sizeof(double)*em->nRates);
+	struct Integrator* integrator = CreateIntegrator(simulation, em);
+	if (!integrator) return ERR;
+	if (sensitivities && (integratorEnableSensitivities(integrator, parameters.size(), &(parameters[0])) != OK))
+	{
+		DestroyIntegrator(&integrator);
+		return ERR;
+	}
+	std::vector<double> values(parameters.size()*em->nOutputs);
+	double tEnd = simulationGetBvarEnd(simulation);
+	double tabT = simulationGetBvarTabStep(simulation);
+	double tout = simulationGetBvarStart(simulation) + tabT;
+	if (tout > tEnd) tout = tEnd;
+	int code = OK;
+	results.clear();
+	if (sensitivities) sensitivities->clear();
+	while (code == OK)
+	{
+		double t;
+		code = integrate(integrator, tout, &t);
+		results.insert(results.end(), em->outputs, em->outputs + em->nOutputs);
+		if (sensitivities && (code == OK))
+		{
+			code = integratorGetOutputSensitivities(integrator, &(values[0]));
+			sensitivities->insert(sensitivities->end(), values.begin(), values.end());
+		}
+		if (fabs(tEnd - t) < ZERO_TOL) break;
+		tout += tabT;
+		if (tout > tEnd) tout = tEnd;
+	}
+	struct IntegratorStatistics stats;
+	integratorGetStatistics(integrator, &stats);
+	*nRhsEvals = stats.nRhsEvals + stats.nSensRhsEvals;
+	DestroyIntegrator(&integrator);
+	return code;
+}
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "<constant index> [constant index ...]", 1) != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	std::vector<struct SensitivityParameter> parameters;
+	for (int i = 2; i < argc; ++i)
+	{
+		struct SensitivityParameter parameter;
+		parameter.isState = 0;
+		parameter.index = atoi(argv[i]);
+		if ((parameter.index < 0) || (parameter.index >= em->nConstants))
+		{
+			ERROR("main", "Invalid constant index: %s\n", argv[i]);
+			return 1;
+		}
+		parameters.push_back(parameter);
+	}
+	std::vector<double> initialStates(em->states, em->states + em->nRates);
+	std::vector<double> base, perturbed, sensitivities, differences;
+	long int nRhsEvals, totalRhsEvals = 0;
+	int nOutputs = em->nOutputs, nParameters = parameters.size();
+
+	// finite differences, one extra simulation per parameter
+	struct Timer* timer = CreateTimer();
+	startTimer(timer);
+	int code = runSimulation(simulation, em, initialStates, parameters, base, NULL, &nRhsEvals);
+	totalRhsEvals += nRhsEvals;
+	for (int p = 0; (p < nParameters) && (code == OK); ++p)
+	{
+		double value = em->constants[parameters[p].index];
+		double h = sqrt(simulationGetRTol(simulation))*((fabs(value) > 0.0) ? fabs(value) : 1.0);
+		em->constants[parameters[p].index] = value + h;
+		code = runSimulation(simulation, em, initialStates, parameters, perturbed, NULL, &nRhsEvals);
+		em->constants[parameters[p].index] = value;
+		totalRhsEvals += nRhsEvals;
+		if (differences.empty()) differences.resize(base.size()*nParameters);
+		for (size_t i = 0; i < base.size()/nOutputs; ++i)
+			for (int j = 0; j < nOutputs; ++j)
+				differences[(i*nParameters + p)*nOutputs + j] = (perturbed[i*nOutputs + j] - base[i*nOutputs + j])/h;
+	}
+	stopTimer(timer);
+	double finiteDifferenceTime = getWallTime(timer);
+	if (code != OK)
+	{
+		ERROR("main", "Finite difference simulations failed\n");
+		return 1;
+	}
+	printf("%-22s %10s %12s\n", "method", "f evals", "wall (s)");
+	printf("%-22s %10ld %12.6f\n", "finite differences", totalRhsEvals, finiteDifferenceTime);
+
+	// forward sensitivities
+	startTimer(timer);
+	code = runSimulation(simulation, em, initialStates, parameters, base, &sensitivities, &nRhsEvals);
+	stopTimer(timer);
+	if (code != OK)
+	{
+		ERROR("main", "Sensitivity simulation failed\n");
+		return 1;
+	}
+	printf("%-22s %10ld %12.6f\n", "forward sensitivities", nRhsEvals, getWallTime(timer));
+
+	// agreement between the two, relative to the largest sensitivity of each output to each parameter
+	double maxDifference = 0.0;
+	for (int p = 0; p < nParameters; ++p)
+	{
+		for (int j = 0; j < nOutputs; ++j)
+		{
+			double scale = 0.0, difference = 0.0;
+			for (size_t i = 0; i < sensitivities.size()/(nParameters*nOutputs); ++i)
+			{
+				size_t k = (i*nParameters + p)*nOutputs + j;
+				scale = fmax(scale, fabs(sensitivities[k]));
+				difference = fmax(difference, fabs(sensitivities[k] - differences[k]));
+			}
+			if (scale > 0.0) difference /= scale;
+			maxDifference = fmax(maxDifference, difference);
+		}
+	}
+	printf("Largest relative difference between the methods: %12.4e\n", maxDifference);
+	DestroyTimer(&timer);
+	return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * Compare the direct steady state solver against the usual approach of integrating the model over
+ * a long time. The model is integrated from the start of the simulation to each of the given end
+ * times (the simulation's end time by default) and the cost and the remaining rates are reported
+ * alongside those of the direct solver.
+ *
+ *   steady-state-benchmark <simulation.xml> [end time ...]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <math.h>
+#include <vector>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "steady-state.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+/* The 2-norm of the model's current rates */
+static double ratesNorm(ExecutableModel* em)
+{
+	double sum = 0.0;
+	for (int i = 0; i < em->nRates; ++i) sum += em->rates[i]*em->rates[i];
+	return sqrt(sum);
+}
+
+/* The largest difference between the states and the reference states, relative to the size of the
+   reference states (or absolute for reference states smaller than one) */
+static double stateDifference(ExecutableModel* em, const std::vector<double>& reference)
+{
+	double maxDifference = 0.0;
+	for (int i = 0; i < em->nRates; ++i)
+		maxDifference = fmax(maxDifference, fabs(em->states[i] - reference[i])/fmax(fabs(reference[i]), 1.0));
+	return maxDifference;
+}
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[end time ...]") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	std::vector<double> endTimes;
+	for (int i = 2; i < argc; ++i) endTimes.push_back(atof(argv[i]));
+	if (endTimes.empty()) endTimes.push_back(simulationGetBvarEnd(simulation));
+	double tStart = simulationGetBvarStart(simulation);
+	std::vector<double> initialStates(em->states, em->states + em->nRates);
+
+	// the direct solver
+	struct Timer* timer = CreateTimer();
+	struct SteadyStateStatistics stats;
+	double residualNorm;
+	startTimer(timer);
+	int code = steadyStateSolve(simulation, em, tStart, &residualNorm, &stats);
+	stopTimer(timer);
+	if (code != OK)
+	{
+		ERROR("main", "Steady state solver failed to converge\n");
+	}
+	std::vector<double> steadyState(em->states, em->states + em->nRates);
+	printf("%-24s %10s %12s %14s %14s\n", "method", "f evals", "wall (s)", "|rates|", "state diff");
+	printf("%-24s %10ld %12.6f %14.6e %14.6e\n", "direct", stats.nRhsEvals, getWallTime(timer), residualNorm,
+		   0.0);
+	printf("  (%d Newton iterations, %d continuation steps, %ld Jacobian evaluations)\n", stats.nNewtonIterations,
+		   stats.nContinuationSteps, stats.nJacobianEvals);
+
+	// long time integration
+	for (size_t k = 0; k < endTimes.size(); ++k)
+	{
+		memcpy(em->states, &(initialStates[0]), sizeof(double)*em->nRates);
+		struct Integrator* integrator = CreateIntegrator(simulation, em);
+		if (!integrator) break;
+		double t;
+		startTimer(timer);
+		int integrateCode = integrate(integrator, endTimes[k], &t);
+		stopTimer(timer);
+		struct IntegratorStatistics integratorStats;
+		integratorGetStatistics(integrator, &integratorStats);
+		DestroyIntegrator(&integrator);
+		em->computeRates(t);
+		char label[64];
+		sprintf(label, "integrate to %g", endTimes[k]);
+		if (integrateCode != OK) printf("%-24s failed at t = %g\n", label, t);
+		else printf("%-24s %10ld %12.6f %14.6e %14.6e\n", label, integratorStats.nRhsEvals, getWallTime(timer),
+					ratesNorm(em), stateDifference(em, steadyState));
+	}
+	DestroyTimer(&timer);
+	return (code == OK) ? 0 : 1;
+}
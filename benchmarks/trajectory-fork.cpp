@@ -0,0 +1,141 @@
+/*
+ * Compare running several protocols which share the first half of the simulation interval (e.g.,
+ * pre-pacing) and then differ in the value of one constant (e.g., a drug block), simulating each
+ * protocol in full, against simulating the shared prefix once and forking the continuations from a
+ * snapshot of it (integratorSnapshot and parameterSweepRunFromSnapshot):
+ *
+ *   trajectory-fork-benchmark <simulation.xml> [constant index] [continuations] [threads]
+ *
+ * The constant is scaled by evenly spaced factors from 0.5 to 1 in the continuations.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "parameter-sweep.hpp"
+#include "CellmlCode.hpp"
+#include "ExecutableModel.hpp"
+#include "benchmark-utils.hpp"
+
+int main(int argc, char* argv[])
+{
+	Benchmark benchmark;
+	if (benchmark.initialise(argc, argv, "[constant index] [continuations] [threads]") != OK) return 1;
+	struct Simulation* simulation = benchmark.simulation;
+	ExecutableModel* em = benchmark.em;
+	int constant = (argc > 2) ? atoi(argv[2]) : 0;
+	int nContinuations = (argc > 3) ? atoi(argv[3]) : 8;
+	int nThreads = (argc > 4) ? atoi(argv[4]) : 4;
+	if (nContinuations < 1) nContinuations = 1;
+	if (nThreads < 1) nThreads = 1;
+	if ((constant < 0) || (constant >= em->nConstants))
+	{
+		ERROR("main", "Invalid constant index: %d\n", constant);
+		return 1;
+	}
+	double t0 = simulationGetBvarStart(simulation);
+	double tEnd = simulationGetBvarEnd(simulation);
+	double tabT = simulationGetBvarTabStep(simulation);
+	/* the fork is at the tabulation point nearest the middle of the interval */
+	double tFork = t0 + tabT * floor(0.5*(tEnd - t0)/tabT + 0.5);
+	if (!(tFork > t0) || !(tFork < tEnd))
+	{
+		ERROR("main", "The simulation interval is too short to fork\n");
+		return 1;
+	}
+	struct SensitivityParameter parameter;
+	parameter.isState = 0;
+	parameter.index = constant;
+	std::vector<double> values(nContinuations);
+	for (int k = 0; k < nContinuations; ++k)
+		values[k] = em->constants[constant] * (0.5 + 0.5*k/((nContinuations > 1) ? nContinuations - 1 : 1));
+	ExecutableModel* instance = em->clone();
+	struct Integrator* integrator = CreateIntegrator(simulation, instance);
+	if (!integrator)
+	{
+		ERROR("main", "Unable to create the integrator\n");
+		return 1;
+	}
+	struct Timer* timer = CreateTimer();
+
+	// each protocol in full, its final outputs kept for comparison
+	std::vector<double> fullOutputs;
+	int code = OK;
+	startTimer(timer);
+	for (int k = 0; (k < nContinuations) && (code == OK); ++k)
+	{
+		double t;
+		instance->copyValues(em);
+		integratorReinitialise(integrator, t0);
+		code = integrate(integrator, tFork, &t);
+		instance->constants[constant] = values[k];
+		if (code == OK) code = integratorReinitialise(integrator, t);
+		if (code == OK) code = integrate(integrator, tEnd, &t);
+		instance->getOutputs(t);
+		fullOutputs.insert(fullOutputs.end(), instance->outputs, instance->outputs + instance->nOutputs);
+	}
+	stopTimer(timer);
+	double fullTime = getWallTime(timer);
+	if (code != OK)
+	{
+		ERROR("main", "Simulation failed\n");
+		return 1;
+	}
+
+	// the prefix once, then the continuations from its snapshot
+	struct Simulation* continuation = simulationClone(simulation);
+	simulationSetBvarStart(continuation, tFork);
+	int nPoints = parameterSweepNumOutputPoints(continuation);
+	std::vector<double> results((long int)nContinuations*nPoints*em->nOutputs);
+	std::vector<int> status(nContinuations);
+	printf("Fork at t = %g, %d continuations\n", tFork, nContinuations);
+	printf("%-24s %8s %12s %16s\n", "method", "threads", "wall (s)", "max difference");
+	printf("%-24s %8d %12.6f %16s\n", "full protocols", 1, fullTime, "-");
+	int threads[2] = {1, nThreads};
+	for (int j = 0; j < ((nThreads > 1) ? 2 : 1); ++j)
+	{
+		double t;
+		startTimer(timer);
+		instance->copyValues(em);
+		integratorReinitialise(integrator, t0);
+		code = integrate(integrator, tFork, &t);
+		struct IntegratorSnapshot* snapshot = (code == OK) ? integratorSnapshot(integrator, t) : NULL;
+		code = snapshot ? parameterSweepRunFromSnapshot(continuation, em, snapshot, 1, &parameter, nContinuations,
+														&(values[0]), threads[j], &(results[0]), &(status[0]), NULL) : ERR;
+		stopTimer(timer);
+		DestroyIntegratorSnapshot(&snapshot);
+		double difference = 0.0;
+		for (int k = 0; k < nContinuations; ++k)
+		{
+			const double* last = &(results[((long int)k*nPoints + nPoints - 1)*em->nOutputs]);
+			for (int i = 0; i < em->nOutputs; ++i)
+			{
+				double full = fullOutputs[k*em->nOutputs + i];
+				difference = fmax(difference, fabs(last[i] - full)/fmax(fabs(full), 1.0));
+			}
+		}
+		printf("%-24s %8d %12.6f %16.4e%s\n", "forked continuations", threads[j], getWallTime(timer), difference,
+			   (code == OK) ? "" : " (failed)");
+	}
+	DestroyTimer(&timer);
+	DestroyIntegrator(&integrator);
+	delete instance;
+	DestroySimulation(&continuation);
+	return 0;
+}
@@ -12,6 +12,7 @@
 #include <cstring>
 #include <vector>
 #include <cmath>
+#include <algorithm>
 
 #include "CellmlSimulator.hpp"
 #include "cellml-utils.hpp"
@@ -20,6 +21,14 @@
 #include "ModelCompiler.hpp"
 #include "ExecutableModel.hpp"
 #include "integrator.hpp"
+#include "steady-state.hpp"
+#include "limit-cycle.hpp"
+#include "parameter-sweep.hpp"
+#include "parameter-estimation.hpp"
+#include "autotune.hpp"
+#include "initial-condition-cache.hpp"
+#include "thread-pool.hpp"
+#include "experimental-data.hpp"
 #include "xmldoc.hpp"
 #include "csim-config.h"
 
@@ -27,13 +36,34 @@
 extern "C"
 {
 #endif
+#include "common.h"
 #include "cellml.h"
 #include "simulation.h"
 #include "outputVariables.h"
+#include "ensemble-statistics.h"
 #ifdef __cplusplus
 }
 #endif
 
+/* the least squares objective for the adjoint gradient, userData is the data */
+static double leastSquaresSample(int k, double t, const double* outputs, double* gradient, void* userData)
+{
+	const std::vector<std::vector<double> >& data = *static_cast<const std::vector<std::vector<double> >*>(userData);
+	double value = 0.0;
+	for (size_t i=0; i<data[k].size(); ++i)
+	{
+		if (std::isnan(data[k][i]))
+		{
+			gradient[i] = 0.0;
+			continue;
+		}
+		double residual = outputs[i] - data[k][i];
+		gradient[i] = residual;
+		value += 0.5*residual*residual;
+	}
+	return value;
+}
+
 #if 0
 static std::string formatOutputValues(const std::vector<double>& values)
 {
@@ -53,8 +83,8 @@ static std::string formatOutputValues(const std::vector<double>& values)
 
 CellmlSimulator::CellmlSimulator() :
     mModel(NULL), mSimulation(NULL), mCode(NULL), mExecutableModel(NULL), mXmlDoc(NULL),
-    mIntegrator(NULL), mBoundCache(NULL), mRatesCache(NULL), mStatesCache(NULL),
-    mConstantsCache(NULL), mAlgebraicCache(NULL), mOutputsCache(NULL)
+    mIntegrator(NULL), mIntegratorResetRequired(false), mBoundCache(NULL), mRatesCache(NULL), mStatesCache(NULL),
+    mConstantsCache(NULL), mAlgebraicCache(NULL), mOutputsCache(NULL), mThreadPool(NULL), mExperimentalData(NULL)
 {
 	std::cout << "Creating cellml simulator." << std::endl;
 }
@@ -74,6 +104,10 @@ CellmlSimulator::~CellmlSimulator()
 	if (mConstantsCache) free(mConstantsCache);
 	if (mAlgebraicCache) free(mAlgebraicCache);
 	if (mOutputsCache) free(mOutputsCache);
+	if (mThreadPool) delete mThreadPool;
+	if (mExperimentalData) DestroyExperimentalData(&mExperimentalData);
+	for (size_t i=0; i<mForks.size(); ++i)
+		if (mForks[i]) DestroyIntegratorSnapshot(&(mForks[i]));
 }
 
 std::string CellmlSimulator::getVersionString()
@@ -222,7 +256,230 @@ int CellmlSimulator::compileModel(bool saveGeneratedCode)
 				<< mCode->codeFileName() << "'" << std::endl;
 		return -3;
 	}
+	mExecutableModel->setThreadPool(mThreadPool);
+
+	return 0;
+}
+
+ExecutableModel* CellmlSimulator::createModelInstance()
+{
+	if (!mExecutableModel)
+	{
+		std::cerr << "CellmlSimulator::createModelInstance: Error, need to compile the model first." << std::endl;
+		return NULL;
+	}
+	return mExecutableModel->clone();
+}
 
+int CellmlSimulator::setupSweep(const std::vector<std::string>& parameterIds,
+		const std::vector<std::vector<double> >& values, double startTime, double endTime, int numSteps,
+		int nThreads, std::vector<struct SensitivityParameter>& parameters, std::vector<double>& parameterValues,
+		struct Simulation** simulation)
+{
+	if (!(mExecutableModel && mSimulation && simulationIsValidDescription(mSimulation)) || values.empty() ||
+		(numSteps < 1) || !(endTime > startTime) || (nThreads < 1))
+	{
+		std::cerr << "CellmlSimulator::parameterSweep: Error, invalid arguments." << std::endl;
+		return -1;
+	}
+	if (mExecutableModel->nOutputs < 1)
+	{
+		std::cerr << "CellmlSimulator::parameterSweep: Error, the simulation has no outputs to return."
+				<< std::endl;
+		return -1;
+	}
+	std::vector<std::pair<bool, int> > ids;
+	int code = findParameters(parameterIds, ids);
+	if (code != 0) return code;
+	parameters.resize(ids.size());
+	for (size_t i=0; i<ids.size(); ++i)
+	{
+		parameters[i].isState = ids[i].first ? 1 : 0;
+		parameters[i].index = ids[i].second;
+	}
+	int nParameters = parameters.size();
+	parameterValues.resize(values.size()*nParameters);
+	for (size_t s=0; s<values.size(); ++s)
+	{
+		if ((int)values[s].size() != nParameters)
+		{
+			std::cerr << "CellmlSimulator::parameterSweep: Error, need a value for each parameter in each "
+					"simulation." << std::endl;
+			return -1;
+		}
+		std::copy(values[s].begin(), values[s].end(), parameterValues.begin() + s*nParameters);
+	}
+	*simulation = simulationClone(mSimulation);
+	simulationSetBvarStart(*simulation, startTime);
+	simulationSetBvarEnd(*simulation, endTime);
+	simulationSetBvarTabStep(*simulation, (endTime - startTime) / numSteps);
+	return 0;
+}
+
+int CellmlSimulator::parameterSweep(const std::vector<std::string>& parameterIds,
+		const std::vector<std::vector<double> >& values, double startTime, double endTime, int numSteps,
+		int nThreads, std::vector<double>& results, std::vector<int>& success, SweepMode mode)
+{
+	std::vector<struct SensitivityParameter> parameters;
+	std::vector<double> parameterValues;
+	struct Simulation* simulation = NULL;
+	int code = setupSweep(parameterIds, values, startTime, endTime, numSteps, nThreads, parameters,
+		parameterValues, &simulation);
+	if (code != 0) return code;
+	int nParameters = parameters.size();
+	results.resize(values.size()*parameterSweepNumOutputPoints(simulation)*mExecutableModel->nOutputs);
+	success.resize(values.size());
+	if (mode == SWEEP_BATCHED)
+		code = parameterSweepRunBatched(simulation, mExecutableModel, nParameters,
+			nParameters ? &(parameters[0]) : NULL, values.size(), nParameters ? &(parameterValues[0]) : NULL,
+			nThreads, &(results[0]), &(success[0]), NULL);
+	else if (mode == SWEEP_PROCESSES)
+		code = parameterSweepRunProcesses(simulation, mExecutableModel, nParameters,
+			nParameters ? &(parameters[0]) : NULL, values.size(), nParameters ? &(parameterValues[0]) : NULL,
+			nThreads, &(results[0]), &(success[0]), NULL);
+	else
+		code = parameterSweepRun(simulation, mExecutableModel, nParameters, nParameters ? &(parameters[0]) : NULL,
+			values.size(), nParameters ? &(parameterValues[0]) : NULL, nThreads, &(results[0]), &(success[0]),
+			NULL);
+	DestroySimulation(&simulation);
+	if (code != OK)
+	{
+		std::cerr << "CellmlSimulator::parameterSweep: Error, not all the simulations succeeded." << std::endl;
+		return -4;
+	}
+	return 0;
+}
+
+int CellmlSimulator::simulateFromFork(int fork, const std::vector<std::string>& parameterIds,
+		const std::vector<std::vector<double> >& values, double endTime, int numSteps, int nThreads,
+		std::vector<double>& results, std::vector<int>& success)
+{
+	if ((fork < 0) || (fork >= (int)mForks.size()) || !mForks[fork])
+	{
+		std::cerr << "CellmlSimulator::simulateFromFork: Error, invalid fork: " << fork << std::endl;
+		return -1;
+	}
+	std::vector<struct SensitivityParameter> parameters;
+	std::vector<double> parameterValues;
+	struct Simulation* simulation = NULL;
+	int code = setupSweep(parameterIds, values, integratorSnapshotTime(mForks[fork]), endTime, numSteps, nThreads,
+		parameters, parameterValues, &simulation);
+	if (code != 0) return code;
+	int nParameters = parameters.size();
+	results.resize(values.size()*parameterSweepNumOutputPoints(simulation)*mExecutableModel->nOutputs);
+	success.resize(values.size());
+	code = parameterSweepRunFromSnapshot(simulation, mExecutableModel, mForks[fork], nParameters,
+		nParameters ? &(parameters[0]) : NULL, values.size(), nParameters ? &(parameterValues[0]) : NULL,
+		nThreads, &(results[0]), &(success[0]), NULL);
+	DestroySimulation(&simulation);
+	if (code != OK)
+	{
+		std::cerr << "CellmlSimulator::simulateFromFork: Error, not all the simulations succeeded." << std::endl;
+		return -4;
+	}
+	return 0;
+}
+
+int CellmlSimulator::simulateEnsemble(const std::vector<std::string>& parameterIds,
+		const std::vector<std::vector<double> >& values, double startTime, double endTime, int numSteps,
+		int nThreads, const std::vector<double>& quantiles, std::vector<double>& mean, std::vector<double>& variance,
+		std::vector<std::vector<double> >& quantileValues, std::vector<int>& success)
+{
+	std::vector<struct SensitivityParameter> parameters;
+	std::vector<double> parameterValues;
+	struct Simulation* simulation = NULL;
+	int code = setupSweep(parameterIds, values, startTime, endTime, numSteps, nThreads, parameters,
+		parameterValues, &simulation);
+	if (code != 0) return code;
+	for (size_t i=0; i<quantiles.size(); ++i)
+	{
+		if (!((quantiles[i] >= 0.0) && (quantiles[i] <= 1.0)))
+		{
+			std::cerr << "CellmlSimulator::simulateEnsemble: Error, invalid quantile: " << quantiles[i] << std::endl;
+			DestroySimulation(&simulation);
+			return -1;
+		}
+	}
+	int nParameters = parameters.size();
+	int nValues = parameterSweepNumOutputPoints(simulation)*mExecutableModel->nOutputs;
+	struct EnsembleStatistics* statistics = CreateEnsembleStatistics(parameterSweepNumOutputPoints(simulation),
+		mExecutableModel->nOutputs, 0.0);
+	if (!statistics)
+	{
+		DestroySimulation(&simulation);
+		return -2;
+	}
+	success.resize(values.size());
+	code = parameterSweepRunEnsemble(simulation, mExecutableModel, nParameters,
+		nParameters ? &(parameters[0]) : NULL, values.size(), nParameters ? &(parameterValues[0]) : NULL,
+		nThreads, statistics, &(success[0]), NULL);
+	DestroySimulation(&simulation);
+	mean.resize(nValues);
+	variance.resize(nValues);
+	quantileValues.resize(quantiles.size());
+	ensembleStatisticsMean(statistics, &(mean[0]));
+	ensembleStatisticsVariance(statistics, &(variance[0]));
+	for (size_t i=0; i<quantiles.size(); ++i)
+	{
+		quantileValues[i].resize(nValues);
+		ensembleStatisticsQuantile(statistics, quantiles[i], &(quantileValues[i][0]));
+	}
+	DestroyEnsembleStatistics(&statistics);
+	if (code != OK)
+	{
+		std::cerr << "CellmlSimulator::simulateEnsemble: Error, not all the simulations succeeded." << std::endl;
+		return -4;
+	}
+	return 0;
+}
+
+std::vector<std::vector<double> > CellmlSimulator::parameterGrid(const std::vector<double>& lower,
+		const std::vector<double>& upper, const std::vector<int>& levels)
+{
+	std::vector<std::vector<double> > points;
+	int nParameters = lower.size();
+	long int size = parameterSweepGridSize(nParameters, levels.empty() ? NULL : &(levels[0]));
+	if ((size < 1) || (upper.size() != lower.size()) || (levels.size() != lower.size()))
+	{
+		std::cerr << "CellmlSimulator::parameterGrid: Error, invalid arguments." << std::endl;
+		return points;
+	}
+	std::vector<double> values(size*nParameters);
+	parameterSweepGrid(nParameters, &(lower[0]), &(upper[0]), &(levels[0]), &(values[0]));
+	for (long int i=0; i<size; ++i)
+		points.push_back(std::vector<double>(values.begin() + i*nParameters, values.begin() + (i+1)*nParameters));
+	return points;
+}
+
+std::vector<std::vector<double> > CellmlSimulator::latinHypercubeSample(const std::vector<double>& lower,
+		const std::vector<double>& upper, int nSamples, unsigned long seed)
+{
+	std::vector<std::vector<double> > points;
+	int nParameters = lower.size();
+	if ((nParameters < 1) || (upper.size() != lower.size()) || (nSamples < 1))
+	{
+		std::cerr << "CellmlSimulator::latinHypercubeSample: Error, invalid arguments." << std::endl;
+		return points;
+	}
+	std::vector<double> values(nSamples*nParameters);
+	parameterSweepLatinHypercube(nParameters, &(lower[0]), &(upper[0]), nSamples, seed, &(values[0]));
+	for (int i=0; i<nSamples; ++i)
+		points.push_back(std::vector<double>(values.begin() + i*nParameters, values.begin() + (i+1)*nParameters));
+	return points;
+}
+
+int CellmlSimulator::setNumberOfThreads(int nThreads)
+{
+	if (nThreads < 1)
+	{
+		std::cerr << "CellmlSimulator::setNumberOfThreads: Invalid number of threads: " << nThreads << std::endl;
+		return -1;
+	}
+	if (mExecutableModel) mExecutableModel->setThreadPool(NULL);
+	if (mThreadPool) delete mThreadPool;
+	mThreadPool = NULL;
+	if (nThreads > 1) mThreadPool = new ThreadPool(nThreads);
+	if (mExecutableModel) mExecutableModel->setThreadPool(mThreadPool);
 	return 0;
 }
 
@@ -269,6 +526,57 @@ int CellmlSimulator::updateModelFromCheckpoint()
 	return 0;
 }
 
+int CellmlSimulator::forkSimulation()
+{
+	if (!(mExecutableModel && mSimulation && simulationIsValidDescription(mSimulation)))
+	{
+		std::cerr << "CellmlSimulator::forkSimulation: Error, need to compile the model before forking the "
+				"simulation." << std::endl;
+		return -1;
+	}
+	// the integrator as it would be used to carry on the simulation
+	if (!mIntegrator) mIntegrator = createIntegrator();
+	else if (mIntegratorResetRequired) integratorReinitialise(mIntegrator, mExecutableModel->bound[0]);
+	mIntegratorResetRequired = false;
+	struct IntegratorSnapshot* snapshot = mIntegrator ?
+		integratorSnapshot(mIntegrator, mExecutableModel->bound[0]) : NULL;
+	if (!snapshot)
+	{
+		std::cerr << "CellmlSimulator::forkSimulation: Error taking the snapshot." << std::endl;
+		return -2;
+	}
+	mForks.push_back(snapshot);
+	return mForks.size() - 1;
+}
+
+int CellmlSimulator::restoreFork(int fork)
+{
+	if (!mExecutableModel || (fork < 0) || (fork >= (int)mForks.size()) || !mForks[fork])
+	{
+		std::cerr << "CellmlSimulator::restoreFork: Error, invalid fork: " << fork << std::endl;
+		return -1;
+	}
+	if (!mIntegrator) mIntegrator = createIntegrator();
+	if (!mIntegrator || (integratorRestore(mIntegrator, mForks[fork]) != OK))
+	{
+		std::cerr << "CellmlSimulator::restoreFork: Error restoring the simulation." << std::endl;
+		return -2;
+	}
+	mIntegratorResetRequired = false;
+	return 0;
+}
+
+int CellmlSimulator::releaseFork(int fork)
+{
+	if ((fork < 0) || (fork >= (int)mForks.size()) || !mForks[fork])
+	{
+		std::cerr << "CellmlSimulator::releaseFork: Error, invalid fork: " << fork << std::endl;
+		return -1;
+	}
+	DestroyIntegratorSnapshot(&(mForks[fork]));
+	return 0;
+}
+
 int CellmlSimulator::setVariableValue(const std::string& variableId, double value)
 {
 	if (!mExecutableModel)
@@ -277,18 +585,7 @@ int CellmlSimulator::setVariableValue(const std::string& variableId, double valu
 				"setting the value of any variable." << std::endl;
 		return -1;
 	}
-	std::vector<std::string>::const_iterator iter = mVariableIds.begin();
-	int variableIndex = -1, i = 0;
-	while (iter != mVariableIds.end())
-	{
-		if (*iter == variableId)
-		{
-			variableIndex = i;
-			break;
-		}
-		++i;
-		++iter;
-	}
+	int variableIndex = findVariable(variableId);
 	if (variableIndex > -1)
 	{
 		enum VariableCodeArray array = outputVariablesGetCodeArray(simulationGetOutputVariables(mSimulation),
@@ -319,6 +616,19 @@ int CellmlSimulator::setVariableValue(const std::string& variableId, double valu
 	return -1;
 }
 
+int CellmlSimulator::findVariable(const std::string& variableId)
+{
+	std::vector<std::string>::const_iterator iter = mVariableIds.begin();
+	int i = 0;
+	while (iter != mVariableIds.end())
+	{
+		if (*iter == variableId) return i;
+		++i;
+		++iter;
+	}
+	return -1;
+}
+
 std::vector<std::string> CellmlSimulator::getModelVariables()
 {
 	return std::vector<std::string>(mVariableIds);
@@ -341,11 +651,32 @@ std::vector<double> CellmlSimulator::getModelOutputs()
 
 std::vector<std::vector<double> > CellmlSimulator::simulateModel(double initialTime, double startTime, double endTime,
 		double numSteps)
+{
+	return simulate(initialTime, startTime, endTime, numSteps, NULL);
+}
+
+std::vector<std::vector<double> > CellmlSimulator::simulateModelSensitivities(double initialTime, double startTime,
+		double endTime, double numSteps, std::vector<std::vector<std::vector<double> > >& sensitivities)
+{
+	sensitivities.clear();
+	if (mSensitivityParameters.empty())
+	{
+		std::cerr << "CellmlSimulator::simulateModelSensitivities: Error, no sensitivity parameters have been "
+				"set." << std::endl;
+		return std::vector<std::vector<double> >();
+	}
+	return simulate(initialTime, startTime, endTime, numSteps, &sensitivities);
+}
+
+std::vector<std::vector<double> > CellmlSimulator::simulate(double initialTime, double startTime, double endTime,
+		double numSteps, std::vector<std::vector<std::vector<double> > >* sensitivities)
 {
 	std::vector<std::vector<double> > results;
 	if (mExecutableModel && mSimulation && simulationIsValidDescription(mSimulation))
 	{
-		if (!mIntegrator) mIntegrator = CreateIntegrator(mSimulation, mExecutableModel);
+		if (!mIntegrator) mIntegrator = createIntegrator();
+		else if (mIntegratorResetRequired) integratorReinitialise(mIntegrator, initialTime);
+		mIntegratorResetRequired = false;
 		if (mIntegrator)
 		{
 			mExecutableModel->bound[0] = initialTime;
@@ -357,6 +688,7 @@ std::vector<std::vector<double> > CellmlSimulator::simulateModel(double initialT
 			}
 			// grab the initial outputs
 			results.push_back(getModelOutputs());
+			if (sensitivities) sensitivities->push_back(getOutputSensitivities());
 			/*
 			std::vector<double> outputs = getModelOutputs();
 			results += formatOutputValues(outputs);
@@ -371,6 +703,7 @@ std::vector<std::vector<double> > CellmlSimulator::simulateModel(double initialT
 			{
 				integrate(mIntegrator, tout, mExecutableModel->bound);
 				results.push_back(getModelOutputs());
+				if (sensitivities) sensitivities->push_back(getOutputSensitivities());
 				/*
 				outputs = getModelOutputs();
 				results += formatOutputValues(outputs);
@@ -409,7 +742,9 @@ int CellmlSimulator::simulateModelOneStep(double stepSize)
 		 *
 		 * FIXME: for now, the reset method will also "reset" the integrator
 		 */
-		if (!mIntegrator) mIntegrator = CreateIntegrator(mSimulation, mExecutableModel);
+		if (!mIntegrator) mIntegrator = createIntegrator();
+		else if (mIntegratorResetRequired) integratorReinitialise(mIntegrator, mExecutableModel->bound[0]);
+		mIntegratorResetRequired = false;
 		if (mIntegrator)
 		{
 			// grab the current "time"
@@ -431,7 +766,8 @@ int CellmlSimulator::simulateModelOneStep(double stepSize)
 
 int CellmlSimulator::resetIntegrator()
 {
-	if (mIntegrator) DestroyIntegrator(&mIntegrator);
+	// the integrator is restarted when next used, so that the model values can be updated in any order
+	if (mIntegrator) mIntegratorResetRequired = true;
 	return 0;
 }
 
@@ -441,6 +777,547 @@ void CellmlSimulator::setTolerances(double aTol, double rTol, int maxSteps)
     {
         simulationSetATol(mSimulation, 1, &aTol);
         simulationSetRTol(mSimulation, rTol);
-        //FIXME: need to handle maxSteps
+        // zero (or less) leaves the integrator to guess the maximum number of steps, clearing any
+        // earlier limit
+        simulationSetMaxNumSteps(mSimulation, (maxSteps > 0) ? maxSteps : 0);
+        // the tolerances are fixed when the integrator is created
+        if (mIntegrator) DestroyIntegrator(&mIntegrator);
+        mIntegratorResetRequired = false;
+    }
+}
+
+int CellmlSimulator::setAbsoluteTolerances(const std::vector<double>& aTol, const std::string& scaling)
+{
+    if (!mSimulation || aTol.empty())
+    {
+        std::cerr << "CellmlSimulator::setAbsoluteTolerances: Error, invalid arguments." << std::endl;
+        return -1;
+    }
+    enum ToleranceScaling ts = toleranceScalingFromString(scaling.c_str());
+    if (ts == INVALID_TS)
+    {
+        std::cerr << "CellmlSimulator::setAbsoluteTolerances: Error, invalid scaling: " << scaling.c_str()
+                  << std::endl;
+        return -2;
     }
+    if (mExecutableModel && (aTol.size() != 1) && ((int)aTol.size() != mExecutableModel->nRates))
+    {
+        std::cerr << "CellmlSimulator::setAbsoluteTolerances: Error, need one absolute tolerance or one for "
+                     "each state variable." << std::endl;
+        return -3;
+    }
+    simulationSetATol(mSimulation, aTol.size(), const_cast<double*>(&(aTol[0])));
+    simulationSetATolScaling(mSimulation, ts);
+    // the tolerances are fixed when the integrator is created
+    if (mIntegrator) DestroyIntegrator(&mIntegrator);
+    mIntegratorResetRequired = false;
+    return 0;
+}
+
+int CellmlSimulator::setAbsoluteTolerances(const std::map<std::string, double>& aTol, const std::string& scaling)
+{
+    if (!mExecutableModel)
+    {
+        std::cerr << "CellmlSimulator::setAbsoluteTolerances: Error, need to compile the model before "
+                     "setting the tolerances of individual variables." << std::endl;
+        return -1;
+    }
+    std::vector<std::string> variableIds;
+    for (std::map<std::string, double>::const_iterator iter = aTol.begin(); iter != aTol.end(); ++iter)
+        variableIds.push_back(iter->first);
+    std::vector<std::pair<bool, int> > parameters;
+    int code = findParameters(variableIds, parameters);
+    if (code != 0) return code;
+    // the state variables not given keep their current tolerance
+    int nStates = mExecutableModel->nRates;
+    int atolLength = simulationGetATolLength(mSimulation);
+    if ((atolLength != 1) && (atolLength != nStates))
+    {
+        std::cerr << "CellmlSimulator::setAbsoluteTolerances: Error, need one absolute tolerance or one for "
+                     "each state variable." << std::endl;
+        return -3;
+    }
+    double* atol = simulationGetATol(mSimulation);
+    std::vector<double> tolerances(nStates);
+    for (int i=0; i<nStates; ++i) tolerances[i] = atol[(atolLength == 1) ? 0 : i];
+    free(atol);
+    for (size_t i=0; i<parameters.size(); ++i)
+    {
+        if (!parameters[i].first)
+        {
+            std::cerr << "CellmlSimulator::setAbsoluteTolerances: Error, the variable " << variableIds[i]
+                      << " is not a state variable." << std::endl;
+            return -3;
+        }
+        tolerances[parameters[i].second] = aTol.find(variableIds[i])->second;
+    }
+    return setAbsoluteTolerances(tolerances, scaling);
+}
+
+int CellmlSimulator::setIntegrationScheme(const std::string& scheme)
+{
+    enum IntegrationScheme is = integrationSchemeFromString(scheme.c_str());
+    if (!mSimulation || (is == INVALID_IS))
+    {
+        std::cerr << "CellmlSimulator::setIntegrationScheme: Error, invalid arguments." << std::endl;
+        return -1;
+    }
+    simulationSetIntegrationScheme(mSimulation, is);
+    // need a new integrator for the new scheme
+    if (mIntegrator) DestroyIntegrator(&mIntegrator);
+    mIntegratorResetRequired = false;
+    return 0;
+}
+
+int CellmlSimulator::setMultistepMethod(const std::string& method)
+{
+    enum MultistepMethod mm = multistepMethodFromString(method.c_str());
+    if (!mSimulation || (mm == INVALID_MM))
+    {
+        std::cerr << "CellmlSimulator::setMultistepMethod: Error, invalid arguments." << std::endl;
+        return -1;
+    }
+    simulationSetMultistepMethod(mSimulation, mm);
+    simulationSetIterationMethod(mSimulation, (mm == ADAMS) ? FUNCTIONAL : NEWTON);
+    // need a new integrator for the new method
+    if (mIntegrator) DestroyIntegrator(&mIntegrator);
+    mIntegratorResetRequired = false;
+    return 0;
+}
+
+int CellmlSimulator::steadyState(double& residualNorm)
+{
+    if (!(mExecutableModel && mSimulation && simulationIsValidDescription(mSimulation)))
+    {
+        std::cerr << "CellmlSimulator::steadyState: Error, invalid arguments." << std::endl;
+        return -1;
+    }
+    struct SteadyStateStatistics stats;
+    int code = steadyStateSolve(mSimulation, mExecutableModel, mExecutableModel->bound[0], &residualNorm, &stats);
+    // the states have changed underneath the integrator
+    if (mIntegrator) mIntegratorResetRequired = true;
+    if (code != OK)
+    {
+        std::cerr << "CellmlSimulator::steadyState: Error, failed to converge to a steady state (residual norm: "
+                  << residualNorm << ")." << std::endl;
+        return -2;
+    }
+    return 0;
+}
+
+int CellmlSimulator::simulateToLimitCycle(double initialTime, double period, int maxCycles, double tolerance,
+                                          std::vector<double>& history, int shootingInterval)
+{
+    history.clear();
+    if (!(mExecutableModel && mSimulation && simulationIsValidDescription(mSimulation) && (maxCycles > 0)))
+    {
+        std::cerr << "CellmlSimulator::simulateToLimitCycle: Error, invalid arguments." << std::endl;
+        return -1;
+    }
+    history.resize(maxCycles);
+    struct LimitCycleStatistics stats;
+    double tEnd = initialTime;
+    int code = limitCycleSolve(mSimulation, mExecutableModel, initialTime, period, maxCycles, tolerance,
+                               shootingInterval, &tEnd, &(history[0]), &stats);
+    history.resize(stats.nCycles);
+    mExecutableModel->bound[0] = tEnd;
+    // the states have changed underneath the integrator
+    if (mIntegrator) mIntegratorResetRequired = true;
+    if (code != OK)
+    {
+        std::cerr << "CellmlSimulator::simulateToLimitCycle: Error, no limit cycle found after " << stats.nCycles
+                  << " cycles." << std::endl;
+        return -2;
+    }
+    return 0;
+}
+
+int CellmlSimulator::autotuneSolver(double calibrationTime, bool useCache)
+{
+    if (!(mExecutableModel && mSimulation && mCode && simulationIsValidDescription(mSimulation) &&
+          (calibrationTime > 0.0)))
+    {
+        std::cerr << "CellmlSimulator::autotuneSolver: Error, invalid arguments." << std::endl;
+        return -1;
+    }
+    // the cache key covers the generated code and everything else which affects the choice
+    uint64_t key;
+    if (hashModelCode(key) != 0) useCache = false;
+    int atolLength = simulationGetATolLength(mSimulation);
+    double* atol = simulationGetATol(mSimulation);
+    double rtol = simulationGetRTol(mSimulation);
+    key = fnv1aHash(atol, sizeof(double) * atolLength, key);
+    key = fnv1aHash(&rtol, sizeof(double), key);
+    key = fnv1aHash(&calibrationTime, sizeof(double), key);
+    free(atol);
+    std::string cacheFile;
+    if (getenv("CSIM_AUTOTUNE_CACHE")) cacheFile = getenv("CSIM_AUTOTUNE_CACHE");
+    else if (getenv("HOME")) cacheFile = std::string(getenv("HOME")) + "/.csim-autotune";
+    else useCache = false;
+
+    struct SolverConfiguration best;
+    if (!(useCache && (autotuneCacheLookup(cacheFile.c_str(), key, &best) == OK)))
+    {
+        if (::autotuneSolver(mSimulation, mExecutableModel, mExecutableModel->bound[0], calibrationTime, &best,
+                             NULL) != OK)
+        {
+            std::cerr << "CellmlSimulator::autotuneSolver: Error, unable to simulate the calibration window."
+                      << std::endl;
+            return -2;
+        }
+        if (useCache) autotuneCacheStore(cacheFile.c_str(), key, &best);
+    }
+    simulationSetIntegrationScheme(mSimulation, CVODE);
+    simulationSetMultistepMethod(mSimulation, best.lmm);
+    simulationSetIterationMethod(mSimulation, best.iter);
+    simulationSetLinearSolver(mSimulation, best.solver);
+    // need a new integrator for the new configuration
+    if (mIntegrator) DestroyIntegrator(&mIntegrator);
+    mIntegratorResetRequired = false;
+    return 0;
+}
+
+int CellmlSimulator::pacedInitialConditions(double initialTime, double period, int maxCycles, double tolerance,
+                                            bool& cached, int shootingInterval)
+{
+    cached = false;
+    if (!(mExecutableModel && mSimulation && mCode && simulationIsValidDescription(mSimulation) &&
+          (maxCycles > 0)))
+    {
+        std::cerr << "CellmlSimulator::pacedInitialConditions: Error, invalid arguments." << std::endl;
+        return -1;
+    }
+    uint64_t modelHash;
+    std::string cacheFile;
+    if (hashModelCode(modelHash) != 0) std::cerr << "CellmlSimulator::pacedInitialConditions: Warning, unable "
+                                                    "to read the model code, not using the cache." << std::endl;
+    else if (getenv("CSIM_INITIAL_CONDITION_CACHE")) cacheFile = getenv("CSIM_INITIAL_CONDITION_CACHE");
+    else if (getenv("HOME")) cacheFile = std::string(getenv("HOME")) + "/.csim-initial-conditions";
+    double tEnd = initialTime;
+    int fromCache = 0;
+    int code = initialConditionPace(cacheFile.empty() ? NULL : cacheFile.c_str(), modelHash, mSimulation,
+                                    mExecutableModel, initialTime, period, maxCycles, tolerance, shootingInterval,
+                                    &tEnd, &fromCache);
+    cached = (fromCache != 0);
+    mExecutableModel->bound[0] = tEnd;
+    // the states have changed underneath the integrator
+    if (mIntegrator) mIntegratorResetRequired = true;
+    if (code != OK)
+    {
+        std::cerr << "CellmlSimulator::pacedInitialConditions: Error, no limit cycle found after " << maxCycles
+                  << " cycles." << std::endl;
+        return -2;
+    }
+    return 0;
+}
+
+int CellmlSimulator::setSensitivityParameters(const std::vector<std::string>& variableIds)
+{
+    if (!mExecutableModel)
+    {
+        std::cerr << "CellmlSimulator::setSensitivityParameters: Error, need to compile the model before "
+                     "selecting the sensitivity parameters." << std::endl;
+        return -1;
+    }
+    std::vector<std::pair<bool, int> > parameters;
+    int code = findParameters(variableIds, parameters);
+    if (code != 0) return code;
+    mSensitivityParameters = parameters;
+    // the sensitivities are set up when the integrator is created
+    if (mIntegrator) DestroyIntegrator(&mIntegrator);
+    mIntegratorResetRequired = false;
+    return 0;
+}
+
+int CellmlSimulator::setFastStateVariables(const std::vector<std::string>& variableIds)
+{
+    if (!mExecutableModel)
+    {
+        std::cerr << "CellmlSimulator::setFastStateVariables: Error, need to compile the model before "
+                     "selecting the fast state variables." << std::endl;
+        return -1;
+    }
+    std::vector<std::pair<bool, int> > parameters;
+    int code = findParameters(variableIds, parameters);
+    if (code != 0) return code;
+    std::vector<int> fastStates;
+    for (size_t i=0; i<parameters.size(); ++i)
+    {
+        if (!parameters[i].first)
+        {
+            std::cerr << "CellmlSimulator::setFastStateVariables: Error, the variable " << variableIds[i]
+                      << " is not a state variable." << std::endl;
+            return -3;
+        }
+        fastStates.push_back(parameters[i].second);
+    }
+    simulationSetFastStates(mSimulation, (int)fastStates.size(), fastStates.empty() ? NULL : &(fastStates[0]));
+    // the partition is set up when the integrator is created
+    if (mIntegrator) DestroyIntegrator(&mIntegrator);
+    mIntegratorResetRequired = false;
+    return 0;
+}
+
+int CellmlSimulator::hashModelCode(uint64_t& hash)
+{
+    hash = FNV1A_OFFSET_BASIS;
+    FILE* codeFile = mCode ? fopen(mCode->codeFileName(), "rb") : NULL;
+    if (!codeFile) return -1;
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), codeFile)) > 0) hash = fnv1aHash(buffer, n, hash);
+    fclose(codeFile);
+    return 0;
+}
+
+int CellmlSimulator::findParameters(const std::vector<std::string>& variableIds,
+                                    std::vector<std::pair<bool, int> >& parameters)
+{
+    for (std::vector<std::string>::const_iterator iter = variableIds.begin(); iter != variableIds.end(); ++iter)
+    {
+        int variableIndex = findVariable(*iter);
+        if (variableIndex < 0)
+        {
+            std::cerr << "CellmlSimulator::findParameters: Error, unknown variable: " << iter->c_str()
+                      << std::endl;
+            return -2;
+        }
+        void* list = simulationGetOutputVariables(mSimulation);
+        enum VariableCodeArray array = outputVariablesGetCodeArray(list, variableIndex);
+        int index = outputVariablesGetCodeIndex(list, variableIndex);
+        if ((array != CONSTANT_ARRAY) && (array != STATE_ARRAY))
+        {
+            std::cerr << "CellmlSimulator::findParameters: Error, the variable " << iter->c_str()
+                      << " is not a constant or state variable." << std::endl;
+            return -3;
+        }
+        parameters.push_back(std::make_pair(array == STATE_ARRAY, index));
+    }
+    return 0;
+}
+
+std::vector<std::vector<double> > CellmlSimulator::getOutputSensitivities()
+{
+    std::vector<std::vector<double> > sensitivities;
+    int nParameters = integratorGetNumSensitivityParameters(mIntegrator);
+    if (nParameters < 1) return sensitivities;
+    int nOutputs = mExecutableModel->nOutputs;
+    std::vector<double> values(nParameters*nOutputs);
+    if (integratorGetOutputSensitivities(mIntegrator, &(values[0])) != OK)
+    {
+        std::cerr << "CellmlSimulator::getOutputSensitivities: Error getting the sensitivities." << std::endl;
+        return sensitivities;
+    }
+    for (int i=0; i<nParameters; ++i)
+        sensitivities.push_back(std::vector<double>(values.begin() + i*nOutputs,
+                                                    values.begin() + (i+1)*nOutputs));
+    return sensitivities;
+}
+
+struct Integrator* CellmlSimulator::createIntegrator()
+{
+    struct Integrator* integrator = CreateIntegrator(mSimulation, mExecutableModel);
+    if (integrator && !mSensitivityParameters.empty())
+    {
+        std::vector<struct SensitivityParameter> parameters(mSensitivityParameters.size());
+        for (size_t i=0; i<mSensitivityParameters.size(); ++i)
+        {
+            parameters[i].isState = mSensitivityParameters[i].first ? 1 : 0;
+            parameters[i].index = mSensitivityParameters[i].second;
+        }
+        if (integratorEnableSensitivities(integrator, parameters.size(), &(parameters[0])) != OK)
+        {
+            std::cerr << "CellmlSimulator::createIntegrator: Error enabling the sensitivity analysis."
+                      << std::endl;
+            DestroyIntegrator(&integrator);
+        }
+    }
+    return integrator;
+}
+
+int CellmlSimulator::computeLeastSquaresGradient(double initialTime, const std::vector<double>& times,
+                                                 const std::vector<std::vector<double> >& data,
+                                                 const std::vector<std::string>& parameterIds, double& objective,
+                                                 std::vector<double>& gradient)
+{
+    if (!(mExecutableModel && mSimulation && simulationIsValidDescription(mSimulation)) || times.empty() ||
+        (times.size() != data.size()) || parameterIds.empty())
+    {
+        std::cerr << "CellmlSimulator::computeLeastSquaresGradient: Error, invalid arguments." << std::endl;
+        return -1;
+    }
+    for (size_t k=0; k<data.size(); ++k)
+    {
+        if ((int)data[k].size() != mExecutableModel->nOutputs)
+        {
+            std::cerr << "CellmlSimulator::computeLeastSquaresGradient: Error, need a value for each output at "
+                         "each time." << std::endl;
+            return -1;
+        }
+    }
+    if (!mSensitivityParameters.empty())
+    {
+        std::cerr << "CellmlSimulator::computeLeastSquaresGradient: Error, not available with forward "
+                     "sensitivity parameters set." << std::endl;
+        return -2;
+    }
+    std::vector<std::pair<bool, int> > ids;
+    int code = findParameters(parameterIds, ids);
+    if (code != 0) return code;
+    std::vector<struct SensitivityParameter> parameters(ids.size());
+    for (size_t i=0; i<ids.size(); ++i)
+    {
+        parameters[i].isState = ids[i].first ? 1 : 0;
+        parameters[i].index = ids[i].second;
+    }
+    if (!mIntegrator) mIntegrator = createIntegrator();
+    if (!mIntegrator)
+    {
+        std::cerr << "CellmlSimulator::computeLeastSquaresGradient: Error creating integrator." << std::endl;
+        return -3;
+    }
+    struct AdjointObjective leastSquares;
+    leastSquares.integrand = NULL;
+    leastSquares.sample = leastSquaresSample;
+    leastSquares.nSamples = times.size();
+    leastSquares.sampleTimes = &(times[0]);
+    leastSquares.userData = const_cast<std::vector<std::vector<double> >*>(&data);
+    gradient.resize(parameters.size());
+    mExecutableModel->bound[0] = initialTime;
+    // the integrator is always restarted from the current model values
+    mIntegratorResetRequired = false;
+    if (integratorAdjointGradient(mIntegrator, initialTime, times.back(), &leastSquares, parameters.size(),
+                                  &(parameters[0]), &objective, &(gradient[0])) != OK)
+    {
+        std::cerr << "CellmlSimulator::computeLeastSquaresGradient: Error computing the gradient." << std::endl;
+        return -4;
+    }
+    mExecutableModel->bound[0] = times.back();
+    return 0;
+}
+
+int CellmlSimulator::useExperimentalData(struct ExperimentalData* data)
+{
+    int n = experimentalDataNumObservations(data);
+    for (int i=0; i<n; ++i)
+    {
+        int output = findVariable(experimentalDataVariableId(data, i));
+        if (output < 0)
+        {
+            std::cerr << "CellmlSimulator::useExperimentalData: Error, the variable "
+                      << experimentalDataVariableId(data, i) << " is not one of the model outputs." << std::endl;
+            DestroyExperimentalData(&data);
+            return -2;
+        }
+        experimentalDataSetOutput(data, i, output);
+    }
+    if (mExperimentalData) DestroyExperimentalData(&mExperimentalData);
+    mExperimentalData = data;
+    return 0;
+}
+
+int CellmlSimulator::loadExperimentalData(const std::string& filename)
+{
+    struct ExperimentalData* data = experimentalDataReadCSV(filename.c_str());
+    if (!data || (experimentalDataNumObservations(data) == 0))
+    {
+        std::cerr << "CellmlSimulator::loadExperimentalData: Error, no observations read from " << filename
+                  << std::endl;
+        if (data) DestroyExperimentalData(&data);
+        return -1;
+    }
+    return useExperimentalData(data);
+}
+
+int CellmlSimulator::setExperimentalData(const std::vector<double>& times,
+                                         const std::vector<std::string>& variableIds,
+                                         const std::vector<double>& values, const std::vector<double>& weights)
+{
+    if (times.empty() || (variableIds.size() != times.size()) || (values.size() != times.size()) ||
+        !(weights.empty() || (weights.size() == times.size())))
+    {
+        std::cerr << "CellmlSimulator::setExperimentalData: Error, invalid arguments." << std::endl;
+        return -1;
+    }
+    struct ExperimentalData* data = CreateExperimentalData();
+    for (size_t i=0; i<times.size(); ++i)
+    {
+        if (experimentalDataAdd(data, times[i], variableIds[i].c_str(), values[i],
+                                weights.empty() ? 1.0 : weights[i]) != OK)
+        {
+            std::cerr << "CellmlSimulator::setExperimentalData: Error, invalid observation " << i << "."
+                      << std::endl;
+            DestroyExperimentalData(&data);
+            return -1;
+        }
+    }
+    return useExperimentalData(data);
+}
+
+int CellmlSimulator::computeResiduals(double initialTime, double& sumOfSquares, std::vector<double>& residuals)
+{
+    if (!(mExecutableModel && mSimulation && simulationIsValidDescription(mSimulation) && mExperimentalData))
+    {
+        std::cerr << "CellmlSimulator::computeResiduals: Error, no model or experimental data." << std::endl;
+        return -1;
+    }
+    if (!mIntegrator) mIntegrator = createIntegrator();
+    if (!mIntegrator)
+    {
+        std::cerr << "CellmlSimulator::computeResiduals: Error creating integrator." << std::endl;
+        return -3;
+    }
+    residuals.resize(experimentalDataNumObservations(mExperimentalData));
+    mExecutableModel->bound[0] = initialTime;
+    // the integrator is always restarted from the current model values
+    mIntegratorResetRequired = false;
+    if (experimentalDataResiduals(mExperimentalData, mIntegrator, mExecutableModel, initialTime, &(residuals[0]),
+                                  &sumOfSquares) != OK)
+    {
+        std::cerr << "CellmlSimulator::computeResiduals: Error computing the residuals." << std::endl;
+        return -4;
+    }
+    return 0;
+}
+
+int CellmlSimulator::estimateParameters(const std::vector<std::string>& parameterIds, std::vector<double>& values,
+                                        const std::vector<double>& lower, const std::vector<double>& upper,
+                                        double initialTime, int nThreads, double& sumOfSquares,
+                                        EstimationMethod method)
+{
+    if (!(mExecutableModel && mSimulation && simulationIsValidDescription(mSimulation) && mExperimentalData) ||
+        parameterIds.empty() || (values.size() != parameterIds.size()) ||
+        !(lower.empty() || (lower.size() == values.size())) ||
+        !(upper.empty() || (upper.size() == values.size())) || (nThreads < 1))
+    {
+        std::cerr << "CellmlSimulator::estimateParameters: Error, invalid arguments." << std::endl;
+        return -1;
+    }
+    std::vector<std::pair<bool, int> > ids;
+    int code = findParameters(parameterIds, ids);
+    if (code != 0) return code;
+    std::vector<struct SensitivityParameter> parameters(ids.size());
+    for (size_t i=0; i<ids.size(); ++i)
+    {
+        parameters[i].isState = ids[i].first ? 1 : 0;
+        parameters[i].index = ids[i].second;
+    }
+    struct Simulation* simulation = simulationClone(mSimulation);
+    simulationSetBvarStart(simulation, initialTime);
+    struct ParameterEstimationStatistics stats;
+    if (method == ESTIMATE_CMA_ES)
+        code = parameterEstimationCMAES(simulation, mExecutableModel, mExperimentalData, parameters.size(),
+            &(parameters[0]), lower.empty() ? NULL : &(lower[0]), upper.empty() ? NULL : &(upper[0]), 0,
+            nThreads, 0, &(values[0]), &sumOfSquares, &stats);
+    else
+        code = parameterEstimationLevenbergMarquardt(simulation, mExecutableModel, mExperimentalData,
+            parameters.size(), &(parameters[0]), lower.empty() ? NULL : &(lower[0]),
+            upper.empty() ? NULL : &(upper[0]), 0, &(values[0]), &sumOfSquares, &stats);
+    DestroySimulation(&simulation);
+    if (code != OK)
+    {
+        std::cerr << "CellmlSimulator::estimateParameters: Error estimating the parameters." << std::endl;
+        return -4;
+    }
+    return 0;
 }
@@ -17,17 +17,37 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <stdint.h>
 
 struct CellMLModel;
 struct Simulation;
 struct Integrator;
+struct SensitivityParameter;
+struct IntegratorSnapshot;
+struct ExperimentalData;
 class CellmlCode;
 class ExecutableModel;
 class XmlDoc;
+class ThreadPool;
 
 class CSIM_API CellmlSimulator
 {
 public:
+	/* How the simulations of a parameter sweep are run */
+	enum SweepMode
+	{
+		SWEEP_THREADS,
+		SWEEP_BATCHED,
+		SWEEP_PROCESSES
+	};
+
+	/* How the parameters are estimated */
+	enum EstimationMethod
+	{
+		ESTIMATE_LEVENBERG_MARQUARDT,
+		ESTIMATE_CMA_ES
+	};
+
 	CellmlSimulator();
 	~CellmlSimulator();
 
@@ -94,6 +114,28 @@ public:
 	 */
 	int updateModelFromCheckpoint();
 
+	/**
+	 * Fork the simulation at its current point, taking a snapshot of the full simulation state (all the model
+	 * values along with the integrator's state) from which any number of continuations can branch, e.g., after
+	 * a long pre-pacing shared by several protocols. Unlike checkpointModelValues, continuing from a fork keeps
+	 * the integrator's step size, method and tolerance scaling, so it avoids the small steps of a cold start.
+	 * The integration is still restarted (at first order), so a continuation agrees with the unforked trajectory
+	 * to within the tolerances rather than exactly. Returns the fork's ID (zero or more), or a negative value on
+	 * error.
+	 */
+	int forkSimulation();
+
+	/**
+	 * Carry on the simulation from the given fork, with the model values and integrator settings as they were
+	 * when it was forked (see forkSimulation). Return 0 on success.
+	 */
+	int restoreFork(int fork);
+
+	/**
+	 * Release the given fork's snapshot. Return 0 on success.
+	 */
+	int releaseFork(int fork);
+
 	/**
 	 * Set the value of the given variable (component.variable) to the specified value. Return 0 on success.
 	 */
@@ -123,17 +165,285 @@ public:
 	int simulateModelOneStep(double stepSize);
 
 	/**
-	 * Reset the integrator. If an integrator exists, simply destroy it so that it will be re-created
-	 * next time the oneStep method is called.
+	 * Reset the integrator. If an integrator exists, it will be restarted from the current model
+	 * values (e.g., after updateModelFromCheckpoint) the next time the model is simulated. The
+	 * existing solver memory is reused, so this is cheap enough to call many times.
 	 */
 	int resetIntegrator();
 
     /**
-      * Set the tolerances and maximum number of steps in the integtator.
+      * Set the tolerances and maximum number of steps in the integtator. Any existing integrator will
+      * be re-created the next time the model is simulated.
+      * @param maxSteps The maximum number of steps to reach each output point, or zero (or less) for the
+      * integrator's default.
       */
     void setTolerances(double aTol, double rTol, int maxSteps);
 
+    /**
+      * Set the absolute tolerances, either a single value or one value for each state variable in the
+      * order the state variables are stored in the compiled model (see setAbsoluteTolerances below to give
+      * the tolerances by variable ID).
+      * @param scaling How to scale the absolute tolerances: "none" to use them as given; or "initial" or
+      * "running" to scale them by the initial or largest-so-far magnitude of each state variable.
+      * @return zero on success.
+      */
+    int setAbsoluteTolerances(const std::vector<double>& aTol, const std::string& scaling = "none");
+
+    /**
+      * Set the absolute tolerances of individual state variables, given by their variable IDs. The state
+      * variables not given keep their current absolute tolerance. The model must be compiled first.
+      * @param scaling As for the method above.
+      * @return zero on success, -2 if a variable is unknown and -3 if it is not a state variable.
+      */
+    int setAbsoluteTolerances(const std::map<std::string, double>& aTol, const std::string& scaling = "none");
+
+    /**
+      * Set the integration scheme to use: "CVODE" (the default), or one of the explicit Runge-Kutta schemes
+      * "Euler" and "RK4" (fixed step, using the maximum step size) or "RK45" (adaptive), or the Rush-Larsen
+      * schemes "RushLarsen" and "RushLarsen2" which update any gating variables exactly over each fixed step,
+      * or "Multirate" for models mixing fast and slow processes (see setFastStateVariables).
+      * @return zero on success.
+      */
+    int setIntegrationScheme(const std::string& scheme);
+
+    /**
+      * Set the linear multistep method used with the CVODE integration scheme: "BDF" (the default, with Newton
+      * iteration) for stiff models, "Adams" (with functional iteration) for nonstiff models, or "Adams-BDF"
+      * (or "Auto") to monitor the stiffness while integrating and switch between the two as needed (e.g., a
+      * model which is only stiff during the upstroke). Any existing integrator will be re-created the next
+      * time the model is simulated.
+      * @return zero on success.
+      */
+    int setMultistepMethod(const std::string& method);
+
+    /**
+      * Bring the model to a steady state, starting from the current model values with the bound variable held
+      * at its current value. A damped Newton iteration is used to find the state variable values for which all
+      * the rates are zero, falling back to pseudo-transient continuation if Newton fails. On return the model
+      * values are the steady state (or the best estimate found) and @residualNorm is the 2-norm of the rates.
+      * Any existing integrator will be restarted from the steady state the next time the model is simulated.
+      * @return zero on success.
+      */
+    int steadyState(double& residualNorm);
+
+    /**
+      * Pace the model to its periodic steady state (limit cycle). Starting from the current model values at
+      * @initialTime the model is simulated one @period at a time, comparing the states at the same phase of
+      * consecutive cycles, until the largest relative change in any state variable over a cycle is no more than
+      * @tolerance (or @maxCycles cycles have been simulated). The change over each cycle is returned in
+      * @history, one entry per cycle simulated. If @shootingInterval is greater than zero a Newton shooting step
+      * on the period map is tried every @shootingInterval cycles to speed up the convergence (CVODE integration
+      * scheme only). On return the model values are those at the end of the last cycle.
+      * @return zero if the limit cycle was found.
+      */
+    int simulateToLimitCycle(double initialTime, double period, int maxCycles, double tolerance,
+                             std::vector<double>& history, int shootingInterval = 0);
+
+    /**
+      * Choose the CVODE solver configuration (multistep method, iteration method and linear solver) for the
+      * model by simulating the first @calibrationTime of the simulation, from the current model values, with
+      * each viable configuration and selecting the fastest one which is as accurate as the default (BDF with
+      * Newton iteration and the dense linear solver). If @useCache is true the choice is stored in, and looked
+      * up from, the cache file given by the CSIM_AUTOTUNE_CACHE environment variable (~/.csim-autotune by
+      * default), keyed on the generated model code and the tolerances. The model values are unchanged and
+      * any existing integrator will be re-created the next time the model is simulated.
+      * @return zero on success.
+      */
+    int autotuneSolver(double calibrationTime, bool useCache = true);
+
+    /**
+      * Pace the model to its periodic steady state (limit cycle) as simulateToLimitCycle does, but look the paced
+      * model values up in the cache file given by the CSIM_INITIAL_CONDITION_CACHE environment variable
+      * (~/.csim-initial-conditions by default) first, and store them there once the limit cycle has been found.
+      * The cache is keyed on the generated model code, the current constants and initial states, the pacing
+      * protocol (@initialTime, @period and @tolerance) and the integration scheme, tolerances and maximum step
+      * size, so identical runs in any job share the pacing. It can safely be shared by concurrent processes. @cached is set to whether the
+      * values came from the cache. On return the model values are those at the end of the last cycle.
+      * @return zero if the limit cycle was found.
+      */
+    int pacedInitialConditions(double initialTime, double period, int maxCycles, double tolerance, bool& cached,
+                               int shootingInterval = 0);
+
+    /**
+      * Create a new instance of the compiled model with a copy of the current model values. The instance shares
+      * the compiled code with this simulator, so it is cheap to create and can be used concurrently with the
+      * simulator and any other instances (e.g., with one integrator per thread). The caller owns the instance.
+      * @return the new instance, or NULL if the model hasn't been compiled.
+      */
+    class ExecutableModel* createModelInstance();
+
+    /**
+      * Simulate the model from @startTime to @endTime in @numSteps once for each row of @values, with the given
+      * parameters (constants or the initial values of state variables, by variable ID) set to the values in that
+      * row and all the other variables starting from the current model values. The simulations are run on
+      * @nThreads threads, each with its own instance of the model and integrator, and are handed out one at a
+      * time as the threads become free. The outputs are returned in @results as one block of (numSteps + 1)
+      * rows of outputs for each simulation, and whether each simulation succeeded in @success. See parameterGrid
+      * and latinHypercubeSample for generating the values. With @mode SWEEP_BATCHED each thread runs its
+      * simulations in lock-step batches with the batched Rosenbrock integrator instead of CVODE, which is faster
+      * for large ensembles of small models at moderate tolerances. With SWEEP_PROCESSES they are run on @nThreads
+      * worker processes instead of threads, for models which aren't thread safe or might crash (a simulation
+      * whose worker dies is retried and then marked as failed).
+      * @return zero if all the simulations succeeded.
+      */
+    int parameterSweep(const std::vector<std::string>& parameterIds, const std::vector<std::vector<double> >& values,
+                       double startTime, double endTime, int numSteps, int nThreads, std::vector<double>& results,
+                       std::vector<int>& success, SweepMode mode = SWEEP_THREADS);
+
+    /**
+      * Run the continuations of a fork (see forkSimulation), as for parameterSweep but with each simulation
+      * carrying on from the fork with the parameters set to one of the @values, from the time of the fork to
+      * @endTime. The simulation up to the fork is shared by all of them rather than repeated, and the fork is
+      * unchanged. The results are in the same layout as for parameterSweep.
+      * @return zero if all the simulations succeeded.
+      */
+    int simulateFromFork(int fork, const std::vector<std::string>& parameterIds,
+                         const std::vector<std::vector<double> >& values, double endTime, int numSteps, int nThreads,
+                         std::vector<double>& results, std::vector<int>& success);
+
+    /**
+      * Simulate an ensemble like parameterSweep, but only keep the statistics of the outputs across the ensemble
+      * rather than every simulation's outputs, so the memory used doesn't grow with the size of the ensemble.
+      * For each output at each of the (numSteps + 1) points the @mean and (sample) @variance are returned, along
+      * with an estimate of each of the given @quantiles (e.g., 0.05, 0.5, 0.95) in @quantileValues, in the same
+      * layout as one simulation's results from parameterSweep. Failed simulations are left out of the statistics.
+      * @return zero if all the simulations succeeded.
+      */
+    int simulateEnsemble(const std::vector<std::string>& parameterIds, const std::vector<std::vector<double> >& values,
+                         double startTime, double endTime, int numSteps, int nThreads,
+                         const std::vector<double>& quantiles, std::vector<double>& mean,
+                         std::vector<double>& variance, std::vector<std::vector<double> >& quantileValues,
+                         std::vector<int>& success);
+
+    /**
+      * Returns the points of the full factorial grid with @levels evenly spaced values from @lower to @upper for
+      * each parameter, with the last parameter varying fastest.
+      */
+    static std::vector<std::vector<double> > parameterGrid(const std::vector<double>& lower,
+        const std::vector<double>& upper, const std::vector<int>& levels);
+
+    /**
+      * Returns a Latin hypercube sample of @nSamples points from the box @lower to @upper. The same @seed gives
+      * the same sample.
+      */
+    static std::vector<std::vector<double> > latinHypercubeSample(const std::vector<double>& lower,
+        const std::vector<double>& upper, int nSamples, unsigned long seed = 1);
+
+    /**
+      * Set the number of threads used to evaluate the rates of the model (including the calling thread).
+      * Only models large enough to be worth splitting up are evaluated in parallel, using the independent
+      * groups of equations found when the code was generated; smaller models are always evaluated serially.
+      * Can be called before or after the model is compiled. The default is one thread.
+      * @return zero on success.
+      */
+    int setNumberOfThreads(int nThreads);
+
+    /**
+      * Select the parameters for the forward sensitivity analysis, each given by its variable ID
+      * (component.variable) and being either a constant or a state variable (in which case the sensitivity
+      * to its initial value is computed). An empty list disables the sensitivity analysis. Any existing
+      * integrator will be re-created the next time the model is simulated. Only available with the CVODE
+      * integration scheme.
+      *
+      * Note: computed constants are recalculated from the other variables each time the rates are evaluated,
+      *       so only variables with an initial value should be selected.
+      * @return zero on success.
+      */
+    int setSensitivityParameters(const std::vector<std::string>& variableIds);
+
+    /**
+      * Select the state variables, by variable ID (component.variable), integrated as fast states with the
+      * "Multirate" integration scheme: they are integrated implicitly with small substeps inside each explicit
+      * macro step of the other (slow) state variables. An empty list (the default) chooses the partition
+      * from estimates of the time scales of the state variables when the integrator is created. Any existing
+      * integrator will be re-created the next time the model is simulated.
+      * @return zero on success.
+      */
+    int setFastStateVariables(const std::vector<std::string>& variableIds);
+
+    /**
+      * Returns the sensitivities of the outputs to each of the sensitivity parameters at the current output
+      * point, one vector of output sensitivities for each parameter.
+      */
+    std::vector<std::vector<double> > getOutputSensitivities();
+
+    /**
+      * As for simulateModel, but also returning the sensitivities of the outputs at each output point
+      * (see getOutputSensitivities) in @sensitivities. This replaces running one simulation per perturbed
+      * parameter value.
+      */
+    std::vector<std::vector<double> > simulateModelSensitivities(double initialTime, double startTime,
+        double endTime, double numSteps, std::vector<std::vector<std::vector<double> > >& sensitivities);
+
+    /**
+      * Compute the least squares objective, half the sum of the squared differences between the outputs and
+      * the given data at each of the given times, and its gradient with respect to each of the given
+      * parameters (constants or the initial values of state variables, by variable ID) using the adjoint
+      * sensitivity analysis. The cost is about that of two simulations, no matter how many parameters there
+      * are. The model is simulated from @initialTime (using the current model values) to the last of the
+      * @times, which must be increasing. Each entry of @data is the outputs at the corresponding time, with NaN
+      * for any output which should not contribute. Not available while any forward sensitivity parameters are
+      * set.
+      * @return zero on success.
+      */
+    int computeLeastSquaresGradient(double initialTime, const std::vector<double>& times,
+        const std::vector<std::vector<double> >& data, const std::vector<std::string>& parameterIds,
+        double& objective, std::vector<double>& gradient);
+
+    /**
+      * Load the experimental data to fit the model to from a CSV file with one observation on each line, as
+      * "time,variable ID,value[,weight]" (the weight defaults to 1 and a header line is skipped). Each
+      * variable must be one of the model outputs. This replaces any previously set experimental data.
+      * @return zero on success.
+      */
+    int loadExperimentalData(const std::string& filename);
+
+    /**
+      * Set the experimental data to fit the model to, as for loadExperimentalData but from the given
+      * observations. @weights may be empty, giving each observation a weight of 1.
+      * @return zero on success.
+      */
+    int setExperimentalData(const std::vector<double>& times, const std::vector<std::string>& variableIds,
+        const std::vector<double>& values, const std::vector<double>& weights);
+
+    /**
+      * Compute the weighted residuals, sqrt(weight)*(output - value), of the experimental data, one for each
+      * observation, and their sum of squares. The model is simulated from @initialTime (using the current
+      * model values) through the observation times, with the residuals evaluated as the integration passes
+      * each of them, so no simulation results are stored. On return the model is at the time of the last
+      * observation.
+      * @return zero on success.
+      */
+    int computeResiduals(double initialTime, double& sumOfSquares, std::vector<double>& residuals);
+
+    /**
+      * Estimate the values of the given parameters (constants or the initial values of state variables, by
+      * variable ID) by fitting the model to the experimental data (see loadExperimentalData), i.e., minimising
+      * the sum of squares of the weighted residuals. Each simulation starts from @initialTime using the current
+      * model values, which are left unchanged. @values holds the initial values of the parameters and on return
+      * the best values found, with their sum of squares in @sumOfSquares. The parameters are kept within
+      * @lower and @upper (either may be empty). Levenberg-Marquardt uses the forward sensitivities and is the
+      * faster from a good starting point, while CMA-ES is derivative free and more robust, evaluating each
+      * generation on @nThreads threads. Every simulation uses the same compiled model.
+      * @return zero on success.
+      */
+    int estimateParameters(const std::vector<std::string>& parameterIds, std::vector<double>& values,
+        const std::vector<double>& lower, const std::vector<double>& upper, double initialTime, int nThreads,
+        double& sumOfSquares, EstimationMethod method = ESTIMATE_LEVENBERG_MARQUARDT);
+
 private:
+    struct Integrator* createIntegrator();
+    int findVariable(const std::string& variableId);
+    int findParameters(const std::vector<std::string>& variableIds, std::vector<std::pair<bool, int> >& parameters);
+    int hashModelCode(uint64_t& hash);
+    int setupSweep(const std::vector<std::string>& parameterIds, const std::vector<std::vector<double> >& values,
+        double startTime, double endTime, int numSteps, int nThreads,
+        std::vector<struct SensitivityParameter>& parameters, std::vector<double>& parameterValues,
+        struct Simulation** simulation);
+    std::vector<std::vector<double> > simulate(double initialTime, double startTime, double endTime,
+        double numSteps, std::vector<std::vector<std::vector<double> > >* sensitivities);
+    int useExperimentalData(struct ExperimentalData* data);
+
 	std::string mUrl;
     std::vector<std::string> mVariableIds;
 	struct CellMLModel* mModel;
@@ -142,12 +452,19 @@ private:
 	class ExecutableModel* mExecutableModel;
     class XmlDoc* mXmlDoc;
 	struct Integrator* mIntegrator;
+	bool mIntegratorResetRequired;
+	// the sensitivity parameters: (is a state variable, index into the constants or states)
+	std::vector<std::pair<bool, int> > mSensitivityParameters;
 	double* mBoundCache;
 	double* mRatesCache;
 	double* mStatesCache;
 	double* mConstantsCache;
 	double* mAlgebraicCache;
 	double* mOutputsCache;
+	class ThreadPool* mThreadPool;
+	struct ExperimentalData* mExperimentalData;
+	// the snapshots of the forks, NULL once released
+	std::vector<struct IntegratorSnapshot*> mForks;
 };
 
 #endif /* CELLMLSIMULATOR_HPP_ */
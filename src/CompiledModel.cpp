@@ -0,0 +1,220 @@
+/*
+ * CompiledModel.cpp
+ */
+
+#include <string>
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/GenericValue.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Target/TargetOptions.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "utils.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "ModelCompiler.hpp"
+#include "CompiledModel.hpp"
+
+CompiledModel::CompiledModel() :
+        nBound(0), nRates(0), nConstants(0), nAlgebraic(0), nOutputs(0), nRoots(0), nGates(0), gateIndices(0),
+        nRateStages(0), nRateTasks(0), rateStageTasks(0), nBatchWidth(0), setupFixedConstants(0), computeRates(0),
+        evaluateVariables(0), getOutputs(0), computeRoots(0), computeGates(0), computeAdjoint(0),
+        computeRatesTask(0), computeRatesBatch(0), mEE(0)
+{
+}
+
+CompiledModel::~CompiledModel()
+{
+	if (gateIndices) free(gateIndices);
+	if (rateStageTasks) free(rateStageTasks);
+	// the execution engine owns the compiled module
+	if (mEE) delete mEE;
+}
+
+static llvm::ExecutionEngine *
+createExecutionEngine(std::unique_ptr<llvm::Module> M, std::string *ErrorStr)
+{
+  // no fused multiply-adds, so the results are the same on any host CPU (see ModelCompiler::compileModel)
+  llvm::TargetOptions options;
+  options.AllowFPOpFusion = llvm::FPOpFusion::Strict;
+  return llvm::EngineBuilder(std::move(M))
+      .setEngineKind(llvm::EngineKind::Either)
+      .setErrorStr(ErrorStr)
+      .setMCPU(llvm::sys::getHostCPUName())
+      .setTargetOptions(options)
+      .create();
+}
+
+int CompiledModel::initialise(ModelCompiler *compiler, const char *filename)
+{
+    if (!compiler)
+    {
+        std::cerr << "Invailid model compiler with which to initialise the model"
+                  << std::endl;
+        return -1;
+    }
+    if (!filename)
+    {
+        std::cerr << "Invailid filename with which to initialise the model"
+                  << std::endl;
+        return -2;
+    }
+    if (mEE)
+    {
+        std::cerr << "The compiled model has already been initialised" << std::endl;
+        return -4;
+    }
+
+    std::unique_ptr<llvm::Module> compiledModel(compiler->compileModel(filename));
+
+    if (!compiledModel)
+    {
+        std::cerr << "Error compiling model" << std::endl;
+        return -3;
+    }
+
+    // FIXME: learn how to use std::unique_ptr - no idea why this works, but its what the clang-interpreter does :)
+    llvm::Module& M = *compiledModel;
+
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    std::string Error;
+
+	// This takes over managing the compiledModel object.
+    mEE = createExecutionEngine(std::move(compiledModel), &Error);
+
+    mEE->finalizeObject();
+
+    llvm::Function* getNbound = M.getFunction("getNbound");
+    llvm::Function* getNrates = M.getFunction("getNrates");
+    llvm::Function* getNalgebraic = M.getFunction("getNalgebraic");
+    llvm::Function* getNconstants = M.getFunction("getNconstants");
+    llvm::Function* getNoutputs = M.getFunction("getNoutputs");
+	if (!(getNalgebraic && getNbound && getNconstants && getNoutputs && getNrates))
+	{
+		llvm::errs() << "'getN*' function not found in module.\n";
+        return -3;
+	}
+    setupFixedConstants = (SetupFixedConstantsFunction)(mEE->getPointerToFunction(M.getFunction("SetupFixedConstants")));
+    computeRates = (ComputeRatesFunction)(mEE->getPointerToFunction(M.getFunction("ComputeRates")));
+    evaluateVariables = (EvaluateVariablesFunction)(mEE->getPointerToFunction(M.getFunction("EvaluateVariables")));
+    getOutputs = (GetOutputsFunction)(mEE->getPointerToFunction(M.getFunction("GetOutputs")));
+	if (!(setupFixedConstants && computeRates && evaluateVariables && getOutputs))
+	{
+		llvm::errs() << "'compute functions' function not found in module.\n";
+        return -3;
+	}
+
+	std::vector<llvm::GenericValue> noargs;
+	llvm::GenericValue gv = mEE->runFunction(getNbound, noargs);
+	nBound = gv.IntVal.getLimitedValue();
+	gv = mEE->runFunction(getNconstants, noargs);
+	nConstants = gv.IntVal.getLimitedValue();
+	gv = mEE->runFunction(getNrates, noargs);
+	nRates = gv.IntVal.getLimitedValue();
+	gv = mEE->runFunction(getNalgebraic, noargs);
+	nAlgebraic = gv.IntVal.getLimitedValue();
+	gv = mEE->runFunction(getNoutputs, noargs);
+	nOutputs = gv.IntVal.getLimitedValue();
+
+	// the root functions are optional
+	llvm::Function* getNroots = M.getFunction("getNroots");
+	llvm::Function* computeRootsFunction = M.getFunction("ComputeRoots");
+	if (getNroots && computeRootsFunction)
+	{
+		gv = mEE->runFunction(getNroots, noargs);
+		nRoots = gv.IntVal.getLimitedValue();
+		computeRoots = (ComputeRootsFunction)(mEE->getPointerToFunction(computeRootsFunction));
+	}
+	if (!computeRoots) nRoots = 0;
+
+	// as are the gates
+	llvm::Function* getNgates = M.getFunction("getNgates");
+	llvm::Function* getGateIndicesFunction = M.getFunction("GetGateIndices");
+	llvm::Function* computeGatesFunction = M.getFunction("ComputeGates");
+	if (getNgates && getGateIndicesFunction && computeGatesFunction)
+	{
+		gv = mEE->runFunction(getNgates, noargs);
+		nGates = gv.IntVal.getLimitedValue();
+		computeGates = (ComputeGatesFunction)(mEE->getPointerToFunction(computeGatesFunction));
+		GetGateIndicesFunction getGateIndices =
+			(GetGateIndicesFunction)(mEE->getPointerToFunction(getGateIndicesFunction));
+		if (computeGates && getGateIndices && (nGates > 0))
+		{
+			gateIndices = (int*) calloc(nGates, sizeof(int));
+			(*getGateIndices)(gateIndices);
+		}
+	}
+	if (!gateIndices) nGates = 0;
+
+	// and the adjoint
+	llvm::Function* computeAdjointFunction = M.getFunction("ComputeAdjoint");
+	if (computeAdjointFunction)
+		computeAdjoint = (ComputeAdjointFunction)(mEE->getPointerToFunction(computeAdjointFunction));
+
+	// and the parallel schedule for the rates
+	llvm::Function* getNrateStages = M.getFunction("getNrateStages");
+	llvm::Function* getRateStageTasksFunction = M.getFunction("GetRateStageTasks");
+	llvm::Function* computeRatesTaskFunction = M.getFunction("ComputeRatesTask");
+	if (getNrateStages && getRateStageTasksFunction && computeRatesTaskFunction)
+	{
+		gv = mEE->runFunction(getNrateStages, noargs);
+		nRateStages = gv.IntVal.getLimitedValue();
+		computeRatesTask = (ComputeRatesTaskFunction)(mEE->getPointerToFunction(computeRatesTaskFunction));
+		GetRateStageTasksFunction getRateStageTasks =
+			(GetRateStageTasksFunction)(mEE->getPointerToFunction(getRateStageTasksFunction));
+		if (computeRatesTask && getRateStageTasks && (nRateStages > 0))
+		{
+			rateStageTasks = (int*) calloc(nRateStages, sizeof(int));
+			(*getRateStageTasks)(rateStageTasks);
+			for (int i = 0; i < nRateStages; ++i) nRateTasks += rateStageTasks[i];
+		}
+	}
+	if (!rateStageTasks)
+	{
+		nRateStages = 0;
+		computeRatesTask = 0;
+	}
+
+	// and the batched rates
+	llvm::Function* getBatchWidth = M.getFunction("getBatchWidth");
+	llvm::Function* computeRatesBatchFunction = M.getFunction("ComputeRatesBatch");
+	if (getBatchWidth && computeRatesBatchFunction)
+	{
+		gv = mEE->runFunction(getBatchWidth, noargs);
+		nBatchWidth = gv.IntVal.getLimitedValue();
+		computeRatesBatch = (ComputeRatesBatchFunction)(mEE->getPointerToFunction(computeRatesBatchFunction));
+	}
+	if (!computeRatesBatch) nBatchWidth = 0;
+
+	if (debugLevel() > 0)
+	{
+		std::cout << "nBound = " << nBound << std::endl;
+		std::cout << "nConstants = " << nConstants << std::endl;
+		std::cout << "nRates = " << nRates << std::endl;
+		std::cout << "nAlgebraic = " << nAlgebraic << std::endl;
+		std::cout << "nOutputs = " << nOutputs << std::endl;
+		std::cout << "nRoots = " << nRoots << std::endl;
+		std::cout << "nGates = " << nGates << std::endl;
+		std::cout << "adjoint = " << (computeAdjoint ? "yes" : "no") << std::endl;
+		std::cout << "nRateStages = " << nRateStages << " (" << nRateTasks << " tasks)" << std::endl;
+		std::cout << "nBatchWidth = " << nBatchWidth << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * CompiledModel.hpp
+ *
+ * The JIT compiled code for a model: the generated functions and the sizes of the model's arrays.
+ * Once initialised a compiled model is never changed, so it can be shared by any number of model
+ * instances (ExecutableModel) which hold the values of the variables, including instances being
+ * used concurrently on different threads.
+ */
+
+#ifndef COMPILEDMODEL_HPP_
+#define COMPILEDMODEL_HPP_
+
+typedef void (*SetupFixedConstantsFunction)(double*, double*, double*);
+typedef void (*ComputeRatesFunction)(double, double*, double*, double*, double*);
+typedef void (*EvaluateVariablesFunction)(double, double*, double*, double*, double*);
+typedef void (*GetOutputsFunction)(double, double*, double*, double*, double*);
+typedef void (*ComputeRootsFunction)(double, double*, double*, double*, double*, double*);
+typedef void (*GetGateIndicesFunction)(int*);
+typedef void (*ComputeGatesFunction)(double, double*, double*, double*, double*, double*, double*);
+typedef void (*ComputeAdjointFunction)(double, double*, double*, double*, double*, double*, double*, double*,
+                                       double*);
+typedef void (*GetRateStageTasksFunction)(int*);
+typedef void (*ComputeRatesTaskFunction)(int, double, double*, double*, double*, double*);
+typedef void (*ComputeRatesBatchFunction)(double*, double*, double*, double*, double*);
+
+// forward declare from LLVM
+namespace llvm
+{
+	class ExecutionEngine;
+}
+class ModelCompiler;
+
+class CompiledModel
+{
+public:
+	CompiledModel();
+	~CompiledModel();
+
+	/* Compile the model code in the given file with the given compiler and look up the generated
+	 * functions.
+	 */
+	int initialise(ModelCompiler* compiler, const char* filename);
+
+	int nBound;
+	int nRates;
+	int nConstants;
+	int nAlgebraic;
+	int nOutputs;
+	int nRoots;
+	int nGates;
+	int* gateIndices;
+	/* The parallel schedule for the rates, the number of tasks in each of the nRateStages stages */
+	int nRateStages;
+	int nRateTasks;
+	int* rateStageTasks;
+	/* The number of instances evaluated together by computeRatesBatch, zero if there isn't one */
+	int nBatchWidth;
+
+	/* The generated functions, the optional ones are NULL if the model doesn't have them */
+	SetupFixedConstantsFunction setupFixedConstants;
+	ComputeRatesFunction computeRates;
+	EvaluateVariablesFunction evaluateVariables;
+	GetOutputsFunction getOutputs;
+	ComputeRootsFunction computeRoots;
+	ComputeGatesFunction computeGates;
+	ComputeAdjointFunction computeAdjoint;
+	ComputeRatesTaskFunction computeRatesTask;
+	ComputeRatesBatchFunction computeRatesBatch;
+
+private:
+	// not copyable, share it instead
+	CompiledModel(const CompiledModel&);
+	CompiledModel& operator=(const CompiledModel&);
+
+	llvm::ExecutionEngine* mEE;
+};
+
+#endif /* COMPILEDMODEL_HPP_ */
@@ -10,30 +10,7 @@
 #include <vector>
 #include <cstdlib>
 #include <cstdio>
-
-#include "clang/CodeGen/CodeGenAction.h"
-#include "clang/Driver/Compilation.h"
-#include "clang/Driver/Driver.h"
-#include "clang/Driver/Tool.h"
-#include "clang/Frontend/CompilerInvocation.h"
-#include "clang/Frontend/CompilerInstance.h"
-#include "clang/Basic/Diagnostic.h"
-#include "clang/Frontend/FrontendDiagnostic.h"
-#include "clang/Frontend/TextDiagnosticPrinter.h"
-
-#include "llvm/IR/Module.h"
-#include "llvm/IR/DerivedTypes.h"
-#include "llvm/ADT/SmallString.h"
-#include "llvm/ExecutionEngine/MCJIT.h"
-#include "llvm/ExecutionEngine/ExecutionEngine.h"
-#include "llvm/ExecutionEngine/GenericValue.h"
-#include "llvm/Support/ManagedStatic.h"
-#include "llvm/Support/raw_ostream.h"
-#include "llvm/Support/Host.h"
-#include "llvm/Support/Path.h"
-#include "llvm/Support/TargetSelect.h"
-using namespace clang;
-using namespace clang::driver;
+#include <cstring>
 
 #ifdef __cplusplus
 extern "C"
@@ -47,111 +24,66 @@ extern "C"
 #include "ModelCompiler.hpp"
 
 #include "ExecutableModel.hpp"
+#include "thread-pool.hpp"
 
 ExecutableModel::ExecutableModel() :
-        bound(0), rates(0), states(0), constants(0), algebraic(0), outputs(0)
+        nBound(0), bound(0), nRates(0), rates(0), states(0), nConstants(0), constants(0), nAlgebraic(0),
+        algebraic(0), nOutputs(0), outputs(0), nRoots(0), nGates(0), gateIndices(0), nRateStages(0),
+        nRateTasks(0), mValues(0), mThreadPool(0)
 {
 }
 
-static llvm::ExecutionEngine *
-createExecutionEngine(std::unique_ptr<llvm::Module> M, std::string *ErrorStr)
+ExecutableModel::~ExecutableModel()
 {
-  return llvm::EngineBuilder(std::move(M))
-      .setEngineKind(llvm::EngineKind::Either)
-      .setErrorStr(ErrorStr)
-      .create();
+	if (mValues) free(mValues);
 }
 
 int ExecutableModel::initialise(ModelCompiler *compiler, const char *filename, double voiInitialValue)
 {
-    if (!compiler)
-    {
-        std::cerr << "Invailid model compiler with which to initialise the model"
-                  << std::endl;
-        return -1;
-    }
-    if (!filename)
-    {
-        std::cerr << "Invailid filename with which to initialise the model"
-                  << std::endl;
-        return -2;
-    }
-
-    std::unique_ptr<llvm::Module> compiledModel(compiler->compileModel(filename));
-
-    if (!compiledModel)
-    {
-        std::cerr << "Error compiling model" << std::endl;
-        return -3;
-    }
-
-    // FIXME: learn how to use std::unique_ptr - no idea why this works, but its what the clang-interpreter does :)
-    llvm::Module& M = *compiledModel;
-
-    llvm::InitializeNativeTarget();
-    llvm::InitializeNativeTargetAsmPrinter();
-
-    std::string Error;
-
-	// This takes over managing the compiledModel object.
-    mEE = createExecutionEngine(std::move(compiledModel), &Error);
-
-    mEE->finalizeObject();
-
-    llvm::Function* getNbound = M.getFunction("getNbound");
-    llvm::Function* getNrates = M.getFunction("getNrates");
-    llvm::Function* getNalgebraic = M.getFunction("getNalgebraic");
-    llvm::Function* getNconstants = M.getFunction("getNconstants");
-    llvm::Function* getNoutputs = M.getFunction("getNoutputs");
-	if (!(getNalgebraic && getNbound && getNconstants && getNoutputs && getNrates))
-	{
-		llvm::errs() << "'getN*' function not found in module.\n";
-        return -3;
-	}
-    mSetupFixedConstants = (SetupFixedConstantsFunction)(mEE->getPointerToFunction(M.getFunction("SetupFixedConstants")));
-    mComputeRates = (ComputeRatesFunction)(mEE->getPointerToFunction(M.getFunction("ComputeRates")));
-    mEvaluateVariables = (EvaluateVariablesFunction)(mEE->getPointerToFunction(M.getFunction("EvaluateVariables")));
-    mGetOutputs = (GetOutputsFunction)(mEE->getPointerToFunction(M.getFunction("GetOutputs")));
-	if (!(mSetupFixedConstants && mComputeRates && mEvaluateVariables && mGetOutputs))
+	std::shared_ptr<CompiledModel> compiledModel(new CompiledModel());
+	int code = compiledModel->initialise(compiler, filename);
+	if (code != 0) return code;
+	return initialise(compiledModel, voiInitialValue);
+}
+
+/* Point the arrays into the single allocation of values */
+static double* allocateValues(ExecutableModel* em)
+{
+	double* values = (double*) calloc(em->nBound + em->nConstants + 2*em->nRates + em->nAlgebraic + em->nOutputs
+		+ 1, sizeof(double));
+	em->bound = values;
+	em->constants = em->bound + em->nBound;
+	em->rates = em->constants + em->nConstants;
+	em->states = em->rates + em->nRates;
+	em->algebraic = em->states + em->nRates;
+	em->outputs = em->algebraic + em->nAlgebraic;
+	return values;
+}
+
+int ExecutableModel::initialise(std::shared_ptr<const CompiledModel> compiledModel, double voiInitialValue)
+{
+	if (!compiledModel || !(compiledModel->computeRates))
 	{
-		llvm::errs() << "'compute functions' function not found in module.\n";
-        return -3;
+		std::cerr << "Invalid compiled model with which to initialise the model" << std::endl;
+		return -1;
 	}
-
-	std::vector<llvm::GenericValue> noargs;
-	llvm::GenericValue gv = mEE->runFunction(getNbound, noargs);
-	nBound = gv.IntVal.getLimitedValue();
-	gv = mEE->runFunction(getNconstants, noargs);
-	nConstants = gv.IntVal.getLimitedValue();
-	gv = mEE->runFunction(getNrates, noargs);
-	nRates = gv.IntVal.getLimitedValue();
-	gv = mEE->runFunction(getNalgebraic, noargs);
-	nAlgebraic = gv.IntVal.getLimitedValue();
-	gv = mEE->runFunction(getNoutputs, noargs);
-	nOutputs = gv.IntVal.getLimitedValue();
-
-	/*
-    llvm::Function* mult = compiledModel->getFunction("mult");
-    std::vector<llvm::GenericValue> oneargs(1);
-    oneargs[0].PointerVal = &nBound;
-    gv = mEE->runFunction(mult, oneargs);
-    */
-
-	if (debugLevel() > 0)
+	if (mValues)
 	{
-		std::cout << "nBound = " << nBound << std::endl;
-		std::cout << "nConstants = " << nConstants << std::endl;
-		std::cout << "nRates = " << nRates << std::endl;
-		std::cout << "nAlgebraic = " << nAlgebraic << std::endl;
-		std::cout << "nOutputs = " << nOutputs << std::endl;
+		std::cerr << "The executable model has already been initialised" << std::endl;
+		return -4;
 	}
-
-	bound = (double*) calloc(nBound, sizeof(double));
-	constants = (double*) calloc(nConstants, sizeof(double));
-	rates = (double*) calloc(nRates, sizeof(double));
-	states = (double*) calloc(nRates, sizeof(double));
-	algebraic = (double*) calloc(nAlgebraic, sizeof(double));
-	outputs = (double*) calloc(nOutputs, sizeof(double));
+	mCompiledModel = compiledModel;
+	nBound = compiledModel->nBound;
+	nRates = compiledModel->nRates;
+	nConstants = compiledModel->nConstants;
+	nAlgebraic = compiledModel->nAlgebraic;
+	nOutputs = compiledModel->nOutputs;
+	nRoots = compiledModel->nRoots;
+	nGates = compiledModel->nGates;
+	gateIndices = compiledModel->gateIndices;
+	nRateStages = compiledModel->nRateStages;
+	nRateTasks = compiledModel->nRateTasks;
+	mValues = allocateValues(this);
 
 	// intialise the arrays
 	setupFixedConstants();
@@ -161,14 +93,41 @@ int ExecutableModel::initialise(ModelCompiler *compiler, const char *filename, d
     return 0;
 }
 
-ExecutableModel::~ExecutableModel()
+ExecutableModel* ExecutableModel::clone() const
 {
-	if (bound) free(bound);
-	if (constants) free(constants);
-	if (rates) free(rates);
-	if (states) free(states);
-	if (algebraic) free(algebraic);
-	if (outputs) free(outputs);
+	if (!mValues) return 0;
+	ExecutableModel* em = new ExecutableModel();
+	em->mCompiledModel = mCompiledModel;
+	em->nBound = nBound;
+	em->nRates = nRates;
+	em->nConstants = nConstants;
+	em->nAlgebraic = nAlgebraic;
+	em->nOutputs = nOutputs;
+	em->nRoots = nRoots;
+	em->nGates = nGates;
+	em->gateIndices = gateIndices;
+	em->nRateStages = nRateStages;
+	em->nRateTasks = nRateTasks;
+	em->mValues = allocateValues(em);
+	em->copyValues(this);
+	return em;
+}
+
+int ExecutableModel::copyValues(const ExecutableModel* source)
+{
+	if (!source || !mValues || !(source->mValues) || (source->mCompiledModel != mCompiledModel))
+	{
+		std::cerr << "Can only copy the values from an instance of the same compiled model" << std::endl;
+		return -1;
+	}
+	if (source != this)
+		memcpy(mValues, source->mValues, sizeof(double)*(nBound + nConstants + 2*nRates + nAlgebraic + nOutputs));
+	return 0;
+}
+
+std::shared_ptr<const CompiledModel> ExecutableModel::compiledModel() const
+{
+	return mCompiledModel;
 }
 
 int ExecutableModel::setupFixedConstants()
@@ -179,10 +138,28 @@ int ExecutableModel::setupFixedConstants()
 	args[2].PointerVal = (void*)states;
 	llvm::GenericValue gv = mEE->runFunction(mSetupFixedConstants, args);
 */
-	(*mSetupFixedConstants)(constants, rates, states);
+	(*(mCompiledModel->setupFixedConstants))(constants, rates, states);
 	return 0;
 }
 
+/* The arguments for the tasks in one stage of the parallel rates evaluation */
+struct RatesTaskData
+{
+	ComputeRatesTaskFunction computeRatesTask;
+	int firstTask;
+	double voi;
+	double* states;
+	double* rates;
+	double* constants;
+	double* algebraic;
+};
+
+static void computeRatesTask(int task, void* data)
+{
+	struct RatesTaskData* d = (struct RatesTaskData*)data;
+	(*(d->computeRatesTask))(d->firstTask + task, d->voi, d->states, d->rates, d->constants, d->algebraic);
+}
+
 int ExecutableModel::computeRates(double voi)
 {
 /*    std::vector<llvm::GenericValue> args(5);
@@ -201,10 +178,33 @@ int ExecutableModel::computeRates(double voi)
 #endif
 	llvm::GenericValue gv = mEE->runFunction(mComputeRates, args);
 */
-	(*mComputeRates)(voi, states, rates, constants, algebraic);
+	const CompiledModel* compiled = mCompiledModel.get();
+	if (mThreadPool && compiled->computeRatesTask && (mThreadPool->size() > 1))
+	{
+		const int* stageTasks = compiled->rateStageTasks;
+		struct RatesTaskData data = { compiled->computeRatesTask, 0, voi, states, rates, constants, algebraic };
+		for (int i = 0; i < nRateStages; ++i)
+		{
+			if (stageTasks[i] == 1) (*(data.computeRatesTask))(data.firstTask, voi, states, rates, constants, algebraic);
+			else mThreadPool->run(stageTasks[i], computeRatesTask, &data);
+			data.firstTask += stageTasks[i];
+		}
+		return 0;
+	}
+	(*(compiled->computeRates))(voi, states, rates, constants, algebraic);
 	return 0;
 }
 
+void ExecutableModel::setThreadPool(ThreadPool* pool)
+{
+	mThreadPool = pool;
+}
+
+bool ExecutableModel::hasParallelRates() const
+{
+	return mCompiledModel && (mCompiledModel->computeRatesTask != 0);
+}
+
 int ExecutableModel::evaluateVariables(double voi)
 {
 /*    std::vector<llvm::GenericValue> args(5);
@@ -215,7 +215,7 @@ int ExecutableModel::evaluateVariables(double voi)
     args[4].PointerVal = algebraic;
     llvm::GenericValue gv = mEE->runFunction(mEvaluateVariables, args);
 */
-	(*mEvaluateVariables)(voi, constants, rates, states, algebraic);
+	(*(mCompiledModel->evaluateVariables))(voi, constants, rates, states, algebraic);
 	return 0;
 }
 
@@ -229,7 +229,34 @@ int ExecutableModel::getOutputs(double voi)
 	args[4].PointerVal = (void*)outputs;
 	llvm::GenericValue gv = mEE->runFunction(mGetOutputs, args);
 */
-	(*mGetOutputs)(voi, constants, states, algebraic, outputs);
+	(*(mCompiledModel->getOutputs))(voi, constants, states, algebraic, outputs);
+	return 0;
+}
+
+int ExecutableModel::computeRoots(double voi, double* roots)
+{
+	if (!mCompiledModel->computeRoots) return -1;
+	(*(mCompiledModel->computeRoots))(voi, constants, rates, states, algebraic, roots);
+	return 0;
+}
+
+int ExecutableModel::computeGates(double voi, double* inf, double* tau)
+{
+	if (!mCompiledModel->computeGates) return -1;
+	(*(mCompiledModel->computeGates))(voi, constants, rates, states, algebraic, inf, tau);
 	return 0;
 }
 
+bool ExecutableModel::hasAdjoint() const
+{
+	return mCompiledModel && (mCompiledModel->computeAdjoint != 0);
+}
+
+int ExecutableModel::computeAdjoint(double voi, double* adjointConstants, double* adjointRates, double* adjointStates,
+									double* adjointAlgebraic)
+{
+	if (!mCompiledModel->computeAdjoint) return -1;
+	(*(mCompiledModel->computeAdjoint))(voi, constants, rates, states, algebraic, adjointConstants, adjointRates, adjointStates,
+					   adjointAlgebraic);
+	return 0;
+}
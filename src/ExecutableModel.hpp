@@ -8,30 +8,48 @@
 #ifndef EXECUTABLEMODEL_HPP_
 #define EXECUTABLEMODEL_HPP_
 
-typedef void (*SetupFixedConstantsFunction)(double*, double*, double*);
-typedef void (*ComputeRatesFunction)(double, double*, double*, double*, double*);
-typedef void (*EvaluateVariablesFunction)(double, double*, double*, double*, double*);
-typedef void (*GetOutputsFunction)(double, double*, double*, double*, double*);
+#include <memory>
+
+#include "CompiledModel.hpp"
 
-// forward declare from LLVM
-namespace llvm
-{
-	class Module;
-	class Function;
-	class ExecutionEngine;
-}
 class ModelCompiler;
+class ThreadPool;
 
+/*
+ * An instance of a model: the values of all the variables, evaluated with the model's compiled code
+ * (CompiledModel). The compiled code is shared by all the instances of the same model, so creating
+ * more instances (see clone) is cheap, just one allocation for all the arrays, and the instances can
+ * be used concurrently on different threads.
+ */
 class ExecutableModel
 {
 public:
     ExecutableModel();
 	~ExecutableModel();
 
-    /* Initialise the executable model for the given compiler and file.
+    /* Initialise the executable model for the given compiler and file, compiling the model code.
       */
     int initialise(ModelCompiler* compiler, const char* filename, double voiInitialValue);
 
+	/* Initialise the executable model as a new instance of the given compiled model, with the
+	 * initial values of all the variables.
+	 */
+	int initialise(std::shared_ptr<const CompiledModel> compiledModel, double voiInitialValue);
+
+	/* A new instance of the same compiled model with a copy of the current values of all the
+	 * variables (but not the thread pool). Returns NULL if this model hasn't been initialised.
+	 */
+	ExecutableModel* clone() const;
+
+	/* Copy the values of all the variables from another instance of the same compiled model, e.g.,
+	 * to reset an instance to a common starting point. Returns 0 on success.
+	 */
+	int copyValues(const ExecutableModel* source);
+
+	/* The compiled code used by this instance.
+	 */
+	std::shared_ptr<const CompiledModel> compiledModel() const;
+
 	/* Set up the output array ready for writing.
 	 */
 	int getOutputs(double voi);
@@ -52,6 +70,43 @@ public:
 	 */
 	int evaluateVariables(double voi);
 
+	/* Compute the root (switching) functions for the conditions found in the model's rates, a
+	 * change in sign of any of the roots indicates a discontinuity. Should be called after
+	 * computeRates for the same states. The roots array must have nRoots entries.
+	 */
+	int computeRoots(double voi, double* roots);
+
+	/* Compute the steady state values (inf) and time constants (tau) of the gating variables,
+	 * i.e., the state variables (with indices gateIndices) whose rate has the form
+	 * (inf - y)/tau. Should be called after computeRates for the same states. The inf and tau
+	 * arrays must have nGates entries.
+	 */
+	int computeGates(double voi, double* inf, double* tau);
+
+	/* Does the model have the generated adjoint (reverse mode derivative) code?
+	 */
+	bool hasAdjoint() const;
+
+	/* Evaluate the model equations for the current states, and then the vector-Jacobian products
+	 * of those equations. On entry adjointRates and adjointAlgebraic are the weights on the rates
+	 * and algebraic variables (these arrays are used as workspace and will be zero on exit), the
+	 * products with the derivatives of the rates and algebraic variables with respect to the
+	 * states and constants are added onto adjointStates and adjointConstants.
+	 */
+	int computeAdjoint(double voi, double* adjointConstants, double* adjointRates, double* adjointStates,
+					   double* adjointAlgebraic);
+
+
+	/* Use the given thread pool (which must outlive the model, or be unset with NULL) to evaluate the
+	 * rates in parallel, if the model is big enough to have been generated with a parallel schedule
+	 * for the rates.
+	 */
+	void setThreadPool(ThreadPool* pool);
+
+	/* Was the model generated with a parallel schedule for the rates?
+	 */
+	bool hasParallelRates() const;
+
 	int nBound;
 	double* bound;
 	int nRates;
@@ -63,13 +118,23 @@ public:
 	double* algebraic;
 	int nOutputs;
 	double* outputs;
+	int nRoots;
+	int nGates;
+	const int* gateIndices;
+	/* The parallel schedule for the rates, the tasks in each stage can be run concurrently but
+	 * the stages must be run in order */
+	int nRateStages;
+	int nRateTasks;
 
 private:
-	SetupFixedConstantsFunction mSetupFixedConstants;
-	ComputeRatesFunction mComputeRates;
-	EvaluateVariablesFunction mEvaluateVariables;
-    GetOutputsFunction mGetOutputs;
-    llvm::ExecutionEngine* mEE;
+	// not copyable, use clone instead
+	ExecutableModel(const ExecutableModel&);
+	ExecutableModel& operator=(const ExecutableModel&);
+
+	std::shared_ptr<const CompiledModel> mCompiledModel;
+	/* single allocation for all the arrays */
+	double* mValues;
+    ThreadPool* mThreadPool;
 };
 
 #endif /* EXECUTABLEMODEL_HPP_ */
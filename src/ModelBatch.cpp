@@ -0,0 +1,123 @@
+/*
+ * ModelBatch.cpp
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+#include "ModelBatch.hpp"
+#include "ExecutableModel.hpp"
+
+ModelBatch::ModelBatch() :
+        width(0), nRates(0), nConstants(0), nAlgebraic(0), voi(0), states(0), rates(0), constants(0),
+        algebraic(0), mValues(0), mLane(0)
+{
+}
+
+ModelBatch::~ModelBatch()
+{
+	if (mValues) free(mValues);
+}
+
+int ModelBatch::initialise(std::shared_ptr<const CompiledModel> compiledModel)
+{
+	if (!compiledModel || !(compiledModel->computeRates))
+	{
+		std::cerr << "Invalid compiled model with which to initialise the model batch" << std::endl;
+		return -1;
+	}
+	if (mValues)
+	{
+		std::cerr << "The model batch has already been initialised" << std::endl;
+		return -4;
+	}
+	mCompiledModel = compiledModel;
+	width = compiledModel->computeRatesBatch ? compiledModel->nBatchWidth : MODEL_BATCH_SCALAR_WIDTH;
+	nRates = compiledModel->nRates;
+	nConstants = compiledModel->nConstants;
+	nAlgebraic = compiledModel->nAlgebraic;
+	int laneSize = 2*nRates + nConstants + nAlgebraic;
+	mValues = (double*) calloc((size_t)width*(laneSize + 1) + laneSize + 1, sizeof(double));
+	voi = mValues;
+	states = voi + width;
+	rates = states + width*nRates;
+	constants = rates + width*nRates;
+	algebraic = constants + width*nConstants;
+	mLane = algebraic + width*nAlgebraic;
+	return 0;
+}
+
+/* scatter the n values into the lane of the batched array */
+static void scatter(double* batched, const double* values, int n, int width, int lane)
+{
+	for (int i = 0; i < n; ++i) batched[i*width + lane] = values[i];
+}
+
+/* gather the lane of the batched array into the n values */
+static void gather(double* values, const double* batched, int n, int width, int lane)
+{
+	for (int i = 0; i < n; ++i) values[i] = batched[i*width + lane];
+}
+
+int ModelBatch::setLane(int lane, const ExecutableModel* em)
+{
+	if (!mValues || !em || (lane < 0) || (lane >= width) || (em->compiledModel() != mCompiledModel))
+	{
+		std::cerr << "Can only set a lane of the model batch from an instance of the same compiled model"
+				  << std::endl;
+		return -1;
+	}
+	voi[lane] = em->bound[0];
+	scatter(states, em->states, nRates, width, lane);
+	scatter(rates, em->rates, nRates, width, lane);
+	scatter(constants, em->constants, nConstants, width, lane);
+	scatter(algebraic, em->algebraic, nAlgebraic, width, lane);
+	return 0;
+}
+
+int ModelBatch::getLane(int lane, ExecutableModel* em) const
+{
+	if (!mValues || !em || (lane < 0) || (lane >= width) || (em->compiledModel() != mCompiledModel))
+	{
+		std::cerr << "Can only get a lane of the model batch into an instance of the same compiled model"
+				  << std::endl;
+		return -1;
+	}
+	em->bound[0] = voi[lane];
+	gather(em->states, states, nRates, width, lane);
+	gather(em->rates, rates, nRates, width, lane);
+	gather(em->constants, constants, nConstants, width, lane);
+	gather(em->algebraic, algebraic, nAlgebraic, width, lane);
+	return 0;
+}
+
+int ModelBatch::computeRates()
+{
+	if (mCompiledModel->computeRatesBatch)
+	{
+		(*(mCompiledModel->computeRatesBatch))(voi, states, rates, constants, algebraic);
+		return 0;
+	}
+	// one lane at a time, the computed constants may change along with the rates
+	double* laneStates = mLane;
+	double* laneRates = laneStates + nRates;
+	double* laneConstants = laneRates + nRates;
+	double* laneAlgebraic = laneConstants + nConstants;
+	for (int lane = 0; lane < width; ++lane)
+	{
+		gather(laneStates, states, nRates, width, lane);
+		gather(laneConstants, constants, nConstants, width, lane);
+		gather(laneAlgebraic, algebraic, nAlgebraic, width, lane);
+		(*(mCompiledModel->computeRates))(voi[lane], laneStates, laneRates, laneConstants, laneAlgebraic);
+		scatter(rates, laneRates, nRates, width, lane);
+		scatter(constants, laneConstants, nConstants, width, lane);
+		scatter(algebraic, laneAlgebraic, nAlgebraic, width, lane);
+	}
+	return 0;
+}
+
+bool ModelBatch::isBatched() const
+{
+	return mCompiledModel && mCompiledModel->computeRatesBatch;
+}
@@ -0,0 +1,74 @@
+/*
+ * ModelBatch.hpp
+ *
+ * A batch of instances of the same compiled model (the lanes of the batch), with the values of each
+ * variable stored structure-of-arrays, X[i*width + lane], so that the rates of all the lanes can be
+ * evaluated together using the model's batched code (SIMD instructions across the lanes). Models
+ * without the batched code (e.g., those with algebraic loops solved by NR_MINIMISE) are evaluated one
+ * lane at a time with the scalar code.
+ */
+
+#ifndef MODELBATCH_HPP_
+#define MODELBATCH_HPP_
+
+#include <memory>
+
+#include "CompiledModel.hpp"
+
+class ExecutableModel;
+
+/* The width of the batch for models without the batched code */
+#define MODEL_BATCH_SCALAR_WIDTH 8
+
+class ModelBatch
+{
+public:
+	ModelBatch();
+	~ModelBatch();
+
+	/* Initialise the batch for the given compiled model, its width is the compiled model's batch
+	 * width. All the values are zero until each lane is set.
+	 */
+	int initialise(std::shared_ptr<const CompiledModel> compiledModel);
+
+	/* Set the values of the given lane from an instance of the same compiled model.
+	 */
+	int setLane(int lane, const ExecutableModel* em);
+
+	/* Copy the values of the given lane into an instance of the same compiled model, the bound
+	 * variable is set to the lane's voi.
+	 */
+	int getLane(int lane, ExecutableModel* em) const;
+
+	/* Compute the rates of all the lanes, each at its own value of the bound variable (voi).
+	 */
+	int computeRates();
+
+	/* Is the batch evaluated with the model's batched (vectorised) code?
+	 */
+	bool isBatched() const;
+
+	int width;
+	int nRates;
+	int nConstants;
+	int nAlgebraic;
+	/* one value for each lane */
+	double* voi;
+	/* width values for each variable */
+	double* states;
+	double* rates;
+	double* constants;
+	double* algebraic;
+
+private:
+	// not copyable
+	ModelBatch(const ModelBatch&);
+	ModelBatch& operator=(const ModelBatch&);
+
+	std::shared_ptr<const CompiledModel> mCompiledModel;
+	/* single allocation for all the arrays, and one lane's worth for the scalar code */
+	double* mValues;
+	double* mLane;
+};
+
+#endif /* MODELBATCH_HPP_ */
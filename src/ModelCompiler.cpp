@@ -93,6 +93,14 @@ std::unique_ptr<llvm::Module> ModelCompiler::compileModel(const char* filename)
 	Args.push_back("c");
 	if (mDebug) Args.push_back("-g");
 	else Args.push_back("-O3");
+	// the model is only ever run on this machine, so make use of its vector instructions, but without
+	// contracting to fused multiply-adds which would change the results from one machine to another
+	Args.push_back("-march=native");
+	Args.push_back("-ffp-contract=off");
+#ifdef CSIM_MODEL_VECLIB
+	// and the vector math library for exp/log/pow in vectorised loops (e.g., the batched rates)
+	Args.push_back("-fveclib=" CSIM_MODEL_VECLIB);
+#endif
 	if (mVerbose) Args.push_back("-v");
 	Args.push_back(filename);
     std::unique_ptr < Compilation > C(TheDriver.BuildCompilation(Args));
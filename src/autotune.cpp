@@ -0,0 +1,283 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#ifndef WIN32
+#  include <sys/file.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "autotune.hpp"
+#include "integrator.hpp"
+#include "ExecutableModel.hpp"
+
+/* The reference solution is computed with the tolerances reduced by this factor */
+#define AUTOTUNE_REFERENCE_TOL_FACTOR 1.0e-2
+/* A configuration is accepted if its error is no more than this factor times the error of the
+   default configuration, or within AUTOTUNE_RTOL_FACTOR times the relative tolerance */
+#define AUTOTUNE_ERROR_FACTOR 2.0
+#define AUTOTUNE_RTOL_FACTOR 10.0
+/* Each configuration is timed this many times and the fastest time taken, since the noise in the
+   timings (other processes, the caches warming up) only ever makes a run slower */
+#define AUTOTUNE_TIMED_RUNS 3
+
+/* The configurations we try, the first is the default configuration */
+static const struct SolverConfiguration configurations[] = {
+  { BDF, NEWTON, DENSE },
+  { BDF, NEWTON, BAND },
+  { BDF, NEWTON, DIAG },
+  { BDF, NEWTON, SPGMR },
+  { BDF, NEWTON, SPBCG },
+  { BDF, NEWTON, SPTFQMR },
+  { ADAMS, FUNCTIONAL, NONE },
+  { ADAMS, NEWTON, DENSE },
+  { ADAMS_BDF, NEWTON, DENSE }
+};
+
+int autotuneNumConfigurations()
+{
+  return (int)(sizeof(configurations)/sizeof(configurations[0]));
+}
+
+/* Simulate the window with the given simulation from the given states, storing the outputs at
+   each tabulation point */
+static int runWindow(struct Simulation* simulation, ExecutableModel* em, double t, double window,
+  const std::vector<double>& states, std::vector<double>& outputs, struct AutotuneResult* result)
+{
+  memcpy(em->states, &(states[0]), sizeof(double)*em->nRates);
+  outputs.clear();
+  struct Integrator* integrator = CreateIntegrator(simulation, em);
+  if (!integrator) return(ERR);
+  int code = integratorReinitialise(integrator, t);
+  double tEnd = t + window;
+  double tabT = simulationGetBvarTabStep(simulation);
+  double tout = t + tabT;
+  if (tout > tEnd) tout = tEnd;
+  struct Timer* timer = CreateTimer();
+  startTimer(timer);
+  while (code == OK)
+  {
+    double tReached;
+    code = integrate(integrator, tout, &tReached);
+    outputs.insert(outputs.end(), em->outputs, em->outputs + em->nOutputs);
+    if (fabs(tEnd - tReached) < ZERO_TOL) break;
+    tout += tabT;
+    if (tout > tEnd) tout = tEnd;
+  }
+  stopTimer(timer);
+  if (result)
+  {
+    struct IntegratorStatistics stats;
+    integratorGetStatistics(integrator, &stats);
+    result->wallTime = getWallTime(timer);
+    result->nSteps = stats.nSteps;
+    result->nRhsEvals = stats.nRhsEvals;
+  }
+  DestroyTimer(&timer);
+  DestroyIntegrator(&integrator);
+  return(code);
+}
+
+/* The largest difference in any output from the reference, relative to the range of that output
+   in the reference */
+static double outputError(const std::vector<double>& outputs, const std::vector<double>& reference,
+  int nOutputs)
+{
+  if ((nOutputs < 1) || (outputs.size() != reference.size())) return(-1.0);
+  size_t nPoints = reference.size() / nOutputs;
+  double maxError = 0.0;
+  int j;
+  for (j=0;j<nOutputs;j++)
+  {
+    double lo = reference[j], hi = reference[j], error = 0.0;
+    size_t i;
+    for (i=0;i<nPoints;i++)
+    {
+      double r = reference[i*nOutputs+j];
+      lo = fmin(lo, r);
+      hi = fmax(hi, r);
+      error = fmax(error, fabs(outputs[i*nOutputs+j] - r));
+    }
+    if (!isfinite(error)) return(-1.0);
+    if (hi > lo) error /= (hi - lo);
+    else if (fabs(hi) > 0.0) error /= fabs(hi);
+    maxError = fmax(maxError, error);
+  }
+  return(maxError);
+}
+
+int autotuneSolver(struct Simulation* simulation, class ExecutableModel* em, double t,
+  double window, struct SolverConfiguration* best, struct AutotuneResult* results)
+{
+  if (!(simulation && em && best && (window > 0.0)))
+  {
+    ERROR("autotuneSolver","Invalid arguments\n");
+    return(ERR);
+  }
+  int nConfigurations = autotuneNumConfigurations();
+  std::vector<struct AutotuneResult> localResults(nConfigurations);
+  if (!results) results = &(localResults[0]);
+  std::vector<double> states(em->states, em->states + em->nRates);
+  std::vector<double> reference, outputs;
+  double rtol = simulationGetRTol(simulation);
+
+  /* the reference solution, with the default configuration and tighter tolerances */
+  struct Simulation* sim = simulationClone(simulation);
+  simulationSetIntegrationScheme(sim, CVODE);
+  simulationSetMultistepMethod(sim, configurations[0].lmm);
+  simulationSetIterationMethod(sim, configurations[0].iter);
+  simulationSetLinearSolver(sim, configurations[0].solver);
+  int atolLength = simulationGetATolLength(sim);
+  double* atol = simulationGetATol(sim);
+  int i;
+  for (i=0;i<atolLength;i++) atol[i] *= AUTOTUNE_REFERENCE_TOL_FACTOR;
+  simulationSetATol(sim, atolLength, atol);
+  simulationSetRTol(sim, rtol*AUTOTUNE_REFERENCE_TOL_FACTOR);
+  free(atol);
+  int code = runWindow(sim, em, t, window, states, reference, NULL);
+  DestroySimulation(&sim);
+  if (code != OK)
+  {
+    ERROR("autotuneSolver","Unable to compute the reference solution\n");
+    memcpy(em->states, &(states[0]), sizeof(double)*em->nRates);
+    return(ERR);
+  }
+
+  for (i=0;i<nConfigurations;i++)
+  {
+    struct AutotuneResult* result = results + i;
+    memset(result, 0, sizeof(struct AutotuneResult));
+    result->configuration = configurations[i];
+    sim = simulationClone(simulation);
+    simulationSetIntegrationScheme(sim, CVODE);
+    simulationSetMultistepMethod(sim, configurations[i].lmm);
+    simulationSetIterationMethod(sim, configurations[i].iter);
+    simulationSetLinearSolver(sim, configurations[i].solver);
+    if (runWindow(sim, em, t, window, states, outputs, result) == OK)
+      result->error = outputError(outputs, reference, em->nOutputs);
+    else result->error = -1.0;
+    int run;
+    for (run=1;(run<AUTOTUNE_TIMED_RUNS) && (result->error >= 0.0);run++)
+    {
+      struct AutotuneResult timing;
+      if (runWindow(sim, em, t, window, states, outputs, &timing) != OK) break;
+      result->wallTime = fmin(result->wallTime, timing.wallTime);
+    }
+    DestroySimulation(&sim);
+    DEBUG(1,"autotuneSolver","%s/%s/%s: %ld steps, %ld f evals, %g s, error %g\n",
+      multistepMethodToString(configurations[i].lmm),iterationMethodToString(configurations[i].iter),
+      linearSolverToString(configurations[i].solver),result->nSteps,result->nRhsEvals,
+      result->wallTime,result->error);
+  }
+  memcpy(em->states, &(states[0]), sizeof(double)*em->nRates);
+
+  /* the fastest configuration which is accurate enough */
+  double threshold = AUTOTUNE_RTOL_FACTOR*rtol;
+  if (results[0].error >= 0.0) threshold = fmax(threshold, AUTOTUNE_ERROR_FACTOR*results[0].error);
+  int bestIndex = -1;
+  for (i=0;i<nConfigurations;i++)
+  {
+    results[i].accepted = (results[i].error >= 0.0) && (results[i].error <= threshold);
+    if (results[i].accepted && ((bestIndex < 0) || (results[i].wallTime < results[bestIndex].wallTime)))
+      bestIndex = i;
+  }
+  if (bestIndex < 0)
+  {
+    ERROR("autotuneSolver","None of the solver configurations succeeded\n");
+    return(ERR);
+  }
+  *best = configurations[bestIndex];
+  return(OK);
+}
+
+uint64_t fnv1aHash(const void* data, size_t length, uint64_t hash)
+{
+  const unsigned char* bytes = (const unsigned char*)data;
+  size_t i;
+  for (i=0;i<length;i++)
+  {
+    hash ^= (uint64_t)bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return(hash);
+}
+
+int autotuneCacheLookup(const char* cacheFile, uint64_t key, struct SolverConfiguration* configuration)
+{
+  if (!(cacheFile && configuration)) return(ERR);
+  FILE* file = fopen(cacheFile, "r");
+  if (!file) return(ERR);
+#ifndef WIN32
+  /* wait for any writer to finish, closing the file releases the lock */
+  if (flock(fileno(file), LOCK_SH) != 0)
+  {
+    WARNING("autotuneCacheLookup","Unable to lock the cache file: %s\n",cacheFile);
+    fclose(file);
+    return(ERR);
+  }
+#endif
+  char line[256];
+  int found = 0;
+  /* later entries override earlier ones */
+  while (fgets(line, sizeof(line), file))
+  {
+    unsigned long long entryKey;
+    char lmm[64], iter[64], solver[64];
+    if (sscanf(line, "%llx %63s %63s %63s", &entryKey, lmm, iter, solver) != 4) continue;
+    if ((uint64_t)entryKey != key) continue;
+    struct SolverConfiguration entry;
+    entry.lmm = multistepMethodFromString(lmm);
+    entry.iter = iterationMethodFromString(iter);
+    entry.solver = linearSolverFromString(solver);
+    if ((entry.lmm == INVALID_MM) || (entry.iter == INVALID_IM) || (entry.solver == INVALID_LS))
+      continue;
+    *configuration = entry;
+    found = 1;
+  }
+  fclose(file);
+  return(found ? OK : ERR);
+}
+
+int autotuneCacheStore(const char* cacheFile, uint64_t key,
+  const struct SolverConfiguration* configuration)
+{
+  if (!(cacheFile && configuration)) return(ERR);
+  FILE* file = fopen(cacheFile, "a");
+  if (!file)
+  {
+    WARNING("autotuneCacheStore","Unable to open the cache file: %s\n",cacheFile);
+    return(ERR);
+  }
+#ifndef WIN32
+  /* so that concurrent writers' entries aren't interleaved */
+  if (flock(fileno(file), LOCK_EX) != 0)
+  {
+    WARNING("autotuneCacheStore","Unable to lock the cache file: %s\n",cacheFile);
+    fclose(file);
+    return(ERR);
+  }
+#endif
+  int code = OK;
+  /* the entry is flushed before closing the file releases the lock */
+  if ((fprintf(file, "%016llx %s %s %s\n", (unsigned long long)key,
+        multistepMethodToString(configuration->lmm), iterationMethodToString(configuration->iter),
+        linearSolverToString(configuration->solver)) < 0) || (fflush(file) != 0))
+  {
+    WARNING("autotuneCacheStore","Unable to write to the cache file: %s\n",cacheFile);
+    code = ERR;
+  }
+  fclose(file);
+  return(code);
+}
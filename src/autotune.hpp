@@ -0,0 +1,74 @@
+
+#ifndef _AUTOTUNE_HPP_
+#define _AUTOTUNE_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "simulation.h"
+#ifdef __cplusplus
+}
+#endif
+
+/*
+ * Choosing the CVODES solver configuration (multistep method, iteration method and linear solver)
+ * for a model by simulating a short calibration window with each viable configuration and picking
+ * the fastest one which is as accurate as the default configuration (BDF with Newton iteration
+ * and the dense solver). The choice can be cached, keyed on a hash of the model code and the
+ * simulation's tolerances, so that the calibration only needs to be done once for each model. The
+ * cache file is locked while it is read or written (on POSIX systems, where flock is available), so
+ * concurrent processes can share it.
+ */
+
+class ExecutableModel;
+
+struct SolverConfiguration
+{
+  enum MultistepMethod lmm;
+  enum IterationMethod iter;
+  enum LinearSolver solver;
+};
+
+/* The measurements for one configuration, the wall time is the fastest of several timed runs and
+   the error is the largest difference in any output from a tightly converged reference solution
+   relative to the range of that output (or negative if the configuration failed) */
+struct AutotuneResult
+{
+  struct SolverConfiguration configuration;
+  double wallTime;
+  long int nSteps;
+  long int nRhsEvals;
+  double error;
+  int accepted;
+};
+
+/* The number of configurations tried */
+int autotuneNumConfigurations();
+
+/*
+ * Simulate the window from t to t+window with each configuration, starting each from the executable
+ * model's current states (which are restored on return), and set best to the fastest configuration
+ * which meets the accuracy of the default configuration. The measurements are returned in results
+ * (autotuneNumConfigurations() entries) if it is not NULL.
+ */
+int autotuneSolver(struct Simulation* simulation, class ExecutableModel* em, double t,
+  double window, struct SolverConfiguration* best, struct AutotuneResult* results);
+
+/* The 64-bit FNV-1a hash of the given data, continuing from the given hash (use
+   FNV1A_OFFSET_BASIS to start a new hash) */
+#define FNV1A_OFFSET_BASIS 14695981039346656037ULL
+uint64_t fnv1aHash(const void* data, size_t length, uint64_t hash);
+
+/* Look up the configuration cached for the given key in the cache file, returns ERR if there is
+   no cache file or the key isn't in it */
+int autotuneCacheLookup(const char* cacheFile, uint64_t key, struct SolverConfiguration* configuration);
+
+/* Add the configuration for the given key to the cache file */
+int autotuneCacheStore(const char* cacheFile, uint64_t key,
+  const struct SolverConfiguration* configuration);
+
+#endif /* _AUTOTUNE_HPP_ */
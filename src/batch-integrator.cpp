@@ -0,0 +1,417 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "linear-algebra.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "batch-integrator.hpp"
+#include "ExecutableModel.hpp"
+#include "ModelBatch.hpp"
+
+/* ROS2, gamma = 1 + 1/sqrt(2) */
+#define ROS2_GAMMA 1.7071067811865475
+/* Limits on the change in step size */
+#define ROS2_SAFETY 0.9
+#define ROS2_MIN_FACTOR 0.2
+#define ROS2_MAX_FACTOR 5.0
+
+/* Private type */
+struct BatchIntegrator
+{
+  /* for setting up and outputting each job */
+  ExecutableModel* em;
+  ModelBatch* batch;
+  int n;
+  int width;
+  double tStart;
+  double tEnd;
+  double tabStep;
+  double maxStep;
+  long int maxSteps;
+  double rtol;
+  double* atol;
+  /* each lane's job (or -1), output point, steps and time, step size and next output time */
+  int* job;
+  int* point;
+  long int* steps;
+  double* t;
+  double* h;
+  double* tout;
+  /* width values for each state variable (y is the solution at t), and the matrix I - gamma h J
+     for each lane */
+  double* y;
+  double* f0;
+  double* k1;
+  double* k2;
+  double* ynew;
+  double* matrix;
+  double* inc;
+  int* pivots;
+  int* singular;
+  /* single allocations for all the arrays above */
+  double* workspace;
+  int* iworkspace;
+  struct BatchIntegratorStatistics stats;
+};
+
+struct BatchIntegrator* CreateBatchIntegrator(struct Simulation* simulation,
+  class ExecutableModel* em)
+{
+  if (!(simulation && em))
+  {
+    ERROR("CreateBatchIntegrator","Invalid arguments when creating integrator\n");
+    return((struct BatchIntegrator*)NULL);
+  }
+  int n = em->nRates;
+  int atolLength = simulationGetATolLength(simulation);
+  if ((atolLength != 1) && (atolLength != n))
+  {
+    ERROR("CreateBatchIntegrator","Need either one absolute tolerance or one for each of the "
+      "%d state variables, but %d were given\n",n,atolLength);
+    return((struct BatchIntegrator*)NULL);
+  }
+  if (!(simulationGetBvarTabStep(simulation) > 0.0) ||
+      !(simulationGetBvarEnd(simulation) > simulationGetBvarStart(simulation)))
+  {
+    ERROR("CreateBatchIntegrator","Invalid simulation interval\n");
+    return((struct BatchIntegrator*)NULL);
+  }
+  ModelBatch* batch = new ModelBatch();
+  if (batch->initialise(em->compiledModel()) != 0)
+  {
+    delete batch;
+    return((struct BatchIntegrator*)NULL);
+  }
+  struct BatchIntegrator* integrator =
+    (struct BatchIntegrator*)malloc(sizeof(struct BatchIntegrator));
+  int width = batch->width;
+  integrator->em = em->clone();
+  integrator->batch = batch;
+  integrator->n = n;
+  integrator->width = width;
+  integrator->tStart = simulationGetBvarStart(simulation);
+  integrator->tEnd = simulationGetBvarEnd(simulation);
+  integrator->tabStep = simulationGetBvarTabStep(simulation);
+  if (simulationIsBvarMaxStepSet(simulation))
+    integrator->maxStep = simulationGetBvarMaxStep(simulation);
+  else integrator->maxStep = integrator->tabStep;
+  integrator->maxSteps = simulationGetMaxNumSteps(simulation);
+  integrator->rtol = simulationGetRTol(simulation);
+
+  size_t nw = (size_t)n*width;
+  integrator->workspace = (double*)calloc(n + 5*nw + (size_t)n*nw + 4*width, sizeof(double));
+  integrator->atol = integrator->workspace;
+  integrator->y = integrator->atol + n;
+  integrator->f0 = integrator->y + nw;
+  integrator->k1 = integrator->f0 + nw;
+  integrator->k2 = integrator->k1 + nw;
+  integrator->ynew = integrator->k2 + nw;
+  integrator->matrix = integrator->ynew + nw;
+  integrator->inc = integrator->matrix + (size_t)n*nw;
+  integrator->t = integrator->inc + width;
+  integrator->h = integrator->t + width;
+  integrator->tout = integrator->h + width;
+  integrator->iworkspace = (int*)calloc(nw + 3*width, sizeof(int));
+  integrator->pivots = integrator->iworkspace;
+  integrator->singular = integrator->pivots + nw;
+  integrator->job = integrator->singular + width;
+  integrator->point = integrator->job + width;
+  integrator->steps = (long int*)calloc(width, sizeof(long int));
+
+  /* any scaling of the absolute tolerances is by the initial magnitude of the state variables */
+  double* atol = simulationGetATol(simulation);
+  enum ToleranceScaling scaling = simulationGetATolScaling(simulation);
+  int i;
+  for (i=0;i<n;i++)
+  {
+    double tol = atol[(atolLength == 1) ? 0 : i];
+    if ((scaling != NO_SCALING) && (fabs(em->states[i]) > 0.0)) tol *= fabs(em->states[i]);
+    integrator->atol[i] = tol;
+  }
+  free(atol);
+  return(integrator);
+}
+
+int DestroyBatchIntegrator(struct BatchIntegrator** integrator)
+{
+  struct BatchIntegrator* intg = *integrator;
+  if (intg)
+  {
+    if (intg->em) delete intg->em;
+    if (intg->batch) delete intg->batch;
+    if (intg->workspace) free(intg->workspace);
+    if (intg->iworkspace) free(intg->iworkspace);
+    if (intg->steps) free(intg->steps);
+    free(intg);
+  }
+  *integrator = NULL;
+  return(OK);
+}
+
+int batchIntegratorWidth(struct BatchIntegrator* integrator)
+{
+  return(integrator ? integrator->width : 0);
+}
+
+/* the batched rates at (voi,states) into f */
+static void evaluateRates(struct BatchIntegrator* integrator, double* f)
+{
+  integrator->batch->computeRates();
+  memcpy(f,integrator->batch->rates,sizeof(double)*integrator->n*integrator->width);
+  integrator->stats.nBatchRhsEvals++;
+}
+
+/* the next output time for the lane, after its current output point */
+static double nextOutputTime(struct BatchIntegrator* integrator, int lane)
+{
+  double tout = integrator->tStart + integrator->point[lane]*integrator->tabStep;
+  return((tout > integrator->tEnd - ZERO_TOL) ? integrator->tEnd : tout);
+}
+
+/* the lane's values at its current time into the executable model, with the outputs */
+static void outputLane(struct BatchIntegrator* integrator, const struct BatchJobQueue* queue, int lane)
+{
+  ExecutableModel* em = integrator->em;
+  ModelBatch* batch = integrator->batch;
+  int i;
+  for (i=0;i<integrator->n;i++) batch->states[i*integrator->width+lane] = integrator->y[i*integrator->width+lane];
+  batch->voi[lane] = integrator->t[lane];
+  batch->getLane(lane,em);
+  em->computeRates(integrator->t[lane]);
+  em->evaluateVariables(integrator->t[lane]);
+  em->getOutputs(integrator->t[lane]);
+  queue->output(queue->userData,integrator->job[lane],integrator->point[lane],em);
+  integrator->point[lane]++;
+}
+
+/* limit the lane's next step to its maximum step size and the distance to its next output time */
+static void clipStep(struct BatchIntegrator* integrator, int lane)
+{
+  if (integrator->h[lane] > integrator->maxStep) integrator->h[lane] = integrator->maxStep;
+  if (integrator->t[lane] + integrator->h[lane] > integrator->tout[lane])
+    integrator->h[lane] = integrator->tout[lane] - integrator->t[lane];
+}
+
+/* start the next job from the queue in the lane, returns 0 if there are no more jobs */
+static int fillLane(struct BatchIntegrator* integrator, const struct BatchJobQueue* queue, int lane)
+{
+  ExecutableModel* em = integrator->em;
+  int width = integrator->width;
+  int i;
+  integrator->job[lane] = queue->next(queue->userData,em);
+  if (integrator->job[lane] < 0) return(0);
+  integrator->stats.nJobs++;
+  em->bound[0] = integrator->tStart;
+  integrator->batch->setLane(lane,em);
+  for (i=0;i<integrator->n;i++) integrator->y[i*width+lane] = em->states[i];
+  integrator->t[lane] = integrator->tStart;
+  integrator->point[lane] = 0;
+  integrator->steps[lane] = 0;
+  outputLane(integrator,queue,lane);
+  integrator->tout[lane] = nextOutputTime(integrator,lane);
+  /* the first step is refined by the error control, but mustn't step past the first output */
+  integrator->h[lane] = fmin(integrator->maxStep,1.0e-3*(integrator->tEnd - integrator->tStart));
+  clipStep(integrator,lane);
+  return(1);
+}
+
+/* finish the job in the lane */
+static void finishLane(struct BatchIntegrator* integrator, const struct BatchJobQueue* queue, int lane,
+  int status)
+{
+  if (status != OK)
+  {
+    integrator->stats.nFailures++;
+    DEBUG(1,"batchIntegratorRun","Job %d failed at t = " REAL_FORMAT "\n",integrator->job[lane],
+      integrator->t[lane]);
+  }
+  queue->finished(queue->userData,integrator->job[lane],status);
+  integrator->job[lane] = -1;
+  integrator->h[lane] = 0.0;
+}
+
+/* One ROS2 step of size h[lane] for every lane (inactive lanes have h = 0, so just stay where they
+   are), leaving the new solutions in ynew. Returns the weighted norm of each lane's error estimate
+   in errors. */
+static void rosenbrockStep(struct BatchIntegrator* integrator, double* errors)
+{
+  ModelBatch* batch = integrator->batch;
+  int n = integrator->n, width = integrator->width;
+  size_t nw = (size_t)n*width;
+  double* y = integrator->y;
+  double* f0 = integrator->f0;
+  double* k1 = integrator->k1;
+  double* k2 = integrator->k2;
+  double* ynew = integrator->ynew;
+  double* matrix = integrator->matrix;
+  double* h = integrator->h;
+  double srur = sqrt(DBL_EPSILON);
+  int i,j,l;
+
+  /* the rates at (t,y) */
+  memcpy(batch->voi,integrator->t,sizeof(double)*width);
+  memcpy(batch->states,y,sizeof(double)*nw);
+  evaluateRates(integrator,f0);
+  /* the matrix I - gamma h J, with the Jacobian by forward differences one column (for every lane)
+     at a time */
+  for (j=0;j<n;j++)
+  {
+    double* yj = batch->states + j*width;
+    for (l=0;l<width;l++)
+    {
+      integrator->inc[l] = srur*fmax(fabs(yj[l]),integrator->atol[j]/fmax(integrator->rtol,DBL_EPSILON));
+      yj[l] += integrator->inc[l];
+    }
+    batch->computeRates();
+    integrator->stats.nBatchRhsEvals++;
+    for (i=0;i<n;i++)
+    {
+      double* mij = matrix + ((size_t)i*n+j)*width;
+      const double* fi = batch->rates + i*width;
+      const double* f0i = f0 + i*width;
+      for (l=0;l<width;l++)
+        mij[l] = ((i == j) ? 1.0 : 0.0) - ROS2_GAMMA*h[l]*(fi[l] - f0i[l])/integrator->inc[l];
+    }
+    memcpy(yj,y + j*width,sizeof(double)*width);
+  }
+  denseLUFactorBatch(n,width,matrix,integrator->pivots,integrator->singular);
+  /* (I - gamma h J) k1 = f(t,y) */
+  memcpy(k1,f0,sizeof(double)*nw);
+  denseLUSolveBatch(n,width,matrix,integrator->pivots,k1);
+  /* (I - gamma h J) k2 = f(t+h,y+h k1) - 2 k1 */
+  for (l=0;l<width;l++) batch->voi[l] = integrator->t[l] + h[l];
+  for (i=0;i<n;i++)
+    for (l=0;l<width;l++) batch->states[i*width+l] = y[i*width+l] + h[l]*k1[i*width+l];
+  evaluateRates(integrator,k2);
+  for (i=0;i<(int)nw;i++) k2[i] -= 2.0*k1[i];
+  denseLUSolveBatch(n,width,matrix,integrator->pivots,k2);
+  /* y(t+h) = y + 3/2 h k1 + 1/2 h k2, with the error from the first order solution y + h k1. That
+     error doesn't vanish for the stiff components (y + h k1 isn't L-stable), so it is filtered by
+     (I - gamma h J)^-1 as in Hairer & Wanner (f0 is free for it now). */
+  for (i=0;i<(int)nw;i++)
+  {
+    l = i % width;
+    ynew[i] = y[i] + h[l]*(1.5*k1[i] + 0.5*k2[i]);
+    f0[i] = 0.5*h[l]*(k1[i] + k2[i]);
+  }
+  denseLUSolveBatch(n,width,matrix,integrator->pivots,f0);
+  for (l=0;l<width;l++) errors[l] = 0.0;
+  for (i=0;i<n;i++)
+  {
+    for (l=0;l<width;l++)
+    {
+      size_t k = (size_t)i*width + l;
+      double scale = integrator->atol[i] + integrator->rtol*fmax(fabs(y[k]),fabs(ynew[k]));
+      double e = f0[k] / scale;
+      errors[l] += e*e;
+    }
+  }
+  for (l=0;l<width;l++)
+  {
+    errors[l] = (n > 0) ? sqrt(errors[l]/n) : 0.0;
+    if (integrator->singular[l]) errors[l] = NAN;
+  }
+}
+
+int batchIntegratorRun(struct BatchIntegrator* integrator, const struct BatchJobQueue* queue,
+  struct BatchIntegratorStatistics* stats)
+{
+  if (!(integrator && queue && queue->next && queue->output && queue->finished))
+  {
+    ERROR("batchIntegratorRun","Invalid arguments\n");
+    return(ERR);
+  }
+  int n = integrator->n, width = integrator->width;
+  int i,l;
+  long int laneSteps = 0, activeLaneSteps = 0;
+  memset(&(integrator->stats),0,sizeof(struct BatchIntegratorStatistics));
+  for (l=0;l<width;l++)
+  {
+    integrator->job[l] = -1;
+    integrator->h[l] = 0.0;
+  }
+  double* errors = (double*)malloc(sizeof(double)*width);
+  int moreJobs = 1;
+  while (1)
+  {
+    /* keep the batch full */
+    int active = 0;
+    for (l=0;l<width;l++)
+    {
+      if ((integrator->job[l] < 0) && moreJobs) moreJobs = fillLane(integrator,queue,l);
+      /* nothing to integrate */
+      while ((integrator->job[l] >= 0) && (n == 0))
+      {
+        while (integrator->t[l] < integrator->tEnd - ZERO_TOL)
+        {
+          integrator->t[l] = nextOutputTime(integrator,l);
+          outputLane(integrator,queue,l);
+        }
+        finishLane(integrator,queue,l,OK);
+        if (moreJobs) moreJobs = fillLane(integrator,queue,l);
+      }
+      if (integrator->job[l] >= 0) active++;
+    }
+    if (active == 0) break;
+    rosenbrockStep(integrator,errors);
+    laneSteps += width;
+    activeLaneSteps += active;
+    for (l=0;l<width;l++)
+    {
+      if (integrator->job[l] < 0) continue;
+      double err = errors[l];
+      double h = integrator->h[l];
+      /* a NaN error (or singular matrix) rejects the step with the largest reduction in step size */
+      double factor = isnan(err) ? ROS2_MIN_FACTOR : ((err > 0.0) ? ROS2_SAFETY/sqrt(err) : ROS2_MAX_FACTOR);
+      if (err <= 1.0)
+      {
+        /* accept the step */
+        for (i=0;i<n;i++) integrator->y[i*width+l] = integrator->ynew[i*width+l];
+        integrator->t[l] += h;
+        integrator->steps[l]++;
+        integrator->stats.nSteps++;
+        int reachedOutput = (integrator->t[l] >= integrator->tout[l] - ZERO_TOL);
+        if (reachedOutput)
+        {
+          integrator->t[l] = integrator->tout[l];
+          outputLane(integrator,queue,l);
+          if (integrator->t[l] >= integrator->tEnd - ZERO_TOL)
+          {
+            finishLane(integrator,queue,l,OK);
+            continue;
+          }
+          integrator->tout[l] = nextOutputTime(integrator,l);
+        }
+        if (factor > ROS2_MAX_FACTOR) factor = ROS2_MAX_FACTOR;
+        integrator->h[l] = h*factor;
+      }
+      else
+      {
+        /* reject the step, including any with a NaN error or singular matrix */
+        if (!(factor >= ROS2_MIN_FACTOR)) factor = ROS2_MIN_FACTOR;
+        integrator->h[l] = h*factor;
+        integrator->stats.nRejectedSteps++;
+      }
+      clipStep(integrator,l);
+      if ((integrator->h[l] < 1.0e-14*fmax(1.0,fabs(integrator->t[l]))) ||
+          ((integrator->maxSteps > 0) && (integrator->steps[l] >= integrator->maxSteps)))
+        finishLane(integrator,queue,l,ERR);
+    }
+  }
+  free(errors);
+  integrator->stats.laneUtilisation = (laneSteps > 0) ? (double)activeLaneSteps/laneSteps : 0.0;
+  if (stats) memcpy(stats,&(integrator->stats),sizeof(struct BatchIntegratorStatistics));
+  return((integrator->stats.nFailures == 0) ? OK : ERR);
+}
@@ -0,0 +1,67 @@
+
+#ifndef _BATCH_INTEGRATOR_HPP_
+#define _BATCH_INTEGRATOR_HPP_
+
+/*
+ * A lock-step integrator for ensembles of small stiff models: the lanes of a model batch (see
+ * ModelBatch) are advanced together, each lane being an independent simulation with its own step
+ * size. Every step evaluates the rates of all the lanes with the batched code, forms the
+ * finite-difference Jacobians with one batched evaluation per state variable, and factors the small
+ * dense matrices of all the lanes at once. Each lane then accepts or rejects its own step. When a
+ * lane's simulation finishes the lane is refilled with the next job from the queue, so the batch
+ * stays full until the queue runs dry.
+ *
+ * The method is the second order L-stable two stage Rosenbrock method ROS2 (Verwer et al., 1999),
+ * with the embedded first order solution for the error control. It only needs the Jacobian for
+ * stability, not accuracy, which makes the finite-difference Jacobian good enough. Being second order
+ * it suits the moderate tolerances typical of ensemble studies; CVODE remains the better choice for
+ * tight tolerances.
+ */
+
+/* Private structure */
+struct Simulation;
+struct BatchIntegrator;
+class ExecutableModel;
+
+/* The source of the simulations (jobs) for the batch integrator */
+struct BatchJobQueue
+{
+  /* Set up the next job in em, whose values are then the initial values for the job (the
+     simulation is run over the simulation's interval), and return the job's number, or -1 if there
+     are no more jobs. */
+  int (*next)(void* userData, class ExecutableModel* em);
+  /* Called at each output point of the job (point 0 being the start of the simulation), with em
+     holding the job's values and outputs at that point */
+  void (*output)(void* userData, int job, int point, class ExecutableModel* em);
+  /* Called when the job has finished, with status OK or ERR */
+  void (*finished)(void* userData, int job, int status);
+  void* userData;
+};
+
+struct BatchIntegratorStatistics
+{
+  int nJobs;
+  int nFailures;
+  /* totals over all the lanes */
+  long int nSteps;
+  long int nRejectedSteps;
+  /* evaluations of the batched rates (each one evaluates every lane) */
+  long int nBatchRhsEvals;
+  /* the fraction of the lane steps which were working on a job */
+  double laneUtilisation;
+};
+
+/* Create a batch integrator for the simulation's interval and tolerances, with a batch of
+   instances of the executable model's compiled model */
+struct BatchIntegrator* CreateBatchIntegrator(struct Simulation* simulation,
+  class ExecutableModel* em);
+int DestroyBatchIntegrator(struct BatchIntegrator** integrator);
+
+/* The number of lanes (simulations run together) */
+int batchIntegratorWidth(struct BatchIntegrator* integrator);
+
+/* Run all the jobs from the queue, returning OK if they all succeeded. stats may be NULL. */
+int batchIntegratorRun(struct BatchIntegrator* integrator, const struct BatchJobQueue* queue,
+  struct BatchIntegratorStatistics* stats);
+
+#endif /* _BATCH_INTEGRATOR_HPP_ */
@@ -2,9 +2,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <float.h>
 #include <assert.h>
 
 #include <limits>
+#include <atomic>
 
 #ifdef _MSC_VER
 #  include <float.h>
@@ -237,93 +239,151 @@ safe_factorof(double num, double den)
   return ((inum % iden) == 0) ? 1.0 : 0.0;
 }
 
+/*
+ * The solver for the equations flagged by the CCGS for Newton-Raphson. The generated code calls
+ * NR_MINIMISE with a function returning the size of the residual of the equation, g(x) >= 0, for the
+ * variable x, every time the equation is evaluated. Since x is an entry in the model's arrays it
+ * starts out at the previous solution, so we start from there with a safeguarded Newton iteration
+ * and only fall back to random restarts if that fails.
+ *
+ * We don't know the sign of the residual, but since g decreases towards a root and increases past
+ * it, s(x) = sign(g'(x)) g(x) is a signed residual which increases through the root. Each iterate
+ * therefore tightens a bracket on the root, and any Newton step which leaves the bracket (or doesn't
+ * shrink quickly enough) is replaced by bisection. If g is a power of the residual, |r|^p, the
+ * Newton step on g is 1/p of the Newton step on r, so p is estimated from consecutive steps and
+ * the step scaled up to keep the quadratic convergence.
+ */
+#define NR_MAX_ITERATIONS 50
 #define NR_RANDOM_STARTS 100
-#define NR_MAX_STEPS 1000
-#define NR_MAX_STEPS_INITIAL 10
+/* convergence when the Newton step is no more than NR_XTOL_REL |x| + NR_XTOL_ABS */
+#define NR_XTOL_REL 1.0e-10
+#define NR_XTOL_ABS 1.0e-20
+/* the difference increment for the derivative, relative to |x| and absolute */
+#define NR_DIFF_REL 1.0e-8
+#define NR_DIFF_ABS 1.0e-12
+/* and at most this fraction of the predicted distance to the root */
+#define NR_DIFF_STEP 1.0e-3
+#define NR_MAX_POWER 8.0
+
+static std::atomic<long> nrSolves(0);
+static std::atomic<long> nrIterations(0);
+static std::atomic<long> nrFunctionEvals(0);
+static std::atomic<long> nrRestarts(0);
+static std::atomic<long> nrFailures(0);
+
+struct NRProblem
+{
+  double(*func)(double VOI, double *C, double *R, double *S, double *A);
+  double VOI;
+  double *C, *R, *S, *A, *x;
+  long nFunctionEvals;
+  long nIterations;
+  /* the best point seen, in case nothing converges */
+  double bestX;
+  double bestG;
+};
 
 static double
-random_double_logUniform()
+nr_evaluate(struct NRProblem* p, double x)
 {
-  union
+  *(p->x) = x;
+  double g = p->func(p->VOI, p->C, p->R, p->S, p->A);
+  p->nFunctionEvals++;
+  if (isfinite(g) && (g < p->bestG))
   {
-    double asDouble;
-#ifdef WIN32
-    uint16_t asIntegers[4];
-#else
-    uint32_t asIntegers[2];
-#endif
-  } X;
-
-#ifdef WIN32
-  uint16_t spareRand;
-#else
-  uint32_t spareRand;
-#endif
+    p->bestG = g;
+    p->bestX = x;
+  }
+  return g;
+}
 
-  do
+/* Safeguarded Newton from x, returns 1 and the solution in *solution if it converged */
+static int
+nr_solve(struct NRProblem* p, double x, double* solution)
+{
+  double lo = -INFINITY, hi = INFINITY;
+  double previousStep = 0.0, previousG = 0.0, power = 1.0;
+  double previousSlope = 0.0, previousX = x, direction = 1.0;
+  int havePrevious = 0;
+  int i;
+  for (i = 0; i < NR_MAX_ITERATIONS; i++)
   {
-    spareRand = rand();
-#ifdef WIN32
-    X.asIntegers[0] = rand() | ((spareRand & 0x1) << 15);
-    X.asIntegers[1] = rand() | ((spareRand & 0x2) << 14);
-    X.asIntegers[2] = rand() | ((spareRand & 0x4) << 13);
-    X.asIntegers[3] = rand() | ((spareRand & 0x8) << 12);
-#else
-    X.asIntegers[0] = rand() | ((spareRand & 0x1) << 31);
-    X.asIntegers[1] = rand() | ((spareRand & 0x2) << 30);
-#endif
+    p->nIterations++;
+    double g = nr_evaluate(p, x);
+    if (!isfinite(g))
+    {
+      /* step back towards the last good iterate, if there is one */
+      if (!havePrevious) return 0;
+      x = previousX + 0.5*(x - previousX);
+      continue;
+    }
+    if (g == 0.0)
+    {
+      *solution = x;
+      return 1;
+    }
+    /* difference away from the root we're approaching, with an increment well below the
+       predicted distance to the root so we don't step over it */
+    double h = NR_DIFF_REL*fabs(x) + NR_DIFF_ABS;
+    if (previousSlope != 0.0)
+      h = fmax(fmin(h, NR_DIFF_STEP*power*g/fabs(previousSlope)), 16.0*DBL_EPSILON*fabs(x));
+    h *= -direction;
+    double slope = (nr_evaluate(p, x + h) - g)/h;
+    double tol = NR_XTOL_REL*fabs(x) + NR_XTOL_ABS;
+    if (!isfinite(slope) || (slope == 0.0))
+    {
+      if (!havePrevious) return 0;
+      x = previousX + 0.5*(x - previousX);
+      continue;
+    }
+    if (slope > 0.0) hi = x;
+    else lo = x;
+    previousSlope = slope;
+    previousX = x;
+    havePrevious = 1;
+    double step = -g/slope;
+    /* g = c|x - root|^p gives g1/g0 = (step1/step0)^p for consecutive steps on the same side */
+    if ((previousStep != 0.0) && (step*previousStep > 0.0) && (g < previousG) &&
+        (fabs(step) < fabs(previousStep)))
+    {
+      double estimate = log(g/previousG)/log(step/previousStep);
+      if (isfinite(estimate)) power = fmin(fmax(estimate, 1.0), NR_MAX_POWER);
+    }
+    previousStep = step;
+    previousG = g;
+    step *= power;
+    if (fabs(step) <= tol)
+    {
+      *solution = x + step;
+      return 1;
+    }
+    double next = x + step;
+    if (isfinite(lo) && isfinite(hi))
+    {
+      /* near a root the Newton step is no bigger than the bracket, so if the bracket is much
+         smaller than the step it has closed in on a minimum of g which isn't a root */
+      if ((hi - lo <= tol) || (hi - lo <= NR_XTOL_REL*fabs(step))) return 0;
+      if (!((next > lo) && (next < hi))) next = 0.5*(lo + hi);
+    }
+    if (!isfinite(next)) return 0;
+    direction = (next > x) ? 1.0 : -1.0;
+    x = next;
   }
-  while (!isfinite(X.asDouble));
-
-  return X.asDouble;
+  return 0;
 }
 
+/* A random starting point, log-uniformly distributed in magnitude about the given scale */
 static double
-take_numeric_derivative
-(
- double(*func)(double VOI, double *C, double *R, double *S, double *A),
- double VOI,
- double *C,
- double *R,
- double *S,
- double *A,
- double *x
-)
+nr_random_start(uint64_t* state, double scale)
 {
-  double saved_x, value0, value1, value2, delta, slope1, slope2, ratio;
-  saved_x = *x;
-  /*
-   * Since we have only 52 bits of mantissa, we need delta to flip only the
-   * last couple of bits.
-   */
-  delta = saved_x * 1E-10;
-  value0 = func(VOI, C, R, S, A);
-  *x -= delta;
-  value1 = func(VOI, C, R, S, A);
-  *x = saved_x + delta;
-  value2 = func(VOI, C, R, S, A);
-  *x = saved_x;
-  /* We take two numeric derivatives, so we can compare them. This stops us
-   * from getting trapped at around discontinuities(which otherwise produce
-   * very steep trapping slopes).
-   */
-  slope1 = (value0 - value1) / delta;
-  slope2 = (value2 - value0) / delta;
-
-  /* If one slope is zero, return the other... */
-  if (slope1 == 0.0 || !isfinite(slope1))
-    return slope2;
-  if (slope2 == 0.0 || !isfinite(slope2))
-    return slope1;
-
-  ratio = slope1 / slope2;
-  /* If the slopes are similar, return the average... */
-  if (ratio > 0.5 && ratio < 2)
-    return (slope1 + slope2) / 2.0;
-  /* Otherwise, return the least steep of the two... */
-  if (fabs(slope1) < fabs(slope2))
-    return slope1;
-  return slope2;
+  /* xorshift64*, so we don't disturb (or depend on) the global rand() */
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  uint64_t bits = *state * 2685821657736338717ULL;
+  double u = (double)(bits >> 11) / 9007199254740992.0;
+  double magnitude = scale * pow(10.0, 12.0*u - 6.0);
+  return (bits & 1) ? -magnitude : magnitude;
 }
 
 void
@@ -338,67 +398,46 @@ NR_MINIMISE
  double *x
 )
 {
-  double best_X = 0.0, best_fX = std::numeric_limits<double>::infinity();;
-  double current_X, current_fX, current_dfX_dX;
-  uint32_t steps, maxsteps;
-  uint32_t i;
-
-  current_X = *x;
-
-  /* We use a 100 random start Newton-Raphson algorithm... */
-  for (i = 0; i < NR_RANDOM_STARTS; i++)
+  struct NRProblem p;
+  p.func = func;
+  p.VOI = VOI;
+  p.C = C;
+  p.R = R;
+  p.S = S;
+  p.A = A;
+  p.x = x;
+  p.nFunctionEvals = 0;
+  p.nIterations = 0;
+  p.bestX = 0.0;
+  p.bestG = std::numeric_limits<double>::infinity();
+
+  /* warm start from the previous solution */
+  double start = isfinite(*x) ? *x : 0.0;
+  double solution = start;
+  int converged = nr_solve(&p, start, &solution);
+  int restarts = 0;
+  if (!converged)
   {
-    /* Choose a random X as a starting point, except for the first run. */
-    if (i > 0 || !isfinite(current_X))
-      current_X = random_double_logUniform();
-
-    maxsteps = NR_MAX_STEPS_INITIAL;
-    for (steps = 0; steps < maxsteps; steps++)
-    {
-      *x = current_X;
-      current_fX = func(VOI, C, R, S, A);
-      if (!isfinite(current_fX))
-      {
-        break;
-      }
-
-      if (best_fX > current_fX)
-      {
-        /* We can go past NR_MAX_STEPS_INITIAL steps up to NR_MAX_STEPS steps,
-         * but only if we keep improving on our previous answer.
-         */
-        maxsteps += 2;
-        if (maxsteps > NR_MAX_STEPS)
-          maxsteps = NR_MAX_STEPS;
-        best_fX = current_fX;
-        best_X = current_X;
-        /* This is quite far from 0(relatively speaking for a double) to avoid
-         * numerical instability issues when the minimum doesn't exist but the
-         * limit at a point from a particular direction would otherwise be the
-         * minimum.
-         */
-        if (best_fX <= 1E-250)
-	{
-          break;
-	}
-      }
-
-      current_dfX_dX = take_numeric_derivative(func, VOI, C, R, S, A, x);
-      /* If it is completely flat, or infinite, we are done with this round. */
-      if (!isfinite(current_dfX_dX) || current_dfX_dX == 0.0)
-      {
-        break;
-      }
-
-      current_X -= current_fX / current_dfX_dX;
-      if (!isfinite(current_X))
-      {
-        break;
-      }
-    }
-    if (best_fX <= 1E-250)
-      break;
+    uint64_t state = 0x9E3779B97F4A7C15ULL ^ (uint64_t)(uintptr_t)func;
+    double scale = fmax(fabs(start), 1.0);
+    for (restarts = 1; !converged && (restarts < NR_RANDOM_STARTS); restarts++)
+      converged = nr_solve(&p, nr_random_start(&state, scale), &solution);
   }
+  *x = converged ? solution : p.bestX;
+
+  nrSolves.fetch_add(1, std::memory_order_relaxed);
+  nrIterations.fetch_add(p.nIterations, std::memory_order_relaxed);
+  nrFunctionEvals.fetch_add(p.nFunctionEvals, std::memory_order_relaxed);
+  if (restarts > 0) nrRestarts.fetch_add(restarts - 1, std::memory_order_relaxed);
+  if (!converged) nrFailures.fetch_add(1, std::memory_order_relaxed);
+}
 
-  *x = best_X;
+void
+NR_getStatistics(struct NRStatistics* stats)
+{
+  stats->nSolves = nrSolves.load(std::memory_order_relaxed);
+  stats->nIterations = nrIterations.load(std::memory_order_relaxed);
+  stats->nFunctionEvals = nrFunctionEvals.load(std::memory_order_relaxed);
+  stats->nRestarts = nrRestarts.load(std::memory_order_relaxed);
+  stats->nFailures = nrFailures.load(std::memory_order_relaxed);
 }
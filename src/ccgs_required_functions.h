@@ -27,6 +27,19 @@ extern "C"
   double safe_factorof(double num, double den);
   void NR_MINIMISE(double(*func)(double VOI, double *C, double *R, double *S, double *A),
                    double VOI,double *C,double *R,double *S,double *A,double *V);
+
+  /* Counters for the Newton-Raphson solves done by NR_MINIMISE, over all models since the program
+     started: the number of solves, the total iterations and function evaluations, the number of
+     random restarts needed, and the solves which didn't converge (the best point found is used) */
+  struct NRStatistics
+  {
+    long nSolves;
+    long nIterations;
+    long nFunctionEvals;
+    long nRestarts;
+    long nFailures;
+  };
+  void NR_getStatistics(struct NRStatistics* stats);
 #ifdef __cplusplus
 }
 #endif
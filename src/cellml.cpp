@@ -59,6 +59,7 @@
 #include "cellml.h"
 #include "cellml-utils.h"
 #include "cellml.hpp"
+#include "code-transforms.hpp"
 #include "utils.hxx"
 
 #ifdef __cplusplus
@@ -71,6 +72,14 @@ extern "C"
 } /* closing brace for extern "C" */
 #endif
 
+/* Models with fewer statements in their rates than this are always evaluated serially, the cost of
+   handing out the tasks would outweigh any gain */
+#define PARALLEL_RATES_MIN_STATEMENTS 1000
+
+/* The number of instances of the model evaluated together by the batched rates, 8 doubles fill an
+   AVX-512 register (or two AVX2 registers) */
+#define MODEL_BATCH_WIDTH 8
+
 struct CellMLModel
 {
   iface::cellml_api::Model* model;
@@ -811,6 +820,95 @@ writeVariableCases(iface::cellml_services::CodeInformation* cci,
 }
 #endif
 
+/*
+ * The MaLaES transform used to generate C code from the model MathML. The relational operators
+ * are written as CSIM_ROOT_XX(lhs, rhs) markers (with all the arguments of an n-ary relation)
+ * which are rewritten into plain comparisons by rewriteRelationalMarkers() once the code has been
+ * generated, letting us collect the conditions used in piecewise expressions. When debugCode is
+ * set, each division checks its denominator.
+ */
+static std::wstring
+malaesTransform(int debugCode)
+{
+  std::wstring transform =
+L"opengroup: (\r\n"
+L"closegroup: )\r\n"
+L"abs: #prec[H]fabs(#expr1)\r\n"
+L"and: #prec[20]#exprs[&&]\r\n"
+L"arccos: #prec[H]acos(#expr1)\r\n"
+L"arccosh: #prec[H]acosh(#expr1)\r\n"
+L"arccot: #prec[1000(900)]atan(1.0/#expr1)\r\n"
+L"arccoth: #prec[1000(900)]atanh(1.0/#expr1)\r\n"
+L"arccsc: #prec[1000(900)]asin(1/#expr1)\r\n"
+L"arccsch: #prec[1000(900)]asinh(1/#expr1)\r\n"
+L"arcsec: #prec[1000(900)]acos(1/#expr1)\r\n"
+L"arcsech: #prec[1000(900)]acosh(1/#expr1)\r\n"
+L"arcsin: #prec[H]asin(#expr1)\r\n"
+L"arcsinh: #prec[H]asinh(#expr1)\r\n"
+L"arctan: #prec[H]atan(#expr1)\r\n"
+L"arctanh: #prec[H]atanh(#expr1)\r\n"
+L"ceiling: #prec[H]ceil(#expr1)\r\n"
+L"cos: #prec[H]cos(#expr1)\r\n"
+L"cosh: #prec[H]cosh(#expr1)\r\n"
+L"cot: #prec[900(0)]1.0/tan(#expr1)\r\n"
+L"coth: #prec[900(0)]1.0/tanh(#expr1)\r\n"
+L"csc: #prec[900(0)]1.0/sin(#expr1)\r\n"
+L"csch: #prec[900(0)]1.0/sinh(#expr1)\r\n"
+L"diff: #lookupDiffVariable\r\n"
+L"divide: #prec[900]#expr1/";
+  if (debugCode) transform += L"CHECK_DENOMINATOR(#expr2,__LINE__)\r\n";
+  else transform += L"#expr2\r\n";
+  transform +=
+L"eq: #prec[30]#exprs[==]\r\n"
+L"exp: #prec[H]exp(#expr1)\r\n"
+L"factorial: #prec[H]factorial(#expr1)\r\n"
+L"factorof: #prec[30(900)]#expr1 % #expr2 == 0\r\n"
+L"floor: #prec[H]floor(#expr1)\r\n"
+L"gcd: #prec[H]gcd_multi(#count, #exprs[, ])\r\n"
+L"geq: #prec[H]CSIM_ROOT_GEQ(#exprs[, ])\r\n"
+L"gt: #prec[H]CSIM_ROOT_GT(#exprs[, ])\r\n"
+L"implies: #prec[10(950)] !#expr1 || #expr2\r\n"
+L"int: #prec[H]defint(func#unique1, BOUND, CONSTANTS, RATES, VARIABLES, "
+L"#bvarIndex)#supplement double func#unique1(double* BOUND, "
+L"double* CONSTANTS, double* RATES, double* VARIABLES) { return #expr1; }\r\n"
+L"lcm: #prec[H]lcm_multi(#count, #exprs[, ])\r\n"
+L"leq: #prec[H]CSIM_ROOT_LEQ(#exprs[, ])\r\n"
+L"ln: #prec[H]log(#expr1)\r\n"
+L"log: #prec[H]arbitrary_log(#expr1, #logbase)\r\n"
+L"lt: #prec[H]CSIM_ROOT_LT(#exprs[, ])\r\n"
+L"max: #prec[H]multi_max(#count, #exprs[, ])\r\n"
+L"min: #prec[H]multi_min(#count, #exprs[, ])\r\n"
+L"minus: #prec[500]#expr1 - #expr2\r\n"
+L"neq: #prec[30]#expr1 != #expr2\r\n"
+L"not: #prec[950]!#expr1\r\n"
+L"or: #prec[10]#exprs[||]\r\n"
+L"plus: #prec[500]#exprs[+]\r\n"
+L"power: #prec[H]pow(#expr1, #expr2)\r\n"
+L"quotient: #prec[900(0)] (int)(#expr1) / (int)(#expr2)\r\n"
+L"rem: #prec[900(0)] (int)(#expr1) % (int)(#expr2)\r\n"
+L"root: #prec[1000(900)] pow(#expr1, 1.0 / #degree)\r\n"
+L"sec: #prec[900(0)]1.0 / cos(#expr1)\r\n"
+L"sech: #prec[900(0)]1.0 / cosh(#expr1)\r\n"
+L"sin: #prec[H] sin(#expr1)\r\n"
+L"sinh: #prec[H] sinh(#expr1)\r\n"
+L"tan: #prec[H] tan(#expr1)\r\n"
+L"tanh: #prec[H] tanh(#expr1)\r\n"
+L"times: #prec[900] #exprs[*]\r\n"
+L"unary_minus: #prec[950]- #expr1\r\n"
+L"units_conversion: #prec[500(900)]#expr1*#expr2 + #expr3\r\n"
+L"units_conversion_factor: #prec[900]#expr1*#expr2\r\n"
+L"units_conversion_offset: #prec[500]#expr1+#expr2\r\n"
+L"xor: #prec[25(30)] (#expr1 != 0) ^ (#expr2 != 0)\r\n"
+L"piecewise_first_case: #prec[5]#expr1 ? #expr2 : \r\n"
+L"piecewise_extra_case: #prec[5]#expr1 ? #expr2 : \r\n"
+L"piecewise_otherwise: #prec[5]#expr1\r\n"
+L"piecewise_no_otherwise: #prec[5]0.0/0.0\r\n"
+L"pi: #prec[999] 3.14159265358979\r\n"
+L"eulergamma: #prec[999]0.577215664901533\r\n"
+L"infinity: #prec[900]1.0/0.0\r\n";
+  return transform;
+}
+
 static std::wstring
 writeCode(iface::cellml_services::CodeInformation* cci,
   iface::cellml_services::CodeGenerator* cg,void* outputVariables,int debugCode)
@@ -847,6 +945,7 @@ writeCode(iface::cellml_services::CodeInformation* cci,
   code += L"extern double pow(double x, double y);";    
   code += L"extern double factorial(double x);";
   code += L"extern double log(double x);";
+  code += L"extern double sqrt(double x);";
   code += L"extern double arbitrary_log(double x, double base);";
   code += L"extern double gcd_pair(double a, double b);";
   code += L"extern double lcm_pair(double a, double b);";
@@ -864,7 +963,7 @@ writeCode(iface::cellml_services::CodeInformation* cci,
     L"}\n";
   */
 
-  std::wstring frag = cci->functionsString();
+  std::wstring frag = rewriteRelationalMarkers(cci->functionsString(), NULL);
   code += frag;
 
   /* if generating debug code we need some extra methods */
@@ -960,7 +1059,7 @@ writeCode(iface::cellml_services::CodeInformation* cci,
    * constants, i.e., ones that are thought to be constant in the model but need to have their value updated
    * if any of the actual constants have their value updated. Based on code from OpenCOR (https://github.com/opencor/opencor/blob/d161b8c721764157717a5089e36ccde5b1327d2e/src/plugins/support/CellMLSupport/src/cellmlfileruntime.cpp#L966).
    */
-  frag = cci->initConstsString();
+  frag = rewriteRelationalMarkers(cci->initConstsString(), NULL);
   std::wstring constantsString;
   std::wstring computedConstantsString;
   std::vector<std::wstring> constantAssignments;
@@ -988,7 +1087,14 @@ writeCode(iface::cellml_services::CodeInformation* cci,
 
   /* rates      - All rates which are not static.
    */
-  frag = cci->ratesString();
+  /* the conditions used in the rates are the ones we want to locate during the integration */
+  std::vector<std::wstring> roots;
+  frag = rewriteRelationalMarkers(cci->ratesString(), &roots);
+  /* the complete evaluation of the model's variables, for the adjoint code below */
+  std::wstring modelEquations = computedConstantsString + frag;
+  /* and look for the Hodgkin-Huxley gates for use with the Rush-Larsen scheme */
+  std::vector<GatingVariable> gates;
+  findGatingVariables(frag, &gates);
   code += L"void ComputeRates(double VOI,double* STATES,double* RATES,"
     L"double* CONSTANTS,double* ALGEBRAIC)\n{\n";
   // add the computed constants in here for now since I'm lazy.
@@ -996,18 +1102,138 @@ writeCode(iface::cellml_services::CodeInformation* cci,
   code += frag;
   code += L"}\n";
 
+  /* batched rates - ComputeRates for MODEL_BATCH_WIDTH instances of the model at once, with each
+   *                 variable stored structure-of-arrays (X[i*width + lane]) so that the lanes can be
+   *                 evaluated with SIMD instructions. Piecewise expressions become branchless selects.
+   */
+  std::wstring batched;
+  if (generateBatchedCode(computedConstantsString + frag, MODEL_BATCH_WIDTH, &batched))
+  {
+    code += L"static inline double CSIM_SELECT(int c, double a, double b) { return c ? a : b; }\n";
+    code += L"int getBatchWidth() { return ";
+    code += formatNumber(MODEL_BATCH_WIDTH);
+    code += L"; }\n";
+    code += L"void ComputeRatesBatch(double* restrict VOI,double* restrict STATES,double* restrict RATES,"
+      L"double* restrict CONSTANTS,double* restrict ALGEBRAIC)\n{\n";
+    code += batched;
+    code += L"}\n";
+  }
+
+  /* rate tasks - the rates (and computed constants) split into tasks which can be evaluated in
+   *              parallel, stage by stage, for big enough models (see partitionStatements).
+   */
+  ParallelSchedule schedule;
+  if (partitionStatements(computedConstantsString + frag, PARALLEL_RATES_MIN_STATEMENTS, &schedule))
+  {
+    code += L"int getNrateStages() { return ";
+    code += formatNumber((int)schedule.stageTasks.size());
+    code += L"; }\n";
+    code += L"void GetRateStageTasks(int* STAGE_TASKS)\n{\n";
+    for (size_t i = 0; i < schedule.stageTasks.size(); ++i)
+    {
+      code += L"STAGE_TASKS[";
+      code += formatNumber((int)i);
+      code += L"] = ";
+      code += formatNumber(schedule.stageTasks[i]);
+      code += L";\n";
+    }
+    code += L"}\n";
+    code += L"void ComputeRatesTask(int TASK,double VOI,double* STATES,double* RATES,"
+      L"double* CONSTANTS,double* ALGEBRAIC)\n{\nswitch (TASK)\n{\n";
+    for (size_t i = 0; i < schedule.tasks.size(); ++i)
+    {
+      code += L"case ";
+      code += formatNumber((int)i);
+      code += L":\n";
+      code += schedule.tasks[i];
+      code += L"break;\n";
+    }
+    code += L"}\n}\n";
+  }
+
   /* variables  - All variables not computed by initConsts or rates
    *  (i.e., these are not required for the integration of the model and
    *   thus only need to be called for output or presentation or similar
    *   purposes)
    */
-  frag = cci->variablesString();
+  frag = rewriteRelationalMarkers(cci->variablesString(), NULL);
+  modelEquations += frag;
   code += L"void EvaluateVariables(double VOI,double* CONSTANTS,"
     L"double* RATES, double* STATES, double* ALGEBRAIC)\n{\n";
   // also add the computed constants in here for now since I'm lazy.
   code += computedConstantsString;
   code += frag;
   code += L"}\n";
+
+  /* roots      - the switching functions for the conditions found in the rates, a sign change
+   *              indicates a discontinuity in the model which the integrator should stop at.
+   *              Expects ComputeRates to have been called with the same STATES.
+   */
+  code += L"int getNroots() { return ";
+  code += formatNumber((int)roots.size());
+  code += L"; }\n";
+  code += L"void ComputeRoots(double VOI,double* CONSTANTS,double* RATES,"
+    L"double* STATES,double* ALGEBRAIC,double* ROOTS)\n{\n";
+  for (size_t i = 0; i < roots.size(); ++i)
+  {
+    code += L"ROOTS[";
+    code += formatNumber((int)i);
+    code += L"] = ";
+    code += roots[i];
+    code += L";\n";
+  }
+  code += L"}\n";
+
+  /* gates      - the steady state value and time constant of each state variable with a rate of
+   *              the form dy/dt = (inf - y)/tau. Expects ComputeRates to have been called with the
+   *              same STATES.
+   */
+  code += L"int getNgates() { return ";
+  code += formatNumber((int)gates.size());
+  code += L"; }\n";
+  code += L"void GetGateIndices(int* INDICES)\n{\n";
+  for (size_t i = 0; i < gates.size(); ++i)
+  {
+    code += L"INDICES[";
+    code += formatNumber((int)i);
+    code += L"] = ";
+    code += formatNumber(gates[i].stateIndex);
+    code += L";\n";
+  }
+  code += L"}\n";
+  code += L"void ComputeGates(double VOI,double* CONSTANTS,double* RATES,"
+    L"double* STATES,double* ALGEBRAIC,double* INF,double* TAU)\n{\n";
+  for (size_t i = 0; i < gates.size(); ++i)
+  {
+    code += L"INF[";
+    code += formatNumber((int)i);
+    code += L"] = ";
+    code += gates[i].inf;
+    code += L";\nTAU[";
+    code += formatNumber((int)i);
+    code += L"] = ";
+    code += gates[i].tau;
+    code += L";\n";
+  }
+  code += L"}\n";
+
+  /* adjoint    - the reverse mode derivative of the model equations (i.e., both ComputeRates and
+   *              EvaluateVariables), for the adjoint sensitivity analysis. On entry the
+   *              ADJOINT_RATES and ADJOINT_ALGEBRAIC are the weights on the rates and algebraic
+   *              variables, which are consumed to add the corresponding vector-Jacobian products
+   *              onto ADJOINT_STATES and ADJOINT_CONSTANTS. Only written if every equation in the
+   *              model can be differentiated.
+   */
+  std::wstring adjoint;
+  if (generateAdjointCode(modelEquations, &adjoint))
+  {
+    code += L"void ComputeAdjoint(double VOI,double* CONSTANTS,double* RATES,"
+      L"double* STATES,double* ALGEBRAIC,double* ADJOINT_CONSTANTS,double* ADJOINT_RATES,"
+      L"double* ADJOINT_STATES,double* ADJOINT_ALGEBRAIC)\n{\n";
+    code += modelEquations;
+    code += adjoint;
+    code += L"}\n";
+  }
   
   return(code);
 } // writeCode
@@ -1198,169 +1424,15 @@ char* getCellMLModelAsCCode(struct CellMLModel* model, void* outputVariables, in
     // Want to use our annotation set so that we get the custom annotations inside the code generation
     cg->useAnnoSet(model->annotationSet);
 
-    if (debugCode)
-    {
-      /* we need to define a special MaLaES with the debug code */
-      iface::cellml_services::MaLaESBootstrap* mbs = CreateMaLaESBootstrap();
-      iface::cellml_services::MaLaESTransform* mt = mbs->compileTransformer(
-L"opengroup: (\r\n"
-L"closegroup: )\r\n"
-L"abs: #prec[H]fabs(#expr1)\r\n"
-L"and: #prec[20]#exprs[&&]\r\n"
-L"arccos: #prec[H]acos(#expr1)\r\n"
-L"arccosh: #prec[H]acosh(#expr1)\r\n"
-L"arccot: #prec[1000(900)]atan(1.0/#expr1)\r\n"
-L"arccoth: #prec[1000(900)]atanh(1.0/#expr1)\r\n"
-L"arccsc: #prec[1000(900)]asin(1/#expr1)\r\n"
-L"arccsch: #prec[1000(900)]asinh(1/#expr1)\r\n"
-L"arcsec: #prec[1000(900)]acos(1/#expr1)\r\n"
-L"arcsech: #prec[1000(900)]acosh(1/#expr1)\r\n"
-L"arcsin: #prec[H]asin(#expr1)\r\n"
-L"arcsinh: #prec[H]asinh(#expr1)\r\n"
-L"arctan: #prec[H]atan(#expr1)\r\n"
-L"arctanh: #prec[H]atanh(#expr1)\r\n"
-L"ceiling: #prec[H]ceil(#expr1)\r\n"
-L"cos: #prec[H]cos(#expr1)\r\n"
-L"cosh: #prec[H]cosh(#expr1)\r\n"
-L"cot: #prec[900(0)]1.0/tan(#expr1)\r\n"
-L"coth: #prec[900(0)]1.0/tanh(#expr1)\r\n"
-L"csc: #prec[900(0)]1.0/sin(#expr1)\r\n"
-L"csch: #prec[900(0)]1.0/sinh(#expr1)\r\n"
-L"diff: #lookupDiffVariable\r\n"
-L"divide: #prec[900]#expr1/CHECK_DENOMINATOR(#expr2,__LINE__)\r\n"
-L"eq: #prec[30]#exprs[==]\r\n"
-L"exp: #prec[H]exp(#expr1)\r\n"
-L"factorial: #prec[H]factorial(#expr1)\r\n"
-L"factorof: #prec[30(900)]#expr1 % #expr2 == 0\r\n"
-L"floor: #prec[H]floor(#expr1)\r\n"
-L"gcd: #prec[H]gcd_multi(#count, #exprs[, ])\r\n"
-L"geq: #prec[30]#exprs[>=]\r\n"
-L"gt: #prec[30]#exprs[>]\r\n"
-L"implies: #prec[10(950)] !#expr1 || #expr2\r\n"
-L"int: #prec[H]defint(func#unique1, BOUND, CONSTANTS, RATES, VARIABLES, "
-L"#bvarIndex)#supplement double func#unique1(double* BOUND, "
-L"double* CONSTANTS, double* RATES, double* VARIABLES) { return #expr1; }\r\n"
-L"lcm: #prec[H]lcm_multi(#count, #exprs[, ])\r\n"
-L"leq: #prec[30]#exprs[<=]\r\n"
-L"ln: #prec[H]log(#expr1)\r\n"
-L"log: #prec[H]arbitrary_log(#expr1, #logbase)\r\n"
-L"lt: #prec[30]#exprs[<]\r\n"
-L"max: #prec[H]multi_max(#count, #exprs[, ])\r\n"
-L"min: #prec[H]multi_min(#count, #exprs[, ])\r\n"
-L"minus: #prec[500]#expr1 - #expr2\r\n"
-L"neq: #prec[30]#expr1 != #expr2\r\n"
-L"not: #prec[950]!#expr1\r\n"
-L"or: #prec[10]#exprs[||]\r\n"
-L"plus: #prec[500]#exprs[+]\r\n"
-L"power: #prec[H]pow(#expr1, #expr2)\r\n"
-L"quotient: #prec[900(0)] (int)(#expr1) / (int)(#expr2)\r\n"
-L"rem: #prec[900(0)] (int)(#expr1) % (int)(#expr2)\r\n"
-L"root: #prec[1000(900)] pow(#expr1, 1.0 / #degree)\r\n"
-L"sec: #prec[900(0)]1.0 / cos(#expr1)\r\n"
-L"sech: #prec[900(0)]1.0 / cosh(#expr1)\r\n"
-L"sin: #prec[H] sin(#expr1)\r\n"
-L"sinh: #prec[H] sinh(#expr1)\r\n"
-L"tan: #prec[H] tan(#expr1)\r\n"
-L"tanh: #prec[H] tanh(#expr1)\r\n"
-L"times: #prec[900] #exprs[*]\r\n"
-L"unary_minus: #prec[950]- #expr1\r\n"
-L"units_conversion: #prec[500(900)]#expr1*#expr2 + #expr3\r\n"
-L"units_conversion_factor: #prec[900]#expr1*#expr2\r\n"
-L"units_conversion_offset: #prec[500]#expr1+#expr2\r\n"
-L"xor: #prec[25(30)] (#expr1 != 0) ^ (#expr2 != 0)\r\n"
-L"piecewise_first_case: #prec[5]#expr1 ? #expr2 : \r\n"
-L"piecewise_extra_case: #prec[5]#expr1 ? #expr2 : \r\n"
-L"piecewise_otherwise: #prec[5]#expr1\r\n"
-L"piecewise_no_otherwise: #prec[5]0.0/0.0\r\n"
-L"pi: #prec[999] 3.14159265358979\r\n"
-L"eulergamma: #prec[999]0.577215664901533\r\n"
-L"infinity: #prec[900]1.0/0.0\r\n"
-        );
-      cg->transform(mt);
-      mt->release_ref();
-    }
-    else
-    {
-      /* keep this for now... */
-#if defined (USE_LOCAL_MALAES)
-    /* assign our own temporary MaLaES transform for testing */
+    /* We always use our own MaLaES transform so that the relational operators are marked up
+       for use in finding the discontinuities in the model (and to add the debug checks when
+       requested). */
     iface::cellml_services::MaLaESBootstrap* mbs = CreateMaLaESBootstrap();
-    iface::cellml_services::MaLaESTransform* mt = mbs->compileTransformer(
-L"opengroup: (\r\n"
-L"closegroup: )\r\n"
-L"abs: #prec[H]fabs(#expr1)\r\n"
-L"and: #prec[20]#exprs[&&]\r\n"
-L"arccos: #prec[H]acos(#expr1)\r\n"
-L"arccosh: #prec[H]acosh(#expr1)\r\n"
-L"arccot: #prec[1000(900)]atan(1.0/#expr1)\r\n"
-L"arccoth: #prec[1000(900)]atanh(1.0/#expr1)\r\n"
-L"arccsc: #prec[1000(900)]asin(1/#expr1)\r\n"
-L"arccsch: #prec[1000(900)]asinh(1/#expr1)\r\n"
-L"arcsec: #prec[1000(900)]acos(1/#expr1)\r\n"
-L"arcsech: #prec[1000(900)]acosh(1/#expr1)\r\n"
-L"arcsin: #prec[H]asin(#expr1)\r\n"
-L"arcsinh: #prec[H]asinh(#expr1)\r\n"
-L"arctan: #prec[H]atan(#expr1)\r\n"
-L"arctanh: #prec[H]atanh(#expr1)\r\n"
-L"ceiling: #prec[H]ceil(#expr1)\r\n"
-L"cos: #prec[H]cos(#expr1)\r\n"
-L"cosh: #prec[H]cosh(#expr1)\r\n"
-L"cot: #prec[900(0)]1.0/tan(#expr1)\r\n"
-L"coth: #prec[900(0)]1.0/tanh(#expr1)\r\n"
-L"csc: #prec[900(0)]1.0/sin(#expr1)\r\n"
-L"csch: #prec[900(0)]1.0/sinh(#expr1)\r\n"
-L"diff: #lookupDiffVariable\r\n"
-L"divide: #prec[900]#expr1/#expr2\r\n"
-L"eq: #prec[30]#exprs[==]\r\n"
-L"exp: #prec[H]exp(#expr1)\r\n"
-L"factorial: #prec[H]factorial(#expr1)\r\n"
-L"factorof: #prec[30(900)]#expr1 % #expr2 == 0\r\n"
-L"floor: #prec[H]floor(#expr1)\r\n"
-L"gcd: #prec[H]gcd_multi(#count, #exprs[, ])\r\n"
-L"geq: #prec[30]#exprs[>=]\r\n"
-L"gt: #prec[30]#exprs[>]\r\n"
-L"implies: #prec[10(950)]!#expr1 || #expr2\r\n"
-L"int: #prec[H]defint(func#unique1, BOUND, CONSTANTS, RATES, VARIABLES, #bvarIndex)#supplement double func#unique1(double* BOUND, double* CONSTANTS, double* RATES, double* VARIABLES) { return #expr1; }\r\n"
-L"lcm: #prec[H]lcm_multi(#count, #exprs[, ])\r\n"
-L"leq: #prec[30]#exprs[<=]\r\n"
-L"ln: #prec[H]log(#expr1)\r\n"
-L"log: #prec[H]arbitrary_log(#expr1, #logbase)\r\n"
-L"lt: #prec[30]#exprs[<]\r\n"
-L"max: #prec[H]multi_max(#count, #exprs[, ])\r\n"
-L"min: #prec[H]multi_min(#count, #exprs[, ])\r\n"
-L"minus: #prec[500]#expr1 - #expr2\r\n"
-L"neq: #prec[30]#expr1 != #expr2\r\n"
-L"not: #prec[950]!#expr1\r\n"
-L"or: #prec[10]#exprs[||]\r\n"
-L"plus: #prec[500]#exprs[+]\r\n"
-L"power: #prec[H]pow(#expr1, #expr2)\r\n"
-L"quotient: #prec[900(0)](int)(#expr1) / (int)(#expr2)\r\n"
-L"rem: #prec[900(0)](int)(#expr1) % (int)(#expr2)\r\n"
-L"root: #prec[1000(900)]pow(#expr1, 1.0 / #degree)\r\n"
-L"sec: #prec[900(0)]1.0 / cos(#expr1)\r\n"
-L"sech: #prec[900(0)]1.0 / cosh(#expr1)\r\n"
-L"sin: #prec[H]sin(#expr1)\r\n"
-L"sinh: #prec[H]sinh(#expr1)\r\n"
-L"tan: #prec[H]tan(#expr1)\r\n"
-L"tanh: #prec[H]tanh(#expr1)\r\n"
-L"times: #prec[900]#exprs[*]\r\n"
-L"unary_minus: #prec[950]-#expr1\r\n"
-L"units_conversion: #prec[500(900)](___#expr1*#expr2 + #expr3___)\r\n"
-L"units_conversion_offset: #prec[500](___#expr1+#expr2___)\r\n"
-L"units_conversion_factor: #prec[900](___#expr1*#expr2___)\r\n"
-L"xor: #prec[25(30)](#expr1 != 0) ^ (#expr2 != 0)\r\n"
-L"piecewise_first_case: #prec[5]#expr1 ? #expr2 : \r\n"
-L"piecewise_extra_case: #prec[5]#expr1 ? #expr2 : \r\n"
-L"piecewise_otherwise: #prec[5]#expr1\r\n"
-L"piecewise_no_otherwise: #prec[5]0.0/0.0\r\n"
-L"pi: #prec[999] 3.14159265358979\r\n"
-L"eulergamma: #prec[999]0.577215664901533\r\n"
-L"infinity: #prec[900]1.0/0.0\r\n"
-        );
+    iface::cellml_services::MaLaESTransform* mt =
+      mbs->compileTransformer(malaesTransform(debugCode));
+    mbs->release_ref();
     cg->transform(mt);
     mt->release_ref();
-#endif /* defined (USE_LOCAL_MALAES) */
-    }
     
     /* generate the code */
     iface::cellml_services::CodeInformation* cci = NULL;
@@ -0,0 +1,991 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <cwchar>
+#include <cwctype>
+
+#include "code-transforms.hpp"
+
+#define RELATIONAL_MARKER L"CSIM_ROOT_"
+
+/* find the closing parenthesis matching the opening one at position open */
+static size_t findClosingParenthesis(const std::wstring& code, size_t open)
+{
+    int depth = 0;
+    for (size_t i = open; i < code.length(); ++i)
+    {
+        if (code[i] == L'(') ++depth;
+        else if (code[i] == L')')
+        {
+            --depth;
+            if (depth == 0) return i;
+        }
+    }
+    return std::wstring::npos;
+}
+
+static std::wstring trimWhitespace(const std::wstring& s)
+{
+    size_t first = s.find_first_not_of(L" \t\r\n");
+    if (first == std::wstring::npos) return L"";
+    size_t last = s.find_last_not_of(L" \t\r\n");
+    return s.substr(first, last - first + 1);
+}
+
+/* the arguments in the given range, split at the commas which are not nested inside parentheses */
+static std::vector<std::wstring> splitTopLevelArguments(const std::wstring& code, size_t start, size_t end)
+{
+    std::vector<std::wstring> arguments;
+    int depth = 0;
+    size_t argumentStart = start;
+    for (size_t i = start; i < end; ++i)
+    {
+        if (code[i] == L'(') ++depth;
+        else if (code[i] == L')') --depth;
+        else if ((code[i] == L',') && (depth == 0))
+        {
+            arguments.push_back(trimWhitespace(code.substr(argumentStart, i - argumentStart)));
+            argumentStart = i + 1;
+        }
+    }
+    arguments.push_back(trimWhitespace(code.substr(argumentStart, end - argumentStart)));
+    return arguments;
+}
+
+static const wchar_t* relationalOperator(const std::wstring& name)
+{
+    if (name == L"LT") return L"<";
+    if (name == L"GT") return L">";
+    if (name == L"LEQ") return L"<=";
+    if (name == L"GEQ") return L">=";
+    return NULL;
+}
+
+std::wstring rewriteRelationalMarkers(const std::wstring& code, std::vector<std::wstring>* roots)
+{
+    std::wstring result(code);
+    std::vector<std::wstring> found;
+    /*
+     * Work backwards through the code so that the marker being rewritten never contains another
+     * (un-rewritten) marker in its arguments.
+     */
+    size_t pos = result.rfind(RELATIONAL_MARKER);
+    while (pos != std::wstring::npos)
+    {
+        size_t nameStart = pos + wcslen(RELATIONAL_MARKER);
+        size_t open = result.find(L'(', nameStart);
+        const wchar_t* op = NULL;
+        size_t close = std::wstring::npos;
+        if (open != std::wstring::npos)
+        {
+            op = relationalOperator(result.substr(nameStart, open - nameStart));
+            close = findClosingParenthesis(result, open);
+        }
+        std::vector<std::wstring> arguments;
+        if (close != std::wstring::npos) arguments = splitTopLevelArguments(result, open + 1, close);
+        if (op && (arguments.size() > 1))
+        {
+            /* an n-ary relation holds if it holds for each consecutive pair of its arguments */
+            std::wstring comparison;
+            for (size_t i = 1; i < arguments.size(); ++i)
+            {
+                if (i > 1) comparison += L" && ";
+                comparison += L"((" + arguments[i-1] + L") " + op + L" (" + arguments[i] + L"))";
+                if (roots)
+                {
+                    /* the roots are collected backwards and reversed at the end, so a repeated
+                       root is moved to the end to keep them in the order they first appear */
+                    std::wstring root = L"(" + arguments[arguments.size()-i-1] + L") - (" +
+                        arguments[arguments.size()-i] + L")";
+                    std::vector<std::wstring>::iterator repeat = std::find(found.begin(), found.end(), root);
+                    if (repeat != found.end()) found.erase(repeat);
+                    found.push_back(root);
+                }
+            }
+            if (arguments.size() > 2) comparison = L"(" + comparison + L")";
+            result.replace(pos, close - pos + 1, comparison);
+        }
+        if (pos == 0) break;
+        pos = result.rfind(RELATIONAL_MARKER, pos - 1);
+    }
+    if (roots)
+    {
+        // we found them in reverse order
+        for (auto it = found.rbegin(); it != found.rend(); ++it)
+        {
+            if (std::find(roots->begin(), roots->end(), *it) == roots->end())
+                roots->push_back(*it);
+        }
+    }
+    return result;
+}
+
+/* is the character at pos a binary (rather than unary or exponent) minus? */
+static bool isBinaryMinus(const std::wstring& s, size_t pos)
+{
+    size_t prev = s.find_last_not_of(L" \t\r\n", pos == 0 ? std::wstring::npos : pos - 1);
+    if ((pos == 0) || (prev == std::wstring::npos)) return false;
+    wchar_t c = s[prev];
+    if (!(iswalnum(c) || (c == L'_') || (c == L')') || (c == L']') || (c == L'.'))) return false;
+    if (((c == L'e') || (c == L'E')) && (prev == pos - 1))
+    {
+        // could be the exponent of a number, e.g., 1.0e-5
+        size_t start = prev;
+        while ((start > 0) && (iswdigit(s[start - 1]) || (s[start - 1] == L'.'))) --start;
+        if ((start < prev) && ((start == 0) || !(iswalnum(s[start - 1]) || (s[start - 1] == L'_'))))
+            return false;
+    }
+    return true;
+}
+
+/* position of the last operator (any of ops) not nested in brackets, or npos */
+static size_t findLastTopLevel(const std::wstring& s, const wchar_t* ops)
+{
+    int depth = 0;
+    size_t found = std::wstring::npos;
+    for (size_t i = 0; i < s.length(); ++i)
+    {
+        wchar_t c = s[i];
+        if ((c == L'(') || (c == L'[')) ++depth;
+        else if ((c == L')') || (c == L']')) --depth;
+        else if ((depth == 0) && wcschr(ops, c))
+        {
+            if ((c != L'-') || isBinaryMinus(s, i)) found = i;
+        }
+    }
+    return found;
+}
+
+/* remove whitespace and any redundant enclosing parentheses */
+static std::wstring stripParentheses(const std::wstring& s)
+{
+    std::wstring e = trimWhitespace(s);
+    while (!e.empty() && (e[0] == L'(') && (findClosingParenthesis(e, 0) == e.length() - 1))
+        e = trimWhitespace(e.substr(1, e.length() - 2));
+    return e;
+}
+
+static std::wstring stateName(int index)
+{
+    return L"STATES[" + std::to_wstring(index) + L"]";
+}
+
+/* a single operand, with no top-level arithmetic operators */
+static bool isOperand(const std::wstring& s)
+{
+    return !s.empty() && (findLastTopLevel(s, L"+-*/") == std::wstring::npos);
+}
+
+static bool hasTopLevelAdditive(const std::wstring& s)
+{
+    return findLastTopLevel(s, L"+-") != std::wstring::npos;
+}
+
+static bool isOne(const std::wstring& s)
+{
+    std::wstring e = stripParentheses(s);
+    if (e.empty()) return false;
+    wchar_t* end;
+    double value = wcstod(e.c_str(), &end);
+    return (*end == L'\0') && (value == 1.0);
+}
+
+/* (X - STATES[i])/Y */
+static bool matchInfTauForm(const std::wstring& expr, int index, GatingVariable& gate)
+{
+    const std::wstring state = stateName(index);
+    std::wstring e = stripParentheses(expr);
+    if (e.empty() || (e[0] != L'(')) return false;
+    size_t close = findClosingParenthesis(e, 0);
+    if (close == std::wstring::npos) return false;
+    std::wstring rest = trimWhitespace(e.substr(close + 1));
+    if (rest.empty() || (rest[0] != L'/')) return false;
+    std::wstring tau = trimWhitespace(rest.substr(1));
+    std::wstring numerator = stripParentheses(e.substr(1, close - 1));
+    size_t minus = findLastTopLevel(numerator, L"+-");
+    if ((minus == std::wstring::npos) || (numerator[minus] != L'-')) return false;
+    if (stripParentheses(numerator.substr(minus + 1)) != state) return false;
+    std::wstring inf = trimWhitespace(numerator.substr(0, minus));
+    if (inf.empty() || !isOperand(tau)) return false;
+    gate.inf = inf;
+    gate.tau = tau;
+    return true;
+}
+
+/* A*(1.0 - STATES[i]) - B*STATES[i] */
+static bool matchAlphaBetaForm(const std::wstring& expr, int index, GatingVariable& gate)
+{
+    const std::wstring state = stateName(index);
+    std::wstring e = stripParentheses(expr);
+    size_t minus = findLastTopLevel(e, L"+-");
+    if ((minus == std::wstring::npos) || (e[minus] != L'-')) return false;
+    std::wstring opening = e.substr(0, minus), closing = e.substr(minus + 1);
+    // closing rate: B*STATES[i]
+    size_t times = findLastTopLevel(closing, L"*/");
+    if ((times == std::wstring::npos) || (closing[times] != L'*')) return false;
+    if (stripParentheses(closing.substr(times + 1)) != state) return false;
+    std::wstring beta = trimWhitespace(closing.substr(0, times));
+    // opening rate: A*(1.0 - STATES[i])
+    times = findLastTopLevel(opening, L"*/");
+    if ((times == std::wstring::npos) || (opening[times] != L'*')) return false;
+    std::wstring closed = stripParentheses(opening.substr(times + 1));
+    size_t m = findLastTopLevel(closed, L"+-");
+    if ((m == std::wstring::npos) || (closed[m] != L'-')) return false;
+    if (!isOne(closed.substr(0, m)) || (stripParentheses(closed.substr(m + 1)) != state)) return false;
+    std::wstring alpha = trimWhitespace(opening.substr(0, times));
+    if (alpha.empty() || beta.empty() || hasTopLevelAdditive(alpha) || hasTopLevelAdditive(beta))
+        return false;
+    gate.inf = L"(" + alpha + L")/((" + alpha + L") + (" + beta + L"))";
+    gate.tau = L"1.0/((" + alpha + L") + (" + beta + L"))";
+    return true;
+}
+
+/* ARRAY[i] = expr; giving i and expr */
+static bool parseArrayAssignment(const std::wstring& line, const std::wstring& array, long* index,
+    std::wstring* expr)
+{
+    size_t n = array.length();
+    if ((line.compare(0, n + 1, array + L"[") != 0) || (line[line.length() - 1] != L';')) return false;
+    size_t close = line.find(L']');
+    if (close == std::wstring::npos) return false;
+    size_t equals = line.find(L'=', close);
+    if (equals == std::wstring::npos) return false;
+    wchar_t* end;
+    std::wstring indexString = line.substr(n + 1, close - n - 1);
+    *index = wcstol(indexString.c_str(), &end, 10);
+    if ((*end != L'\0') || (trimWhitespace(line.substr(close + 1, equals - close - 1)) != L""))
+        return false;
+    *expr = line.substr(equals + 1, line.length() - equals - 2);
+    return true;
+}
+
+/* whether expr mentions the state, directly or through the algebraic variables it uses */
+static bool dependsOnState(const std::wstring& expr, const std::wstring& state,
+    const std::map<long, std::wstring>& algebraic, std::vector<long>& visited)
+{
+    if (expr.find(state) != std::wstring::npos) return true;
+    const std::wstring name(L"ALGEBRAIC[");
+    for (size_t pos = expr.find(name); pos != std::wstring::npos; pos = expr.find(name, pos + 1))
+    {
+        // not, e.g., ADJOINT_ALGEBRAIC[
+        if ((pos > 0) && (iswalnum(expr[pos - 1]) || (expr[pos - 1] == L'_'))) continue;
+        long index = wcstol(expr.c_str() + pos + name.length(), NULL, 10);
+        if (std::find(visited.begin(), visited.end(), index) != visited.end()) continue;
+        visited.push_back(index);
+        std::map<long, std::wstring>::const_iterator definition = algebraic.find(index);
+        if ((definition != algebraic.end()) && dependsOnState(definition->second, state, algebraic, visited))
+            return true;
+    }
+    return false;
+}
+
+void findGatingVariables(const std::wstring& code, std::vector<GatingVariable>* gates)
+{
+    std::map<long, std::wstring> algebraic;
+    std::vector<std::pair<long, std::wstring> > rates;
+    size_t lineStart = 0;
+    while (lineStart < code.length())
+    {
+        size_t lineEnd = code.find(L'\n', lineStart);
+        if (lineEnd == std::wstring::npos) lineEnd = code.length();
+        std::wstring line = trimWhitespace(code.substr(lineStart, lineEnd - lineStart));
+        lineStart = lineEnd + 1;
+        long index;
+        std::wstring expr;
+        if (parseArrayAssignment(line, L"RATES", &index, &expr))
+            rates.push_back(std::make_pair(index, expr));
+        else if (parseArrayAssignment(line, L"ALGEBRAIC", &index, &expr))
+            algebraic[index] = expr;
+    }
+    for (size_t i = 0; i < rates.size(); ++i)
+    {
+        GatingVariable gate;
+        gate.stateIndex = (int)rates[i].first;
+        if (!(matchInfTauForm(rates[i].second, gate.stateIndex, gate) ||
+              matchAlphaBetaForm(rates[i].second, gate.stateIndex, gate)))
+            continue;
+        // inf and tau must not depend on the gate itself, even through the algebraic variables
+        const std::wstring state = stateName(gate.stateIndex);
+        std::vector<long> visited;
+        if (dependsOnState(gate.inf, state, algebraic, visited)) continue;
+        visited.clear();
+        if (dependsOnState(gate.tau, state, algebraic, visited)) continue;
+        gates->push_back(gate);
+    }
+}
+
+/*
+ * Reverse mode differentiation of the generated code. The statements are parsed into expression
+ * trees, and for each statement (in reverse order) the adjoint of the assigned variable is
+ * propagated to each of the variables the expression depends on.
+ */
+namespace
+{
+
+struct ExpressionNode
+{
+    enum Type { NUMBER, VARIABLE, UNARY, BINARY, CONDITIONAL, CALL } type;
+    std::wstring text;
+    std::vector<ExpressionNode> children;
+};
+
+class ExpressionParser
+{
+public:
+    explicit ExpressionParser(const std::wstring& s) : mS(s), mPos(0), mOk(true) {}
+
+    bool parse(ExpressionNode& node)
+    {
+        node = conditional();
+        skipWhitespace();
+        return mOk && (mPos == mS.length());
+    }
+
+private:
+    void skipWhitespace()
+    {
+        while ((mPos < mS.length()) && iswspace(mS[mPos])) ++mPos;
+    }
+
+    bool accept(const wchar_t* token)
+    {
+        skipWhitespace();
+        size_t n = wcslen(token);
+        if (mS.compare(mPos, n, token) != 0) return false;
+        // don't split a two character operator
+        if ((n == 1) && (mPos + 1 < mS.length()) && (mS[mPos + 1] == L'='))
+        {
+            if (wcschr(L"<>=!", token[0])) return false;
+        }
+        if ((n == 1) && (mPos + 1 < mS.length()) && (mS[mPos + 1] == token[0]))
+        {
+            if (wcschr(L"&|", token[0])) return false;
+        }
+        mPos += n;
+        return true;
+    }
+
+    ExpressionNode fail()
+    {
+        mOk = false;
+        ExpressionNode node;
+        node.type = ExpressionNode::NUMBER;
+        node.text = L"0.0";
+        return node;
+    }
+
+    static ExpressionNode makeNode(ExpressionNode::Type type, const std::wstring& text)
+    {
+        ExpressionNode node;
+        node.type = type;
+        node.text = text;
+        return node;
+    }
+
+    ExpressionNode binary(const std::wstring& op, const ExpressionNode& a, const ExpressionNode& b)
+    {
+        ExpressionNode node = makeNode(ExpressionNode::BINARY, op);
+        node.children.push_back(a);
+        node.children.push_back(b);
+        return node;
+    }
+
+    ExpressionNode conditional()
+    {
+        ExpressionNode condition = logicalOr();
+        if (!mOk || !accept(L"?")) return condition;
+        ExpressionNode node = makeNode(ExpressionNode::CONDITIONAL, L"?");
+        node.children.push_back(condition);
+        node.children.push_back(conditional());
+        if (!accept(L":")) return fail();
+        node.children.push_back(conditional());
+        return node;
+    }
+
+    ExpressionNode logicalOr()
+    {
+        ExpressionNode node = logicalAnd();
+        while (mOk && accept(L"||")) node = binary(L"||", node, logicalAnd());
+        return node;
+    }
+
+    ExpressionNode logicalAnd()
+    {
+        ExpressionNode node = equality();
+        while (mOk && accept(L"&&")) node = binary(L"&&", node, equality());
+        return node;
+    }
+
+    ExpressionNode equality()
+    {
+        ExpressionNode node = relational();
+        while (mOk)
+        {
+            if (accept(L"==")) node = binary(L"==", node, relational());
+            else if (accept(L"!=")) node = binary(L"!=", node, relational());
+            else break;
+        }
+        return node;
+    }
+
+    ExpressionNode relational()
+    {
+        ExpressionNode node = additive();
+        while (mOk)
+        {
+            if (accept(L"<=")) node = binary(L"<=", node, additive());
+            else if (accept(L">=")) node = binary(L">=", node, additive());
+            else if (accept(L"<")) node = binary(L"<", node, additive());
+            else if (accept(L">")) node = binary(L">", node, additive());
+            else break;
+        }
+        return node;
+    }
+
+    ExpressionNode additive()
+    {
+        ExpressionNode node = multiplicative();
+        while (mOk)
+        {
+            if (accept(L"+")) node = binary(L"+", node, multiplicative());
+            else if (accept(L"-")) node = binary(L"-", node, multiplicative());
+            else break;
+        }
+        return node;
+    }
+
+    ExpressionNode multiplicative()
+    {
+        ExpressionNode node = unary();
+        while (mOk)
+        {
+            if (accept(L"*")) node = binary(L"*", node, unary());
+            else if (accept(L"/")) node = binary(L"/", node, unary());
+            else break;
+        }
+        return node;
+    }
+
+    ExpressionNode unary()
+    {
+        const wchar_t* ops[] = { L"-", L"+", L"!" };
+        for (int i = 0; i < 3; ++i)
+        {
+            if (accept(ops[i]))
+            {
+                ExpressionNode node = makeNode(ExpressionNode::UNARY, ops[i]);
+                node.children.push_back(unary());
+                return node;
+            }
+        }
+        return primary();
+    }
+
+    ExpressionNode primary()
+    {
+        skipWhitespace();
+        if (mPos >= mS.length()) return fail();
+        if (accept(L"("))
+        {
+            ExpressionNode node = conditional();
+            if (!accept(L")")) return fail();
+            return node;
+        }
+        wchar_t c = mS[mPos];
+        if (iswdigit(c) || (c == L'.'))
+        {
+            const wchar_t* start = mS.c_str() + mPos;
+            wchar_t* end;
+            wcstod(start, &end);
+            if (end == start) return fail();
+            size_t n = end - start;
+            mPos += n;
+            return makeNode(ExpressionNode::NUMBER, mS.substr(mPos - n, n));
+        }
+        if (!(iswalpha(c) || (c == L'_'))) return fail();
+        size_t start = mPos;
+        while ((mPos < mS.length()) && (iswalnum(mS[mPos]) || (mS[mPos] == L'_'))) ++mPos;
+        std::wstring name = mS.substr(start, mPos - start);
+        if (name == L"VOI") return makeNode(ExpressionNode::VARIABLE, name);
+        if ((name == L"CONSTANTS") || (name == L"STATES") || (name == L"RATES") || (name == L"ALGEBRAIC"))
+        {
+            if (!accept(L"[")) return fail();
+            skipWhitespace();
+            size_t indexStart = mPos;
+            while ((mPos < mS.length()) && iswdigit(mS[mPos])) ++mPos;
+            if ((mPos == indexStart)) return fail();
+            std::wstring index = mS.substr(indexStart, mPos - indexStart);
+            if (!accept(L"]")) return fail();
+            return makeNode(ExpressionNode::VARIABLE, name + L"[" + index + L"]");
+        }
+        if (!accept(L"(")) return fail();
+        ExpressionNode node = makeNode(ExpressionNode::CALL, name);
+        if (!accept(L")"))
+        {
+            do node.children.push_back(conditional());
+            while (mOk && accept(L","));
+            if (!accept(L")")) return fail();
+        }
+        return node;
+    }
+
+    const std::wstring mS;
+    size_t mPos;
+    bool mOk;
+};
+
+std::wstring expressionString(const ExpressionNode& node)
+{
+    switch (node.type)
+    {
+    case ExpressionNode::NUMBER:
+    case ExpressionNode::VARIABLE:
+        return node.text;
+    case ExpressionNode::UNARY:
+        return L"(" + node.text + expressionString(node.children[0]) + L")";
+    case ExpressionNode::BINARY:
+        return L"(" + expressionString(node.children[0]) + L" " + node.text + L" "
+            + expressionString(node.children[1]) + L")";
+    case ExpressionNode::CONDITIONAL:
+        return L"(" + expressionString(node.children[0]) + L" ? " + expressionString(node.children[1])
+            + L" : " + expressionString(node.children[2]) + L")";
+    case ExpressionNode::CALL:
+    {
+        std::wstring s = node.text + L"(";
+        for (size_t i = 0; i < node.children.size(); ++i)
+        {
+            if (i > 0) s += L", ";
+            s += expressionString(node.children[i]);
+        }
+        return s + L")";
+    }
+    }
+    return L"";
+}
+
+/* does the value of the expression depend on any of the model's variables (other than VOI)? */
+bool dependsOnVariables(const ExpressionNode& node)
+{
+    if (node.type == ExpressionNode::VARIABLE) return node.text != L"VOI";
+    for (size_t i = 0; i < node.children.size(); ++i)
+        if (dependsOnVariables(node.children[i])) return true;
+    return false;
+}
+
+/* the derivative of the single argument function name at a, or empty if we don't know it */
+std::wstring functionDerivative(const std::wstring& name, const std::wstring& a)
+{
+    if (name == L"exp") return L"exp(" + a + L")";
+    if (name == L"log") return L"(1.0/" + a + L")";
+    if (name == L"sqrt") return L"(0.5/sqrt(" + a + L"))";
+    if (name == L"sin") return L"cos(" + a + L")";
+    if (name == L"cos") return L"(-sin(" + a + L"))";
+    if (name == L"tan") return L"(1.0/(cos(" + a + L")*cos(" + a + L")))";
+    if (name == L"sinh") return L"cosh(" + a + L")";
+    if (name == L"cosh") return L"sinh(" + a + L")";
+    if (name == L"tanh") return L"(1.0 - tanh(" + a + L")*tanh(" + a + L"))";
+    if (name == L"asin") return L"(1.0/sqrt(1.0 - " + a + L"*" + a + L"))";
+    if (name == L"acos") return L"(-1.0/sqrt(1.0 - " + a + L"*" + a + L"))";
+    if (name == L"atan") return L"(1.0/(1.0 + " + a + L"*" + a + L"))";
+    if (name == L"asinh") return L"(1.0/sqrt(" + a + L"*" + a + L" + 1.0))";
+    if (name == L"acosh") return L"(1.0/sqrt(" + a + L"*" + a + L" - 1.0))";
+    if (name == L"atanh") return L"(1.0/(1.0 - " + a + L"*" + a + L"))";
+    if (name == L"fabs") return L"((" + a + L" < 0.0) ? -1.0 : 1.0)";
+    if ((name == L"floor") || (name == L"ceil")) return L"0.0";
+    return L"";
+}
+
+class AdjointWriter
+{
+public:
+    AdjointWriter() : mTemporaries(0) {}
+
+    std::wstring code;
+
+    /* a name for the given seed expression, so that it is only evaluated once */
+    std::wstring temporary(const std::wstring& seed)
+    {
+        if (iswalpha(seed[0]) && (seed.find_first_of(L"()+-*/ ") == std::wstring::npos)) return seed;
+        std::wstring name = L"adjoint" + std::to_wstring(mTemporaries++);
+        code += L"double " + name + L" = " + seed + L";\n";
+        return name;
+    }
+
+    /* propagate the adjoint seed of the expression to the variables it depends on */
+    bool propagate(const ExpressionNode& node, const std::wstring& seed)
+    {
+        if (!dependsOnVariables(node)) return true;
+        switch (node.type)
+        {
+        case ExpressionNode::NUMBER:
+            return true;
+        case ExpressionNode::VARIABLE:
+            code += L"ADJOINT_" + node.text + L" += " + seed + L";\n";
+            return true;
+        case ExpressionNode::UNARY:
+            if (node.text == L"-") return propagate(node.children[0], L"(-" + seed + L")");
+            if (node.text == L"+") return propagate(node.children[0], seed);
+            return true; // logical not
+        case ExpressionNode::BINARY:
+        {
+            const ExpressionNode& a = node.children[0];
+            const ExpressionNode& b = node.children[1];
+            std::wstring as = expressionString(a), bs = expressionString(b);
+            if ((node.text == L"+") || (node.text == L"-"))
+            {
+                std::wstring s = temporary(seed);
+                if (!propagate(a, s)) return false;
+                return propagate(b, (node.text == L"+") ? s : L"(-" + s + L")");
+            }
+            if (node.text == L"*")
+            {
+                std::wstring s = temporary(seed);
+                if (!propagate(a, s + L"*" + bs)) return false;
+                return propagate(b, s + L"*" + as);
+            }
+            if (node.text == L"/")
+            {
+                std::wstring s = temporary(seed);
+                if (!propagate(a, s + L"/" + bs)) return false;
+                return propagate(b, L"(-" + s + L"*" + as + L"/(" + bs + L"*" + bs + L"))");
+            }
+            return true; // relational and logical operators are piecewise constant
+        }
+        case ExpressionNode::CONDITIONAL:
+        {
+            std::wstring s = temporary(seed);
+            std::wstring condition = expressionString(node.children[0]);
+            if (!propagate(node.children[1], L"(" + condition + L" ? " + s + L" : 0.0)")) return false;
+            return propagate(node.children[2], L"(" + condition + L" ? 0.0 : " + s + L")");
+        }
+        case ExpressionNode::CALL:
+        {
+            const std::vector<ExpressionNode>& args = node.children;
+            if ((node.text == L"pow") && (args.size() == 2))
+            {
+                std::wstring s = temporary(seed);
+                std::wstring as = expressionString(args[0]), bs = expressionString(args[1]);
+                if (!propagate(args[0], s + L"*" + bs + L"*pow(" + as + L", " + bs + L" - 1.0)")) return false;
+                /* nothing to propagate to a fixed exponent, and no log(a) which isn't finite for a <= 0 */
+                if (!dependsOnVariables(args[1])) return true;
+                /* a variable exponent is only differentiable for a > 0 (pow isn't defined otherwise unless
+                   the exponent is an integer, in which case a small change in it isn't) */
+                return propagate(args[1], L"((" + as + L" > 0.0) ? " + s + L"*pow(" + as + L", " + bs + L")*log("
+                                 + as + L") : 0.0)");
+            }
+            if ((node.text == L"arbitrary_log") && (args.size() == 2))
+            {
+                std::wstring s = temporary(seed);
+                std::wstring as = expressionString(args[0]), bs = expressionString(args[1]);
+                if (!propagate(args[0], s + L"/(" + as + L"*log(" + bs + L"))")) return false;
+                return propagate(args[1], L"(-" + s + L"*log(" + as + L")/(" + bs + L"*log(" + bs + L")*log("
+                                 + bs + L")))");
+            }
+            if (args.size() != 1) return false;
+            std::wstring derivative = functionDerivative(node.text, expressionString(args[0]));
+            if (derivative.empty()) return false;
+            if (derivative == L"0.0") return true;
+            return propagate(args[0], seed + L"*" + derivative);
+        }
+        }
+        return false;
+    }
+
+private:
+    int mTemporaries;
+};
+
+} // namespace
+
+namespace
+{
+
+/* split the code into its assignment statements, X[i] = expr; returns false if there is anything else */
+bool parseAssignments(const std::wstring& code, std::vector<std::pair<std::wstring, ExpressionNode> >& statements)
+{
+    size_t start = 0;
+    while (start < code.length())
+    {
+        size_t end = code.find(L';', start);
+        if (end == std::wstring::npos)
+        {
+            if (trimWhitespace(code.substr(start)) != L"") return false;
+            break;
+        }
+        std::wstring statement = trimWhitespace(code.substr(start, end - start));
+        start = end + 1;
+        if (statement.empty()) continue;
+        size_t equals = statement.find(L'=');
+        if ((equals == std::wstring::npos) || (equals + 1 >= statement.length()) || (statement[equals + 1] == L'='))
+            return false;
+        ExpressionNode lhs, rhs;
+        ExpressionParser lhsParser(trimWhitespace(statement.substr(0, equals)));
+        if (!lhsParser.parse(lhs) || (lhs.type != ExpressionNode::VARIABLE) || (lhs.text == L"VOI")) return false;
+        ExpressionParser rhsParser(statement.substr(equals + 1));
+        if (!rhsParser.parse(rhs)) return false;
+        statements.push_back(std::make_pair(lhs.text, rhs));
+    }
+    return true;
+}
+
+} // namespace
+
+bool generateAdjointCode(const std::wstring& code, std::wstring* adjointCode)
+{
+    std::vector<std::pair<std::wstring, ExpressionNode> > statements;
+    if (!parseAssignments(code, statements)) return false;
+    AdjointWriter writer;
+    for (auto it = statements.rbegin(); it != statements.rend(); ++it)
+    {
+        const std::wstring adjoint = L"ADJOINT_" + it->first;
+        writer.code += L"if (" + adjoint + L" != 0.0)\n{\n";
+        writer.code += L"double seed = " + adjoint + L";\n";
+        writer.code += adjoint + L" = 0.0;\n";
+        if (!writer.propagate(it->second, L"seed")) return false;
+        writer.code += L"}\n";
+    }
+    *adjointCode = writer.code;
+    return true;
+}
+
+/*
+ * Batched evaluation of the generated code. Every variable is stored structure-of-arrays, X[i*width + LANE],
+ * and the statements are evaluated in a loop over the lanes which the compiler can vectorise. Anything
+ * which would introduce a branch into the loop body is written without one.
+ */
+namespace
+{
+
+std::wstring batchedString(const ExpressionNode& node, int width)
+{
+    switch (node.type)
+    {
+    case ExpressionNode::NUMBER:
+        return node.text;
+    case ExpressionNode::VARIABLE:
+    {
+        if (node.text == L"VOI") return L"VOI[LANE]";
+        size_t open = node.text.find(L'[');
+        long index = wcstol(node.text.c_str() + open + 1, NULL, 10);
+        return node.text.substr(0, open) + L"[" + std::to_wstring(index * width) + L" + LANE]";
+    }
+    case ExpressionNode::UNARY:
+        return L"(" + node.text + batchedString(node.children[0], width) + L")";
+    case ExpressionNode::BINARY:
+        // evaluate both sides of the logical operators rather than short-circuiting
+        if ((node.text == L"&&") || (node.text == L"||"))
+            return L"((" + batchedString(node.children[0], width) + L" != 0) " + node.text.substr(1) + L" ("
+                + batchedString(node.children[1], width) + L" != 0))";
+        return L"(" + batchedString(node.children[0], width) + L" " + node.text + L" "
+            + batchedString(node.children[1], width) + L")";
+    case ExpressionNode::CONDITIONAL:
+        return L"CSIM_SELECT(" + batchedString(node.children[0], width) + L", "
+            + batchedString(node.children[1], width) + L", " + batchedString(node.children[2], width) + L")";
+    case ExpressionNode::CALL:
+    {
+        std::wstring s = node.text + L"(";
+        for (size_t i = 0; i < node.children.size(); ++i)
+        {
+            if (i > 0) s += L", ";
+            s += batchedString(node.children[i], width);
+        }
+        return s + L")";
+    }
+    }
+    return L"";
+}
+
+} // namespace
+
+bool generateBatchedCode(const std::wstring& code, int width, std::wstring* batchedCode)
+{
+    std::vector<std::pair<std::wstring, ExpressionNode> > statements;
+    if ((width < 1) || !parseAssignments(code, statements)) return false;
+    std::wstring batched = L"int LANE;\n#pragma clang loop vectorize(enable)\nfor (LANE = 0; LANE < "
+        + std::to_wstring(width) + L"; ++LANE)\n{\n";
+    for (size_t i = 0; i < statements.size(); ++i)
+    {
+        ExpressionNode lhs;
+        lhs.type = ExpressionNode::VARIABLE;
+        lhs.text = statements[i].first;
+        batched += batchedString(lhs, width) + L" = " + batchedString(statements[i].second, width) + L";\n";
+    }
+    batched += L"}\n";
+    *batchedCode = batched;
+    return true;
+}
+
+/*
+ * Level scheduling of the generated code. Each statement is given the lowest level that comes after
+ * every statement it depends on: those writing the variables it reads (read after write), those
+ * writing the variable it writes (write after write) and those reading the variable it writes
+ * (write after read). The statements in a level are then independent of each other.
+ */
+
+/* Statements per level with less work than this (in characters of code) aren't split up, and no
+   task is given less than this much work */
+#define TASK_MIN_COST 4000
+#define STAGE_MAX_TASKS 64
+
+namespace
+{
+
+struct ScheduledStatement
+{
+    std::wstring code;
+    size_t level;
+};
+
+const wchar_t* const modelArrays[] = { L"CONSTANTS", L"RATES", L"STATES", L"ALGEBRAIC" };
+
+/* a key for the model variable ARRAY[index] */
+long long variableKey(int array, long index)
+{
+    return ((long long)array << 40) | (long long)index;
+}
+
+/* Parse the model variable reference ARRAY[index] at position pos, returning its key and moving pos
+   past it (or -1 if there isn't one) */
+long long parseVariable(const std::wstring& s, size_t& pos)
+{
+    if ((pos > 0) && (iswalnum(s[pos - 1]) || (s[pos - 1] == L'_'))) return -1;
+    for (int a = 0; a < 4; ++a)
+    {
+        size_t n = wcslen(modelArrays[a]);
+        if ((s.compare(pos, n, modelArrays[a]) != 0) || (pos + n >= s.length()) || (s[pos + n] != L'['))
+            continue;
+        const wchar_t* start = s.c_str() + pos + n + 1;
+        wchar_t* end;
+        long index = wcstol(start, &end, 10);
+        if ((end == start) || (*end != L']')) return -1;
+        pos = (end - s.c_str()) + 1;
+        return variableKey(a, index);
+    }
+    return -1;
+}
+
+} // namespace
+
+bool partitionStatements(const std::wstring& code, size_t minStatements, ParallelSchedule* schedule)
+{
+    if ((code.find(L'{') != std::wstring::npos) || (code.find(L'}') != std::wstring::npos)) return false;
+    std::vector<ScheduledStatement> statements;
+    // the level of the last statement writing each variable, and the highest level reading it
+    std::map<long long, size_t> writers, readers;
+    size_t floor = 0, maxLevel = 0;
+    size_t start = 0;
+    while (start < code.length())
+    {
+        size_t end = code.find(L';', start);
+        if (end == std::wstring::npos)
+        {
+            if (trimWhitespace(code.substr(start)) != L"") return false;
+            break;
+        }
+        ScheduledStatement statement;
+        statement.code = trimWhitespace(code.substr(start, end - start));
+        start = end + 1;
+        if (statement.code.empty()) continue;
+        size_t pos = 0;
+        long long lhs = parseVariable(statement.code, pos);
+        size_t equals = statement.code.find_first_not_of(L" \t\r\n", pos);
+        bool assignment = (lhs >= 0) && (equals != std::wstring::npos) && (statement.code[equals] == L'=') &&
+                          (equals + 1 < statement.code.length()) && (statement.code[equals + 1] != L'=');
+        if (!assignment)
+        {
+            // a barrier, after everything before it and before everything after it
+            statement.level = statements.empty() ? 0 : maxLevel + 1;
+            floor = statement.level + 1;
+            maxLevel = statement.level;
+            statements.push_back(statement);
+            continue;
+        }
+        std::vector<long long> reads;
+        for (pos = equals + 1; pos < statement.code.length(); ++pos)
+        {
+            size_t p = pos;
+            long long key = parseVariable(statement.code, p);
+            if (key >= 0)
+            {
+                reads.push_back(key);
+                pos = p - 1;
+            }
+        }
+        size_t level = floor;
+        std::map<long long, size_t>::const_iterator found;
+        for (size_t i = 0; i < reads.size(); ++i)
+            if ((found = writers.find(reads[i])) != writers.end()) level = std::max(level, found->second + 1);
+        if ((found = writers.find(lhs)) != writers.end()) level = std::max(level, found->second + 1);
+        if ((found = readers.find(lhs)) != readers.end()) level = std::max(level, found->second + 1);
+        statement.level = level;
+        writers[lhs] = level;
+        for (size_t i = 0; i < reads.size(); ++i)
+        {
+            // reading its own value doesn't constrain the statement against itself
+            if (reads[i] == lhs) continue;
+            size_t& reader = readers[reads[i]];
+            reader = std::max(reader, level);
+        }
+        maxLevel = std::max(maxLevel, level);
+        statements.push_back(statement);
+    }
+    if (statements.size() < minStatements) return false;
+
+    // group the statements by level, keeping them in their original order
+    std::vector<std::vector<size_t> > levels(maxLevel + 1);
+    for (size_t i = 0; i < statements.size(); ++i) levels[statements[i].level].push_back(i);
+
+    schedule->stageTasks.clear();
+    schedule->tasks.clear();
+    bool parallel = false;
+    std::vector<size_t> serial;
+    for (size_t l = 0; l <= levels.size(); ++l)
+    {
+        size_t cost = 0;
+        if (l < levels.size())
+            for (size_t i = 0; i < levels[l].size(); ++i) cost += statements[levels[l][i]].code.length();
+        size_t nTasks = std::min(cost / TASK_MIN_COST, std::min((size_t)STAGE_MAX_TASKS, l < levels.size() ?
+                                                                levels[l].size() : 0));
+        if ((l < levels.size()) && (nTasks < 2))
+        {
+            serial.insert(serial.end(), levels[l].begin(), levels[l].end());
+            continue;
+        }
+        // finish off the serial stage before this one, in the original order
+        if (!serial.empty())
+        {
+            std::sort(serial.begin(), serial.end());
+            std::wstring task;
+            for (size_t i = 0; i < serial.size(); ++i) task += statements[serial[i]].code + L";\n";
+            schedule->tasks.push_back(task);
+            schedule->stageTasks.push_back(1);
+            serial.clear();
+        }
+        if (l == levels.size()) break;
+        // the longest statements first, each to the task with the least work so far
+        std::vector<std::pair<size_t, size_t> > byCost;
+        for (size_t i = 0; i < levels[l].size(); ++i)
+            byCost.push_back(std::make_pair(statements[levels[l][i]].code.length(), levels[l][i]));
+        std::sort(byCost.rbegin(), byCost.rend());
+        std::vector<size_t> taskCost(nTasks, 0);
+        std::vector<std::vector<size_t> > taskStatements(nTasks);
+        for (size_t i = 0; i < byCost.size(); ++i)
+        {
+            size_t t = std::min_element(taskCost.begin(), taskCost.end()) - taskCost.begin();
+            taskCost[t] += byCost[i].first;
+            taskStatements[t].push_back(byCost[i].second);
+        }
+        for (size_t t = 0; t < nTasks; ++t)
+        {
+            std::sort(taskStatements[t].begin(), taskStatements[t].end());
+            std::wstring task;
+            for (size_t i = 0; i < taskStatements[t].size(); ++i)
+                task += statements[taskStatements[t][i]].code + L";\n";
+            schedule->tasks.push_back(task);
+        }
+        schedule->stageTasks.push_back((int)nTasks);
+        parallel = true;
+    }
+    return parallel;
+}
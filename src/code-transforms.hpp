@@ -0,0 +1,91 @@
+
+#ifndef _CODE_TRANSFORMS_HPP_
+#define _CODE_TRANSFORMS_HPP_
+
+#include <string>
+#include <vector>
+
+/*
+ * Textual transformations applied to the code fragments generated by the CCGS before they are
+ * written out for compilation.
+ */
+
+/*
+ * Our MaLaES transform writes the relational operators (lt, gt, leq, geq) as markers of the form
+ * CSIM_ROOT_LT(lhs, rhs). This method rewrites those markers into plain C comparisons, with the
+ * n-ary relations, e.g., CSIM_ROOT_LT(a, b, c), holding if they hold for each consecutive pair of their
+ * arguments, ((a) < (b)) && ((b) < (c)). If roots is non-NULL, the expression "(lhs) - (rhs)" for each
+ * comparison is appended to the vector, in the order they first appear (duplicates are ignored), so
+ * that it can be used as a root function locating the switching point of any piecewise expression
+ * containing the comparison.
+ */
+std::wstring rewriteRelationalMarkers(const std::wstring& code, std::vector<std::wstring>* roots);
+
+/*
+ * A state variable whose rate has the Hodgkin-Huxley gating form, dy/dt = (inf - y)/tau, so that it
+ * can be updated exactly over a step with fixed inf and tau (the Rush-Larsen scheme).
+ */
+struct GatingVariable
+{
+    int stateIndex;
+    std::wstring inf;
+    std::wstring tau;
+};
+
+/*
+ * Look through the rate assignments in the given (already rewritten) code for the gating forms
+ *   RATES[i] = (X - STATES[i])/Y;                          inf = X, tau = Y
+ *   RATES[i] = A*(1.0 - STATES[i]) - B*STATES[i];          inf = A/(A+B), tau = 1/(A+B)
+ * where X, Y, A and B do not depend on STATES[i], either directly or through the ALGEBRAIC variables
+ * they use (as assigned in the given code). Each gating variable found is appended to gates.
+ */
+void findGatingVariables(const std::wstring& code, std::vector<GatingVariable>* gates);
+
+/*
+ * Generate the reverse mode derivative of the given (already rewritten) code, which must consist
+ * only of assignments X[i] = expr; to the CONSTANTS, RATES, STATES or ALGEBRAIC arrays. The
+ * generated code expects the variables to have the values computed by the given code, and
+ * propagates the adjoints in the arrays ADJOINT_X (one for each of the arrays above) back through
+ * each assignment, in reverse order. The adjoint of each assigned variable is consumed (set to zero)
+ * and added onto the adjoints of the variables it depends on. Returns false if the code contains
+ * anything we can't differentiate (e.g., calls to NR_MINIMISE or integer arithmetic).
+ */
+bool generateAdjointCode(const std::wstring& code, std::wstring* adjointCode);
+
+/*
+ * Generate a batched version of the given (already rewritten) code, which must consist only of
+ * assignments X[i] = expr; to the CONSTANTS, RATES, STATES or ALGEBRAIC arrays, evaluating the code for
+ * width instances of the model at once. The variables are stored structure-of-arrays, X[i*width + lane],
+ * VOI is an array of one value per lane, and the statements are evaluated in a loop over the lanes for
+ * the compiler to vectorise. Conditional expressions are written as calls to CSIM_SELECT(condition, a, b),
+ * which must be defined to evaluate both a and b (i.e., a branchless select), and the logical operators
+ * evaluate both of their operands. Returns false if the code contains anything else.
+ */
+bool generateBatchedCode(const std::wstring& code, int width, std::wstring* batchedCode);
+
+/*
+ * The schedule for evaluating a block of generated code in parallel. The statements are grouped
+ * into stages which must be run one after the other, and each stage is split into tasks which can
+ * be run concurrently. The code for each task is its statements in their original order.
+ */
+struct ParallelSchedule
+{
+    /* the number of tasks in each stage */
+    std::vector<int> stageTasks;
+    /* the code for each task, stage by stage */
+    std::vector<std::wstring> tasks;
+};
+
+/*
+ * Build the dependency graph of the statements in the given (already rewritten) code, from the
+ * variables each assignment reads and writes, and partition it into levels of independent
+ * statements. Levels with enough work are split into balanced tasks, while consecutive levels
+ * without enough work are merged into a single serial task. Any statement other than an assignment
+ * (e.g., a call to NR_MINIMISE, whose residual function may read any variable) is a barrier between
+ * the statements before and after it. Returns false, leaving the code to be evaluated serially, if
+ * there are fewer than minStatements statements, the code has anything other than simple
+ * statements in it, or none of the levels are worth splitting.
+ */
+bool partitionStatements(const std::wstring& code, size_t minStatements, ParallelSchedule* schedule);
+
+#endif /* _CODE_TRANSFORMS_HPP_ */
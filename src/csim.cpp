@@ -30,6 +30,7 @@ extern "C"
 #include "CellmlCode.hpp"
 #include "ModelCompiler.hpp"
 #include "ExecutableModel.hpp"
+#include "thread-pool.hpp"
 
 /* Just for convenience */
 #define PRE_EXIT_FREE                                         \
@@ -93,6 +94,11 @@ static void usage(char* prog)
 					"  --generate-debug-code\n"
 					"\tGenerate code with debug bits included, useful for finding errors in "
 					"models.\n"
+					"  --no-root-finding\n"
+					"\tIntegrate straight through the discontinuities in the model rather than\n"
+					"\tlocating them and restarting the integrator at each one.\n"
+					"  --threads <n>\n"
+					"\tEvaluate the rates of large models using n threads (default 1).\n"
 					"\n");
 #endif // _MSC_VER
 }
@@ -136,6 +142,8 @@ int main(int argc, char* argv[])
 	static int versionRequest = 0;
 	static int saveTempFiles = 0;
 	static int generateDebugCode = 0;
+	static int noRootFinding = 0;
+	int nThreads = 1;
 #ifdef _MSC_VER
 	// no standard getopt_long for windows, so default some decent options
 	setQuiet();
@@ -163,8 +171,10 @@ int main(int argc, char* argv[])
 		{ "version", no_argument, &versionRequest, 1 },
 		{ "save-temp-files", no_argument, &saveTempFiles, 1 },
 		{ "generate-debug-code", no_argument, &generateDebugCode, 1 },
+		{ "no-root-finding", no_argument, &noRootFinding, 1 },
 		{ "quiet", no_argument, NULL, 13 },
 		{ "debug", no_argument, NULL, 14 },
+		{ "threads", required_argument, NULL, 15 },
 		{ 0, 0, 0, 0 } };
 		int option_index;
 		int c = getopt_long(argc, argv, "", long_options, &option_index);
@@ -194,6 +204,17 @@ int main(int argc, char* argv[])
 			setDebugLevel();
 		}
 			break;
+		case 15:
+		{
+			/* number of threads to evaluate the rates with */
+			nThreads = atoi(optarg);
+			if (nThreads < 1)
+			{
+				ERROR("main", "Invalid number of threads: %s\n", optarg);
+				invalidargs = 1;
+			}
+		}
+			break;
 		case '?':
 		{
 			/* unknown option/missing argument found */
@@ -270,6 +291,7 @@ int main(int argc, char* argv[])
 	int code = OK;
 	if (simulation)
 	{
+		if (noRootFinding) simulationSetRootFinding(simulation, 0);
 		if (simulationIsValidDescription(simulation))
 		{
 			// create the code from the cellml model
@@ -285,6 +307,15 @@ int main(int argc, char* argv[])
 				PRE_EXIT_FREE;
 				return -1;
 			}
+			// any absolute tolerances given for individual state variables
+			if (simulationApplyVariableATol(simulation, em.nRates) != OK)
+			{
+				ERROR("main", "Invalid absolute tolerances\n");
+				PRE_EXIT_FREE;
+				return -1;
+			}
+			ThreadPool threadPool(nThreads);
+			em.setThreadPool(&threadPool);
 			char* simulationName = simulationGetID(simulation);
 			MESSAGE("Running the simulation: %s\n", simulationName);
 			//simulationPrint(simulation, stdout, "###");
@@ -0,0 +1,321 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "utils.h"
+#include "ensemble-statistics.h"
+
+#ifndef M_PI
+#  define M_PI 3.14159265358979323846
+#endif
+
+/* the moments and range kept for each output at each point */
+#define COUNT 0
+#define MEAN 1
+#define M2 2
+#define MIN 3
+#define MAX 4
+#define N_MOMENTS 5
+
+/* a t-digest centroid, a single value until it is merged with others */
+struct Centroid
+{
+  double mean;
+  double weight;
+};
+
+/* Private type */
+struct EnsembleStatistics
+{
+  int nPoints;
+  int nOutputs;
+  double compression;
+  /* for each output at each point (nPoints*nOutputs cells): the moments, the number of centroids
+     and buffered (unmerged) values in its t-digest, and the space for those, the centroids first */
+  double* moments;
+  int* nCentroids;
+  int* nBuffered;
+  struct Centroid* centroids;
+  /* the space for each cell's digest, and how much of it is for the buffered values */
+  int cellSize;
+  int bufferSize;
+};
+
+struct EnsembleStatistics* CreateEnsembleStatistics(int nPoints, int nOutputs, double compression)
+{
+  if ((nPoints < 1) || (nOutputs < 1))
+  {
+    ERROR("CreateEnsembleStatistics","Invalid number of points (%d) or outputs (%d)\n",nPoints,
+      nOutputs);
+    return((struct EnsembleStatistics*)NULL);
+  }
+  if (!(compression > 0.0)) compression = ENSEMBLE_STATISTICS_COMPRESSION;
+  struct EnsembleStatistics* s =
+    (struct EnsembleStatistics*)malloc(sizeof(struct EnsembleStatistics));
+  long int nCells = (long int)nPoints * nOutputs;
+  s->nPoints = nPoints;
+  s->nOutputs = nOutputs;
+  s->compression = compression;
+  /* the merged digest has at most about compression centroids */
+  s->bufferSize = (int)ceil(compression);
+  s->cellSize = 2*s->bufferSize + 2;
+  s->moments = (double*)calloc(nCells*N_MOMENTS,sizeof(double));
+  s->nCentroids = (int*)calloc(2*nCells,sizeof(int));
+  s->nBuffered = s->nCentroids + nCells;
+  s->centroids = (struct Centroid*)malloc(sizeof(struct Centroid)*nCells*s->cellSize);
+  if (!(s->moments && s->nCentroids && s->centroids))
+  {
+    ERROR("CreateEnsembleStatistics","Unable to allocate the statistics for %ld values\n",nCells);
+    DestroyEnsembleStatistics(&s);
+    return((struct EnsembleStatistics*)NULL);
+  }
+  return(s);
+}
+
+int DestroyEnsembleStatistics(struct EnsembleStatistics** statistics)
+{
+  struct EnsembleStatistics* s = *statistics;
+  if (s)
+  {
+    if (s->moments) free(s->moments);
+    if (s->nCentroids) free(s->nCentroids);
+    if (s->centroids) free(s->centroids);
+    free(s);
+  }
+  *statistics = NULL;
+  return(OK);
+}
+
+int ensembleStatisticsNumPoints(const struct EnsembleStatistics* statistics)
+{
+  return(statistics ? statistics->nPoints : 0);
+}
+
+int ensembleStatisticsNumOutputs(const struct EnsembleStatistics* statistics)
+{
+  return(statistics ? statistics->nOutputs : 0);
+}
+
+double ensembleStatisticsCompression(const struct EnsembleStatistics* statistics)
+{
+  return(statistics ? statistics->compression : 0.0);
+}
+
+/* the t-digest scale function k1, centroids may only span one unit of k */
+static double scale(const struct EnsembleStatistics* s, double q)
+{
+  double x = 2.0*q - 1.0;
+  if (x > 1.0) x = 1.0;
+  else if (x < -1.0) x = -1.0;
+  return(s->compression / (2.0*M_PI) * asin(x));
+}
+
+/* order by mean, and then weight so that the order is unique */
+static int compareCentroids(const void* a, const void* b)
+{
+  const struct Centroid* x = (const struct Centroid*)a;
+  const struct Centroid* y = (const struct Centroid*)b;
+  if (x->mean < y->mean) return(-1);
+  if (x->mean > y->mean) return(1);
+  if (x->weight < y->weight) return(-1);
+  if (x->weight > y->weight) return(1);
+  return(0);
+}
+
+/* merge the buffered values into the cell's centroids, in place */
+static void compressCell(const struct EnsembleStatistics* s, long int cell)
+{
+  struct Centroid* c = s->centroids + cell*s->cellSize;
+  int m = s->nCentroids[cell] + s->nBuffered[cell];
+  int i,out = 0;
+  if (s->nBuffered[cell] == 0) return;
+  qsort(c,m,sizeof(struct Centroid),compareCentroids);
+  double total = 0.0;
+  for (i=0;i<m;i++) total += c[i].weight;
+  /* the weight before the current centroid */
+  double before = 0.0;
+  double kLeft = scale(s,0.0);
+  struct Centroid current = c[0];
+  for (i=1;i<m;i++)
+  {
+    double q = (before + current.weight + c[i].weight) / total;
+    if (scale(s,q) - kLeft <= 1.0)
+    {
+      current.weight += c[i].weight;
+      current.mean += (c[i].mean - current.mean) * c[i].weight / current.weight;
+    }
+    else
+    {
+      c[out++] = current;
+      before += current.weight;
+      kLeft = scale(s,before/total);
+      current = c[i];
+    }
+  }
+  c[out++] = current;
+  s->nCentroids[cell] = out;
+  s->nBuffered[cell] = 0;
+}
+
+/* add a (weighted) value to the cell's digest */
+static void addToDigest(struct EnsembleStatistics* s, long int cell, double mean, double weight)
+{
+  if (s->nCentroids[cell] + s->nBuffered[cell] >= s->cellSize) compressCell(s,cell);
+  struct Centroid* c = s->centroids + cell*s->cellSize + s->nCentroids[cell] + s->nBuffered[cell];
+  c->mean = mean;
+  c->weight = weight;
+  s->nBuffered[cell]++;
+}
+
+int ensembleStatisticsAdd(struct EnsembleStatistics* statistics, const double* outputs)
+{
+  long int nCells,cell;
+  if (!(statistics && outputs))
+  {
+    ERROR("ensembleStatisticsAdd","Invalid arguments\n");
+    return(ERR);
+  }
+  nCells = (long int)statistics->nPoints * statistics->nOutputs;
+  for (cell=0;cell<nCells;cell++)
+  {
+    double x = outputs[cell];
+    double* m = statistics->moments + cell*N_MOMENTS;
+    if (isnan(x)) continue;
+    /* Welford's update */
+    m[COUNT] += 1.0;
+    double delta = x - m[MEAN];
+    m[MEAN] += delta / m[COUNT];
+    m[M2] += delta * (x - m[MEAN]);
+    if ((m[COUNT] == 1.0) || (x < m[MIN])) m[MIN] = x;
+    if ((m[COUNT] == 1.0) || (x > m[MAX])) m[MAX] = x;
+    addToDigest(statistics,cell,x,1.0);
+  }
+  return(OK);
+}
+
+int ensembleStatisticsMerge(struct EnsembleStatistics* statistics,
+  const struct EnsembleStatistics* from)
+{
+  long int nCells,cell;
+  int i;
+  if (!(statistics && from && (statistics->nPoints == from->nPoints) &&
+        (statistics->nOutputs == from->nOutputs)))
+  {
+    ERROR("ensembleStatisticsMerge","Can only merge statistics of the same outputs\n");
+    return(ERR);
+  }
+  nCells = (long int)statistics->nPoints * statistics->nOutputs;
+  for (cell=0;cell<nCells;cell++)
+  {
+    double* a = statistics->moments + cell*N_MOMENTS;
+    const double* b = from->moments + cell*N_MOMENTS;
+    if (b[COUNT] == 0.0) continue;
+    if (a[COUNT] == 0.0) memcpy(a,b,sizeof(double)*N_MOMENTS);
+    else
+    {
+      /* Chan et al.'s pairwise update */
+      double n = a[COUNT] + b[COUNT];
+      double delta = b[MEAN] - a[MEAN];
+      a[MEAN] += delta * b[COUNT] / n;
+      a[M2] += b[M2] + delta*delta * a[COUNT] * b[COUNT] / n;
+      a[COUNT] = n;
+      if (b[MIN] < a[MIN]) a[MIN] = b[MIN];
+      if (b[MAX] > a[MAX]) a[MAX] = b[MAX];
+    }
+    const struct Centroid* c = from->centroids + cell*from->cellSize;
+    for (i=0;i<from->nCentroids[cell]+from->nBuffered[cell];i++)
+      addToDigest(statistics,cell,c[i].mean,c[i].weight);
+  }
+  return(OK);
+}
+
+/* copy one of the moments, NaN where there are fewer than minCount values */
+static int getMoment(const struct EnsembleStatistics* statistics, int moment, double minCount,
+  double* values)
+{
+  long int nCells,cell;
+  if (!(statistics && values)) return(ERR);
+  nCells = (long int)statistics->nPoints * statistics->nOutputs;
+  for (cell=0;cell<nCells;cell++)
+  {
+    const double* m = statistics->moments + cell*N_MOMENTS;
+    values[cell] = (m[COUNT] >= minCount) ? m[moment] : NAN;
+  }
+  return(OK);
+}
+
+int ensembleStatisticsCount(const struct EnsembleStatistics* statistics, double* count)
+{
+  return(getMoment(statistics,COUNT,0.0,count));
+}
+
+int ensembleStatisticsMean(const struct EnsembleStatistics* statistics, double* mean)
+{
+  return(getMoment(statistics,MEAN,1.0,mean));
+}
+
+int ensembleStatisticsVariance(const struct EnsembleStatistics* statistics, double* variance)
+{
+  long int nCells,cell;
+  if (getMoment(statistics,M2,2.0,variance) != OK) return(ERR);
+  nCells = (long int)statistics->nPoints * statistics->nOutputs;
+  for (cell=0;cell<nCells;cell++)
+    variance[cell] /= statistics->moments[cell*N_MOMENTS+COUNT] - 1.0;
+  return(OK);
+}
+
+int ensembleStatisticsRange(const struct EnsembleStatistics* statistics, double* min, double* max)
+{
+  if (getMoment(statistics,MIN,1.0,min) != OK) return(ERR);
+  return(getMoment(statistics,MAX,1.0,max));
+}
+
+int ensembleStatisticsQuantile(struct EnsembleStatistics* statistics, double q, double* quantile)
+{
+  long int nCells,cell;
+  int i;
+  if (!(statistics && quantile && (q >= 0.0) && (q <= 1.0)))
+  {
+    ERROR("ensembleStatisticsQuantile","Invalid arguments\n");
+    return(ERR);
+  }
+  nCells = (long int)statistics->nPoints * statistics->nOutputs;
+  for (cell=0;cell<nCells;cell++)
+  {
+    const double* m = statistics->moments + cell*N_MOMENTS;
+    double total = m[COUNT];
+    if (total == 0.0)
+    {
+      quantile[cell] = NAN;
+      continue;
+    }
+    compressCell(statistics,cell);
+    const struct Centroid* c = statistics->centroids + cell*statistics->cellSize;
+    int n = statistics->nCentroids[cell];
+    /* each centroid's mean is taken to be at the middle of its weight, with the range at the ends */
+    double t = q * total;
+    if (n == 1) quantile[cell] = c[0].mean;
+    else if (t <= 0.5*c[0].weight)
+      quantile[cell] = m[MIN] + (c[0].mean - m[MIN]) * t / (0.5*c[0].weight);
+    else if (t >= total - 0.5*c[n-1].weight)
+      quantile[cell] = m[MAX] - (m[MAX] - c[n-1].mean) * (total - t) / (0.5*c[n-1].weight);
+    else
+    {
+      double position = 0.5*c[0].weight;
+      quantile[cell] = c[n-1].mean;
+      for (i=0;i<n-1;i++)
+      {
+        double next = position + 0.5*(c[i].weight + c[i+1].weight);
+        if (t <= next)
+        {
+          quantile[cell] = c[i].mean + (c[i+1].mean - c[i].mean) * (t - position) / (next - position);
+          break;
+        }
+        position = next;
+      }
+    }
+  }
+  return(OK);
+}
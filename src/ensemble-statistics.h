@@ -0,0 +1,47 @@
+
+#ifndef _ENSEMBLE_STATISTICS_H_
+#define _ENSEMBLE_STATISTICS_H_
+
+/*
+ * Streaming statistics of the outputs of an ensemble of simulations, so that only the statistics are
+ * kept rather than every simulation's outputs. Each simulation's outputs (nPoints rows of nOutputs
+ * values) are folded into an accumulator for each output at each point: the count, mean and sum of
+ * squared deviations (Welford's algorithm), the range, and a t-digest (Dunning & Ertl, 2019) for the
+ * quantiles. The memory used is independent of the number of simulations, about
+ * 32*(compression+2) bytes for each output at each point. Accumulators for the same outputs can be
+ * merged, so each thread can have its own; merging them in the same order gives the same result.
+ * NaN values (e.g., from failed simulations) are left out.
+ */
+
+/* Private structure */
+struct EnsembleStatistics;
+
+/* The compression used when none is given, the t-digest keeps at most about this many centroids and
+   the quantiles are accurate to a fraction of a percent (much better towards the tails) */
+#define ENSEMBLE_STATISTICS_COMPRESSION 100
+
+/* Create an empty accumulator, compression <= 0 gives ENSEMBLE_STATISTICS_COMPRESSION */
+struct EnsembleStatistics* CreateEnsembleStatistics(int nPoints, int nOutputs, double compression);
+int DestroyEnsembleStatistics(struct EnsembleStatistics** statistics);
+
+int ensembleStatisticsNumPoints(const struct EnsembleStatistics* statistics);
+int ensembleStatisticsNumOutputs(const struct EnsembleStatistics* statistics);
+double ensembleStatisticsCompression(const struct EnsembleStatistics* statistics);
+
+/* Add one simulation's outputs, nPoints rows of nOutputs values */
+int ensembleStatisticsAdd(struct EnsembleStatistics* statistics, const double* outputs);
+
+/* Merge the statistics from another accumulator with the same number of points and outputs */
+int ensembleStatisticsMerge(struct EnsembleStatistics* statistics,
+  const struct EnsembleStatistics* from);
+
+/* The statistics of each output at each point, nPoints rows of nOutputs values (NaN where there are
+   no values, or only one for the variance). The variance is the sample variance. */
+int ensembleStatisticsCount(const struct EnsembleStatistics* statistics, double* count);
+int ensembleStatisticsMean(const struct EnsembleStatistics* statistics, double* mean);
+int ensembleStatisticsVariance(const struct EnsembleStatistics* statistics, double* variance);
+int ensembleStatisticsRange(const struct EnsembleStatistics* statistics, double* min, double* max);
+/* The estimate of the q quantile (0 <= q <= 1) */
+int ensembleStatisticsQuantile(struct EnsembleStatistics* statistics, double q, double* quantile);
+
+#endif /* _ENSEMBLE_STATISTICS_H_ */
@@ -0,0 +1,373 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "experimental-data.hpp"
+#include "integrator.hpp"
+#include "ExecutableModel.hpp"
+
+/* The longest line read from a CSV file */
+#define DATA_LINE_LENGTH 4096
+
+/* an observation's time and position, for putting them in time order */
+struct ObservationTime
+{
+  double t;
+  int i;
+};
+
+/* Private type */
+struct ExperimentalData
+{
+  int nObservations;
+  int capacity;
+  double* times;
+  double* values;
+  double* weights;
+  int* outputs;
+  char** variableIds;
+  /* the distinct observation times in order, and the observations at each of them (in time
+     order, sampleObservations[sampleStart[k]] to sampleObservations[sampleStart[k+1]-1]), set up
+     when first needed after any observations are added */
+  int nSamples;
+  double* sampleTimes;
+  int* sampleStart;
+  int* sampleObservations;
+};
+
+/* One evaluation of the residuals, passed to the sample callback */
+struct ResidualEvaluation
+{
+  struct ExperimentalData* data;
+  struct Integrator* integrator;
+  double* residuals;
+  double sumOfSquares;
+  double maxSumOfSquares;
+  /* the Jacobian of the residuals and the output sensitivities at the current sample, if wanted */
+  double* jacobian;
+  double* sensitivities;
+  int nParameters;
+  int nOutputs;
+};
+
+struct ExperimentalData* CreateExperimentalData()
+{
+  struct ExperimentalData* data =
+    (struct ExperimentalData*)calloc(1,sizeof(struct ExperimentalData));
+  return(data);
+}
+
+static void clearSamples(struct ExperimentalData* data)
+{
+  if (data->sampleTimes) free(data->sampleTimes);
+  if (data->sampleStart) free(data->sampleStart);
+  if (data->sampleObservations) free(data->sampleObservations);
+  data->sampleTimes = NULL;
+  data->sampleStart = NULL;
+  data->sampleObservations = NULL;
+  data->nSamples = 0;
+}
+
+int DestroyExperimentalData(struct ExperimentalData** data)
+{
+  struct ExperimentalData* d = *data;
+  int i;
+  if (d)
+  {
+    clearSamples(d);
+    for (i=0;i<d->nObservations;i++) free(d->variableIds[i]);
+    if (d->times) free(d->times);
+    if (d->values) free(d->values);
+    if (d->weights) free(d->weights);
+    if (d->outputs) free(d->outputs);
+    if (d->variableIds) free(d->variableIds);
+    free(d);
+  }
+  *data = NULL;
+  return(OK);
+}
+
+int experimentalDataAdd(struct ExperimentalData* data, double t, const char* variableId,
+  double value, double weight)
+{
+  if (!(data && variableId && !isnan(t) && (weight >= 0.0)))
+  {
+    ERROR("experimentalDataAdd","Invalid observation\n");
+    return(ERR);
+  }
+  if (data->nObservations == data->capacity)
+  {
+    data->capacity = data->capacity ? 2*data->capacity : 64;
+    data->times = (double*)realloc(data->times,sizeof(double)*data->capacity);
+    data->values = (double*)realloc(data->values,sizeof(double)*data->capacity);
+    data->weights = (double*)realloc(data->weights,sizeof(double)*data->capacity);
+    data->outputs = (int*)realloc(data->outputs,sizeof(int)*data->capacity);
+    data->variableIds = (char**)realloc(data->variableIds,sizeof(char*)*data->capacity);
+  }
+  int i = data->nObservations++;
+  data->times[i] = t;
+  data->values[i] = value;
+  data->weights[i] = weight;
+  data->outputs[i] = -1;
+  data->variableIds[i] = strcopy(variableId);
+  clearSamples(data);
+  return(OK);
+}
+
+/* the next comma separated field of the line from *position (which is moved past it), with
+   surrounding white space and quotes removed, in place */
+static char* nextField(char** position)
+{
+  char* field = *position;
+  if (!field) return(NULL);
+  char* comma = strchr(field,',');
+  if (comma)
+  {
+    *comma = '\0';
+    *position = comma + 1;
+  }
+  else *position = NULL;
+  while (isspace((unsigned char)*field)) field++;
+  char* end = field + strlen(field);
+  while ((end > field) && isspace((unsigned char)end[-1])) end--;
+  *end = '\0';
+  if ((end - field >= 2) && (field[0] == '"') && (end[-1] == '"'))
+  {
+    end[-1] = '\0';
+    field++;
+  }
+  return(field);
+}
+
+/* the field as a number, returns 0 if it isn't one */
+static int parseNumber(const char* field, double* value)
+{
+  char* end;
+  if (!field || !*field) return(0);
+  *value = strtod(field,&end);
+  return(*end == '\0');
+}
+
+struct ExperimentalData* experimentalDataReadCSV(const char* filename)
+{
+  FILE* file = filename ? fopen(filename,"r") : NULL;
+  if (!file)
+  {
+    ERROR("experimentalDataReadCSV","Unable to open the data file: %s\n",filename ? filename : "");
+    return((struct ExperimentalData*)NULL);
+  }
+  struct ExperimentalData* data = CreateExperimentalData();
+  char line[DATA_LINE_LENGTH];
+  int lineNumber = 0;
+  int code = OK;
+  while ((code == OK) && fgets(line,DATA_LINE_LENGTH,file))
+  {
+    lineNumber++;
+    char* position = line;
+    char* timeField = nextField(&position);
+    /* skip blank lines */
+    if (!position && (!timeField || !*timeField)) continue;
+    char* idField = nextField(&position);
+    char* valueField = nextField(&position);
+    char* weightField = nextField(&position);
+    double t, value, weight = 1.0;
+    if (!parseNumber(timeField,&t))
+    {
+      /* the header */
+      if ((lineNumber == 1) && (data->nObservations == 0)) continue;
+      code = ERR;
+    }
+    else if (!(idField && *idField && parseNumber(valueField,&value))) code = ERR;
+    else if (weightField && *weightField && !parseNumber(weightField,&weight)) code = ERR;
+    else code = experimentalDataAdd(data,t,idField,value,weight);
+    if (code != OK)
+      ERROR("experimentalDataReadCSV","Invalid observation on line %d of %s\n",lineNumber,filename);
+  }
+  fclose(file);
+  if (code != OK) DestroyExperimentalData(&data);
+  return(data);
+}
+
+int experimentalDataNumObservations(const struct ExperimentalData* data)
+{
+  return(data ? data->nObservations : 0);
+}
+
+const char* experimentalDataVariableId(const struct ExperimentalData* data, int i)
+{
+  if (!data || (i < 0) || (i >= data->nObservations)) return(NULL);
+  return(data->variableIds[i]);
+}
+
+int experimentalDataSetOutput(struct ExperimentalData* data, int i, int output)
+{
+  if (!data || (i < 0) || (i >= data->nObservations) || (output < 0))
+  {
+    ERROR("experimentalDataSetOutput","Invalid arguments\n");
+    return(ERR);
+  }
+  data->outputs[i] = output;
+  return(OK);
+}
+
+static int compareObservationTimes(const void* a, const void* b)
+{
+  const struct ObservationTime* x = (const struct ObservationTime*)a;
+  const struct ObservationTime* y = (const struct ObservationTime*)b;
+  if (x->t < y->t) return(-1);
+  if (x->t > y->t) return(1);
+  return(x->i - y->i);
+}
+
+/* group the observations by time */
+static void setupSamples(struct ExperimentalData* data)
+{
+  int n = data->nObservations;
+  int i,k = 0;
+  struct ObservationTime* order =
+    (struct ObservationTime*)malloc(sizeof(struct ObservationTime)*n);
+  for (i=0;i<n;i++)
+  {
+    order[i].t = data->times[i];
+    order[i].i = i;
+  }
+  qsort(order,n,sizeof(struct ObservationTime),compareObservationTimes);
+  data->sampleTimes = (double*)malloc(sizeof(double)*n);
+  data->sampleStart = (int*)malloc(sizeof(int)*(n+1));
+  data->sampleObservations = (int*)malloc(sizeof(int)*n);
+  for (i=0;i<n;i++)
+  {
+    if ((i == 0) || (order[i].t != order[i-1].t))
+    {
+      data->sampleTimes[k] = order[i].t;
+      data->sampleStart[k] = i;
+      k++;
+    }
+    data->sampleObservations[i] = order[i].i;
+  }
+  data->sampleStart[k] = n;
+  data->nSamples = k;
+  free(order);
+}
+
+/* IntegratorSampleFunction: the residuals of the observations at this time (and their derivatives),
+   stopping once the sum of squares is too big */
+static int sampleResiduals(int k, double t, ExecutableModel* em, void* userData)
+{
+  struct ResidualEvaluation* evaluation = static_cast<struct ResidualEvaluation*>(userData);
+  const struct ExperimentalData* data = evaluation->data;
+  int j,p;
+  if (evaluation->jacobian &&
+      (integratorGetOutputSensitivities(evaluation->integrator,evaluation->sensitivities) != OK))
+    return(ERR);
+  for (j=data->sampleStart[k];j<data->sampleStart[k+1];j++)
+  {
+    int i = data->sampleObservations[j];
+    double w = sqrt(data->weights[i]);
+    double r = w * (em->outputs[data->outputs[i]] - data->values[i]);
+    evaluation->residuals[i] = r;
+    evaluation->sumOfSquares += r*r;
+    if (evaluation->jacobian)
+    {
+      for (p=0;p<evaluation->nParameters;p++)
+        evaluation->jacobian[i*evaluation->nParameters+p] =
+          w * evaluation->sensitivities[p*evaluation->nOutputs+data->outputs[i]];
+    }
+  }
+  /* NaN outputs can't be rejected on, they will fail the integration soon enough */
+  return((evaluation->sumOfSquares > evaluation->maxSumOfSquares) ? ERR : OK);
+}
+
+static int evaluateResiduals(struct ExperimentalData* data, struct Integrator* integrator,
+  class ExecutableModel* em, double t, double maxSumOfSquares, double* residuals,
+  double* sumOfSquares, double* jacobian)
+{
+  int i;
+  if (!(data && integrator && em && (data->nObservations > 0)))
+  {
+    ERROR("experimentalDataResiduals","Invalid arguments\n");
+    return(ERR);
+  }
+  for (i=0;i<data->nObservations;i++)
+  {
+    if ((data->outputs[i] < 0) || (data->outputs[i] >= em->nOutputs))
+    {
+      ERROR("experimentalDataResiduals","The variable of observation %d (%s) isn't one of the "
+        "model outputs\n",i,data->variableIds[i]);
+      return(ERR);
+    }
+  }
+  struct ResidualEvaluation evaluation;
+  evaluation.data = data;
+  evaluation.integrator = integrator;
+  evaluation.sumOfSquares = 0.0;
+  evaluation.maxSumOfSquares = maxSumOfSquares;
+  evaluation.jacobian = jacobian;
+  evaluation.sensitivities = NULL;
+  evaluation.nParameters = integratorGetNumSensitivityParameters(integrator);
+  evaluation.nOutputs = em->nOutputs;
+  if (jacobian && (evaluation.nParameters < 1))
+  {
+    ERROR("experimentalDataJacobian","The forward sensitivities aren't enabled\n");
+    return(ERR);
+  }
+  if (!data->sampleTimes) setupSamples(data);
+  if (data->sampleTimes[0] < t)
+  {
+    ERROR("experimentalDataResiduals","The observations start before the simulation\n");
+    return(ERR);
+  }
+  evaluation.residuals = residuals ? residuals : (double*)malloc(sizeof(double)*data->nObservations);
+  for (i=0;i<data->nObservations;i++) evaluation.residuals[i] = NAN;
+  if (jacobian)
+  {
+    evaluation.sensitivities = (double*)malloc(sizeof(double)*evaluation.nParameters*em->nOutputs);
+    for (i=0;i<data->nObservations*evaluation.nParameters;i++) jacobian[i] = NAN;
+  }
+  int code = integratorSample(integrator,t,data->nSamples,data->sampleTimes,sampleResiduals,
+    &evaluation);
+  if (sumOfSquares)
+  {
+    int rejected = (code != OK) && (evaluation.sumOfSquares > maxSumOfSquares);
+    *sumOfSquares = ((code == OK) || rejected) ? evaluation.sumOfSquares : NAN;
+  }
+  if (!residuals) free(evaluation.residuals);
+  if (evaluation.sensitivities) free(evaluation.sensitivities);
+  return(code);
+}
+
+int experimentalDataResiduals(struct ExperimentalData* data, struct Integrator* integrator,
+  class ExecutableModel* em, double t, double* residuals, double* sumOfSquares)
+{
+  return(evaluateResiduals(data,integrator,em,t,INFINITY,residuals,sumOfSquares,NULL));
+}
+
+int experimentalDataResidualsBounded(struct ExperimentalData* data, struct Integrator* integrator,
+  class ExecutableModel* em, double t, double maxSumOfSquares, double* residuals,
+  double* sumOfSquares)
+{
+  return(evaluateResiduals(data,integrator,em,t,maxSumOfSquares,residuals,sumOfSquares,NULL));
+}
+
+int experimentalDataJacobian(struct ExperimentalData* data, struct Integrator* integrator,
+  class ExecutableModel* em, double t, double* residuals, double* sumOfSquares, double* jacobian)
+{
+  if (!jacobian)
+  {
+    ERROR("experimentalDataJacobian","Invalid arguments\n");
+    return(ERR);
+  }
+  return(evaluateResiduals(data,integrator,em,t,INFINITY,residuals,sumOfSquares,jacobian));
+}
@@ -0,0 +1,70 @@
+
+#ifndef _EXPERIMENTAL_DATA_HPP_
+#define _EXPERIMENTAL_DATA_HPP_
+
+/*
+ * Experimental data to fit the model to: a set of observations, each being the measured value of one
+ * of the model's outputs (given by its variable ID, and then resolved to the output) at some time,
+ * with a weight. The residuals are evaluated on the fly during a single integration through the
+ * observation times (see integratorSample), so the simulated trajectories are never stored.
+ */
+
+/* Private structure */
+struct ExperimentalData;
+struct Integrator;
+class ExecutableModel;
+
+struct ExperimentalData* CreateExperimentalData();
+int DestroyExperimentalData(struct ExperimentalData** data);
+
+/* Add an observation, the weight must not be negative */
+int experimentalDataAdd(struct ExperimentalData* data, double t, const char* variableId,
+  double value, double weight);
+
+/*
+ * Read the observations from a CSV file with one observation on each line, as
+ *   time,variable ID,value[,weight]
+ * with the weight being 1 if it is not given. A first line whose time isn't a number is taken to be
+ * a header and skipped. Returns NULL if the file can't be read.
+ */
+struct ExperimentalData* experimentalDataReadCSV(const char* filename);
+
+int experimentalDataNumObservations(const struct ExperimentalData* data);
+const char* experimentalDataVariableId(const struct ExperimentalData* data, int i);
+/* Set the model output that observation i is of */
+int experimentalDataSetOutput(struct ExperimentalData* data, int i, int output);
+
+/*
+ * Integrate from the executable model's current states at t (no later than the first observation)
+ * through the observations with the integrator (for the same model), and evaluate the weighted
+ * residuals, sqrt(weight)*(output - value), one for each observation in the order they were added,
+ * and their sum of squares. Either of residuals and sumOfSquares may be NULL. If the integration
+ * fails the residuals from there on are NaN and ERR is returned. On return the model is at the time
+ * of the last observation.
+ */
+int experimentalDataResiduals(struct ExperimentalData* data, struct Integrator* integrator,
+  class ExecutableModel* em, double t, double* residuals, double* sumOfSquares);
+
+/*
+ * As experimentalDataResiduals, but giving up as soon as the sum of squares of the residuals so far
+ * exceeds maxSumOfSquares, for rejecting runs which are diverging from the data without integrating
+ * them to the end. A rejected run returns ERR with the remaining residuals NaN and *sumOfSquares the
+ * sum so far (for a failed integration it is NaN).
+ */
+int experimentalDataResidualsBounded(struct ExperimentalData* data, struct Integrator* integrator,
+  class ExecutableModel* em, double t, double maxSumOfSquares, double* residuals,
+  double* sumOfSquares);
+
+/*
+ * As experimentalDataResiduals, also evaluating the Jacobian of the residuals with respect to the
+ * integrator's forward sensitivity parameters (see integratorEnableSensitivities), one row of
+ * nParameters values for each observation.
+ */
+int experimentalDataJacobian(struct ExperimentalData* data, struct Integrator* integrator,
+  class ExecutableModel* em, double t, double* residuals, double* sumOfSquares, double* jacobian);
+
+/* Any number of evaluations (each with its own integrator and model) may use the same data at once,
+   as long as it isn't changed and it has been evaluated at least once since the last observation was
+   added. */
+
+#endif /* _EXPERIMENTAL_DATA_HPP_ */
@@ -0,0 +1,424 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "explicit-integrators.hpp"
+#include "ExecutableModel.hpp"
+
+/* Number of stages (with first same as last) for Dormand-Prince */
+#define DP_STAGES 7
+/* Limits on the change in step size for the adaptive scheme */
+#define DP_SAFETY 0.9
+#define DP_MIN_FACTOR 0.2
+#define DP_MAX_FACTOR 5.0
+
+/* Private type */
+struct ExplicitIntegrator
+{
+  enum IntegrationScheme scheme;
+  ExecutableModel* em;
+  int n;
+  double t;
+  /* the fixed step size, or the next step size to try for the adaptive scheme */
+  double h;
+  double maxStep;
+  /* the maximum number of steps to reach each output time, zero for no limit */
+  long int maxSteps;
+  double rtol;
+  double* atol;
+  /* the states at t */
+  double* y;
+  /* stage derivatives, k[0] is the rates at (t,y) when haveRates is set */
+  double* k[DP_STAGES];
+  int haveRates;
+  double* ytmp;
+  double* yerr;
+  /* for the Rush-Larsen schemes, the gate (or -1) for each state variable and the current
+     steady state values and time constants of the gates */
+  int* gateOfState;
+  double* inf;
+  double* tau;
+  /* single allocation for all the arrays above */
+  double* workspace;
+  struct IntegratorStatistics stats;
+};
+
+/* evaluate the rates at (t,y) into k, leaving the executable model's states at y */
+static void evaluateRates(struct ExplicitIntegrator* integrator, double t, const double* y, double* k)
+{
+  ExecutableModel* em = integrator->em;
+  memcpy(em->states, y, sizeof(double)*integrator->n);
+  em->computeRates(t);
+  memcpy(k, em->rates, sizeof(double)*integrator->n);
+  integrator->stats.nRhsEvals++;
+}
+
+/* the weighted RMS norm used for the error control */
+static double weightedNorm(struct ExplicitIntegrator* integrator, const double* v, const double* y1,
+  const double* y2)
+{
+  double sum = 0.0;
+  int i;
+  for (i=0;i<integrator->n;i++)
+  {
+    double scale = integrator->atol[i] + integrator->rtol*fmax(fabs(y1[i]),fabs(y2[i]));
+    double e = v[i] / scale;
+    sum += e*e;
+  }
+  return sqrt(sum / integrator->n);
+}
+
+struct ExplicitIntegrator* CreateExplicitIntegrator(struct Simulation* simulation,
+  class ExecutableModel* em)
+{
+  if (!(simulation && em))
+  {
+    ERROR("CreateExplicitIntegrator","Invalid arguments when creating integrator\n");
+    return((struct ExplicitIntegrator*)NULL);
+  }
+  enum IntegrationScheme scheme = simulationGetIntegrationScheme(simulation);
+  if ((scheme != EULER) && (scheme != RK4) && (scheme != RK45) && (scheme != RUSH_LARSEN) &&
+      (scheme != RUSH_LARSEN2))
+  {
+    ERROR("CreateExplicitIntegrator","Invalid integration scheme: %s\n",
+      integrationSchemeToString(scheme));
+    return((struct ExplicitIntegrator*)NULL);
+  }
+  int n = em->nRates;
+  int atolLength = simulationGetATolLength(simulation);
+  if ((atolLength != 1) && (atolLength != n))
+  {
+    ERROR("CreateExplicitIntegrator","Need either one absolute tolerance or one for each of the "
+      "%d state variables, but %d were given\n",n,atolLength);
+    return((struct ExplicitIntegrator*)NULL);
+  }
+  /* the fixed step schemes use the maximum step size, which is also the limit for the adaptive
+     scheme */
+  double maxStep = simulationIsBvarMaxStepSet(simulation) ? simulationGetBvarMaxStep(simulation) :
+    simulationGetBvarTabStep(simulation);
+  if (!(maxStep > 0.0))
+  {
+    ERROR("CreateExplicitIntegrator","The step size must be positive, but %g was given\n",maxStep);
+    return((struct ExplicitIntegrator*)NULL);
+  }
+  struct ExplicitIntegrator* integrator =
+    (struct ExplicitIntegrator*)malloc(sizeof(struct ExplicitIntegrator));
+  integrator->scheme = scheme;
+  integrator->em = em;
+  integrator->n = n;
+  int nGates = em->nGates;
+  if (((scheme == RUSH_LARSEN) || (scheme == RUSH_LARSEN2)) && (nGates < 1))
+    WARNING("CreateExplicitIntegrator","No gating variables found in the model, the Rush-Larsen "
+      "scheme reduces to an explicit Runge-Kutta scheme\n");
+  integrator->workspace = (double*)calloc((size_t)n*(DP_STAGES+4) + 2*nGates,sizeof(double));
+  integrator->atol = integrator->workspace;
+  integrator->y = integrator->atol + n;
+  integrator->ytmp = integrator->y + n;
+  integrator->yerr = integrator->ytmp + n;
+  int i;
+  for (i=0;i<DP_STAGES;i++) integrator->k[i] = integrator->yerr + (i+1)*n;
+  integrator->inf = integrator->workspace + (size_t)n*(DP_STAGES+4);
+  integrator->tau = integrator->inf + nGates;
+  integrator->gateOfState = (int*)malloc(sizeof(int)*(n > 0 ? n : 1));
+  for (i=0;i<n;i++) integrator->gateOfState[i] = -1;
+  for (i=0;i<nGates;i++) integrator->gateOfState[em->gateIndices[i]] = i;
+
+  integrator->maxStep = maxStep;
+  integrator->maxSteps = simulationIsMaxNumStepsSet(simulation) ?
+    simulationGetMaxNumSteps(simulation) : 0;
+
+  /* the tolerances are only used by the adaptive scheme, any scaling is by the initial magnitude
+     of the state variables */
+  integrator->rtol = simulationGetRTol(simulation);
+  double* atol = simulationGetATol(simulation);
+  enum ToleranceScaling scaling = simulationGetATolScaling(simulation);
+  for (i=0;i<n;i++)
+  {
+    double tol = atol[(atolLength == 1) ? 0 : i];
+    if ((scaling != NO_SCALING) && (fabs(em->states[i]) > 0.0)) tol *= fabs(em->states[i]);
+    integrator->atol[i] = tol;
+  }
+  free(atol);
+
+  explicitIntegratorReinitialise(integrator,simulationGetBvarStart(simulation));
+  return(integrator);
+}
+
+int DestroyExplicitIntegrator(struct ExplicitIntegrator** integrator)
+{
+  struct ExplicitIntegrator* intg = *integrator;
+  if (intg)
+  {
+    if (intg->workspace) free(intg->workspace);
+    if (intg->gateOfState) free(intg->gateOfState);
+    free(intg);
+  }
+  *integrator = NULL;
+  return(OK);
+}
+
+int explicitIntegratorReinitialise(struct ExplicitIntegrator* integrator, double t)
+{
+  if (!integrator) return(ERR);
+  memcpy(integrator->y,integrator->em->states,sizeof(double)*integrator->n);
+  integrator->t = t;
+  integrator->h = integrator->maxStep;
+  integrator->haveRates = 0;
+  memset(&(integrator->stats),0,sizeof(struct IntegratorStatistics));
+  if ((integrator->scheme == RK45) && (integrator->n > 0))
+  {
+    /* Initial step size guess (Hairer, Norsett and Wanner, Solving Ordinary Differential
+       Equations I, section II.4) */
+    evaluateRates(integrator,t,integrator->y,integrator->k[0]);
+    integrator->haveRates = 1;
+    double d0 = weightedNorm(integrator,integrator->y,integrator->y,integrator->y);
+    double d1 = weightedNorm(integrator,integrator->k[0],integrator->y,integrator->y);
+    double h0 = ((d0 < 1.0e-5) || (d1 < 1.0e-5)) ? 1.0e-6 : 0.01*d0/d1;
+    if (h0 < integrator->h) integrator->h = h0;
+  }
+  return(OK);
+}
+
+/* y(t+h) = y(t) + h f(t,y) */
+static void eulerStep(struct ExplicitIntegrator* integrator, double h)
+{
+  int i, n = integrator->n;
+  double* y = integrator->y;
+  double** k = integrator->k;
+  if (!integrator->haveRates) evaluateRates(integrator,integrator->t,y,k[0]);
+  for (i=0;i<n;i++) y[i] += h*k[0][i];
+  integrator->haveRates = 0;
+}
+
+/* classical fourth order Runge-Kutta */
+static void rk4Step(struct ExplicitIntegrator* integrator, double h)
+{
+  int i, n = integrator->n;
+  double t = integrator->t;
+  double* y = integrator->y;
+  double* ytmp = integrator->ytmp;
+  double** k = integrator->k;
+  if (!integrator->haveRates) evaluateRates(integrator,t,y,k[0]);
+  for (i=0;i<n;i++) ytmp[i] = y[i] + 0.5*h*k[0][i];
+  evaluateRates(integrator,t+0.5*h,ytmp,k[1]);
+  for (i=0;i<n;i++) ytmp[i] = y[i] + 0.5*h*k[1][i];
+  evaluateRates(integrator,t+0.5*h,ytmp,k[2]);
+  for (i=0;i<n;i++) ytmp[i] = y[i] + h*k[2][i];
+  evaluateRates(integrator,t+h,ytmp,k[3]);
+  for (i=0;i<n;i++) y[i] += h/6.0*(k[0][i] + 2.0*k[1][i] + 2.0*k[2][i] + k[3][i]);
+  integrator->haveRates = 0;
+}
+
+/* make sure k[0] holds the rates, and the executable model the algebraic variables, at (t,y) */
+static void ensureRates(struct ExplicitIntegrator* integrator)
+{
+  if (!integrator->haveRates ||
+      (memcmp(integrator->em->states,integrator->y,sizeof(double)*integrator->n) != 0))
+  {
+    evaluateRates(integrator,integrator->t,integrator->y,integrator->k[0]);
+    integrator->haveRates = 1;
+  }
+}
+
+/* yout = y0 updated over h, the gates exactly using the current inf and tau and the other states
+   with the rates k. */
+static void rushLarsenUpdate(struct ExplicitIntegrator* integrator, const double* y0,
+  const double* k, double h, double* yout)
+{
+  int i;
+  for (i=0;i<integrator->n;i++)
+  {
+    int g = integrator->gateOfState[i];
+    double tau = (g < 0) ? 0.0 : integrator->tau[g];
+    /* fall back to Euler for any gate with an invalid time constant */
+    if ((tau > 0.0) && isfinite(tau))
+    {
+      double inf = integrator->inf[g];
+      yout[i] = inf + (y0[i] - inf)*exp(-h/tau);
+    }
+    else yout[i] = y0[i] + h*k[i];
+  }
+}
+
+/* Rush-Larsen: exact gate update with forward Euler for everything else */
+static void rushLarsenStep(struct ExplicitIntegrator* integrator, double h)
+{
+  ensureRates(integrator);
+  integrator->em->computeGates(integrator->t,integrator->inf,integrator->tau);
+  rushLarsenUpdate(integrator,integrator->y,integrator->k[0],h,integrator->y);
+  integrator->haveRates = 0;
+}
+
+/* Second order Rush-Larsen: a half step with the first order scheme to get the midpoint, where
+   the rates, inf and tau are evaluated for the full step (Sundnes et al., 2009) */
+static void rushLarsen2Step(struct ExplicitIntegrator* integrator, double h)
+{
+  ensureRates(integrator);
+  ExecutableModel* em = integrator->em;
+  em->computeGates(integrator->t,integrator->inf,integrator->tau);
+  rushLarsenUpdate(integrator,integrator->y,integrator->k[0],0.5*h,integrator->ytmp);
+  evaluateRates(integrator,integrator->t+0.5*h,integrator->ytmp,integrator->k[1]);
+  em->computeGates(integrator->t+0.5*h,integrator->inf,integrator->tau);
+  rushLarsenUpdate(integrator,integrator->y,integrator->k[1],h,integrator->y);
+  integrator->haveRates = 0;
+}
+
+/* Dormand-Prince 5(4) step with the error estimate, the new solution is left in ytmp with its
+   rates (first same as last) in k[6]. Returns the weighted norm of the error estimate. */
+static double dormandPrinceStep(struct ExplicitIntegrator* integrator, double h)
+{
+  int i, n = integrator->n;
+  double t = integrator->t;
+  double* y = integrator->y;
+  double* ytmp = integrator->ytmp;
+  double** k = integrator->k;
+  if (!integrator->haveRates)
+  {
+    evaluateRates(integrator,t,y,k[0]);
+    integrator->haveRates = 1;
+  }
+  for (i=0;i<n;i++) ytmp[i] = y[i] + h*(1.0/5.0)*k[0][i];
+  evaluateRates(integrator,t+h/5.0,ytmp,k[1]);
+  for (i=0;i<n;i++) ytmp[i] = y[i] + h*(3.0/40.0*k[0][i] + 9.0/40.0*k[1][i]);
+  evaluateRates(integrator,t+3.0*h/10.0,ytmp,k[2]);
+  for (i=0;i<n;i++)
+    ytmp[i] = y[i] + h*(44.0/45.0*k[0][i] - 56.0/15.0*k[1][i] + 32.0/9.0*k[2][i]);
+  evaluateRates(integrator,t+4.0*h/5.0,ytmp,k[3]);
+  for (i=0;i<n;i++)
+    ytmp[i] = y[i] + h*(19372.0/6561.0*k[0][i] - 25360.0/2187.0*k[1][i] +
+      64448.0/6561.0*k[2][i] - 212.0/729.0*k[3][i]);
+  evaluateRates(integrator,t+8.0*h/9.0,ytmp,k[4]);
+  for (i=0;i<n;i++)
+    ytmp[i] = y[i] + h*(9017.0/3168.0*k[0][i] - 355.0/33.0*k[1][i] + 46732.0/5247.0*k[2][i] +
+      49.0/176.0*k[3][i] - 5103.0/18656.0*k[4][i]);
+  evaluateRates(integrator,t+h,ytmp,k[5]);
+  for (i=0;i<n;i++)
+    ytmp[i] = y[i] + h*(35.0/384.0*k[0][i] + 500.0/1113.0*k[2][i] + 125.0/192.0*k[3][i] -
+      2187.0/6784.0*k[4][i] + 11.0/84.0*k[5][i]);
+  evaluateRates(integrator,t+h,ytmp,k[6]);
+  for (i=0;i<n;i++)
+    integrator->yerr[i] = h*(71.0/57600.0*k[0][i] - 71.0/16695.0*k[2][i] + 71.0/1920.0*k[3][i] -
+      17253.0/339200.0*k[4][i] + 22.0/525.0*k[5][i] - 1.0/40.0*k[6][i]);
+  return weightedNorm(integrator,integrator->yerr,y,ytmp);
+}
+
+/* are all the states at t finite? */
+static int finiteStates(struct ExplicitIntegrator* integrator)
+{
+  int i;
+  for (i=0;i<integrator->n;i++) if (!isfinite(integrator->y[i])) return(0);
+  return(1);
+}
+
+int explicitIntegrate(struct ExplicitIntegrator* integrator, double tout, double* t)
+{
+  double tol = 1.0e-12*fmax(1.0,fabs(tout));
+  long int steps = 0;
+  while ((tout - integrator->t) > tol)
+  {
+    if ((integrator->maxSteps > 0) && (steps >= integrator->maxSteps))
+    {
+      ERROR("explicitIntegrate","Took the maximum number of steps (%ld) before reaching tout = "
+        REAL_FORMAT " at t = " REAL_FORMAT "\n",integrator->maxSteps,tout,integrator->t);
+      *t = integrator->t;
+      return(ERR);
+    }
+    steps++;
+    double h = integrator->h;
+    int last = 0;
+    if ((integrator->t + h) >= (tout - tol))
+    {
+      h = tout - integrator->t;
+      last = 1;
+    }
+    if (integrator->scheme == RK45)
+    {
+      double err = dormandPrinceStep(integrator,h);
+      /* a non-finite error estimate (e.g., from NaN rates) rejects the step with the largest
+         reduction in step size */
+      double factor = !isfinite(err) ? DP_MIN_FACTOR :
+        ((err > 0.0) ? DP_SAFETY*pow(err,-0.2) : DP_MAX_FACTOR);
+      if (err <= 1.0)
+      {
+        /* accept the step, the rates at the new point become the first stage of the next */
+        memcpy(integrator->y,integrator->ytmp,sizeof(double)*integrator->n);
+        double* k0 = integrator->k[0];
+        integrator->k[0] = integrator->k[6];
+        integrator->k[6] = k0;
+        integrator->t = last ? tout : (integrator->t + h);
+        integrator->stats.nSteps++;
+        if (factor > DP_MAX_FACTOR) factor = DP_MAX_FACTOR;
+        /* don't let the truncated last step limit the next step */
+        if (!last || (h*factor > integrator->h)) integrator->h = h*factor;
+      }
+      else
+      {
+        if (factor < DP_MIN_FACTOR) factor = DP_MIN_FACTOR;
+        integrator->h = h*factor;
+        integrator->stats.nErrTestFails++;
+      }
+      if (integrator->h > integrator->maxStep) integrator->h = integrator->maxStep;
+      if (integrator->h < 1.0e-14*fmax(1.0,fabs(integrator->t)))
+      {
+        ERROR("explicitIntegrate","Step size too small at t = " REAL_FORMAT "\n",integrator->t);
+        *t = integrator->t;
+        return(ERR);
+      }
+    }
+    else
+    {
+      switch (integrator->scheme)
+      {
+        case EULER: eulerStep(integrator,h); break;
+        case RK4: rk4Step(integrator,h); break;
+        case RUSH_LARSEN: rushLarsenStep(integrator,h); break;
+        case RUSH_LARSEN2: rushLarsen2Step(integrator,h); break;
+        default: return(ERR);
+      }
+      if (!finiteStates(integrator))
+      {
+        ERROR("explicitIntegrate","The solution is not finite after the step from t = " REAL_FORMAT
+          "\n",integrator->t);
+        *t = integrator->t;
+        return(ERR);
+      }
+      integrator->t = last ? tout : (integrator->t + h);
+      integrator->stats.nSteps++;
+    }
+  }
+  /* make sure the executable model is consistent with the solution at t */
+  if (integrator->haveRates)
+  {
+    ExecutableModel* em = integrator->em;
+    if (memcmp(em->states,integrator->y,sizeof(double)*integrator->n) != 0)
+      integrator->haveRates = 0;
+  }
+  if (!integrator->haveRates)
+  {
+    evaluateRates(integrator,integrator->t,integrator->y,integrator->k[0]);
+    integrator->haveRates = 1;
+  }
+  *t = integrator->t;
+  return(OK);
+}
+
+int explicitIntegratorGetStatistics(struct ExplicitIntegrator* integrator,
+  struct IntegratorStatistics* stats)
+{
+  if (!(integrator && stats)) return(ERR);
+  memcpy(stats,&(integrator->stats),sizeof(struct IntegratorStatistics));
+  return(OK);
+}
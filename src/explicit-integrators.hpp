@@ -0,0 +1,35 @@
+
+#ifndef _EXPLICIT_INTEGRATORS_HPP_
+#define _EXPLICIT_INTEGRATORS_HPP_
+
+/*
+ * Explicit Runge-Kutta integrators (forward Euler, classical RK4 and the adaptive Dormand-Prince
+ * RK45) and the Rush-Larsen schemes, which work directly on the executable model's arrays. These
+ * are used by the main integrator (integrator.hpp) when the simulation asks for one of these
+ * integration schemes, they are not expected to be used directly.
+ */
+
+/* Private structure */
+struct Simulation;
+struct ExplicitIntegrator;
+struct IntegratorStatistics;
+class ExecutableModel;
+
+struct ExplicitIntegrator* CreateExplicitIntegrator(struct Simulation* simulation,
+  class ExecutableModel* em);
+int DestroyExplicitIntegrator(struct ExplicitIntegrator** integrator);
+
+/* restart the integration from the executable model's current states at the bound variable
+   value t */
+int explicitIntegratorReinitialise(struct ExplicitIntegrator* integrator, double t);
+
+/* advance the executable model's states to tout, on return the executable model's rates and
+   algebraic variables are consistent with the states at tout. Returns ERR if the solution stops
+   being finite, the adaptive step size becomes too small, or reaching tout takes more than the
+   simulation's maximum number of steps (if set). */
+int explicitIntegrate(struct ExplicitIntegrator* integrator, double tout, double* t);
+
+int explicitIntegratorGetStatistics(struct ExplicitIntegrator* integrator,
+  struct IntegratorStatistics* stats);
+
+#endif /* _EXPLICIT_INTEGRATORS_HPP_ */
@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#ifndef WIN32
+#  include <sys/file.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "initial-condition-cache.hpp"
+#include "limit-cycle.hpp"
+#include "autotune.hpp"
+#include "ExecutableModel.hpp"
+
+/* Take a lock (LOCK_SH or LOCK_EX) on the whole cache file, waiting for any other process
+   holding a conflicting lock */
+#ifndef WIN32
+static int lockFile(FILE* file, int operation)
+{
+  if (flock(fileno(file), operation) != 0)
+  {
+    WARNING("lockFile","Unable to lock the initial condition cache file\n");
+    return(ERR);
+  }
+  return(OK);
+}
+#endif
+
+/* Read the next line (of any length), returns ERR at the end of the file */
+static int readLine(FILE* file, std::string& line)
+{
+  char buffer[1024];
+  line.clear();
+  while (fgets(buffer, sizeof(buffer), file))
+  {
+    line += buffer;
+    if (line[line.size()-1] == '\n') return(OK);
+  }
+  return(line.empty() ? ERR : OK);
+}
+
+/* Parse a cache entry: the key, the number of states, the time paced and the states. A line which
+   was only partly written (no newline, or some other entry appended to it) is rejected. */
+static int parseEntry(const std::string& line, uint64_t* key, std::vector<double>& states,
+  double* pacedTime)
+{
+  if (line.empty() || (line[line.size()-1] != '\n')) return(ERR);
+  const char* p = line.c_str();
+  char* end;
+  *key = (uint64_t)strtoull(p, &end, 16);
+  if (end == p) return(ERR);
+  p = end;
+  long int nStates = strtol(p, &end, 10);
+  if ((end == p) || (nStates < 0)) return(ERR);
+  p = end;
+  *pacedTime = strtod(p, &end);
+  if (end == p) return(ERR);
+  states.resize(nStates);
+  for (long int i=0;i<nStates;i++)
+  {
+    p = end;
+    states[i] = strtod(p, &end);
+    if (end == p) return(ERR);
+  }
+  while (*end && isspace((unsigned char)*end)) end++;
+  return((*end == '\0') ? OK : ERR);
+}
+
+/* Scan the (locked) cache file for the last complete entry with the given key and number of states,
+   later entries override earlier ones */
+static int findEntry(FILE* file, uint64_t key, int nStates, double* states, double* pacedTime)
+{
+  std::string line;
+  std::vector<double> entryStates;
+  int found = 0;
+  while (readLine(file, line) == OK)
+  {
+    uint64_t entryKey;
+    double entryTime;
+    if (parseEntry(line, &entryKey, entryStates, &entryTime) != OK) continue;
+    if ((entryKey != key) || ((int)entryStates.size() != nStates)) continue;
+    if (states) memcpy(states, &(entryStates[0]), sizeof(double)*nStates);
+    if (pacedTime) *pacedTime = entryTime;
+    found = 1;
+  }
+  return(found ? OK : ERR);
+}
+
+uint64_t initialConditionCacheKey(uint64_t modelHash, struct Simulation* simulation,
+  class ExecutableModel* em, double t, double period, double tolerance)
+{
+  uint64_t key = fnv1aHash(&modelHash, sizeof(uint64_t), FNV1A_OFFSET_BASIS);
+  /* the constants include any which have been overridden, and the states any initial values */
+  key = fnv1aHash(&(em->nConstants), sizeof(int), key);
+  key = fnv1aHash(em->constants, sizeof(double)*em->nConstants, key);
+  key = fnv1aHash(&(em->nRates), sizeof(int), key);
+  key = fnv1aHash(em->states, sizeof(double)*em->nRates, key);
+  /* the pacing protocol */
+  key = fnv1aHash(&t, sizeof(double), key);
+  key = fnv1aHash(&period, sizeof(double), key);
+  key = fnv1aHash(&tolerance, sizeof(double), key);
+  /* and the integration scheme and its method, whether discontinuities are located, the
+     tolerances, the step size limit (which defaults to the tabulation step) and the step count
+     limit (0 for the integrator's default) */
+  enum IntegrationScheme scheme = simulationGetIntegrationScheme(simulation);
+  key = fnv1aHash(&scheme, sizeof(enum IntegrationScheme), key);
+  enum MultistepMethod multistep = simulationGetMultistepMethod(simulation);
+  enum IterationMethod iteration = simulationGetIterationMethod(simulation);
+  int rootFinding = simulationGetRootFinding(simulation);
+  key = fnv1aHash(&multistep, sizeof(enum MultistepMethod), key);
+  key = fnv1aHash(&iteration, sizeof(enum IterationMethod), key);
+  key = fnv1aHash(&rootFinding, sizeof(int), key);
+  int atolLength = simulationGetATolLength(simulation);
+  double* atol = simulationGetATol(simulation);
+  double rtol = simulationGetRTol(simulation);
+  enum ToleranceScaling scaling = simulationGetATolScaling(simulation);
+  if (atol) key = fnv1aHash(atol, sizeof(double)*atolLength, key);
+  key = fnv1aHash(&rtol, sizeof(double), key);
+  key = fnv1aHash(&scaling, sizeof(enum ToleranceScaling), key);
+  free(atol);
+  double maxStep = simulationIsBvarMaxStepSet(simulation) ? simulationGetBvarMaxStep(simulation) :
+    simulationGetBvarTabStep(simulation);
+  key = fnv1aHash(&maxStep, sizeof(double), key);
+  long int maxNumSteps = simulationIsMaxNumStepsSet(simulation) ? simulationGetMaxNumSteps(simulation) :
+    0;
+  key = fnv1aHash(&maxNumSteps, sizeof(long int), key);
+  return(key);
+}
+
+int initialConditionCacheLookup(const char* cacheFile, uint64_t key, int nStates, double* states,
+  double* pacedTime)
+{
+  if (!(cacheFile && states && pacedTime && (nStates > 0))) return(ERR);
+  FILE* file = fopen(cacheFile, "r");
+  if (!file) return(ERR);
+  int code = OK;
+#ifndef WIN32
+  code = lockFile(file, LOCK_SH);
+#endif
+  if (code == OK) code = findEntry(file, key, nStates, states, pacedTime);
+  /* closing the file releases the lock */
+  fclose(file);
+  return(code);
+}
+
+int initialConditionCacheStore(const char* cacheFile, uint64_t key, int nStates,
+  const double* states, double pacedTime)
+{
+  if (!(cacheFile && states && (nStates > 0))) return(ERR);
+  FILE* file = fopen(cacheFile, "a+");
+  if (!file)
+  {
+    WARNING("initialConditionCacheStore","Unable to open the cache file: %s\n",cacheFile);
+    return(ERR);
+  }
+#ifndef WIN32
+  if (lockFile(file, LOCK_EX) != OK)
+  {
+    fclose(file);
+    return(ERR);
+  }
+#endif
+  /* another worker may have paced the same model while we were */
+  rewind(file);
+  if (findEntry(file, key, nStates, NULL, NULL) == OK)
+  {
+    fclose(file);
+    return(OK);
+  }
+  /* the whole entry is written in one go, and flushed before the lock is released */
+  std::string entry;
+  /* start a new line if a writer which crashed left a partial entry */
+  if ((fseek(file, -1, SEEK_END) == 0) && (fgetc(file) != '\n')) entry += "\n";
+  char buffer[64];
+  sprintf(buffer, "%016llx %d %.17g", (unsigned long long)key, nStates, pacedTime);
+  entry += buffer;
+  int i;
+  for (i=0;i<nStates;i++)
+  {
+    sprintf(buffer, " %.17g", states[i]);
+    entry += buffer;
+  }
+  entry += "\n";
+  int code = OK;
+  fseek(file, 0, SEEK_END);
+  if ((fwrite(entry.c_str(), 1, entry.size(), file) != entry.size()) || (fflush(file) != 0))
+  {
+    WARNING("initialConditionCacheStore","Unable to write to the cache file: %s\n",cacheFile);
+    code = ERR;
+  }
+  fclose(file);
+  return(code);
+}
+
+int initialConditionPace(const char* cacheFile, uint64_t modelHash, struct Simulation* simulation,
+  class ExecutableModel* em, double t, double period, int maxCycles, double tolerance,
+  int shootingInterval, double* tEnd, int* cached)
+{
+  if (cached) *cached = 0;
+  if (!(simulation && em && tEnd && (em->nRates > 0))) return(ERR);
+  int n = em->nRates;
+  /* the key needs the states before they are paced */
+  uint64_t key = initialConditionCacheKey(modelHash, simulation, em, t, period, tolerance);
+  std::vector<double> states(n);
+  double pacedTime;
+  if (cacheFile && (initialConditionCacheLookup(cacheFile, key, n, &(states[0]), &pacedTime) == OK))
+  {
+    DEBUG(1,"initialConditionPace","Found the paced states in the cache: %016llx\n",
+      (unsigned long long)key);
+    memcpy(em->states, &(states[0]), sizeof(double)*n);
+    *tEnd = t + pacedTime;
+    /* leave the model consistent with the states, as limitCycleSolve does */
+    em->computeRates(*tEnd);
+    em->evaluateVariables(*tEnd);
+    if (cached) *cached = 1;
+    return(OK);
+  }
+  int code = limitCycleSolve(simulation, em, t, period, maxCycles, tolerance, shootingInterval, tEnd,
+    NULL, NULL);
+  /* only a converged limit cycle is worth keeping */
+  if (cacheFile && (code == OK)) initialConditionCacheStore(cacheFile, key, n, em->states, *tEnd - t);
+  return(code);
+}
@@ -0,0 +1,54 @@
+
+#ifndef _INITIAL_CONDITION_CACHE_HPP_
+#define _INITIAL_CONDITION_CACHE_HPP_
+
+#include <stdint.h>
+
+/*
+ * A persistent cache of paced initial conditions. The state variable values at the end of pacing a
+ * model to its limit cycle (see limit-cycle.hpp) are stored in a cache file, keyed on everything
+ * which determines them: a hash of the model code, the model's constants and initial states, the
+ * pacing protocol and the integration settings. Later runs with the same key, in this process or
+ * any other, get the paced states from the cache rather than pacing the model again. The cache file
+ * is a text file with one entry per line; readers take a shared lock on it and writers an exclusive
+ * lock, so any number of concurrent workers can share it (on POSIX systems, where flock is
+ * available).
+ */
+
+/* Private structure */
+struct Simulation;
+class ExecutableModel;
+
+/*
+ * The key for pacing the executable model from its current constants and states at the bound
+ * variable value t with the given period and limit cycle tolerance, using the simulation's
+ * integration scheme (with its multistep and iteration methods), root finding, tolerances (and their
+ * scaling), maximum step size and maximum number of steps. modelHash identifies
+ * the model code (e.g., the fnv1aHash of the generated code, see autotune.hpp).
+ */
+uint64_t initialConditionCacheKey(uint64_t modelHash, struct Simulation* simulation,
+  class ExecutableModel* em, double t, double period, double tolerance);
+
+/* Look up the paced states (nStates values) and the time paced for the given key in the cache
+   file. Returns ERR if there is no cache file or the key isn't in it with that number of states. */
+int initialConditionCacheLookup(const char* cacheFile, uint64_t key, int nStates, double* states,
+  double* pacedTime);
+
+/* Add the paced states and the time paced for the given key to the cache file, unless another
+   process has already added them */
+int initialConditionCacheStore(const char* cacheFile, uint64_t key, int nStates,
+  const double* states, double pacedTime);
+
+/*
+ * Pace the executable model to its limit cycle as limitCycleSolve does, from its current states at
+ * the bound variable value t, but look the paced states up in the cache file first and, if they
+ * need to be computed, store them there once the limit cycle has been found. *cached is set to
+ * whether the states came from the cache (may be NULL). cacheFile may be NULL to skip the cache. On
+ * return the executable model's states are those at the bound variable value *tEnd, the same
+ * whether or not they came from the cache. Returns OK if the limit cycle was found.
+ */
+int initialConditionPace(const char* cacheFile, uint64_t modelHash, struct Simulation* simulation,
+  class ExecutableModel* em, double t, double period, int maxCycles, double tolerance,
+  int shootingInterval, double* tEnd, int* cached);
+
+#endif /* _INITIAL_CONDITION_CACHE_HPP_ */
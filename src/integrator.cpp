@@ -1,11 +1,16 @@
 #include <iostream>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 /* Header files with a description of contents used in cvsdenx.c */
 #include <cvodes/cvodes.h>         /* prototypes for CVODES fcts. and consts. */
 #include <nvector/nvector_serial.h> /* serial N_Vector types, fcts., and macros */
+#ifdef CSIM_HAVE_NVECTOR_OPENMP
+#  include <nvector/nvector_openmp.h> /* OpenMP N_Vector for large models */
+#  include <omp.h>
+#endif
 #include <cvodes/cvodes_dense.h>   /* prototype for CVDense */
 #include <cvodes/cvodes_band.h>    /* prototype for CVBand */
 #include <cvodes/cvodes_diag.h>    /* prototype for CVDiag */
@@ -22,11 +27,14 @@ extern "C"
 #include "utils.h"
 #include "simulation.h"
 #include "ccgs_required_functions.h"
+#include "outputVariables.h"
 #ifdef __cplusplus
 }
 #endif
 
 #include "integrator.hpp"
+#include "explicit-integrators.hpp"
+#include "multirate.hpp"
 #include "ExecutableModel.hpp"
 
 /* FIXME: Temporary? */
@@ -34,6 +42,54 @@ extern "C"
 # error "Sorry, can only handle double precision versions of Sundials"
 #endif
 
+/* The state vectors use the OpenMP N_Vector, when it is available, for models with at least this
+   many state variables so that the vector operations in CVODES are shared across the cores. Below
+   this the threading overhead outweighs the gain. All the state vectors are accessed through the
+   generic N_Vector interface so that they can be of either type. */
+#define NVECTOR_THREADED_MIN_LENGTH 20000
+#define NV_DATA(v) N_VGetArrayPointer(v)
+
+/* The number of steps between the checkpoints stored during the forward integration for the
+   adjoint sensitivity analysis, and the most checkpoints stored so that the memory used doesn't
+   grow without bound with the length of the integration */
+#define ADJOINT_CHECKPOINT_STEPS 100
+#define ADJOINT_MAX_CHECKPOINTS 2000
+
+/* The stiffness of the problem is checked every STIFFNESS_CHECK_STEPS steps when switching between
+   the Adams and BDF methods, using a few power iterations to estimate the spectral radius (rho) of
+   the Jacobian. We switch to BDF when the Adams steps are limited by stability (h*rho above
+   ADAMS_STIFF_LIMIT) and back to Adams once the BDF steps would be stable for Adams (h*rho below
+   BDF_NONSTIFF_LIMIT). */
+#define STIFFNESS_CHECK_STEPS 20
+#define STIFFNESS_POWER_ITERATIONS 3
+#define ADAMS_STIFF_LIMIT 1.0
+#define BDF_NONSTIFF_LIMIT 0.2
+
+/* Workspace for the adjoint sensitivity analysis */
+struct AdjointWorkspace
+{
+  struct Integrator* integrator;
+  const struct AdjointObjective* objective;
+  int nParameters;
+  const struct SensitivityParameter* parameters;
+  /* the adjoints of the model arrays, for the generated adjoint code */
+  double* adjointConstants;
+  double* adjointRates;
+  double* adjointStates;
+  double* adjointAlgebraic;
+  /* the outputs and the gradient of the objective with respect to them */
+  double* outputGradient;
+  /* base values for the difference quotients */
+  double* rates;
+  double* outputs;
+  /* the parameter products from the most recent backward right hand side evaluation */
+  realtype tCache;
+  N_Vector yBCache;
+  N_Vector yBdot;
+  double* parameterProducts;
+  int cacheValid;
+};
+
 /* Private type */
 struct Integrator
 {
@@ -42,12 +98,71 @@ struct Integrator
   struct Simulation* simulation;
   // FIXME: really need to handle this properly, but for now simply grabbing a handle.
   ExecutableModel* em;
+  /* Used in place of CVODES for the explicit integration schemes */
+  struct ExplicitIntegrator* explicitIntegrator;
+  /* Used in place of CVODES for the multirate integration scheme */
+  struct MultirateIntegrator* multirateIntegrator;
+  /* Number of root functions registered with CVODES (0 if root finding is not being used) */
+  int nRoots;
+  /* The CVODES counters are reset each time the integrator is restarted, so we keep track of
+     the totals from before the most recent restart here */
+  struct IntegratorStatistics previousStatistics;
+  long int nDiscontinuities;
+  /* The absolute tolerances when using a tolerance per state variable, and the state variable
+     magnitudes used to scale them */
+  N_Vector abstol;
+  double* atol;
+  int atolLength;
+  double* stateMagnitudes;
+  /* The forward sensitivity analysis, if enabled */
+  int nSensitivities;
+  struct SensitivityParameter* sensitivityParameters;
+  N_Vector* yS;
+  realtype* pbar;
+  /* The adjoint sensitivity analysis, while it is running */
+  struct AdjointWorkspace* adjoint;
+  /* Switching between Adams (with functional iteration) and BDF: the solver memory for the method
+     not currently in use (created when first needed), whether we are using BDF, and the
+     workspace for the stiffness monitor */
+  int methodSwitching;
+  void* otherCvodeMem;
+  int stiff;
+  long int nMethodSwitches;
+  int stepsSinceStiffnessCheck;
+  N_Vector* stiffnessWork;
+  long int maxNumSteps;
+  /* The number of threads used for the vector operations (1 for serial N_Vectors) */
+  int nVectorThreads;
+  /* The algebraic loop solver counters when the integrator was created */
+  struct NRStatistics nrStatistics;
 };
 
-/* Function called by the Solver (CVODES only) */
+/* Functions called by the Solver (CVODES only) */
 static int f(realtype t,N_Vector y,N_Vector ydot,void *f_data);
+static int g(realtype t,N_Vector y,realtype* gout,void *g_data);
+static int fS(int Ns,realtype t,N_Vector y,N_Vector ydot,int iS,N_Vector yS,N_Vector ySdot,
+  void *user_data,N_Vector tmp1,N_Vector tmp2);
+static int fQ(realtype t,N_Vector y,N_Vector yQdot,void *user_data);
+static int fB(realtype t,N_Vector y,N_Vector yB,N_Vector yBdot,void *user_dataB);
+static int fQB(realtype t,N_Vector y,N_Vector yB,N_Vector qBdot,void *user_dataB);
 
 static int check_flag(void *flagvalue,const char *funcname,int opt);
+static void printAlgebraicLoopStats(struct Integrator* integrator);
+static int integratorVectorThreads(long int n);
+static N_Vector integratorNewVector(struct Integrator* integrator,long int n);
+static void integratorAccumulateStatistics(struct Integrator* integrator);
+static int integratorAttachLinearSolver(struct Integrator* integrator,void* cvode_mem);
+static int integratorApplyTolerances(struct Integrator* integrator,void* cvode_mem);
+static int integratorMonitorStiffness(struct Integrator* integrator,realtype t);
+static int integratorSwitchMethod(struct Integrator* integrator,realtype t);
+static int integratorSetupTolerances(struct Integrator* integrator);
+static int integratorUpdateStateMagnitudes(struct Integrator* integrator);
+static double integratorStateATol(struct Integrator* integrator,int i);
+static void integratorInitialSensitivities(struct Integrator* integrator);
+static double sensitivityIncrement(struct Integrator* integrator,N_Vector y,N_Vector yS,int iS);
+static int adjointProducts(struct AdjointWorkspace* ws,double t,const realtype* y,
+  const realtype* lambda,const double* outputGradient,realtype* stateProducts,
+  double* parameterProducts);
 
 /*
  * Functions to use CVODES
@@ -69,6 +184,29 @@ struct Integrator* CreateIntegrator(struct Simulation* sim,
   integrator->simulation = simulationClone(sim);
   // FIXME: really need to handle this properly, but for now simply grabbing a handle.
   integrator->em = em;
+  integrator->explicitIntegrator = NULL;
+  integrator->multirateIntegrator = NULL;
+  integrator->nRoots = 0;
+  memset(&(integrator->previousStatistics),0,sizeof(struct IntegratorStatistics));
+  integrator->nDiscontinuities = 0;
+  integrator->abstol = NULL;
+  integrator->atol = NULL;
+  integrator->atolLength = 0;
+  integrator->stateMagnitudes = NULL;
+  integrator->nSensitivities = 0;
+  integrator->sensitivityParameters = NULL;
+  integrator->yS = NULL;
+  integrator->pbar = NULL;
+  integrator->adjoint = NULL;
+  integrator->methodSwitching = 0;
+  integrator->otherCvodeMem = NULL;
+  integrator->stiff = 0;
+  integrator->nMethodSwitches = 0;
+  integrator->stepsSinceStiffnessCheck = 0;
+  integrator->stiffnessWork = NULL;
+  integrator->maxNumSteps = 0;
+  integrator->nVectorThreads = integratorVectorThreads(em->nRates);
+  NR_getStatistics(&(integrator->nrStatistics));
 
   /* Check for errors in the simulation */
   if (simulationGetATolLength(integrator->simulation) < 1)
@@ -100,15 +238,37 @@ struct Integrator* CreateIntegrator(struct Simulation* sim,
     return(NULL);
   }
 
-  /* Create serial vector of length NR for I.C. */
-  integrator->y = N_VNew_Serial(em->nRates);
-  if (check_flag((void *)(integrator->y),"N_VNew_Serial",0))
+  /* The explicit and multirate schemes don't need any of the CVODES setup */
+  if (simulationGetIntegrationScheme(integrator->simulation) == MULTIRATE)
+  {
+    integrator->multirateIntegrator = CreateMultirateIntegrator(integrator->simulation,em);
+    if (!integrator->multirateIntegrator)
+    {
+      DestroyIntegrator(&integrator);
+      return(NULL);
+    }
+    return(integrator);
+  }
+  if (simulationGetIntegrationScheme(integrator->simulation) != CVODE)
+  {
+    integrator->explicitIntegrator = CreateExplicitIntegrator(integrator->simulation,em);
+    if (!integrator->explicitIntegrator)
+    {
+      DestroyIntegrator(&integrator);
+      return(NULL);
+    }
+    return(integrator);
+  }
+
+  /* Create the vector of length NR for I.C. */
+  integrator->y = integratorNewVector(integrator,em->nRates);
+  if (check_flag((void *)(integrator->y),"integratorNewVector",0))
   {
     DestroyIntegrator(&integrator);
     return(NULL);
   }
   /* Initialize y */
-  realtype* yD = NV_DATA_S(integrator->y);
+  realtype* yD = NV_DATA(integrator->y);
   int i;
   for (i=0;i<(em->nRates);i++) yD[i] = (realtype)(em->states[i]);
 
@@ -125,6 +285,13 @@ struct Integrator* CreateIntegrator(struct Simulation* sim,
       mlmm = CV_BDF;
       break;
     }
+    case ADAMS_BDF:
+    {
+      /* start out assuming the problem is nonstiff */
+      mlmm = CV_ADAMS;
+      integrator->methodSwitching = 1;
+      break;
+    }
     default:
     {
       ERROR("CreateIntegrator","Invalid multistep method choice\n");
@@ -151,6 +318,17 @@ struct Integrator* CreateIntegrator(struct Simulation* sim,
       return(NULL);
     }
   }
+  /* the iteration method given is for the BDF method, Adams always uses functional iteration */
+  if (integrator->methodSwitching)
+  {
+    miter = CV_FUNCTIONAL;
+    integrator->stiffnessWork = N_VCloneVectorArray(5,integrator->y);
+    if (check_flag((void *)(integrator->stiffnessWork),"N_VCloneVectorArray",0))
+    {
+      DestroyIntegrator(&integrator);
+      return(NULL);
+    }
+  }
   /* 
      Call CVodeCreate to create the solver memory:     
      A pointer to the integrator problem memory is returned and
@@ -182,112 +360,21 @@ struct Integrator* CreateIntegrator(struct Simulation* sim,
       return(NULL);
   }
 
-  double* atol = simulationGetATol(integrator->simulation);
-  if (simulationGetATolLength(integrator->simulation) == 1)
-  {
-	  flag = CVodeSStolerances(integrator->cvode_mem,simulationGetRTol(integrator->simulation),atol[0]);
-	  if (check_flag(&flag,"CVodeSStolerances",1))
-	  {
-		  DestroyIntegrator(&integrator);
-		  return(NULL);
-	  }
-  }
-  else
+  if (integratorSetupTolerances(integrator) != OK)
   {
-	  ERROR("CreateIntegrator", "array abstol not supported yet.");
-	  DestroyIntegrator(&integrator);
-	  return(NULL);
+    DestroyIntegrator(&integrator);
+    return(NULL);
   }
-  free(atol);
 
   /* if using Newton iteration need a linear solver */
-  if (simulationGetIterationMethod(integrator->simulation) == NEWTON)
+  if ((miter == CV_NEWTON) && (integratorAttachLinearSolver(integrator,integrator->cvode_mem) != OK))
   {
-    switch (simulationGetLinearSolver(integrator->simulation))
-    {
-      case DENSE:
-      {
-        /* Call CVDense to specify the CVDENSE dense linear solver */
-        flag = CVDense(integrator->cvode_mem,em->nRates);
-        if (check_flag(&flag,"CVDense",1))
-        {
-          DestroyIntegrator(&integrator);
-          return(NULL);
-        }
-      } break;
-      case BAND:
-      {
-        /* Call CVBand to specify the CVBAND linear solver */
-        long int upperBW = em->nRates - 1; /* FIXME: This probably doesn't make */
-        long int lowerBW = em->nRates - 1; /* any sense, but should do until I */
-                                           /* fix it */
-        flag = CVBand(integrator->cvode_mem,em->nRates,upperBW,lowerBW);
-        if (check_flag(&flag,"CVBand",1))
-        {
-          DestroyIntegrator(&integrator);
-          return(NULL);
-        }
-      } break;
-      case DIAG:
-      {
-        /* Call CVDiag to specify the CVDIAG linear solver */
-        flag = CVDiag(integrator->cvode_mem);
-        if (check_flag(&flag,"CVDiag",1))
-        {
-          DestroyIntegrator(&integrator);
-          return(NULL);
-        }
-      } break;
-      case SPGMR:
-      {
-        /* Call CVSpgmr to specify the linear solver CVSPGMR 
-           with no preconditioning and the maximum Krylov dimension maxl */
-        flag = CVSpgmr(integrator->cvode_mem,PREC_NONE,0);
-        if(check_flag(&flag,"CVSpgmr",1))
-        {
-          DestroyIntegrator(&integrator);
-          return(NULL);
-        }
-
-      } break;
-      case SPBCG:
-      {
-        /* Call CVSpbcg to specify the linear solver CVSPBCG 
-           with no preconditioning and the maximum Krylov dimension maxl */
-        flag = CVSpbcg(integrator->cvode_mem,PREC_NONE,0);
-        if(check_flag(&flag,"CVSpbcg",1))
-        {
-          DestroyIntegrator(&integrator);
-          return(NULL);
-        }
-
-      } break;
-      case SPTFQMR:
-      {
-        /* Call CVSptfqmr to specify the linear solver CVSPTFQMR 
-           with no preconditioning and the maximum Krylov dimension maxl */
-        flag = CVSptfqmr(integrator->cvode_mem,PREC_NONE,0);
-        if(check_flag(&flag,"CVSptfqmr",1))
-        {
-          DestroyIntegrator(&integrator);
-          return(NULL);
-        }
-
-      } break;
-      default:
-      {
-        ERROR("CreateIntegrator",
-          "Must specify a valid linear solver when using "
-          "Newton iteration\n");
-        DestroyIntegrator(&integrator);
-        return(NULL);
-      }
-    }
+    DestroyIntegrator(&integrator);
+    return(NULL);
   }
 
-  /* Pass through the executable model to f */
-  // FIXME: really need to handle this properly, but for now simply grabbing a handle.
-  flag = CVodeSetUserData(integrator->cvode_mem,(void*)(em));
+  /* Pass through the integrator (and hence the executable model) to f */
+  flag = CVodeSetUserData(integrator->cvode_mem,(void*)(integrator));
   if (check_flag(&flag,"CVodeSetUserData",1))
   {
     DestroyIntegrator(&integrator);
@@ -322,6 +409,21 @@ struct Integrator* CreateIntegrator(struct Simulation* sim,
   }
   simulationSetBvarMaxStep(integrator->simulation,maxStep);
   simulationSetBvarMaxStep(sim,maxStep);
+
+  /* Locate the switching points of any piecewise expressions in the rates, so that we can stop
+     the integration at each discontinuity rather than stepping blindly across it */
+  if (simulationGetRootFinding(integrator->simulation) && (em->nRoots > 0) &&
+      (em->nRates > 0))
+  {
+    flag = CVodeRootInit(integrator->cvode_mem,em->nRoots,g);
+    if (check_flag(&flag,"CVodeRootInit",1))
+    {
+      DestroyIntegrator(&integrator);
+      return(NULL);
+    }
+    integrator->nRoots = em->nRoots;
+  }
+
   /* try and make a sensible guess at the maximal number of steps to
      get to tout to take into account case where we simply want to
      integrate over a large time period in small steps (why?) */
@@ -334,12 +436,15 @@ struct Integrator* CreateIntegrator(struct Simulation* sim,
   }
   long int maxsteps = (long int)ceil(tout/maxStep) * 100;
   if (maxsteps < 500) maxsteps = 500; /* default value */
+  if (simulationIsMaxNumStepsSet(integrator->simulation))
+    maxsteps = simulationGetMaxNumSteps(integrator->simulation);
   flag = CVodeSetMaxNumSteps(integrator->cvode_mem,maxsteps);
   if (check_flag(&flag,"CVodeSetMaxNumSteps",1))
   {
     DestroyIntegrator(&integrator);
     return(NULL);
   }
+  integrator->maxNumSteps = maxsteps;
   return(integrator);
 }
 
@@ -348,8 +453,18 @@ int DestroyIntegrator(struct Integrator** integrator)
   struct Integrator* intg = *integrator;
   if (intg)
   {
-    if (intg->y) N_VDestroy_Serial(intg->y);
+    if (intg->explicitIntegrator) DestroyExplicitIntegrator(&(intg->explicitIntegrator));
+    if (intg->multirateIntegrator) DestroyMultirateIntegrator(&(intg->multirateIntegrator));
+    if (intg->y) N_VDestroy(intg->y);
+    if (intg->abstol) N_VDestroy(intg->abstol);
+    if (intg->atol) free(intg->atol);
+    if (intg->stateMagnitudes) free(intg->stateMagnitudes);
+    if (intg->yS) N_VDestroyVectorArray(intg->yS,intg->nSensitivities);
+    if (intg->sensitivityParameters) free(intg->sensitivityParameters);
+    if (intg->pbar) free(intg->pbar);
     if (intg->cvode_mem) CVodeFree(&(intg->cvode_mem));
+    if (intg->otherCvodeMem) CVodeFree(&(intg->otherCvodeMem));
+    if (intg->stiffnessWork) N_VDestroyVectorArray(intg->stiffnessWork,5);
     if (intg->simulation) DestroySimulation(&(intg->simulation));
     free(intg);
   }
@@ -365,7 +480,7 @@ int integratorInitialise(struct Integrator* integrator)
 #if 0
 	int i;
     /* Initialize y */
-    realtype* yD = NV_DATA_S(integrator->y);
+    realtype* yD = NV_DATA(integrator->y);
     for (i=0;i<(integrator->em->nRates);i++) yD[i] = (realtype)(integrator->em->states[i]);
 #endif
     code = OK;
@@ -373,18 +488,103 @@ int integratorInitialise(struct Integrator* integrator)
   return(code);
 }
 
+int integratorReinitialise(struct Integrator* integrator, double t)
+{
+  if (!integrator) return(ERR);
+  /* nothing to restart if there are no differential equations */
+  if (integrator->em->nRates < 1) return(OK);
+  if (integrator->explicitIntegrator)
+    return(explicitIntegratorReinitialise(integrator->explicitIntegrator,t));
+  if (integrator->multirateIntegrator)
+    return(multirateIntegratorReinitialise(integrator->multirateIntegrator,t));
+  realtype* yD = NV_DATA(integrator->y);
+  int i;
+  for (i=0;i<(integrator->em->nRates);i++) yD[i] = (realtype)(integrator->em->states[i]);
+  /* Keeps the existing solver memory, linear solver and options, just restarting the solution
+     (and the statistics) from the given point */
+  int flag = CVodeReInit(integrator->cvode_mem,(realtype)t,integrator->y);
+  if (check_flag(&flag,"CVodeReInit",1)) return(ERR);
+  /* back to estimating the initial step, in case it was set by integratorRestore */
+  flag = CVodeSetInitStep(integrator->cvode_mem,0.0);
+  if (check_flag(&flag,"CVodeSetInitStep",1)) return(ERR);
+  if (integrator->nSensitivities > 0)
+  {
+    integratorInitialSensitivities(integrator);
+    flag = CVodeSensReInit(integrator->cvode_mem,CV_STAGGERED,integrator->yS);
+    if (check_flag(&flag,"CVodeSensReInit",1)) return(ERR);
+  }
+  memset(&(integrator->previousStatistics),0,sizeof(struct IntegratorStatistics));
+  integrator->nDiscontinuities = 0;
+  integrator->nMethodSwitches = 0;
+  integrator->stepsSinceStiffnessCheck = 0;
+  return(OK);
+}
+
 int integrate(struct Integrator* integrator, double tout, double* t)
 {
-  if (integrator->em->nRates > 0)
+  if ((integrator->em->nRates > 0) && integrator->explicitIntegrator)
+  {
+    if (explicitIntegrate(integrator->explicitIntegrator,tout,t) != OK) return(ERR);
+    integrator->em->evaluateVariables(*t);
+  }
+  else if ((integrator->em->nRates > 0) && integrator->multirateIntegrator)
+  {
+    if (multirateIntegrate(integrator->multirateIntegrator,tout,t) != OK) return(ERR);
+    integrator->em->evaluateVariables(*t);
+  }
+  else if (integrator->em->nRates > 0)
   {
     /* need to integrate if we have any differential equations */
     int flag;
+    /* when switching between methods we take one step at a time so that we can keep an eye on
+       the stiffness, the switching is suspended while computing sensitivities */
+    int monitorStiffness = integrator->methodSwitching && (integrator->nSensitivities == 0);
+    int task = monitorStiffness ? CV_ONE_STEP : CV_NORMAL;
     /* Make sure we don't go past the specified end time - could run into
        trouble if we're almost reaching a threshold */
     flag = CVodeSetStopTime(integrator->cvode_mem,(realtype)tout);
     if (check_flag(&flag,"CVode",1)) return(ERR);
-    flag = CVode(integrator->cvode_mem,tout,integrator->y,t,CV_NORMAL);
+    flag = CVode(integrator->cvode_mem,tout,integrator->y,t,task);
     if (check_flag(&flag,"CVode",1)) return(ERR);
+    while ((flag == CV_ROOT_RETURN) || (monitorStiffness && (*t < tout)))
+    {
+      if (flag == CV_ROOT_RETURN)
+      {
+        /* We have reached a discontinuity in the model, so restart the integrator from here to
+           avoid the solution history from the other side of the switch being used for the
+           steps that follow. This is the same whether or not the discontinuity is at tout, in
+           which case the next call carries on from the restarted integrator. */
+        integrator->nDiscontinuities++;
+        integratorAccumulateStatistics(integrator);
+        flag = CVodeReInit(integrator->cvode_mem,*t,integrator->y);
+        if (check_flag(&flag,"CVodeReInit",1)) return(ERR);
+        if (integrator->nSensitivities > 0)
+        {
+          /* the sensitivities carry straight on across the discontinuity */
+          realtype tS;
+          flag = CVodeGetSens(integrator->cvode_mem,&tS,integrator->yS);
+          if (check_flag(&flag,"CVodeGetSens",1)) return(ERR);
+          flag = CVodeSensReInit(integrator->cvode_mem,CV_STAGGERED,integrator->yS);
+          if (check_flag(&flag,"CVodeSensReInit",1)) return(ERR);
+        }
+      }
+      else
+      {
+        /* a successful step, the stiffness monitor may switch us to the other method */
+        if (integratorMonitorStiffness(integrator,*t) != OK) return(ERR);
+      }
+      if (*t >= tout) break;
+      flag = CVodeSetStopTime(integrator->cvode_mem,(realtype)tout);
+      if (check_flag(&flag,"CVodeSetStopTime",1)) return(ERR);
+      flag = CVode(integrator->cvode_mem,tout,integrator->y,t,task);
+      if (check_flag(&flag,"CVode",1)) return(ERR);
+    }
+    /* the most recent evaluation of f (or fS) may not have been for the solution at t */
+    realtype* yD = NV_DATA(integrator->y);
+    int i;
+    for (i=0;i<(integrator->em->nRates);i++) integrator->em->states[i] = (double)(yD[i]);
+    /* track the state magnitudes used to scale the absolute tolerances */
+    if (integratorUpdateStateMagnitudes(integrator) != OK) return(ERR);
     /* we also need to evaluate all the other variables that are not required
        to be updated during integration */
     integrator->em->evaluateVariables(*t);
@@ -413,6 +613,259 @@ int integrate(struct Integrator* integrator, double tout, double* t)
   return(OK);
 }
 
+int integratorSample(struct Integrator* integrator, double t, int nSamples,
+  const double* sampleTimes, IntegratorSampleFunction sample, void* userData)
+{
+  int i,k;
+  if (!(integrator && sample && (nSamples > 0) && sampleTimes && (sampleTimes[0] >= t)))
+  {
+    ERROR("integratorSample","Invalid arguments\n");
+    return(ERR);
+  }
+  for (k=1;k<nSamples;k++)
+  {
+    if (sampleTimes[k] < sampleTimes[k-1])
+    {
+      ERROR("integratorSample","The sample times must be increasing\n");
+      return(ERR);
+    }
+  }
+  ExecutableModel* em = integrator->em;
+  if (integratorReinitialise(integrator,t) != OK) return(ERR);
+  /* any samples at the start */
+  em->computeRates(t);
+  em->evaluateVariables(t);
+  em->getOutputs(t);
+  for (k=0;(k<nSamples) && (sampleTimes[k] <= t);k++)
+    if (sample(k,sampleTimes[k],em,userData) != OK) return(ERR);
+  if (k == nSamples) return(OK);
+  if (integrator->explicitIntegrator || integrator->multirateIntegrator || (em->nRates == 0) ||
+      (integrator->nSensitivities > 0))
+  {
+    /* stop at each sample time */
+    for (;k<nSamples;k++)
+    {
+      double tk;
+      if (integrate(integrator,sampleTimes[k],&tk) != OK) return(ERR);
+      if (sample(k,tk,em,userData) != OK) return(ERR);
+    }
+    return(OK);
+  }
+
+  double tEnd = sampleTimes[nSamples-1];
+  N_Vector yk = N_VClone(integrator->y);
+  realtype* ykD = NV_DATA(yk);
+  realtype tcur = (realtype)t;
+  int flag, code = OK;
+  while ((code == OK) && (k < nSamples))
+  {
+    /* one step at a time, only stopping at the end (the stiffness monitor may have changed the
+       solver memory since the previous step) */
+    flag = CVodeSetStopTime(integrator->cvode_mem,(realtype)tEnd);
+    if (check_flag(&flag,"CVodeSetStopTime",1))
+    {
+      code = ERR;
+      break;
+    }
+    int stepFlag = CVode(integrator->cvode_mem,tEnd,integrator->y,&tcur,CV_ONE_STEP);
+    if (check_flag(&stepFlag,"CVode",1))
+    {
+      code = ERR;
+      break;
+    }
+    /* the samples passed in this step, from the interpolating polynomial */
+    for (;(k<nSamples) && (sampleTimes[k] <= tcur);k++)
+    {
+      flag = CVodeGetDky(integrator->cvode_mem,(realtype)sampleTimes[k],0,yk);
+      if (check_flag(&flag,"CVodeGetDky",1))
+      {
+        code = ERR;
+        break;
+      }
+      for (i=0;i<em->nRates;i++) em->states[i] = (double)(ykD[i]);
+      em->computeRates(sampleTimes[k]);
+      em->evaluateVariables(sampleTimes[k]);
+      em->getOutputs(sampleTimes[k]);
+      if (sample(k,sampleTimes[k],em,userData) != OK)
+      {
+        code = ERR;
+        break;
+      }
+    }
+    if (code != OK) break;
+    if (stepFlag == CV_ROOT_RETURN)
+    {
+      /* restart at the discontinuity, as in integrate(), even if it is at the last sample */
+      integrator->nDiscontinuities++;
+      integratorAccumulateStatistics(integrator);
+      flag = CVodeReInit(integrator->cvode_mem,tcur,integrator->y);
+      if (check_flag(&flag,"CVodeReInit",1)) code = ERR;
+    }
+    else if ((k < nSamples) && integrator->methodSwitching)
+    {
+      if (integratorMonitorStiffness(integrator,tcur) != OK) code = ERR;
+    }
+  }
+  N_VDestroy(yk);
+  /* leave the model at the end of the integration */
+  realtype* yD = NV_DATA(integrator->y);
+  for (i=0;i<em->nRates;i++) em->states[i] = (double)(yD[i]);
+  if (code == OK) code = integratorUpdateStateMagnitudes(integrator);
+  em->computeRates(tcur);
+  em->evaluateVariables(tcur);
+  em->getOutputs(tcur);
+  return(code);
+}
+
+/* Private type */
+struct IntegratorSnapshot
+{
+  double t;
+  /* a copy of the executable model, holding all of its values */
+  ExecutableModel* em;
+  /* the step size CVODES would have tried next and the method in use */
+  double h;
+  int stiff;
+  int stepsSinceStiffnessCheck;
+  /* the state magnitudes scaling the absolute tolerances, if any */
+  int nStates;
+  double* stateMagnitudes;
+  /* the state sensitivities, nSensitivities rows of nStates values */
+  int nSensitivities;
+  double* sensitivities;
+};
+
+struct IntegratorSnapshot* integratorSnapshot(struct Integrator* integrator, double t)
+{
+  if (!integrator)
+  {
+    ERROR("integratorSnapshot","Invalid arguments\n");
+    return((struct IntegratorSnapshot*)NULL);
+  }
+  ExecutableModel* em = integrator->em;
+  struct IntegratorSnapshot* snapshot =
+    (struct IntegratorSnapshot*)calloc(1,sizeof(struct IntegratorSnapshot));
+  snapshot->t = t;
+  snapshot->em = em->clone();
+  snapshot->nStates = em->nRates;
+  snapshot->stiff = integrator->stiff;
+  snapshot->stepsSinceStiffnessCheck = integrator->stepsSinceStiffnessCheck;
+  if (!snapshot->em)
+  {
+    ERROR("integratorSnapshot","Unable to copy the executable model\n");
+    DestroyIntegratorSnapshot(&snapshot);
+    return(snapshot);
+  }
+  /* only CVODES has anything more than the model values to carry on from */
+  if (integrator->explicitIntegrator || integrator->multirateIntegrator || (em->nRates < 1))
+    return(snapshot);
+  realtype h = 0.0;
+  int flag = CVodeGetCurrentStep(integrator->cvode_mem,&h);
+  if (!check_flag(&flag,"CVodeGetCurrentStep",1)) snapshot->h = (double)h;
+  if (integrator->stateMagnitudes)
+  {
+    snapshot->stateMagnitudes = (double*)malloc(sizeof(double)*em->nRates);
+    memcpy(snapshot->stateMagnitudes,integrator->stateMagnitudes,sizeof(double)*em->nRates);
+  }
+  if (integrator->nSensitivities > 0)
+  {
+    snapshot->nSensitivities = integrator->nSensitivities;
+    snapshot->sensitivities =
+      (double*)malloc(sizeof(double)*integrator->nSensitivities*em->nRates);
+    if (integratorGetStateSensitivities(integrator,snapshot->sensitivities) != OK)
+    {
+      ERROR("integratorSnapshot","Unable to get the sensitivities\n");
+      DestroyIntegratorSnapshot(&snapshot);
+    }
+  }
+  return(snapshot);
+}
+
+int DestroyIntegratorSnapshot(struct IntegratorSnapshot** snapshot)
+{
+  struct IntegratorSnapshot* s = *snapshot;
+  if (s)
+  {
+    if (s->em) delete s->em;
+    if (s->stateMagnitudes) free(s->stateMagnitudes);
+    if (s->sensitivities) free(s->sensitivities);
+    free(s);
+  }
+  *snapshot = NULL;
+  return(OK);
+}
+
+double integratorSnapshotTime(const struct IntegratorSnapshot* snapshot)
+{
+  return(snapshot ? snapshot->t : 0.0);
+}
+
+int integratorRestore(struct Integrator* integrator, const struct IntegratorSnapshot* snapshot)
+{
+  if (!(integrator && snapshot))
+  {
+    ERROR("integratorRestore","Invalid arguments\n");
+    return(ERR);
+  }
+  ExecutableModel* em = integrator->em;
+  if (em->copyValues(snapshot->em) != 0)
+  {
+    ERROR("integratorRestore","The snapshot is of a different model\n");
+    return(ERR);
+  }
+  if ((integrator->nSensitivities > 0) && (integrator->nSensitivities != snapshot->nSensitivities))
+  {
+    ERROR("integratorRestore","The snapshot has %d sensitivity parameters but the integrator %d\n",
+      snapshot->nSensitivities,integrator->nSensitivities);
+    return(ERR);
+  }
+  int i,j,flag;
+  realtype t = (realtype)(snapshot->t);
+  if (integrator->stateMagnitudes && snapshot->stateMagnitudes && integrator->abstol)
+  {
+    /* the tolerances as they were scaled for the snapshot */
+    realtype* tolD = NV_DATA(integrator->abstol);
+    memcpy(integrator->stateMagnitudes,snapshot->stateMagnitudes,sizeof(double)*em->nRates);
+    for (i=0;i<em->nRates;i++)
+    {
+      double tol = integrator->atol[(integrator->atolLength == 1) ? 0 : i];
+      if (integrator->stateMagnitudes[i] > 0.0) tol *= integrator->stateMagnitudes[i];
+      tolD[i] = (realtype)tol;
+    }
+    if (integratorApplyTolerances(integrator,integrator->cvode_mem) != OK) return(ERR);
+  }
+  if (integratorReinitialise(integrator,snapshot->t) != OK) return(ERR);
+  if (integrator->explicitIntegrator || integrator->multirateIntegrator || (em->nRates < 1))
+    return(OK);
+  if (integrator->methodSwitching && (integrator->stiff != snapshot->stiff))
+  {
+    if (integratorSwitchMethod(integrator,t) != OK) return(ERR);
+    integrator->nMethodSwitches = 0;
+  }
+  integrator->stepsSinceStiffnessCheck = snapshot->stepsSinceStiffnessCheck;
+  /* carry on with the step size reached rather than starting from a tiny step (the solver starts
+     again at first order, the history of the earlier steps isn't available from CVODES) */
+  if (snapshot->h != 0.0)
+  {
+    flag = CVodeSetInitStep(integrator->cvode_mem,(realtype)(snapshot->h));
+    if (check_flag(&flag,"CVodeSetInitStep",1)) return(ERR);
+  }
+  if (integrator->nSensitivities > 0)
+  {
+    for (i=0;i<integrator->nSensitivities;i++)
+    {
+      realtype* ySD = NV_DATA(integrator->yS[i]);
+      for (j=0;j<em->nRates;j++) ySD[j] = (realtype)(snapshot->sensitivities[i*em->nRates+j]);
+    }
+    flag = CVodeSensReInit(integrator->cvode_mem,CV_STAGGERED,integrator->yS);
+    if (check_flag(&flag,"CVodeSensReInit",1)) return(ERR);
+  }
+  em->computeRates(snapshot->t);
+  em->evaluateVariables(snapshot->t);
+  em->getOutputs(snapshot->t);
+  return(OK);
+}
+
 /*
  *-------------------------------
  * Functions called by the solver
@@ -425,10 +878,10 @@ int integrate(struct Integrator* integrator, double tout, double* t)
 
 static int f(realtype t,N_Vector y,N_Vector ydot,void *f_data)
 {
-  ExecutableModel* em = (ExecutableModel*)f_data;
-  realtype* yD = NV_DATA_S(y);
-  realtype* ydotD = NV_DATA_S(ydot);
-  long int len = NV_LENGTH_S(y);
+  ExecutableModel* em = ((struct Integrator*)f_data)->em;
+  realtype* yD = NV_DATA(y);
+  realtype* ydotD = NV_DATA(ydot);
+  long int len = em->nRates;
   long int i;
 
   for (i=0;i<len;i++) em->states[i]=(double)yD[i];
@@ -440,66 +893,562 @@ static int f(realtype t,N_Vector y,N_Vector ydot,void *f_data)
 }
 
 /*
- * Check function return value...
- *   opt == 0 means SUNDIALS function allocates memory so check if
- *            returned NULL pointer
- *   opt == 1 means SUNDIALS function returns a flag so check if
- *            flag >= 0
- *   opt == 2 means function allocates memory so check if returned
- *            NULL pointer
- *
- * FIXME: non-standard error code used, should change?
+ * g routine. Compute the root functions g(t,y) for the discontinuities in the model.
  */
-static int check_flag(void *flagvalue, const char *funcname, int opt)
+
+static int g(realtype t,N_Vector y,realtype* gout,void *g_data)
 {
-  int *errflag;
+  ExecutableModel* em = ((struct Integrator*)g_data)->em;
+  realtype* yD = NV_DATA(y);
+  long int len = em->nRates;
+  long int i;
 
-  /* Check if SUNDIALS function returned NULL pointer - no memory allocated */
-  if (opt == 0 && flagvalue == NULL)
-  {
-    ERROR("check_flag",
-      "\nSUNDIALS_ERROR: %s() failed - returned NULL pointer\n\n",
-	    funcname);
-    return(1);
-  }
-  /* Check if flag < 0 */
-  else if (opt == 1)
-  {
-    errflag = (int *) flagvalue;
-    if (*errflag < 0)
-    {
-      ERROR("check_flag","\nSUNDIALS_ERROR: %s() failed with flag = %d\n\n",
-	      funcname,*errflag);
-      return(1);
-    }
-  }
-  /* Check if function returned NULL pointer - no memory allocated */
-  else if (opt == 2 && flagvalue == NULL)
+  for (i=0;i<len;i++) em->states[i]=(double)yD[i];
+  /* the conditions may depend on algebraic variables which are computed with the rates */
+  em->computeRates(t);
+  em->computeRoots(t,gout);
+
+  return(0);
+}
+
+/*
+ * fS routine. Compute the right hand side of the sensitivity equations for parameter iS,
+ *   dyS/dt = (df/dy) yS + df/dp
+ * which is the directional derivative of f along (yS, e_iS), approximated by a forward
+ * difference.
+ */
+
+static int fS(int Ns,realtype t,N_Vector y,N_Vector ydot,int iS,N_Vector yS,N_Vector ySdot,
+  void *user_data,N_Vector tmp1,N_Vector tmp2)
+{
+  struct Integrator* integrator = (struct Integrator*)user_data;
+  ExecutableModel* em = integrator->em;
+  const struct SensitivityParameter* parameter = &(integrator->sensitivityParameters[iS]);
+  realtype* yD = NV_DATA(y);
+  realtype* ydotD = NV_DATA(ydot);
+  realtype* ySD = NV_DATA(yS);
+  realtype* ySdotD = NV_DATA(ySdot);
+  long int len = em->nRates;
+  long int i;
+
+  double sigma = sensitivityIncrement(integrator,y,yS,iS);
+  for (i=0;i<len;i++) em->states[i] = (double)(yD[i] + sigma*ySD[i]);
+  double p = 0.0;
+  if (!parameter->isState)
   {
-    ERROR("check_flag",
-      "\nMEMORY_ERROR: %s() failed - returned NULL pointer\n\n",
-	    funcname);
-    return(1);
+    p = em->constants[parameter->index];
+    em->constants[parameter->index] = p + sigma;
   }
+  em->computeRates(t);
+  for (i=0;i<len;i++) ySdotD[i] = (realtype)((em->rates[i] - ydotD[i])/sigma);
+  if (!parameter->isState) em->constants[parameter->index] = p;
+
   return(0);
 }
 
-/* 
- * Get and print some final statistics
+/*
+ * fQ routine. The integrand of the adjoint objective, integrated along with the forward solution.
  */
-void PrintFinalStats(struct Integrator* integrator)
+
+static int fQ(realtype t,N_Vector y,N_Vector yQdot,void *user_data)
 {
-  void* cvode_mem = integrator->cvode_mem;
-  long int lenrw = -1, leniw = -1, nst = -1, nfe = -1, nsetups = -1, nni = -1, ncfn = -1, netf = -1;
-  long int lenrwLS = -1, leniwLS = -1, nje = -1, nfeLS = -1,npe = -1,nps = -1,ncfl = -1,nli = -1;
-  int flag;
+  struct AdjointWorkspace* ws = ((struct Integrator*)user_data)->adjoint;
+  ExecutableModel* em = ws->integrator->em;
+  realtype* yD = NV_DATA(y);
+  int i;
 
-  flag = CVodeGetWorkSpace(cvode_mem, &lenrw, &leniw);
-  check_flag(&flag, "CVodeGetWorkSpace", 1);
-  flag = CVodeGetNumSteps(cvode_mem, &nst);
-  check_flag(&flag, "CVodeGetNumSteps", 1);
-  flag = CVodeGetNumRhsEvals(cvode_mem, &nfe);
-  check_flag(&flag, "CVodeGetNumRhsEvals", 1);
+  for (i=0;i<(em->nRates);i++) em->states[i] = (double)(yD[i]);
+  em->computeRates(t);
+  em->evaluateVariables(t);
+  em->getOutputs(t);
+  NV_Ith_S(yQdot,0) = (realtype)(ws->objective->integrand(t,em->outputs,ws->outputGradient,
+    ws->objective->userData));
+
+  return(0);
+}
+
+/*
+ * fB routine. The right hand side of the adjoint equations,
+ *   dyB/dt = -(df/dy)^T yB - (dg/dy)^T
+ */
+
+static int fB(realtype t,N_Vector y,N_Vector yB,N_Vector yBdot,void *user_dataB)
+{
+  struct AdjointWorkspace* ws = (struct AdjointWorkspace*)user_dataB;
+  ExecutableModel* em = ws->integrator->em;
+  realtype* yD = NV_DATA(y);
+  realtype* yBdotD = NV_DATA(yBdot);
+  const double* outputGradient = NULL;
+  int i;
+
+  if (ws->objective->integrand)
+  {
+    for (i=0;i<(em->nRates);i++) em->states[i] = (double)(yD[i]);
+    em->computeRates(t);
+    em->evaluateVariables(t);
+    em->getOutputs(t);
+    ws->objective->integrand(t,em->outputs,ws->outputGradient,ws->objective->userData);
+    outputGradient = ws->outputGradient;
+  }
+  if (adjointProducts(ws,t,yD,NV_DATA(yB),outputGradient,yBdotD,ws->parameterProducts) != OK)
+    return(-1);
+  for (i=0;i<(em->nRates);i++) yBdotD[i] = -yBdotD[i];
+  /* the quadrature right hand side is usually wanted next for the same point */
+  ws->tCache = t;
+  N_VScale(1.0,yB,ws->yBCache);
+  ws->cacheValid = 1;
+
+  return(0);
+}
+
+/*
+ * fQB routine. The right hand side of the quadrature giving the gradient with respect to the
+ * parameters,
+ *   dqB/dt = -(df/dp)^T yB - (dg/dp)^T
+ */
+
+static int fQB(realtype t,N_Vector y,N_Vector yB,N_Vector qBdot,void *user_dataB)
+{
+  struct AdjointWorkspace* ws = (struct AdjointWorkspace*)user_dataB;
+  realtype* qBdotD = NV_DATA(qBdot);
+  int i;
+
+  int cached = ws->cacheValid && (ws->tCache == t) &&
+    (memcmp(NV_DATA(yB),NV_DATA(ws->yBCache),sizeof(realtype)*ws->integrator->em->nRates) == 0);
+  if (!cached)
+  {
+    /* fB computes the parameter products as well */
+    int flag = fB(t,y,yB,ws->yBdot,user_dataB);
+    if (flag != 0) return(flag);
+  }
+  for (i=0;i<(ws->nParameters);i++) qBdotD[i] = (realtype)(-ws->parameterProducts[i]);
+
+  return(0);
+}
+
+/*
+ * The size of the difference increment along the direction (yS, e_iS), chosen so that the
+ * change in each state is small relative to the state's magnitude (or its absolute tolerance)
+ * and the change in the parameter is small relative to the parameter's magnitude.
+ */
+static double sensitivityIncrement(struct Integrator* integrator,N_Vector y,N_Vector yS,int iS)
+{
+  realtype* yD = NV_DATA(y);
+  realtype* ySD = NV_DATA(yS);
+  long int len = integrator->em->nRates;
+  long int i;
+  double delta = sqrt(fmax(simulationGetRTol(integrator->simulation),UNIT_ROUNDOFF));
+  double sigma = delta*integrator->pbar[iS];
+  for (i=0;i<len;i++)
+  {
+    double change = fabs(sigma*ySD[i]);
+    double limit = delta*fmax(fabs(yD[i]),integratorStateATol(integrator,i));
+    if (change > limit) sigma *= limit/change;
+  }
+  return(sigma);
+}
+
+/* The number of threads to use for the vector operations with n state variables */
+static int integratorVectorThreads(long int n)
+{
+#ifdef CSIM_HAVE_NVECTOR_OPENMP
+  if (n >= NVECTOR_THREADED_MIN_LENGTH)
+  {
+    int nThreads = omp_get_max_threads();
+    if (nThreads > 1)
+    {
+      DEBUG(1,"integratorVectorThreads","Using the OpenMP N_Vector with %d threads for %ld state "
+        "variables\n",nThreads,n);
+      return(nThreads);
+    }
+  }
+#endif
+  return(1);
+}
+
+/* A new vector of length n, of the type used for the integrator's state vectors */
+static N_Vector integratorNewVector(struct Integrator* integrator,long int n)
+{
+#ifdef CSIM_HAVE_NVECTOR_OPENMP
+  if (integrator->nVectorThreads > 1) return(N_VNew_OpenMP(n,integrator->nVectorThreads));
+#endif
+  return(N_VNew_Serial(n));
+}
+
+/*
+ * Check function return value...
+ *   opt == 0 means SUNDIALS function allocates memory so check if
+ *            returned NULL pointer
+ *   opt == 1 means SUNDIALS function returns a flag so check if
+ *            flag >= 0
+ *   opt == 2 means function allocates memory so check if returned
+ *            NULL pointer
+ *
+ * FIXME: non-standard error code used, should change?
+ */
+static int check_flag(void *flagvalue, const char *funcname, int opt)
+{
+  int *errflag;
+
+  /* Check if SUNDIALS function returned NULL pointer - no memory allocated */
+  if (opt == 0 && flagvalue == NULL)
+  {
+    ERROR("check_flag",
+      "\nSUNDIALS_ERROR: %s() failed - returned NULL pointer\n\n",
+	    funcname);
+    return(1);
+  }
+  /* Check if flag < 0 */
+  else if (opt == 1)
+  {
+    errflag = (int *) flagvalue;
+    if (*errflag < 0)
+    {
+      ERROR("check_flag","\nSUNDIALS_ERROR: %s() failed with flag = %d\n\n",
+	      funcname,*errflag);
+      return(1);
+    }
+  }
+  /* Check if function returned NULL pointer - no memory allocated */
+  else if (opt == 2 && flagvalue == NULL)
+  {
+    ERROR("check_flag",
+      "\nMEMORY_ERROR: %s() failed - returned NULL pointer\n\n",
+	    funcname);
+    return(1);
+  }
+  return(0);
+}
+
+/*
+ * Attach the linear solver from the simulation to the given CVODES solver memory, for use with the
+ * Newton iteration.
+ */
+static int integratorAttachLinearSolver(struct Integrator* integrator,void* cvode_mem)
+{
+  ExecutableModel* em = integrator->em;
+  int flag;
+  switch (simulationGetLinearSolver(integrator->simulation))
+  {
+    case DENSE:
+    {
+      /* Call CVDense to specify the CVDENSE dense linear solver */
+      flag = CVDense(cvode_mem,em->nRates);
+      if (check_flag(&flag,"CVDense",1))
+      {
+        return(ERR);
+      }
+    } break;
+    case BAND:
+    {
+      /* Call CVBand to specify the CVBAND linear solver */
+      long int upperBW = em->nRates - 1; /* FIXME: This probably doesn't make */
+      long int lowerBW = em->nRates - 1; /* any sense, but should do until I */
+                                         /* fix it */
+      flag = CVBand(cvode_mem,em->nRates,upperBW,lowerBW);
+      if (check_flag(&flag,"CVBand",1))
+      {
+        return(ERR);
+      }
+    } break;
+    case DIAG:
+    {
+      /* Call CVDiag to specify the CVDIAG linear solver */
+      flag = CVDiag(cvode_mem);
+      if (check_flag(&flag,"CVDiag",1))
+      {
+        return(ERR);
+      }
+    } break;
+    case SPGMR:
+    {
+      /* Call CVSpgmr to specify the linear solver CVSPGMR 
+         with no preconditioning and the maximum Krylov dimension maxl */
+      flag = CVSpgmr(cvode_mem,PREC_NONE,0);
+      if(check_flag(&flag,"CVSpgmr",1))
+      {
+        return(ERR);
+      }
+
+    } break;
+    case SPBCG:
+    {
+      /* Call CVSpbcg to specify the linear solver CVSPBCG 
+         with no preconditioning and the maximum Krylov dimension maxl */
+      flag = CVSpbcg(cvode_mem,PREC_NONE,0);
+      if(check_flag(&flag,"CVSpbcg",1))
+      {
+        return(ERR);
+      }
+
+    } break;
+    case SPTFQMR:
+    {
+      /* Call CVSptfqmr to specify the linear solver CVSPTFQMR 
+         with no preconditioning and the maximum Krylov dimension maxl */
+      flag = CVSptfqmr(cvode_mem,PREC_NONE,0);
+      if(check_flag(&flag,"CVSptfqmr",1))
+      {
+        return(ERR);
+      }
+
+    } break;
+    default:
+    {
+      ERROR("integratorAttachLinearSolver",
+        "Must specify a valid linear solver when using "
+        "Newton iteration\n");
+      return(ERR);
+    }
+  }
+  return(OK);
+}
+
+/*
+ * Set the integration tolerances, a single absolute tolerance is passed straight through to
+ * CVODES, otherwise we set up the vector of absolute tolerances (one per state variable, scaled
+ * by the state magnitudes if requested).
+ */
+static int integratorSetupTolerances(struct Integrator* integrator)
+{
+  struct Simulation* sim = integrator->simulation;
+  int nStates = integrator->em->nRates;
+  enum ToleranceScaling scaling = simulationGetATolScaling(sim);
+  int i;
+
+  integrator->atolLength = simulationGetATolLength(sim);
+  integrator->atol = simulationGetATol(sim);
+  if ((nStates < 1) || ((integrator->atolLength == 1) && (scaling == NO_SCALING)))
+    return(integratorApplyTolerances(integrator,integrator->cvode_mem));
+  if ((integrator->atolLength != 1) && (integrator->atolLength != nStates))
+  {
+    ERROR("integratorSetupTolerances","Need either one absolute tolerance or one for each of the "
+      "%d state variables, but %d were given\n",nStates,integrator->atolLength);
+    return(ERR);
+  }
+  integrator->abstol = integratorNewVector(integrator,nStates);
+  if (check_flag((void *)(integrator->abstol),"integratorNewVector",0)) return(ERR);
+  integrator->stateMagnitudes = (double*)malloc(sizeof(double)*nStates);
+  for (i=0;i<nStates;i++) integrator->stateMagnitudes[i] = fabs(integrator->em->states[i]);
+  realtype* tolD = NV_DATA(integrator->abstol);
+  for (i=0;i<nStates;i++)
+  {
+    double tol = integrator->atol[(integrator->atolLength == 1) ? 0 : i];
+    /* states which are initially zero have nothing to scale by, so get the given tolerance */
+    if ((scaling != NO_SCALING) && (integrator->stateMagnitudes[i] > 0.0))
+      tol *= integrator->stateMagnitudes[i];
+    tolD[i] = (realtype)tol;
+  }
+  return(integratorApplyTolerances(integrator,integrator->cvode_mem));
+}
+
+/*
+ * The absolute tolerance of the i-th state variable, as currently passed to CVODES
+ */
+static double integratorStateATol(struct Integrator* integrator,int i)
+{
+  if (integrator->abstol) return((double)(NV_DATA(integrator->abstol)[i]));
+  return(integrator->atol[(integrator->atolLength == 1) ? 0 : i]);
+}
+
+/*
+ * Pass the tolerances set up by integratorSetupTolerances to the given CVODES solver memory
+ */
+static int integratorApplyTolerances(struct Integrator* integrator,void* cvode_mem)
+{
+  double rtol = simulationGetRTol(integrator->simulation);
+  int flag;
+  if (integrator->abstol)
+  {
+    flag = CVodeSVtolerances(cvode_mem,rtol,integrator->abstol);
+    if (check_flag(&flag,"CVodeSVtolerances",1)) return(ERR);
+  }
+  else
+  {
+    flag = CVodeSStolerances(cvode_mem,rtol,integrator->atol[0]);
+    if (check_flag(&flag,"CVodeSStolerances",1)) return(ERR);
+  }
+  return(OK);
+}
+
+/*
+ * Create the CVODES solver memory for the method we are switching to, starting from the current
+ * solution at t, with the same options as the solver memory created in CreateIntegrator.
+ */
+static void* integratorCreateOtherSolver(struct Integrator* integrator,realtype t)
+{
+  int mlmm = integrator->stiff ? CV_ADAMS : CV_BDF;
+  int miter = (integrator->stiff ||
+    (simulationGetIterationMethod(integrator->simulation) == FUNCTIONAL)) ? CV_FUNCTIONAL : CV_NEWTON;
+  void* cvode_mem = CVodeCreate(mlmm,miter);
+  if (check_flag((void *)cvode_mem,"CVodeCreate",0)) return(NULL);
+  int flag = CVodeInit(cvode_mem,f,t,integrator->y);
+  int code = check_flag(&flag,"CVodeInit",1) ? ERR : OK;
+  if (code == OK) code = integratorApplyTolerances(integrator,cvode_mem);
+  if ((code == OK) && (miter == CV_NEWTON))
+    code = integratorAttachLinearSolver(integrator,cvode_mem);
+  if (code == OK)
+  {
+    flag = CVodeSetUserData(cvode_mem,(void*)(integrator));
+    if (check_flag(&flag,"CVodeSetUserData",1)) code = ERR;
+  }
+  if (code == OK)
+  {
+    flag = CVodeSetMaxStep(cvode_mem,(realtype)simulationGetBvarMaxStep(integrator->simulation));
+    if (check_flag(&flag,"CVodeSetMaxStep",1)) code = ERR;
+  }
+  if ((code == OK) && (integrator->nRoots > 0))
+  {
+    flag = CVodeRootInit(cvode_mem,integrator->nRoots,g);
+    if (check_flag(&flag,"CVodeRootInit",1)) code = ERR;
+  }
+  if (code == OK)
+  {
+    flag = CVodeSetMaxNumSteps(cvode_mem,integrator->maxNumSteps);
+    if (check_flag(&flag,"CVodeSetMaxNumSteps",1)) code = ERR;
+  }
+  if (code != OK) CVodeFree(&cvode_mem);
+  return(cvode_mem);
+}
+
+/*
+ * Switch to the other method, restarting from the current solution at t
+ */
+static int integratorSwitchMethod(struct Integrator* integrator,realtype t)
+{
+  void* cvode_mem = integrator->otherCvodeMem;
+  if (cvode_mem)
+  {
+    int flag = CVodeReInit(cvode_mem,t,integrator->y);
+    if (check_flag(&flag,"CVodeReInit",1)) return(ERR);
+    /* the absolute tolerances may have been rescaled since this memory was last used */
+    if (integratorApplyTolerances(integrator,cvode_mem) != OK) return(ERR);
+  }
+  else
+  {
+    cvode_mem = integratorCreateOtherSolver(integrator,t);
+    if (!cvode_mem) return(ERR);
+  }
+  /* the counters of the solver memory we are leaving are lost when it is next restarted */
+  integratorAccumulateStatistics(integrator);
+  integrator->otherCvodeMem = integrator->cvode_mem;
+  integrator->cvode_mem = cvode_mem;
+  integrator->stiff = !integrator->stiff;
+  integrator->nMethodSwitches++;
+  DEBUG(2,"integratorSwitchMethod","Switched to %s at t = " REAL_FORMAT "\n",
+    integrator->stiff ? "BDF" : "Adams",(double)t);
+  return(OK);
+}
+
+/*
+ * Called after each successful step when switching between methods. Every STIFFNESS_CHECK_STEPS
+ * steps the spectral radius of the Jacobian at the current solution is estimated by power
+ * iteration with difference quotients, working with the perturbations scaled by the error weights
+ * so that they are a small fraction of the tolerances, and compared to the last step size.
+ */
+static int integratorMonitorStiffness(struct Integrator* integrator,realtype t)
+{
+  if (++(integrator->stepsSinceStiffnessCheck) < STIFFNESS_CHECK_STEPS) return(OK);
+  integrator->stepsSinceStiffnessCheck = 0;
+  void* cvode_mem = integrator->cvode_mem;
+  realtype h;
+  int flag = CVodeGetLastStep(cvode_mem,&h);
+  if (check_flag(&flag,"CVodeGetLastStep",1)) return(ERR);
+  N_Vector ewt = integrator->stiffnessWork[0];
+  N_Vector fy = integrator->stiffnessWork[1];
+  N_Vector v = integrator->stiffnessWork[2];
+  N_Vector yv = integrator->stiffnessWork[3];
+  N_Vector fv = integrator->stiffnessWork[4];
+  flag = CVodeGetErrWeights(cvode_mem,ewt);
+  if (check_flag(&flag,"CVodeGetErrWeights",1)) return(ERR);
+  realtype* ewtD = NV_DATA(ewt);
+  realtype* fyD = NV_DATA(fy);
+  realtype* vD = NV_DATA(v);
+  realtype* yD = NV_DATA(integrator->y);
+  realtype* yvD = NV_DATA(yv);
+  realtype* fvD = NV_DATA(fv);
+  long int n = integrator->em->nRates;
+  long int i;
+  f(t,integrator->y,fy,(void*)integrator);
+  /* start from the direction the solution is moving in (in the weighted space) */
+  for (i=0;i<n;i++) vD[i] = fyD[i]*ewtD[i];
+  realtype norm = sqrt(N_VDotProd(v,v)/n);
+  if (norm > 0.0) N_VScale(1.0/norm,v,v);
+  else N_VConst(1.0,v);
+  /* perturbations of about sqrt(unit roundoff) relative to the solution */
+  realtype sigma = sqrt(UNIT_ROUNDOFF)/simulationGetRTol(integrator->simulation);
+  realtype rho = 0.0;
+  int k, nRhsEvals = 1;
+  for (k=0;k<STIFFNESS_POWER_ITERATIONS;k++)
+  {
+    for (i=0;i<n;i++) yvD[i] = yD[i] + sigma*vD[i]/ewtD[i];
+    f(t,yv,fv,(void*)integrator);
+    nRhsEvals++;
+    for (i=0;i<n;i++) vD[i] = ewtD[i]*(fvD[i] - fyD[i])/sigma;
+    rho = sqrt(N_VDotProd(v,v)/n);
+    if (!(rho > 0.0)) break;
+    N_VScale(1.0/rho,v,v);
+  }
+  /* the rate evaluations for the monitor aren't seen by CVODES */
+  integrator->previousStatistics.nRhsEvals += nRhsEvals;
+  double hrho = fabs((double)h)*(double)rho;
+  DEBUG(3,"integratorMonitorStiffness","t = " REAL_FORMAT ", h*rho = " REAL_FORMAT "\n",
+    (double)t,hrho);
+  if ((!integrator->stiff && (hrho > ADAMS_STIFF_LIMIT)) ||
+      (integrator->stiff && (hrho < BDF_NONSTIFF_LIMIT)))
+    return(integratorSwitchMethod(integrator,t));
+  return(OK);
+}
+
+/*
+ * When scaling the absolute tolerances by the running magnitude of the state variables, we scale
+ * by the largest magnitude seen at the output points so far. Called after each output point.
+ */
+static int integratorUpdateStateMagnitudes(struct Integrator* integrator)
+{
+  if (simulationGetATolScaling(integrator->simulation) != RUNNING_MAGNITUDE) return(OK);
+  if (!integrator->abstol) return(OK);
+  realtype* yD = NV_DATA(integrator->y);
+  realtype* tolD = NV_DATA(integrator->abstol);
+  int i, changed = 0;
+  for (i=0;i<(integrator->em->nRates);i++)
+  {
+    double magnitude = fabs(yD[i]);
+    if (magnitude > integrator->stateMagnitudes[i])
+    {
+      integrator->stateMagnitudes[i] = magnitude;
+      tolD[i] = (realtype)(integrator->atol[(integrator->atolLength == 1) ? 0 : i] * magnitude);
+      changed = 1;
+    }
+  }
+  if (changed)
+  {
+    int flag = CVodeSVtolerances(integrator->cvode_mem,
+      simulationGetRTol(integrator->simulation),integrator->abstol);
+    if (check_flag(&flag,"CVodeSVtolerances",1)) return(ERR);
+  }
+  return(OK);
+}
+
+/*
+ * Get the statistics for the integration so far, including any restarts of the integrator
+ */
+int integratorGetStatistics(struct Integrator* integrator,
+  struct IntegratorStatistics* stats)
+{
+  if (!(integrator && stats)) return(ERR);
+  if (integrator->explicitIntegrator)
+    return(explicitIntegratorGetStatistics(integrator->explicitIntegrator,stats));
+  if (integrator->multirateIntegrator)
+    return(multirateIntegratorGetStatistics(integrator->multirateIntegrator,stats));
+  void* cvode_mem = integrator->cvode_mem;
+  long int nst = 0, nfe = 0, nsetups = 0, nni = 0, ncfn = 0, netf = 0, nge = 0, nfSe = 0;
+  int flag;
+
+  flag = CVodeGetNumSteps(cvode_mem, &nst);
+  check_flag(&flag, "CVodeGetNumSteps", 1);
+  flag = CVodeGetNumRhsEvals(cvode_mem, &nfe);
+  check_flag(&flag, "CVodeGetNumRhsEvals", 1);
   flag = CVodeGetNumLinSolvSetups(cvode_mem, &nsetups);
   check_flag(&flag, "CVodeGetNumLinSolvSetups", 1);
   flag = CVodeGetNumErrTestFails(cvode_mem, &netf);
@@ -508,6 +1457,657 @@ void PrintFinalStats(struct Integrator* integrator)
   check_flag(&flag, "CVodeGetNumNonlinSolvIters", 1);
   flag = CVodeGetNumNonlinSolvConvFails(cvode_mem, &ncfn);
   check_flag(&flag, "CVodeGetNumNonlinSolvConvFails", 1);
+  if (integrator->nRoots > 0)
+  {
+    flag = CVodeGetNumGEvals(cvode_mem, &nge);
+    check_flag(&flag, "CVodeGetNumGEvals", 1);
+  }
+  if (integrator->nSensitivities > 0)
+  {
+    flag = CVodeGetSensNumRhsEvals(cvode_mem, &nfSe);
+    check_flag(&flag, "CVodeGetSensNumRhsEvals", 1);
+  }
+
+  const struct IntegratorStatistics* previous = &(integrator->previousStatistics);
+  stats->nSteps = previous->nSteps + nst;
+  stats->nRhsEvals = previous->nRhsEvals + nfe;
+  stats->nLinSolvSetups = previous->nLinSolvSetups + nsetups;
+  stats->nNonlinSolvIters = previous->nNonlinSolvIters + nni;
+  stats->nNonlinSolvConvFails = previous->nNonlinSolvConvFails + ncfn;
+  stats->nErrTestFails = previous->nErrTestFails + netf;
+  stats->nRootEvals = previous->nRootEvals + nge;
+  stats->nDiscontinuities = integrator->nDiscontinuities;
+  stats->nSensRhsEvals = previous->nSensRhsEvals + nfSe;
+  stats->nMethodSwitches = integrator->nMethodSwitches;
+  stats->nFastSteps = 0;
+  return(OK);
+}
+
+/*
+ * Store the statistics so far before restarting the integrator (which resets the CVODES counters)
+ */
+static void integratorAccumulateStatistics(struct Integrator* integrator)
+{
+  integratorGetStatistics(integrator,&(integrator->previousStatistics));
+}
+
+/*
+ * Forward sensitivity analysis
+ */
+int integratorEnableSensitivities(struct Integrator* integrator, int nParameters,
+  const struct SensitivityParameter* parameters)
+{
+  if (!(integrator && parameters && (nParameters > 0)))
+  {
+    ERROR("integratorEnableSensitivities","Invalid arguments\n");
+    return(ERR);
+  }
+  if (integrator->explicitIntegrator || integrator->multirateIntegrator)
+  {
+    ERROR("integratorEnableSensitivities","Sensitivities are only available with the CVODE "
+      "integration scheme\n");
+    return(ERR);
+  }
+  if (integrator->nSensitivities > 0)
+  {
+    ERROR("integratorEnableSensitivities","Sensitivities have already been enabled\n");
+    return(ERR);
+  }
+  ExecutableModel* em = integrator->em;
+  if (em->nRates < 1)
+  {
+    ERROR("integratorEnableSensitivities","No state variables, so nothing to integrate\n");
+    return(ERR);
+  }
+  int i, flag;
+  for (i=0;i<nParameters;i++)
+  {
+    int n = parameters[i].isState ? em->nRates : em->nConstants;
+    if ((parameters[i].index < 0) || (parameters[i].index >= n))
+    {
+      ERROR("integratorEnableSensitivities","Invalid index for parameter %d: %d\n",i,
+        parameters[i].index);
+      return(ERR);
+    }
+  }
+  integrator->sensitivityParameters = (struct SensitivityParameter*)
+    malloc(sizeof(struct SensitivityParameter)*nParameters);
+  memcpy(integrator->sensitivityParameters,parameters,
+    sizeof(struct SensitivityParameter)*nParameters);
+  /* the parameter magnitudes, used to scale the sensitivity error estimates and the difference
+     increments */
+  integrator->pbar = (realtype*)malloc(sizeof(realtype)*nParameters);
+  for (i=0;i<nParameters;i++)
+  {
+    double p = parameters[i].isState ? em->states[parameters[i].index] :
+      em->constants[parameters[i].index];
+    integrator->pbar[i] = (fabs(p) > 0.0) ? (realtype)fabs(p) : 1.0;
+  }
+  integrator->yS = N_VCloneVectorArray(nParameters,integrator->y);
+  if (check_flag((void *)(integrator->yS),"N_VCloneVectorArray",0)) return(ERR);
+  integrator->nSensitivities = nParameters;
+  integratorInitialSensitivities(integrator);
+
+  flag = CVodeSensInit1(integrator->cvode_mem,nParameters,CV_STAGGERED,fS,integrator->yS);
+  if (check_flag(&flag,"CVodeSensInit1",1)) return(ERR);
+  flag = CVodeSetSensParams(integrator->cvode_mem,NULL,integrator->pbar,NULL);
+  if (check_flag(&flag,"CVodeSetSensParams",1)) return(ERR);
+  flag = CVodeSensEEtolerances(integrator->cvode_mem);
+  if (check_flag(&flag,"CVodeSensEEtolerances",1)) return(ERR);
+  /* include the sensitivities in the error control, otherwise they can be quite inaccurate */
+  flag = CVodeSetSensErrCon(integrator->cvode_mem,TRUE);
+  if (check_flag(&flag,"CVodeSetSensErrCon",1)) return(ERR);
+  return(OK);
+}
+
+int integratorGetNumSensitivityParameters(struct Integrator* integrator)
+{
+  if (!integrator) return(0);
+  return(integrator->nSensitivities);
+}
+
+int integratorGetStateSensitivities(struct Integrator* integrator, double* sensitivities)
+{
+  if (!(integrator && sensitivities && (integrator->nSensitivities > 0))) return(ERR);
+  realtype t;
+  int flag = CVodeGetSens(integrator->cvode_mem,&t,integrator->yS);
+  if (check_flag(&flag,"CVodeGetSens",1)) return(ERR);
+  int nRates = integrator->em->nRates;
+  int i, j;
+  for (i=0;i<(integrator->nSensitivities);i++)
+  {
+    realtype* ySD = NV_DATA(integrator->yS[i]);
+    for (j=0;j<nRates;j++) sensitivities[i*nRates+j] = (double)(ySD[j]);
+  }
+  return(OK);
+}
+
+/*
+ * The outputs may depend on the parameters through any of the model's variables, so we take the
+ * same directional differences as for the sensitivity right hand sides, but evaluating all the
+ * variables and outputs.
+ */
+int integratorGetOutputSensitivities(struct Integrator* integrator, double* sensitivities)
+{
+  if (!(integrator && sensitivities && (integrator->nSensitivities > 0))) return(ERR);
+  realtype t;
+  int flag = CVodeGetSens(integrator->cvode_mem,&t,integrator->yS);
+  if (check_flag(&flag,"CVodeGetSens",1)) return(ERR);
+  ExecutableModel* em = integrator->em;
+  int nOutputs = em->nOutputs;
+  realtype* yD = NV_DATA(integrator->y);
+  double* outputs = (double*)malloc(sizeof(double)*nOutputs);
+  memcpy(outputs,em->outputs,sizeof(double)*nOutputs);
+  int i, j;
+  for (i=0;i<(integrator->nSensitivities);i++)
+  {
+    const struct SensitivityParameter* parameter = &(integrator->sensitivityParameters[i]);
+    realtype* ySD = NV_DATA(integrator->yS[i]);
+    double sigma = sensitivityIncrement(integrator,integrator->y,integrator->yS[i],i);
+    for (j=0;j<(em->nRates);j++) em->states[j] = (double)(yD[j] + sigma*ySD[j]);
+    double p = 0.0;
+    if (!parameter->isState)
+    {
+      p = em->constants[parameter->index];
+      em->constants[parameter->index] = p + sigma;
+    }
+    em->computeRates(t);
+    em->evaluateVariables(t);
+    em->getOutputs(t);
+    for (j=0;j<nOutputs;j++) sensitivities[i*nOutputs+j] = (em->outputs[j] - outputs[j])/sigma;
+    if (!parameter->isState) em->constants[parameter->index] = p;
+  }
+  /* and put the model back to the solution at t */
+  for (j=0;j<(em->nRates);j++) em->states[j] = (double)(yD[j]);
+  em->computeRates(t);
+  em->evaluateVariables(t);
+  em->getOutputs(t);
+  free(outputs);
+  return(OK);
+}
+
+/*
+ * The vector-Jacobian products of the model equations with lambda (the weights on the rates) and
+ * outputGradient (the weights on the outputs) at (t,y), giving the products with respect to the
+ * states (stateProducts) and the parameters (parameterProducts). Either set of weights may be NULL.
+ * Uses the model's generated adjoint code if it has it, otherwise difference quotients.
+ */
+static int adjointProducts(struct AdjointWorkspace* ws,double t,const realtype* y,
+  const realtype* lambda,const double* outputGradient,realtype* stateProducts,
+  double* parameterProducts)
+{
+  struct Integrator* integrator = ws->integrator;
+  ExecutableModel* em = integrator->em;
+  void* outputVariables = simulationGetOutputVariables(integrator->simulation);
+  int i, j;
+
+  for (i=0;i<(em->nRates);i++) em->states[i] = (double)(y[i]);
+  if (em->hasAdjoint())
+  {
+    memset(ws->adjointConstants,0,sizeof(double)*em->nConstants);
+    memset(ws->adjointStates,0,sizeof(double)*em->nRates);
+    memset(ws->adjointAlgebraic,0,sizeof(double)*em->nAlgebraic);
+    for (i=0;i<(em->nRates);i++) ws->adjointRates[i] = lambda ? (double)(lambda[i]) : 0.0;
+    /* the outputs are simply copies of the model variables */
+    for (i=0;outputGradient && (i<(em->nOutputs));i++)
+    {
+      int index = outputVariablesGetCodeIndex(outputVariables,i);
+      switch (outputVariablesGetCodeArray(outputVariables,i))
+      {
+        case STATE_ARRAY: ws->adjointStates[index] += outputGradient[i]; break;
+        case ALGEBRAIC_ARRAY: ws->adjointAlgebraic[index] += outputGradient[i]; break;
+        case CONSTANT_ARRAY: ws->adjointConstants[index] += outputGradient[i]; break;
+        default: break;
+      }
+    }
+    em->computeAdjoint(t,ws->adjointConstants,ws->adjointRates,ws->adjointStates,
+      ws->adjointAlgebraic);
+    for (i=0;i<(em->nRates);i++) stateProducts[i] = (realtype)(ws->adjointStates[i]);
+    for (i=0;i<(ws->nParameters);i++)
+      parameterProducts[i] = ws->parameters[i].isState ? 0.0 :
+        ws->adjointConstants[ws->parameters[i].index];
+    return(OK);
+  }
+
+  /* one difference quotient for each state and parameter */
+  double delta = sqrt(fmax(simulationGetRTol(integrator->simulation),UNIT_ROUNDOFF));
+  em->computeRates(t);
+  memcpy(ws->rates,em->rates,sizeof(double)*em->nRates);
+  if (outputGradient)
+  {
+    em->evaluateVariables(t);
+    em->getOutputs(t);
+    memcpy(ws->outputs,em->outputs,sizeof(double)*em->nOutputs);
+  }
+  for (i=0;i<(em->nRates)+(ws->nParameters);i++)
+  {
+    double* value;
+    if (i < em->nRates) value = &(em->states[i]);
+    else if (ws->parameters[i-em->nRates].isState)
+    {
+      parameterProducts[i-em->nRates] = 0.0;
+      continue;
+    }
+    else value = &(em->constants[ws->parameters[i-em->nRates].index]);
+    double v = *value;
+    double h = delta*fmax(fabs(v),(i < em->nRates) ? integratorStateATol(integrator,i) : delta);
+    *value = v + h;
+    em->computeRates(t);
+    double product = 0.0;
+    for (j=0;lambda && (j<(em->nRates));j++) product += lambda[j]*(em->rates[j] - ws->rates[j])/h;
+    if (outputGradient)
+    {
+      em->evaluateVariables(t);
+      em->getOutputs(t);
+      for (j=0;j<(em->nOutputs);j++)
+        product += outputGradient[j]*(em->outputs[j] - ws->outputs[j])/h;
+    }
+    *value = v;
+    if (i < em->nRates) stateProducts[i] = (realtype)product;
+    else parameterProducts[i-em->nRates] = product;
+  }
+  return(OK);
+}
+
+static struct AdjointWorkspace* CreateAdjointWorkspace(struct Integrator* integrator,
+  const struct AdjointObjective* objective,int nParameters,
+  const struct SensitivityParameter* parameters)
+{
+  ExecutableModel* em = integrator->em;
+  struct AdjointWorkspace* ws =
+    (struct AdjointWorkspace*)malloc(sizeof(struct AdjointWorkspace));
+  ws->integrator = integrator;
+  ws->objective = objective;
+  ws->nParameters = nParameters;
+  ws->parameters = parameters;
+  /* calloc'd with at least one entry to avoid any zero sized allocations */
+  ws->adjointConstants = (double*)calloc(em->nConstants+1,sizeof(double));
+  ws->adjointRates = (double*)calloc(em->nRates+1,sizeof(double));
+  ws->adjointStates = (double*)calloc(em->nRates+1,sizeof(double));
+  ws->adjointAlgebraic = (double*)calloc(em->nAlgebraic+1,sizeof(double));
+  ws->outputGradient = (double*)calloc(em->nOutputs+1,sizeof(double));
+  ws->rates = (double*)calloc(em->nRates+1,sizeof(double));
+  ws->outputs = (double*)calloc(em->nOutputs+1,sizeof(double));
+  ws->parameterProducts = (double*)calloc(nParameters+1,sizeof(double));
+  ws->yBCache = integratorNewVector(integrator,em->nRates);
+  ws->yBdot = integratorNewVector(integrator,em->nRates);
+  ws->tCache = 0.0;
+  ws->cacheValid = 0;
+  return(ws);
+}
+
+static void DestroyAdjointWorkspace(struct AdjointWorkspace** workspace)
+{
+  struct AdjointWorkspace* ws = *workspace;
+  if (ws)
+  {
+    free(ws->adjointConstants);
+    free(ws->adjointRates);
+    free(ws->adjointStates);
+    free(ws->adjointAlgebraic);
+    free(ws->outputGradient);
+    free(ws->rates);
+    free(ws->outputs);
+    free(ws->parameterProducts);
+    if (ws->yBCache) N_VDestroy(ws->yBCache);
+    if (ws->yBdot) N_VDestroy(ws->yBdot);
+    free(ws);
+  }
+  *workspace = NULL;
+}
+
+/*
+ * The adjoint analysis itself, the integrator's adjoint workspace has been set up and the CVODES
+ * adjoint memory allocated. The sampled objective adds a jump to the adjoint variables at each
+ * sample time, so the backward integration is restarted at each of them.
+ */
+static int integratorAdjointSolve(struct Integrator* integrator, double t, double tEnd,
+  const struct AdjointObjective* objective, int nParameters,
+  const struct SensitivityParameter* parameters, double* value, double* gradient,
+  N_Vector yQ, N_Vector yB, N_Vector qB, double* sampleStates, double* sampleGradients)
+{
+  struct AdjointWorkspace* ws = integrator->adjoint;
+  ExecutableModel* em = integrator->em;
+  void* cvode_mem = integrator->cvode_mem;
+  int nRates = em->nRates, nOutputs = em->nOutputs;
+  int nSamples = objective->sample ? objective->nSamples : 0;
+  realtype tret;
+  int i, k, flag, ncheck = 0, which;
+  double t0 = t;
+
+  /* forward, stopping at each sample time */
+  *value = 0.0;
+  for (k=0;k<=nSamples;k++)
+  {
+    double tout = (k < nSamples) ? objective->sampleTimes[k] : tEnd;
+    if ((tout < t) || (tout > tEnd))
+    {
+      ERROR("integratorAdjointGradient","Sample time %g is outside the integration interval\n",
+        tout);
+      return(ERR);
+    }
+    if (tout > t)
+    {
+      /* only as many steps as there are checkpoints left */
+      long int budget = (long int)(ADJOINT_MAX_CHECKPOINTS - ncheck)*ADJOINT_CHECKPOINT_STEPS;
+      long int maxSteps = (budget < integrator->maxNumSteps) ? budget : integrator->maxNumSteps;
+      if (maxSteps <= 0)
+      {
+        ERROR("integratorAdjointGradient","Reached the limit of %d checkpoints at t = %g, "
+          "try a shorter integration interval\n",ADJOINT_MAX_CHECKPOINTS,t);
+        return(ERR);
+      }
+      flag = CVodeSetMaxNumSteps(cvode_mem,maxSteps);
+      if (check_flag(&flag,"CVodeSetMaxNumSteps",1)) return(ERR);
+      flag = CVodeSetStopTime(cvode_mem,(realtype)tout);
+      if (check_flag(&flag,"CVodeSetStopTime",1)) return(ERR);
+      flag = CVodeF(cvode_mem,tout,integrator->y,&tret,CV_NORMAL,&ncheck);
+      if ((flag == CV_TOO_MUCH_WORK) && (budget < integrator->maxNumSteps))
+      {
+        ERROR("integratorAdjointGradient","Reached the limit of %d checkpoints at t = %g, "
+          "try a shorter integration interval\n",ADJOINT_MAX_CHECKPOINTS,(double)tret);
+        return(ERR);
+      }
+      if (check_flag(&flag,"CVodeF",1)) return(ERR);
+      t = tret;
+    }
+    if (k == nSamples) break;
+    realtype* yD = NV_DATA(integrator->y);
+    for (i=0;i<nRates;i++)
+    {
+      em->states[i] = (double)(yD[i]);
+      sampleStates[k*nRates+i] = (double)(yD[i]);
+    }
+    em->computeRates(t);
+    em->evaluateVariables(t);
+    em->getOutputs(t);
+    *value += objective->sample(k,t,em->outputs,&(sampleGradients[k*nOutputs]),
+      objective->userData);
+  }
+  if (objective->integrand)
+  {
+    flag = CVodeGetQuad(cvode_mem,&tret,yQ);
+    if (check_flag(&flag,"CVodeGetQuad",1)) return(ERR);
+    *value += NV_Ith_S(yQ,0);
+  }
+
+  /* the backward problem */
+  double* jumpParameters = (double*)calloc(nParameters+1,sizeof(double));
+  realtype* jumpStates = (realtype*)calloc(nRates+1,sizeof(realtype));
+  for (i=0;i<nParameters;i++) gradient[i] = 0.0;
+  N_VConst(0.0,yB);
+  N_VConst(0.0,qB);
+  double tB = tEnd;
+  int initialised = 0, code = OK;
+  for (k=nSamples-1;(k>=-1) && (code == OK);k--)
+  {
+    double tout = (k >= 0) ? objective->sampleTimes[k] : t0;
+    if (tout < tB)
+    {
+      if (!initialised)
+      {
+        flag = CVodeCreateB(cvode_mem,
+          (simulationGetMultistepMethod(integrator->simulation) == ADAMS) ? CV_ADAMS : CV_BDF,
+          (simulationGetIterationMethod(integrator->simulation) == NEWTON) ? CV_NEWTON :
+          CV_FUNCTIONAL,&which);
+        if (check_flag(&flag,"CVodeCreateB",1)) { code = ERR; break; }
+        flag = CVodeInitB(cvode_mem,which,fB,(realtype)tB,yB);
+        if (check_flag(&flag,"CVodeInitB",1)) { code = ERR; break; }
+        /* the adjoint variables are scaled like the states they belong to */
+        if (integrator->abstol)
+          flag = CVodeSVtolerancesB(cvode_mem,which,simulationGetRTol(integrator->simulation),
+            integrator->abstol);
+        else
+          flag = CVodeSStolerancesB(cvode_mem,which,simulationGetRTol(integrator->simulation),
+            integrator->atol[0]);
+        if (check_flag(&flag,"CVodeSVtolerancesB",1)) { code = ERR; break; }
+        flag = CVodeSetUserDataB(cvode_mem,which,(void*)ws);
+        if (check_flag(&flag,"CVodeSetUserDataB",1)) { code = ERR; break; }
+        flag = CVodeSetMaxStepB(cvode_mem,which,simulationGetBvarMaxStep(integrator->simulation));
+        if (check_flag(&flag,"CVodeSetMaxStepB",1)) { code = ERR; break; }
+        if (simulationIsMaxNumStepsSet(integrator->simulation))
+        {
+          flag = CVodeSetMaxNumStepsB(cvode_mem,which,
+            simulationGetMaxNumSteps(integrator->simulation));
+          if (check_flag(&flag,"CVodeSetMaxNumStepsB",1)) { code = ERR; break; }
+        }
+        /* the dense linear solver is always used for the backward problem */
+        if (simulationGetIterationMethod(integrator->simulation) == NEWTON)
+        {
+          flag = CVDenseB(cvode_mem,which,nRates);
+          if (check_flag(&flag,"CVDenseB",1)) { code = ERR; break; }
+        }
+        flag = CVodeQuadInitB(cvode_mem,which,fQB,qB);
+        if (check_flag(&flag,"CVodeQuadInitB",1)) { code = ERR; break; }
+        /* the gradient takes the tightest of the state tolerances */
+        flag = CVodeQuadSStolerancesB(cvode_mem,which,simulationGetRTol(integrator->simulation),
+          integrator->abstol ? N_VMin(integrator->abstol) : integrator->atol[0]);
+        if (check_flag(&flag,"CVodeQuadSStolerancesB",1)) { code = ERR; break; }
+        flag = CVodeSetQuadErrConB(cvode_mem,which,TRUE);
+        if (check_flag(&flag,"CVodeSetQuadErrConB",1)) { code = ERR; break; }
+        initialised = 1;
+      }
+      else
+      {
+        flag = CVodeReInitB(cvode_mem,which,(realtype)tB,yB);
+        if (check_flag(&flag,"CVodeReInitB",1)) { code = ERR; break; }
+        flag = CVodeQuadReInitB(cvode_mem,which,qB);
+        if (check_flag(&flag,"CVodeQuadReInitB",1)) { code = ERR; break; }
+      }
+      ws->cacheValid = 0;
+      flag = CVodeB(cvode_mem,(realtype)tout,CV_NORMAL);
+      if (check_flag(&flag,"CVodeB",1)) { code = ERR; break; }
+      flag = CVodeGetB(cvode_mem,which,&tret,yB);
+      if (check_flag(&flag,"CVodeGetB",1)) { code = ERR; break; }
+      flag = CVodeGetQuadB(cvode_mem,which,&tret,qB);
+      if (check_flag(&flag,"CVodeGetQuadB",1)) { code = ERR; break; }
+      tB = tout;
+    }
+    if (k >= 0)
+    {
+      /* the jump in the adjoint variables due to the sample at tout */
+      if (adjointProducts(ws,tout,&(sampleStates[k*nRates]),NULL,&(sampleGradients[k*nOutputs]),
+          jumpStates,jumpParameters) != OK) { code = ERR; break; }
+      realtype* yBD = NV_DATA(yB);
+      for (i=0;i<nRates;i++) yBD[i] += jumpStates[i];
+      for (i=0;i<nParameters;i++) gradient[i] += jumpParameters[i];
+    }
+  }
+  if (code == OK)
+  {
+    realtype* yBD = NV_DATA(yB);
+    for (i=0;i<nParameters;i++)
+    {
+      gradient[i] += NV_Ith_S(qB,i);
+      /* the initial values depend directly on the state parameters */
+      if (parameters[i].isState) gradient[i] += yBD[parameters[i].index];
+    }
+  }
+  free(jumpParameters);
+  free(jumpStates);
+  return(code);
+}
+
+int integratorAdjointGradient(struct Integrator* integrator, double t, double tEnd,
+  const struct AdjointObjective* objective, int nParameters,
+  const struct SensitivityParameter* parameters, double* value, double* gradient)
+{
+  if (!(integrator && objective && parameters && value && gradient && (nParameters > 0) &&
+        (objective->integrand || objective->sample) && (tEnd > t)))
+  {
+    ERROR("integratorAdjointGradient","Invalid arguments\n");
+    return(ERR);
+  }
+  if (integrator->explicitIntegrator || integrator->multirateIntegrator ||
+      (integrator->nSensitivities > 0))
+  {
+    ERROR("integratorAdjointGradient","The adjoint sensitivities are only available with the "
+      "CVODE integration scheme and without the forward sensitivities\n");
+    return(ERR);
+  }
+  ExecutableModel* em = integrator->em;
+  int i, flag;
+  if (em->nRates < 1)
+  {
+    ERROR("integratorAdjointGradient","No state variables, so nothing to integrate\n");
+    return(ERR);
+  }
+  for (i=0;i<nParameters;i++)
+  {
+    int n = parameters[i].isState ? em->nRates : em->nConstants;
+    if ((parameters[i].index < 0) || (parameters[i].index >= n))
+    {
+      ERROR("integratorAdjointGradient","Invalid index for parameter %d: %d\n",i,
+        parameters[i].index);
+      return(ERR);
+    }
+  }
+  if (objective->sample && (objective->nSamples > 0) && !objective->sampleTimes)
+  {
+    ERROR("integratorAdjointGradient","Missing sample times\n");
+    return(ERR);
+  }
+
+  if (integratorReinitialise(integrator,t) != OK) return(ERR);
+  /* we can't restart the forward integration without losing the checkpoints */
+  if (integrator->nRoots > 0)
+  {
+    flag = CVodeRootInit(integrator->cvode_mem,0,NULL);
+    if (check_flag(&flag,"CVodeRootInit",1)) return(ERR);
+  }
+  integrator->adjoint = CreateAdjointWorkspace(integrator,objective,nParameters,parameters);
+  int nSamples = objective->sample ? objective->nSamples : 0;
+  double* sampleStates = (double*)calloc(nSamples*em->nRates+1,sizeof(double));
+  double* sampleGradients = (double*)calloc(nSamples*em->nOutputs+1,sizeof(double));
+  N_Vector yQ = N_VNew_Serial(1);
+  N_Vector yB = integratorNewVector(integrator,em->nRates);
+  N_Vector qB = N_VNew_Serial(nParameters);
+  int code = OK;
+  if (objective->integrand)
+  {
+    N_VConst(0.0,yQ);
+    flag = CVodeQuadInit(integrator->cvode_mem,fQ,yQ);
+    if (check_flag(&flag,"CVodeQuadInit",1)) code = ERR;
+  }
+  if (code == OK)
+  {
+    flag = CVodeAdjInit(integrator->cvode_mem,ADJOINT_CHECKPOINT_STEPS,CV_HERMITE);
+    if (check_flag(&flag,"CVodeAdjInit",1)) code = ERR;
+  }
+  if (code == OK)
+  {
+    code = integratorAdjointSolve(integrator,t,tEnd,objective,nParameters,parameters,value,
+      gradient,yQ,yB,qB,sampleStates,sampleGradients);
+    CVodeAdjFree(integrator->cvode_mem);
+  }
+  if (objective->integrand) CVodeQuadFree(integrator->cvode_mem);
+
+  /* put everything back for the normal integration, the model is at tEnd */
+  flag = CVodeSetMaxNumSteps(integrator->cvode_mem,integrator->maxNumSteps);
+  if (check_flag(&flag,"CVodeSetMaxNumSteps",1)) code = ERR;
+  if (integrator->nRoots > 0)
+  {
+    flag = CVodeRootInit(integrator->cvode_mem,integrator->nRoots,g);
+    if (check_flag(&flag,"CVodeRootInit",1)) code = ERR;
+  }
+  realtype* yD = NV_DATA(integrator->y);
+  for (i=0;i<(em->nRates);i++) em->states[i] = (double)(yD[i]);
+  em->computeRates(tEnd);
+  em->evaluateVariables(tEnd);
+  em->getOutputs(tEnd);
+  N_VDestroy(yQ);
+  N_VDestroy(yB);
+  N_VDestroy(qB);
+  free(sampleStates);
+  free(sampleGradients);
+  DestroyAdjointWorkspace(&(integrator->adjoint));
+  return(code);
+}
+
+/*
+ * Set the initial sensitivities, which are zero except for the parameters which are the initial
+ * values of state variables. The sensitivity vectors are clones of the state vector, so they may be
+ * OpenMP vectors and are only accessed through the generic interface.
+ */
+static void integratorInitialSensitivities(struct Integrator* integrator)
+{
+  int i;
+  for (i=0;i<(integrator->nSensitivities);i++)
+  {
+    N_VConst(0.0,integrator->yS[i]);
+    if (integrator->sensitivityParameters[i].isState)
+      NV_DATA(integrator->yS[i])[integrator->sensitivityParameters[i].index] = 1.0;
+  }
+}
+
+/* 
+ * Get and print some final statistics
+ */
+/* The algebraic loop (NR_MINIMISE) counters are global, so we report the change since the
+   integrator was created and only if the model has any algebraic loops */
+static void printAlgebraicLoopStats(struct Integrator* integrator)
+{
+  struct NRStatistics stats;
+  NR_getStatistics(&stats);
+  if (stats.nSolves == integrator->nrStatistics.nSolves) return;
+  printf(" Number of algebraic loop solves          = %4ld \n",
+    stats.nSolves - integrator->nrStatistics.nSolves);
+  printf(" Number of algebraic loop iterations      = %4ld \n",
+    stats.nIterations - integrator->nrStatistics.nIterations);
+  printf(" Number of algebraic loop function evals  = %4ld \n",
+    stats.nFunctionEvals - integrator->nrStatistics.nFunctionEvals);
+  printf(" Number of algebraic loop random restarts = %4ld \n",
+    stats.nRestarts - integrator->nrStatistics.nRestarts);
+  printf(" Number of algebraic loop failures        = %4ld \n\n",
+    stats.nFailures - integrator->nrStatistics.nFailures);
+}
+
+void PrintFinalStats(struct Integrator* integrator)
+{
+  void* cvode_mem = integrator->cvode_mem;
+  long int lenrw = -1, leniw = -1;
+  long int lenrwLS = -1, leniwLS = -1, nje = -1, nfeLS = -1,npe = -1,nps = -1,ncfl = -1,nli = -1;
+  int flag;
+  struct IntegratorStatistics stats;
+
+  if (integrator->explicitIntegrator)
+  {
+    integratorGetStatistics(integrator, &stats);
+    printf("\n Final integrator statistics for this run:\n");
+    printf(" (scheme: %s; max-step: %0.4le)\n",
+      integrationSchemeToString(
+        simulationGetIntegrationScheme(integrator->simulation)),
+      simulationGetBvarMaxStep(integrator->simulation));
+    printf(" Number of steps                          = %4ld \n",  stats.nSteps);
+    printf(" Number of f-s                            = %4ld \n",  stats.nRhsEvals);
+    printf(" Number of rejected steps                 = %4ld \n\n",stats.nErrTestFails);
+    printAlgebraicLoopStats(integrator);
+    return;
+  }
+  if (integrator->multirateIntegrator)
+  {
+    integratorGetStatistics(integrator, &stats);
+    printf("\n Final integrator statistics for this run:\n");
+    printf(" (scheme: %s; max-step: %0.4le; fast states: %d of %d)\n",
+      integrationSchemeToString(
+        simulationGetIntegrationScheme(integrator->simulation)),
+      simulationGetBvarMaxStep(integrator->simulation),
+      multirateIntegratorGetFastStates(integrator->multirateIntegrator,NULL),
+      integrator->em->nRates);
+    printf(" Number of macro steps                    = %4ld \n",  stats.nSteps);
+    printf(" Number of fast substeps                  = %4ld \n",  stats.nFastSteps);
+    printf(" Number of f-s                            = %4ld \n",  stats.nRhsEvals);
+    printf(" Number of setups                         = %4ld \n",  stats.nLinSolvSetups);
+    printf(" Number of nonlinear iterations           = %4ld \n",  stats.nNonlinSolvIters);
+    printf(" Number of nonlinear convergence failures = %4ld \n",  stats.nNonlinSolvConvFails);
+    printf(" Number of rejected steps                 = %4ld \n\n",stats.nErrTestFails);
+    printAlgebraicLoopStats(integrator);
+    return;
+  }
+
+  flag = CVodeGetWorkSpace(cvode_mem, &lenrw, &leniw);
+  check_flag(&flag, "CVodeGetWorkSpace", 1);
+  integratorGetStatistics(integrator, &stats);
 
   printf("\n Final integrator statistics for this run:\n");
   printf(" (MM: %s; IM: %s; LS: %s; max-step: %0.4le)\n",
@@ -519,14 +2119,21 @@ void PrintFinalStats(struct Integrator* integrator)
     simulationGetBvarMaxStep(integrator->simulation));
   printf(" CVode real workspace length              = %4ld \n", lenrw);
   printf(" CVode integer workspace length           = %4ld \n", leniw);
-  printf(" Number of steps                          = %4ld \n",  nst);
-  printf(" Number of f-s                            = %4ld \n",  nfe);
-  printf(" Number of setups                         = %4ld \n",  nsetups);
-  printf(" Number of nonlinear iterations           = %4ld \n",  nni);
-  printf(" Number of nonlinear convergence failures = %4ld \n",  ncfn);
-  printf(" Number of error test failures            = %4ld \n\n",netf);
+  printf(" Number of steps                          = %4ld \n",  stats.nSteps);
+  printf(" Number of f-s                            = %4ld \n",  stats.nRhsEvals);
+  printf(" Number of setups                         = %4ld \n",  stats.nLinSolvSetups);
+  printf(" Number of nonlinear iterations           = %4ld \n",  stats.nNonlinSolvIters);
+  printf(" Number of nonlinear convergence failures = %4ld \n",  stats.nNonlinSolvConvFails);
+  printf(" Number of error test failures            = %4ld \n",  stats.nErrTestFails);
+  printf(" Number of root function evaluations      = %4ld \n",  stats.nRootEvals);
+  printf(" Number of discontinuities located        = %4ld \n",  stats.nDiscontinuities);
+  printf(" Number of sensitivity rhs evaluations    = %4ld \n",  stats.nSensRhsEvals);
+  printf(" Number of Adams/BDF method switches      = %4ld \n\n",stats.nMethodSwitches);
+  printAlgebraicLoopStats(integrator);
 
-  if (simulationGetIterationMethod(integrator->simulation) == NEWTON)
+  /* when switching methods, the linear solver is only attached while using BDF */
+  if ((simulationGetIterationMethod(integrator->simulation) == NEWTON) &&
+      (!integrator->methodSwitching || integrator->stiff))
   {
     enum LinearSolver solver =
       simulationGetLinearSolver(integrator->simulation);
@@ -552,7 +2159,7 @@ void PrintFinalStats(struct Integrator* integrator)
       } break;
       case DIAG:
       {
-        nje = nsetups;
+        nje = stats.nLinSolvSetups;
         flag = CVDiagGetNumRhsEvals(cvode_mem, &nfeLS);
         check_flag(&flag, "CVDiagGetNumRhsEvals", 1);
         flag = CVDiagGetWorkSpace(cvode_mem, &lenrwLS, &leniwLS);
@@ -562,7 +2169,7 @@ void PrintFinalStats(struct Integrator* integrator)
       case SPBCG:
       case SPTFQMR:
       {
-        nje = nsetups;
+        nje = stats.nLinSolvSetups;
         flag = CVSpilsGetWorkSpace(cvode_mem,&lenrwLS,&leniwLS);
         check_flag(&flag, "CVSpilsGetWorkSpace", 1);
         flag = CVSpilsGetNumRhsEvals(cvode_mem, &nfeLS);
@@ -14,9 +14,125 @@ int DestroyIntegrator(struct Integrator** integrator);
 
 int integratorInitialise(struct Integrator* integrator);
 
+/* Restart the integration from the current states of the executable model at the bound variable
+   value t, reusing the existing solver memory and linear solver workspace. Much cheaper than
+   destroying and creating a new integrator. */
+int integratorReinitialise(struct Integrator* integrator, double t);
+
 /* advance in the bound variable */
 int integrate(struct Integrator* integrator, double tout, double* t);
 
+/* The callback for integratorSample, called with the model's variables and outputs at the sample
+   time t of sample k. Returns OK to carry on, anything else stops the integration there (e.g., to
+   give up on a simulation which is clearly not going to be useful). */
+typedef int (*IntegratorSampleFunction)(int k, double t, class ExecutableModel* em,
+  void* userData);
+
+/* Integrate from the executable model's current states at t through each of the sample times, which
+   must be increasing and no earlier than t, calling sample at each of them. With the CVODE
+   integration scheme the integration isn't stopped at the sample times, the values there are
+   interpolated with CVODES's dense output instead, so the samples don't limit the step sizes (the
+   other schemes, and the forward sensitivities, stop at each sample time). On return the model is at
+   the last sample time, or where the integration was stopped (returning ERR). */
+int integratorSample(struct Integrator* integrator, double t, int nSamples,
+  const double* sampleTimes, IntegratorSampleFunction sample, void* userData);
+
+/* Private structure */
+struct IntegratorSnapshot;
+
+/* Snapshot the integration at t, the time reached by the last call to integrate() (or where the
+   integrator was reinitialised): a copy of all the executable model's values, and what the
+   integrator needs to pick up from there (the step size reached and the method in use when
+   switching methods, the scaling of the absolute tolerances and any state sensitivities). CVODES
+   doesn't give access to its step history, so a continuation restarts the integration at first
+   order with that step size; it is not identical to the trajectory the integrator would have
+   followed, but agrees with it to within the tolerances. The snapshot is independent of the
+   integrator, which can carry on or be destroyed. */
+struct IntegratorSnapshot* integratorSnapshot(struct Integrator* integrator, double t);
+int DestroyIntegratorSnapshot(struct IntegratorSnapshot** snapshot);
+double integratorSnapshotTime(const struct IntegratorSnapshot* snapshot);
+
+/* Continue from a snapshot: copy the snapshot's model values into the integrator's executable
+   model, which must be an instance of the same compiled model (see ExecutableModel::clone), and
+   restart the integration from there at first order with the snapshot's step size. The integrator must be for the same simulation, and if it has
+   forward sensitivities the snapshot must have been taken with the same sensitivity parameters
+   (otherwise any sensitivities in the snapshot are ignored). The snapshot is only read, so
+   any number of integrators (e.g., on different threads) can be restored from it at the same time,
+   and the model's constants can be changed afterwards to give different continuations. */
+int integratorRestore(struct Integrator* integrator, const struct IntegratorSnapshot* snapshot);
+
+/* The integrator statistics, accumulated over any restarts of the integrator (e.g., at
+   discontinuities in the model) */
+struct IntegratorStatistics
+{
+  long int nSteps;
+  long int nRhsEvals;
+  long int nLinSolvSetups;
+  long int nNonlinSolvIters;
+  long int nNonlinSolvConvFails;
+  long int nErrTestFails;
+  long int nRootEvals;
+  long int nDiscontinuities;
+  long int nSensRhsEvals;
+  /* switches between the Adams and BDF methods (multistep method ADAMS_BDF) */
+  long int nMethodSwitches;
+  /* substeps taken by the fast state variables (MULTIRATE integration scheme) */
+  long int nFastSteps;
+};
+int integratorGetStatistics(struct Integrator* integrator,
+  struct IntegratorStatistics* stats);
+
+/* A model parameter for the forward sensitivity analysis: either one of the model's constants
+   (isState = 0) or the initial value of one of the state variables (isState = 1), with index
+   being the index into the corresponding executable model array. */
+struct SensitivityParameter
+{
+  int isState;
+  int index;
+};
+
+/* Enable the CVODES forward sensitivity analysis for the given parameters, the sensitivities of
+   the state variables are integrated along with the states from the current states of the
+   executable model. The sensitivity right hand sides are evaluated by directional differences of
+   the model's rates. Only available with the CVODE integration scheme. */
+int integratorEnableSensitivities(struct Integrator* integrator, int nParameters,
+  const struct SensitivityParameter* parameters);
+int integratorGetNumSensitivityParameters(struct Integrator* integrator);
+
+/* Get the sensitivities at the most recent output point (i.e., the last call to integrate()).
+   The state sensitivities are returned as nParameters rows of nRates values, and the output
+   sensitivities as nParameters rows of nOutputs values. */
+int integratorGetStateSensitivities(struct Integrator* integrator, double* sensitivities);
+int integratorGetOutputSensitivities(struct Integrator* integrator, double* sensitivities);
+
+/* The objective function for the adjoint sensitivity analysis, in terms of the model outputs
+     G = int g(t,outputs) dt + sum_k h_k(outputs(t_k))
+   where either part may be omitted (NULL). Each callback returns the value of its part of the
+   objective and sets gradient to the derivative with respect to the outputs (nOutputs values).
+   The sample times must be increasing. */
+struct AdjointObjective
+{
+  double (*integrand)(double t, const double* outputs, double* gradient, void* userData);
+  double (*sample)(int k, double t, const double* outputs, double* gradient, void* userData);
+  int nSamples;
+  const double* sampleTimes;
+  void* userData;
+};
+
+/* Integrate from the executable model's current states at t to tEnd and evaluate the objective
+   (value) and its gradient with respect to each of the given parameters using the CVODES adjoint
+   sensitivity analysis, i.e., for about the cost of a forward and a backward integration no matter
+   how many parameters there are. The forward solution is checkpointed every
+   ADJOINT_CHECKPOINT_STEPS steps, so only that many steps are stored in full at any time, and
+   fails once ADJOINT_MAX_CHECKPOINTS checkpoints have been stored so the memory is bounded. The
+   model's generated adjoint code is used for the vector-Jacobian products, falling back to
+   difference quotients if the model doesn't have it. On return the model is at tEnd.
+   Discontinuities are not located during the forward integration. Only available with the CVODE
+   integration scheme and without the forward sensitivities. */
+int integratorAdjointGradient(struct Integrator* integrator, double t, double tEnd,
+  const struct AdjointObjective* objective, int nParameters,
+  const struct SensitivityParameter* parameters, double* value, double* gradient);
+
 /* function to print final statistics */
 void PrintFinalStats(struct Integrator* integrator);
 
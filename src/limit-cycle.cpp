@@ -0,0 +1,242 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "linear-algebra.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "limit-cycle.hpp"
+#include "integrator.hpp"
+#include "ExecutableModel.hpp"
+
+/* Private type */
+struct LimitCycleSolver
+{
+  ExecutableModel* em;
+  int n;
+  double period;
+  double* atol;
+  struct Integrator* integrator;
+  /* created on demand for the shooting steps, with the sensitivities to all the initial states */
+  struct Integrator* shootingIntegrator;
+  /* the states at the start of the current cycle, and the candidate from a shooting step */
+  double* y0;
+  double* y1;
+  double* dy;
+  double* jacobian;
+  int* pivots;
+  /* single allocation for all the arrays above */
+  double* workspace;
+};
+
+/* the largest relative change in the states from y0 */
+static double cycleChange(struct LimitCycleSolver* solver, const double* y0, const double* y)
+{
+  double change = 0.0;
+  int i;
+  for (i=0;i<solver->n;i++)
+  {
+    double d = fabs(y[i] - y0[i]) / (fabs(y[i]) + solver->atol[i]);
+    if (!(d <= change)) change = d; /* picks up NaN */
+  }
+  return change;
+}
+
+/* integrate the executable model's states over one period from t */
+static int simulateCycle(struct LimitCycleSolver* solver, struct Integrator* integrator, double t)
+{
+  double tout;
+  if (integratorReinitialise(integrator, t) != OK) return(ERR);
+  return(integrate(integrator, t + solver->period, &tout));
+}
+
+/* One Newton shooting step on the period map P from the executable model's current states y0 at
+   t: one cycle with the sensitivities gives P(y0) and its Jacobian M, and the candidate fixed point
+   is y0 + dy with (M - I) dy = y0 - P(y0). On return the executable model's states are P(y0) and
+   *change is the change over that cycle. Returns ERR if no candidate could be computed. */
+static int shootingStep(struct LimitCycleSolver* solver, double t, double* change)
+{
+  ExecutableModel* em = solver->em;
+  int n = solver->n;
+  int i,p;
+  *change = INFINITY;
+  memcpy(solver->y0, em->states, sizeof(double)*n);
+  if (simulateCycle(solver, solver->shootingIntegrator, t) != OK) return(ERR);
+  *change = cycleChange(solver, solver->y0, em->states);
+  /* the state sensitivities are a row of n values for each initial state */
+  if (integratorGetStateSensitivities(solver->shootingIntegrator, solver->jacobian) != OK)
+    return(ERR);
+  for (i=0;i<n;i++)
+  {
+    for (p=i+1;p<n;p++)
+    {
+      double tmp = solver->jacobian[i*n+p];
+      solver->jacobian[i*n+p] = solver->jacobian[p*n+i];
+      solver->jacobian[p*n+i] = tmp;
+    }
+    solver->jacobian[i*n+i] -= 1.0;
+    solver->dy[i] = solver->y0[i] - em->states[i];
+  }
+  if (denseLUFactor(n, solver->jacobian, solver->pivots) != OK)
+  {
+    DEBUG(2,"shootingStep","Singular period map Jacobian\n");
+    return(ERR);
+  }
+  denseLUSolve(n, solver->jacobian, solver->pivots, solver->dy);
+  for (i=0;i<n;i++)
+  {
+    solver->y1[i] = solver->y0[i] + solver->dy[i];
+    if (!isfinite(solver->y1[i])) return(ERR);
+  }
+  return(OK);
+}
+
+/* create the integrator for the shooting steps, returns ERR if the sensitivities aren't available */
+static int createShootingIntegrator(struct LimitCycleSolver* solver, struct Simulation* simulation)
+{
+  int n = solver->n;
+  struct SensitivityParameter* parameters =
+    (struct SensitivityParameter*)malloc(sizeof(struct SensitivityParameter)*n);
+  int i;
+  for (i=0;i<n;i++)
+  {
+    parameters[i].isState = 1;
+    parameters[i].index = i;
+  }
+  solver->shootingIntegrator = CreateIntegrator(simulation, solver->em);
+  int code = solver->shootingIntegrator ? OK : ERR;
+  if (code == OK) code = integratorEnableSensitivities(solver->shootingIntegrator, n, parameters);
+  if ((code != OK) && solver->shootingIntegrator) DestroyIntegrator(&(solver->shootingIntegrator));
+  free(parameters);
+  return(code);
+}
+
+int limitCycleSolve(struct Simulation* simulation, class ExecutableModel* em, double t,
+  double period, int maxCycles, double tolerance, int shootingInterval, double* tEnd,
+  double* history, struct LimitCycleStatistics* stats)
+{
+  struct LimitCycleStatistics localStats;
+  if (!stats) stats = &localStats;
+  memset(stats, 0, sizeof(struct LimitCycleStatistics));
+  if (!(simulation && em && tEnd && (period > 0.0) && (maxCycles > 0) && (tolerance > 0.0)))
+  {
+    ERROR("limitCycleSolve","Invalid arguments\n");
+    return(ERR);
+  }
+  int n = em->nRates;
+  int atolLength = simulationGetATolLength(simulation);
+  if (n < 1)
+  {
+    ERROR("limitCycleSolve","No state variables, so nothing to integrate\n");
+    return(ERR);
+  }
+  if ((atolLength != 1) && (atolLength != n))
+  {
+    ERROR("limitCycleSolve","Need either one absolute tolerance or one for each of the %d state "
+      "variables, but %d were given\n",n,atolLength);
+    return(ERR);
+  }
+  struct LimitCycleSolver solver;
+  memset(&solver, 0, sizeof(struct LimitCycleSolver));
+  solver.em = em;
+  solver.n = n;
+  solver.period = period;
+  solver.workspace = (double*)malloc(sizeof(double)*((size_t)n*(n+4)));
+  solver.pivots = (int*)malloc(sizeof(int)*n);
+  solver.atol = solver.workspace;
+  solver.y0 = solver.atol + n;
+  solver.y1 = solver.y0 + n;
+  solver.dy = solver.y1 + n;
+  solver.jacobian = solver.dy + n;
+  double* atol = simulationGetATol(simulation);
+  int i;
+  for (i=0;i<n;i++) solver.atol[i] = atol[(atolLength == 1) ? 0 : i];
+  free(atol);
+  solver.integrator = CreateIntegrator(simulation, em);
+  int code = solver.integrator ? OK : ERR;
+  if ((code == OK) && (shootingInterval > 0) &&
+      (createShootingIntegrator(&solver, simulation) != OK))
+  {
+    WARNING("limitCycleSolve","Unable to use the forward sensitivities, carrying on without the "
+      "shooting steps\n");
+    shootingInterval = 0;
+  }
+  int converged = 0;
+  while ((code == OK) && !converged && (stats->nCycles < maxCycles))
+  {
+    double change;
+    if ((shootingInterval > 0) && (stats->nCycles > 0) &&
+        (stats->nCycles % shootingInterval == 0) && (stats->nCycles + 2 <= maxCycles))
+    {
+      stats->nShootingSteps++;
+      int candidate = shootingStep(&solver, t, &change);
+      if (history) history[stats->nCycles] = change;
+      stats->nCycles++;
+      t += period;
+      if (!isfinite(change))
+      {
+        code = ERR;
+        break;
+      }
+      if (change <= tolerance)
+      {
+        converged = 1;
+        break;
+      }
+      if (candidate != OK)
+      {
+        stats->nRejectedShootingSteps++;
+        continue;
+      }
+      /* try a cycle from the candidate, keeping it only if it is closer to the limit cycle */
+      memcpy(solver.dy, em->states, sizeof(double)*n);
+      memcpy(em->states, solver.y1, sizeof(double)*n);
+      double candidateChange;
+      if (simulateCycle(&solver, solver.integrator, t) == OK)
+        candidateChange = cycleChange(&solver, solver.y1, em->states);
+      else candidateChange = INFINITY;
+      if (history) history[stats->nCycles] = candidateChange;
+      stats->nCycles++;
+      t += period;
+      if (candidateChange < change)
+      {
+        converged = (candidateChange <= tolerance);
+      }
+      else
+      {
+        DEBUG(2,"limitCycleSolve","Rejected shooting step after cycle %d\n",stats->nCycles);
+        stats->nRejectedShootingSteps++;
+        memcpy(em->states, solver.dy, sizeof(double)*n);
+      }
+      continue;
+    }
+    memcpy(solver.y0, em->states, sizeof(double)*n);
+    code = simulateCycle(&solver, solver.integrator, t);
+    change = cycleChange(&solver, solver.y0, em->states);
+    if (history) history[stats->nCycles] = change;
+    stats->nCycles++;
+    t += period;
+    if (!isfinite(change)) code = ERR;
+    converged = (change <= tolerance);
+  }
+  *tEnd = t;
+  /* leave the model consistent with the final states */
+  em->computeRates(t);
+  em->evaluateVariables(t);
+  if (solver.integrator) DestroyIntegrator(&(solver.integrator));
+  if (solver.shootingIntegrator) DestroyIntegrator(&(solver.shootingIntegrator));
+  free(solver.workspace);
+  free(solver.pivots);
+  if (code != OK) ERROR("limitCycleSolve","Integration failed in cycle %d\n",stats->nCycles);
+  return((code == OK) && converged ? OK : ERR);
+}
@@ -0,0 +1,38 @@
+
+#ifndef _LIMIT_CYCLE_HPP_
+#define _LIMIT_CYCLE_HPP_
+
+/*
+ * Periodic steady state (limit cycle) detection for paced models. The model is integrated one
+ * pacing period at a time and the states at the same phase of consecutive cycles are compared,
+ * stopping as soon as the change over a cycle is small enough. Optionally the convergence can be
+ * accelerated by Newton shooting on the period map, y -> y(t + period), using the CVODES forward
+ * sensitivities with respect to the initial states to get the Jacobian of the map.
+ */
+
+/* Private structure */
+struct Simulation;
+class ExecutableModel;
+
+struct LimitCycleStatistics
+{
+  int nCycles;
+  int nShootingSteps;
+  /* the shooting steps which didn't reduce the change over a cycle, and were discarded */
+  int nRejectedShootingSteps;
+};
+
+/*
+ * Pace the executable model from its current states at the bound variable value t until the
+ * largest relative change in any state variable over one period, |dy|/(|y| + atol), is no more than
+ * tolerance, or maxCycles periods have been simulated. The change over each cycle is written to
+ * history (maxCycles entries, may be NULL). If shootingInterval is greater than zero a Newton
+ * shooting step is tried every shootingInterval cycles (requires the CVODE integration scheme).
+ * On return the executable model's states are those at the bound variable value *tEnd. Returns OK
+ * if the limit cycle was found; stats may be NULL.
+ */
+int limitCycleSolve(struct Simulation* simulation, class ExecutableModel* em, double t,
+  double period, int maxCycles, double tolerance, int shootingInterval, double* tEnd,
+  double* history, struct LimitCycleStatistics* stats);
+
+#endif /* _LIMIT_CYCLE_HPP_ */
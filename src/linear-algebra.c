@@ -0,0 +1,216 @@
+#include <math.h>
+
+#include "common.h"
+#include "linear-algebra.h"
+
+int denseLUFactor(int n, double* a, int* pivots)
+{
+  int i,j,k;
+  for (k=0;k<n;k++)
+  {
+    /* find the pivot row */
+    int p = k;
+    double max = fabs(a[k*n+k]);
+    for (i=k+1;i<n;i++)
+    {
+      if (fabs(a[i*n+k]) > max)
+      {
+        max = fabs(a[i*n+k]);
+        p = i;
+      }
+    }
+    pivots[k] = p;
+    if (max == 0.0) return(ERR);
+    if (p != k)
+    {
+      for (j=0;j<n;j++)
+      {
+        double tmp = a[k*n+j];
+        a[k*n+j] = a[p*n+j];
+        a[p*n+j] = tmp;
+      }
+    }
+    /* eliminate below the pivot, keeping the multipliers in the lower triangle */
+    double pivot = a[k*n+k];
+    for (i=k+1;i<n;i++)
+    {
+      double m = a[i*n+k] / pivot;
+      a[i*n+k] = m;
+      if (m != 0.0) for (j=k+1;j<n;j++) a[i*n+j] -= m*a[k*n+j];
+    }
+  }
+  return(OK);
+}
+
+void denseLUSolve(int n, const double* a, const int* pivots, double* b)
+{
+  int i,j;
+  /* forward substitution with the unit lower triangle, applying the row interchanges */
+  for (i=0;i<n;i++)
+  {
+    if (pivots[i] != i)
+    {
+      double tmp = b[i];
+      b[i] = b[pivots[i]];
+      b[pivots[i]] = tmp;
+    }
+  }
+  for (i=1;i<n;i++)
+  {
+    double sum = b[i];
+    for (j=0;j<i;j++) sum -= a[i*n+j]*b[j];
+    b[i] = sum;
+  }
+  /* back substitution with the upper triangle */
+  for (i=n-1;i>=0;i--)
+  {
+    double sum = b[i];
+    for (j=i+1;j<n;j++) sum -= a[i*n+j]*b[j];
+    b[i] = sum / a[i*n+i];
+  }
+}
+
+int denseLUFactorBatch(int n, int width, double* a, int* pivots, int* singular)
+{
+  int i,j,k,l;
+  int code = OK;
+  for (l=0;l<width;l++) singular[l] = 0;
+  for (k=0;k<n;k++)
+  {
+    /* find the pivot row and swap it into place, separately for each system */
+    for (l=0;l<width;l++)
+    {
+      int p = k;
+      double max = fabs(a[(k*n+k)*width+l]);
+      for (i=k+1;i<n;i++)
+      {
+        if (fabs(a[(i*n+k)*width+l]) > max)
+        {
+          max = fabs(a[(i*n+k)*width+l]);
+          p = i;
+        }
+      }
+      pivots[k*width+l] = p;
+      if (!(max > 0.0))
+      {
+        /* carry on with the other systems */
+        singular[l] = 1;
+        a[(k*n+k)*width+l] = 1.0;
+        code = ERR;
+      }
+      if (p != k)
+      {
+        for (j=0;j<n;j++)
+        {
+          double tmp = a[(k*n+j)*width+l];
+          a[(k*n+j)*width+l] = a[(p*n+j)*width+l];
+          a[(p*n+j)*width+l] = tmp;
+        }
+      }
+    }
+    /* eliminate below the pivots, keeping the multipliers in the lower triangle */
+    for (i=k+1;i<n;i++)
+    {
+      double* m = a + (i*n+k)*width;
+      const double* pivot = a + (k*n+k)*width;
+      for (l=0;l<width;l++) m[l] /= pivot[l];
+      for (j=k+1;j<n;j++)
+      {
+        double* aij = a + (i*n+j)*width;
+        const double* akj = a + (k*n+j)*width;
+        for (l=0;l<width;l++) aij[l] -= m[l]*akj[l];
+      }
+    }
+  }
+  return(code);
+}
+
+void denseLUSolveBatch(int n, int width, const double* a, const int* pivots, double* b)
+{
+  int i,j,l;
+  /* forward substitution with the unit lower triangle, applying the row interchanges */
+  for (i=0;i<n;i++)
+  {
+    for (l=0;l<width;l++)
+    {
+      int p = pivots[i*width+l];
+      if (p != i)
+      {
+        double tmp = b[i*width+l];
+        b[i*width+l] = b[p*width+l];
+        b[p*width+l] = tmp;
+      }
+    }
+  }
+  for (i=1;i<n;i++)
+    for (j=0;j<i;j++)
+    {
+      const double* aij = a + (i*n+j)*width;
+      for (l=0;l<width;l++) b[i*width+l] -= aij[l]*b[j*width+l];
+    }
+  /* back substitution with the upper triangle */
+  for (i=n-1;i>=0;i--)
+  {
+    for (j=i+1;j<n;j++)
+    {
+      const double* aij = a + (i*n+j)*width;
+      for (l=0;l<width;l++) b[i*width+l] -= aij[l]*b[j*width+l];
+    }
+    const double* aii = a + (i*n+i)*width;
+    for (l=0;l<width;l++) b[i*width+l] /= aii[l];
+  }
+}
+
+int denseSymmetricEigen(int n, double* a, double* eigenvalues, double* eigenvectors)
+{
+  int i,j,k,sweep;
+  for (i=0;i<n;i++)
+    for (j=0;j<n;j++) eigenvectors[i*n+j] = (i == j) ? 1.0 : 0.0;
+  /* cyclic Jacobi, each rotation zeroing one off-diagonal element */
+  for (sweep=0;sweep<LINEAR_ALGEBRA_MAX_JACOBI_SWEEPS;sweep++)
+  {
+    double off = 0.0, diagonal = 0.0;
+    for (i=0;i<n;i++)
+    {
+      diagonal += a[i*n+i]*a[i*n+i];
+      for (j=i+1;j<n;j++) off += a[i*n+j]*a[i*n+j];
+    }
+    if (off <= 1.0e-30*diagonal)
+    {
+      for (i=0;i<n;i++) eigenvalues[i] = a[i*n+i];
+      return(OK);
+    }
+    for (i=0;i<n-1;i++)
+    {
+      for (j=i+1;j<n;j++)
+      {
+        if (a[i*n+j] == 0.0) continue;
+        double theta = (a[j*n+j] - a[i*n+i]) / (2.0*a[i*n+j]);
+        double t = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta*theta + 1.0));
+        double c = 1.0 / sqrt(t*t + 1.0);
+        double s = t*c;
+        for (k=0;k<n;k++)
+        {
+          /* columns i and j, then rows i and j */
+          double aki = a[k*n+i], akj = a[k*n+j];
+          a[k*n+i] = c*aki - s*akj;
+          a[k*n+j] = s*aki + c*akj;
+        }
+        for (k=0;k<n;k++)
+        {
+          double aik = a[i*n+k], ajk = a[j*n+k];
+          a[i*n+k] = c*aik - s*ajk;
+          a[j*n+k] = s*aik + c*ajk;
+        }
+        for (k=0;k<n;k++)
+        {
+          double vki = eigenvectors[k*n+i], vkj = eigenvectors[k*n+j];
+          eigenvectors[k*n+i] = c*vki - s*vkj;
+          eigenvectors[k*n+j] = s*vki + c*vkj;
+        }
+      }
+    }
+  }
+  for (i=0;i<n;i++) eigenvalues[i] = a[i*n+i];
+  return(ERR);
+}
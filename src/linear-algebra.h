@@ -0,0 +1,35 @@
+
+#ifndef _LINEAR_ALGEBRA_H_
+#define _LINEAR_ALGEBRA_H_
+
+/*
+ * Small dense linear algebra routines for the solvers which work directly on the executable
+ * model's arrays. Matrices are stored row-major, with element (i,j) of an n by n matrix at
+ * a[i*n+j].
+ */
+
+/* LU factorisation with partial pivoting of the n by n matrix a, in place. The row interchanges
+   are recorded in pivots (length n). Returns ERR if the matrix is singular. */
+int denseLUFactor(int n, double* a, int* pivots);
+
+/* Solve the system a x = b using the LU factors from denseLUFactor, overwriting b with x */
+void denseLUSolve(int n, const double* a, const int* pivots, double* b);
+
+/* The batched versions work on width independent n by n systems at once (e.g., one for each lane of
+   a model batch), interleaved so that the innermost loops run across the systems: element (i,j) of
+   system l is a[(i*n+j)*width+l], element i of its vector is b[i*width+l] and its row interchanges
+   are pivots[k*width+l]. Each system is pivoted independently, and singular (length width) is set
+   to 1 for each singular system (whose factors are then meaningless) and 0 for the others. Returns
+   ERR if any of the systems are singular. */
+int denseLUFactorBatch(int n, int width, double* a, int* pivots, int* singular);
+void denseLUSolveBatch(int n, int width, const double* a, const int* pivots, double* b);
+
+/* The most sweeps of the Jacobi eigenvalue iteration */
+#define LINEAR_ALGEBRA_MAX_JACOBI_SWEEPS 50
+
+/* The eigenvalues and eigenvectors of the n by n symmetric matrix a, which is overwritten, by the
+   cyclic Jacobi method (for small matrices). Eigenvector j is column j of eigenvectors, with
+   eigenvalue eigenvalues[j]. Returns ERR if the iteration doesn't converge. */
+int denseSymmetricEigen(int n, double* a, double* eigenvalues, double* eigenvectors);
+
+#endif /* _LINEAR_ALGEBRA_H_ */
@@ -0,0 +1,635 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include <algorithm>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "linear-algebra.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "integrator.hpp"
+#include "multirate.hpp"
+#include "ExecutableModel.hpp"
+
+/* The time scales of the fast and slow states must differ by at least this factor for the
+   automatic partition, otherwise all the state variables are treated as fast */
+#define MR_MIN_TIMESCALE_SEPARATION 100.0
+/* The diagonal coefficient of the two stage, second order, L-stable SDIRK method (Alexander) */
+#define MR_GAMMA (1.0 - 0.70710678118654752440)
+/* The modified Newton iteration for the implicit stages */
+#define MR_NEWTON_MAX_ITERATIONS 5
+#define MR_NEWTON_TOL 0.05
+#define MR_NEWTON_MAX_RATE 0.9
+/* Limits on the change in the step sizes */
+#define MR_SAFETY 0.9
+#define MR_MIN_FACTOR 0.2
+#define MR_MAX_FACTOR 5.0
+/* the fast substep size is kept unless it can grow by more than this factor, to save factoring the
+   iteration matrix again */
+#define MR_HOLD_FACTOR 1.2
+/* the step size is reduced by this factor when the fast states can't be advanced */
+#define MR_FAILURE_FACTOR 0.25
+
+/* Private type */
+struct MultirateIntegrator
+{
+  ExecutableModel* em;
+  int n;
+  int nFast;
+  int nSlow;
+  /* the indices of the fast and slow state variables */
+  int* fast;
+  int* slow;
+  double t;
+  /* the next macro step size and fast substep size to try */
+  double H;
+  double h;
+  double maxStep;
+  double rtol;
+  double* atol;
+  /* the states at t and the rates there (when haveRates is set) */
+  double* y;
+  double* f0;
+  int haveRates;
+  /* the candidate states at the end of the macro step and the rates at the predicted end point */
+  double* y1;
+  double* f1;
+  /* the fast states during the substeps: at the start of the substep, the stage values and their
+     rates, and the Newton corrections and error estimate */
+  double* u;
+  double* U1;
+  double* U2;
+  double* k1;
+  double* k2;
+  double* v;
+  double* r;
+  /* the Jacobian of the fast rates with respect to the fast states, and the LU factors of the
+     iteration matrix I - h*gamma*J for the step size factoredStep */
+  double* jacobian;
+  double* iterationMatrix;
+  int* pivots;
+  int haveJacobian;
+  int jacobianCurrent;
+  double factoredStep;
+  /* single allocations for the arrays above */
+  double* workspace;
+  int* indices;
+  struct IntegratorStatistics stats;
+};
+
+/* evaluate the rates at (t,y) into f, leaving the executable model's states at y */
+static void evaluateRates(struct MultirateIntegrator* integrator, double t, const double* y,
+  double* f)
+{
+  ExecutableModel* em = integrator->em;
+  memcpy(em->states, y, sizeof(double)*integrator->n);
+  em->computeRates(t);
+  memcpy(f, em->rates, sizeof(double)*integrator->n);
+  integrator->stats.nRhsEvals++;
+}
+
+/* evaluate the rates of the fast states u at tau within the current macro step, with the slow
+   states following their predictor y + (tau - t) f0 */
+static void fastRates(struct MultirateIntegrator* integrator, double tau, const double* u,
+  double* k)
+{
+  ExecutableModel* em = integrator->em;
+  double dt = tau - integrator->t;
+  int i;
+  for (i=0;i<integrator->nSlow;i++)
+  {
+    int s = integrator->slow[i];
+    em->states[s] = integrator->y[s] + dt*integrator->f0[s];
+  }
+  for (i=0;i<integrator->nFast;i++) em->states[integrator->fast[i]] = u[i];
+  em->computeRates(tau);
+  for (i=0;i<integrator->nFast;i++) k[i] = em->rates[integrator->fast[i]];
+  integrator->stats.nRhsEvals++;
+}
+
+/* the weighted RMS norm of v over the given states (indices into the full state vector) */
+static double weightedNorm(struct MultirateIntegrator* integrator, int n, const int* states,
+  const double* v, const double* y1, const double* y2)
+{
+  if (n < 1) return(0.0);
+  double sum = 0.0;
+  int i;
+  for (i=0;i<n;i++)
+  {
+    double scale = integrator->atol[states[i]] + integrator->rtol*fmax(fabs(y1[i]),fabs(y2[i]));
+    double e = v[i] / scale;
+    sum += e*e;
+  }
+  return sqrt(sum / n);
+}
+
+/* the norm used for the slow states, which are stored in the full state vectors */
+static double slowNorm(struct MultirateIntegrator* integrator, const double* v, const double* y1,
+  const double* y2)
+{
+  double sum = 0.0;
+  int i;
+  for (i=0;i<integrator->nSlow;i++)
+  {
+    int s = integrator->slow[i];
+    double scale = integrator->atol[s] + integrator->rtol*fmax(fabs(y1[s]),fabs(y2[s]));
+    double e = v[s] / scale;
+    sum += e*e;
+  }
+  return (integrator->nSlow > 0) ? sqrt(sum / integrator->nSlow) : 0.0;
+}
+
+/* The time scale of each state variable, 1/|df_i/dy_i|, from difference quotients at (t,y) */
+static void estimateTimescales(struct MultirateIntegrator* integrator, double t, double* timescales)
+{
+  int n = integrator->n;
+  double* y = integrator->y1;
+  double* f = integrator->f1;
+  double srur = sqrt(DBL_EPSILON);
+  int j;
+  memcpy(y, integrator->y, sizeof(double)*n);
+  evaluateRates(integrator, t, y, integrator->f0);
+  for (j=0;j<n;j++)
+  {
+    double inc = srur*fmax(fabs(y[j]), integrator->atol[j]/fmax(integrator->rtol,DBL_EPSILON));
+    y[j] += inc;
+    evaluateRates(integrator, t, y, f);
+    y[j] = integrator->y[j];
+    double diagonal = (f[j] - integrator->f0[j]) / inc;
+    timescales[j] = (isfinite(diagonal) && (diagonal != 0.0)) ? 1.0/fabs(diagonal) : INFINITY;
+  }
+  /* leave the model at the initial states */
+  evaluateRates(integrator, t, integrator->y, integrator->f0);
+  integrator->haveRates = 1;
+}
+
+/* Split the state variables at the largest gap in their time scales, returns the number of fast
+   states with isFast set for each of them */
+static int partitionStates(struct MultirateIntegrator* integrator, double t, int* isFast)
+{
+  int n = integrator->n;
+  std::vector<double> timescales(n);
+  estimateTimescales(integrator, t, &(timescales[0]));
+  std::vector<double> sorted;
+  int i;
+  for (i=0;i<n;i++) if (isfinite(timescales[i])) sorted.push_back(timescales[i]);
+  std::sort(sorted.begin(), sorted.end());
+  double split = INFINITY, largestGap = 0.0;
+  size_t k;
+  for (k=1;k<sorted.size();k++)
+  {
+    double gap = sorted[k] / sorted[k-1];
+    if (gap > largestGap)
+    {
+      largestGap = gap;
+      split = sqrt(sorted[k]*sorted[k-1]);
+    }
+  }
+  if (largestGap < MR_MIN_TIMESCALE_SEPARATION)
+  {
+    DEBUG(1,"partitionStates","No clear separation of the time scales (largest ratio %g), "
+      "integrating all the state variables as fast states\n",largestGap);
+    split = INFINITY;
+  }
+  int nFast = 0;
+  for (i=0;i<n;i++)
+  {
+    /* state variables which don't depend on themselves at all are left with the slow states */
+    isFast[i] = (timescales[i] < split);
+    if (isFast[i]) nFast++;
+  }
+  DEBUG(1,"partitionStates","%d fast and %d slow state variables (split at a time scale of %g)\n",
+    nFast,n-nFast,split);
+  return(nFast);
+}
+
+struct MultirateIntegrator* CreateMultirateIntegrator(struct Simulation* simulation,
+  class ExecutableModel* em)
+{
+  if (!(simulation && em))
+  {
+    ERROR("CreateMultirateIntegrator","Invalid arguments when creating integrator\n");
+    return((struct MultirateIntegrator*)NULL);
+  }
+  int n = em->nRates;
+  int atolLength = simulationGetATolLength(simulation);
+  if ((atolLength != 1) && (atolLength != n))
+  {
+    ERROR("CreateMultirateIntegrator","Need either one absolute tolerance or one for each of the "
+      "%d state variables, but %d were given\n",n,atolLength);
+    return((struct MultirateIntegrator*)NULL);
+  }
+  int nGiven = simulationGetFastStatesLength(simulation);
+  int* given = simulationGetFastStates(simulation);
+  int i;
+  for (i=0;i<nGiven;i++)
+  {
+    if ((given[i] < 0) || (given[i] >= n))
+    {
+      ERROR("CreateMultirateIntegrator","Invalid fast state variable index: %d\n",given[i]);
+      free(given);
+      return((struct MultirateIntegrator*)NULL);
+    }
+  }
+  struct MultirateIntegrator* integrator =
+    (struct MultirateIntegrator*)malloc(sizeof(struct MultirateIntegrator));
+  memset(integrator, 0, sizeof(struct MultirateIntegrator));
+  integrator->em = em;
+  integrator->n = n;
+  /* all the vectors are allocated for the full number of states, which also covers the fast
+     states whatever the partition turns out to be */
+  integrator->workspace = (double*)calloc((size_t)n*(12 + 2*n) + 1,sizeof(double));
+  integrator->atol = integrator->workspace;
+  integrator->y = integrator->atol + n;
+  integrator->f0 = integrator->y + n;
+  integrator->y1 = integrator->f0 + n;
+  integrator->f1 = integrator->y1 + n;
+  integrator->u = integrator->f1 + n;
+  integrator->U1 = integrator->u + n;
+  integrator->U2 = integrator->U1 + n;
+  integrator->k1 = integrator->U2 + n;
+  integrator->k2 = integrator->k1 + n;
+  integrator->v = integrator->k2 + n;
+  integrator->r = integrator->v + n;
+  integrator->jacobian = integrator->r + n;
+  integrator->iterationMatrix = integrator->jacobian + (size_t)n*n;
+  integrator->indices = (int*)calloc(3*n + 1,sizeof(int));
+  integrator->fast = integrator->indices;
+  integrator->slow = integrator->fast + n;
+  integrator->pivots = integrator->slow + n;
+
+  if (simulationIsBvarMaxStepSet(simulation))
+    integrator->maxStep = simulationGetBvarMaxStep(simulation);
+  else integrator->maxStep = simulationGetBvarTabStep(simulation);
+  integrator->rtol = simulationGetRTol(simulation);
+  double* atol = simulationGetATol(simulation);
+  enum ToleranceScaling scaling = simulationGetATolScaling(simulation);
+  for (i=0;i<n;i++)
+  {
+    double tol = atol[(atolLength == 1) ? 0 : i];
+    if ((scaling != NO_SCALING) && (fabs(em->states[i]) > 0.0)) tol *= fabs(em->states[i]);
+    integrator->atol[i] = tol;
+  }
+  free(atol);
+  memcpy(integrator->y, em->states, sizeof(double)*n);
+
+  /* the partition, as given or from the time scales at the start */
+  std::vector<int> isFast(n > 0 ? n : 1, 0);
+  if (nGiven > 0) for (i=0;i<nGiven;i++) isFast[given[i]] = 1;
+  else if (n > 0) partitionStates(integrator, simulationGetBvarStart(simulation), &(isFast[0]));
+  if (given) free(given);
+  for (i=0;i<n;i++)
+  {
+    if (isFast[i]) integrator->fast[integrator->nFast++] = i;
+    else integrator->slow[integrator->nSlow++] = i;
+  }
+
+  multirateIntegratorReinitialise(integrator,simulationGetBvarStart(simulation));
+  return(integrator);
+}
+
+int DestroyMultirateIntegrator(struct MultirateIntegrator** integrator)
+{
+  struct MultirateIntegrator* intg = *integrator;
+  if (intg)
+  {
+    if (intg->workspace) free(intg->workspace);
+    if (intg->indices) free(intg->indices);
+    free(intg);
+  }
+  *integrator = NULL;
+  return(OK);
+}
+
+/* an initial step size for the given states (Hairer, Norsett and Wanner, Solving Ordinary
+   Differential Equations I, section II.4) */
+static double initialStep(struct MultirateIntegrator* integrator, int n, const int* states)
+{
+  double d0 = 0.0, d1 = 0.0;
+  int i;
+  for (i=0;i<n;i++)
+  {
+    int s = states[i];
+    double scale = integrator->atol[s] + integrator->rtol*fabs(integrator->y[s]);
+    d0 += (integrator->y[s]/scale)*(integrator->y[s]/scale);
+    d1 += (integrator->f0[s]/scale)*(integrator->f0[s]/scale);
+  }
+  if (n > 0)
+  {
+    d0 = sqrt(d0 / n);
+    d1 = sqrt(d1 / n);
+  }
+  double h0 = ((d0 < 1.0e-5) || (d1 < 1.0e-5)) ? 1.0e-6 : 0.01*d0/d1;
+  return(fmin(h0, integrator->maxStep));
+}
+
+int multirateIntegratorReinitialise(struct MultirateIntegrator* integrator, double t)
+{
+  if (!integrator) return(ERR);
+  memcpy(integrator->y,integrator->em->states,sizeof(double)*integrator->n);
+  integrator->t = t;
+  integrator->haveJacobian = 0;
+  integrator->jacobianCurrent = 0;
+  integrator->factoredStep = 0.0;
+  memset(&(integrator->stats),0,sizeof(struct IntegratorStatistics));
+  integrator->H = integrator->maxStep;
+  integrator->h = integrator->maxStep;
+  integrator->haveRates = 0;
+  if (integrator->n > 0)
+  {
+    evaluateRates(integrator,t,integrator->y,integrator->f0);
+    integrator->haveRates = 1;
+    /* with no slow states the macro steps just set the output points for the fast states */
+    if (integrator->nSlow > 0)
+      integrator->H = initialStep(integrator,integrator->nSlow,integrator->slow);
+    integrator->h = initialStep(integrator,integrator->nFast,integrator->fast);
+  }
+  return(OK);
+}
+
+/* the Jacobian of the fast rates k at (tau,u) with respect to the fast states */
+static void fastJacobian(struct MultirateIntegrator* integrator, double tau, const double* u,
+  const double* k)
+{
+  int nf = integrator->nFast;
+  double* up = integrator->v;
+  double* kp = integrator->r;
+  double srur = sqrt(DBL_EPSILON);
+  int i,j;
+  memcpy(up, u, sizeof(double)*nf);
+  for (j=0;j<nf;j++)
+  {
+    double atol = integrator->atol[integrator->fast[j]];
+    double inc = srur*fmax(fabs(u[j]), atol/fmax(integrator->rtol,DBL_EPSILON));
+    up[j] = u[j] + inc;
+    fastRates(integrator, tau, up, kp);
+    up[j] = u[j];
+    for (i=0;i<nf;i++) integrator->jacobian[i*nf+j] = (kp[i] - k[i]) / inc;
+  }
+  integrator->haveJacobian = 1;
+  integrator->jacobianCurrent = 1;
+  integrator->factoredStep = 0.0;
+}
+
+/* factor the iteration matrix I - hg*J, returns ERR if it is singular */
+static int factorIterationMatrix(struct MultirateIntegrator* integrator, double hg)
+{
+  int nf = integrator->nFast;
+  int i;
+  for (i=0;i<nf*nf;i++) integrator->iterationMatrix[i] = -hg*integrator->jacobian[i];
+  for (i=0;i<nf;i++) integrator->iterationMatrix[i*nf+i] += 1.0;
+  integrator->stats.nLinSolvSetups++;
+  if (denseLUFactor(nf, integrator->iterationMatrix, integrator->pivots) != OK)
+  {
+    integrator->factoredStep = 0.0;
+    return(ERR);
+  }
+  integrator->factoredStep = hg;
+  return(OK);
+}
+
+/* Solve the stage equation U = v + hg F(tau,U) by modified Newton iteration from the initial
+   guess in U, setting k to the rates at the solution. Returns ERR if the iteration fails. */
+static int solveStage(struct MultirateIntegrator* integrator, double tau, double hg,
+  const double* v, double* U, double* k)
+{
+  int nf = integrator->nFast;
+  double* r = integrator->r;
+  double previousNorm = 0.0;
+  int i,iteration;
+  for (iteration=0;iteration<MR_NEWTON_MAX_ITERATIONS;iteration++)
+  {
+    fastRates(integrator, tau, U, k);
+    for (i=0;i<nf;i++) r[i] = v[i] + hg*k[i] - U[i];
+    denseLUSolve(nf, integrator->iterationMatrix, integrator->pivots, r);
+    for (i=0;i<nf;i++) U[i] += r[i];
+    integrator->stats.nNonlinSolvIters++;
+    double norm = weightedNorm(integrator, nf, integrator->fast, r, U, v);
+    if (!isfinite(norm)) break;
+    if ((iteration > 0) && (norm > MR_NEWTON_MAX_RATE*previousNorm)) break;
+    if (norm <= MR_NEWTON_TOL)
+    {
+      /* the rates consistent with the converged stage value */
+      for (i=0;i<nf;i++) k[i] = (U[i] - v[i]) / hg;
+      return(OK);
+    }
+    previousNorm = norm;
+  }
+  integrator->stats.nNonlinSolvConvFails++;
+  return(ERR);
+}
+
+/* One SDIRK substep of size h for the fast states from (ts,u), the new fast states are left in U2.
+   Returns the weighted norm of the error estimate, or a negative value if the implicit stages
+   couldn't be solved. */
+static double sdirkStep(struct MultirateIntegrator* integrator, double ts, double h)
+{
+  int nf = integrator->nFast;
+  double hg = MR_GAMMA*h;
+  double* u = integrator->u;
+  double* U1 = integrator->U1;
+  double* U2 = integrator->U2;
+  double* k1 = integrator->k1;
+  double* k2 = integrator->k2;
+  int i;
+  if ((integrator->factoredStep != hg) && (factorIterationMatrix(integrator, hg) != OK))
+    return(-1.0);
+  memcpy(U1, u, sizeof(double)*nf);
+  if (solveStage(integrator, ts + hg, hg, u, U1, k1) != OK) return(-1.0);
+  /* the second stage starts from the first stage value extrapolated to the end of the step */
+  double* v2 = integrator->v;
+  for (i=0;i<nf;i++)
+  {
+    v2[i] = u[i] + (1.0 - MR_GAMMA)*h*k1[i];
+    U2[i] = v2[i] + hg*k1[i];
+  }
+  if (solveStage(integrator, ts + h, hg, v2, U2, k2) != OK) return(-1.0);
+  /* the difference from the embedded first order solution, u + h k1, filtered through the
+     iteration matrix so that it stays bounded for the very stiff components */
+  double* e = integrator->r;
+  for (i=0;i<nf;i++) e[i] = hg*(k2[i] - k1[i]);
+  denseLUSolve(nf, integrator->iterationMatrix, integrator->pivots, e);
+  double norm = weightedNorm(integrator, nf, integrator->fast, e, u, U2);
+  return(isfinite(norm) ? norm : -1.0);
+}
+
+/* Integrate the fast states in u from the start of the macro step over H, with the slow states
+   following their predictor. */
+static int integrateFast(struct MultirateIntegrator* integrator, double H)
+{
+  double ts = integrator->t;
+  double tEnd = integrator->t + H;
+  double tol = 1.0e-12*fmax(1.0,fabs(tEnd));
+  int nf = integrator->nFast;
+  double h = fmin(integrator->h, H);
+  while ((tEnd - ts) > tol)
+  {
+    int last = 0;
+    double step = h;
+    if ((ts + step) >= (tEnd - tol))
+    {
+      step = tEnd - ts;
+      last = 1;
+    }
+    if (!integrator->haveJacobian)
+    {
+      fastRates(integrator, ts, integrator->u, integrator->k1);
+      fastJacobian(integrator, ts, integrator->u, integrator->k1);
+    }
+    double err = sdirkStep(integrator, ts, step);
+    double factor;
+    if (err < 0.0)
+    {
+      /* try again with a fresh Jacobian before cutting the step */
+      if (!integrator->jacobianCurrent)
+      {
+        integrator->haveJacobian = 0;
+        continue;
+      }
+      factor = MR_FAILURE_FACTOR;
+    }
+    else
+    {
+      factor = (err > 0.0) ? MR_SAFETY*pow(err,-0.5) : MR_MAX_FACTOR;
+      if (err <= 1.0)
+      {
+        memcpy(integrator->u, integrator->U2, sizeof(double)*nf);
+        ts = last ? tEnd : (ts + step);
+        integrator->stats.nFastSteps++;
+        integrator->jacobianCurrent = 0;
+        if (factor > MR_MAX_FACTOR) factor = MR_MAX_FACTOR;
+        if ((factor >= 1.0) && (factor < MR_HOLD_FACTOR)) factor = 1.0;
+        /* don't let the truncated last step limit the next step */
+        if (last && (step*factor < h)) factor = h/step;
+      }
+      else
+      {
+        integrator->stats.nErrTestFails++;
+        if (factor < MR_MIN_FACTOR) factor = MR_MIN_FACTOR;
+      }
+    }
+    h = step*factor;
+    if (h < 1.0e-14*fmax(1.0,fabs(ts)))
+    {
+      DEBUG(1,"integrateFast","Fast step size too small at t = " REAL_FORMAT "\n",ts);
+      return(ERR);
+    }
+  }
+  integrator->h = h;
+  return(OK);
+}
+
+/* One macro step of size H from (t,y), the candidate solution is left in y1. Returns the weighted
+   norm of the error estimate for the slow states, or a negative value if the fast states couldn't
+   be integrated over the macro step. */
+static double macroStep(struct MultirateIntegrator* integrator, double H)
+{
+  int n = integrator->n;
+  double* y = integrator->y;
+  double* y1 = integrator->y1;
+  double* f0 = integrator->f0;
+  double* f1 = integrator->f1;
+  int i;
+  if (!integrator->haveRates)
+  {
+    evaluateRates(integrator, integrator->t, y, f0);
+    integrator->haveRates = 1;
+  }
+  for (i=0;i<integrator->nFast;i++) integrator->u[i] = y[integrator->fast[i]];
+  if ((integrator->nFast > 0) && (integrateFast(integrator, H) != OK)) return(-1.0);
+  /* the Euler predictor for the slow states and the fast states at the end of the macro step */
+  for (i=0;i<n;i++) y1[i] = y[i] + H*f0[i];
+  for (i=0;i<integrator->nFast;i++) y1[integrator->fast[i]] = integrator->u[i];
+  if (integrator->nSlow < 1) return(0.0);
+  /* Heun's method for the slow states, with the difference from the predictor as the error */
+  evaluateRates(integrator, integrator->t + H, y1, f1);
+  for (i=0;i<integrator->nSlow;i++)
+  {
+    int s = integrator->slow[i];
+    double corrected = y[s] + 0.5*H*(f0[s] + f1[s]);
+    f1[s] = corrected - y1[s];
+    y1[s] = corrected;
+  }
+  double norm = slowNorm(integrator, f1, y, y1);
+  return(isfinite(norm) ? norm : -1.0);
+}
+
+int multirateIntegrate(struct MultirateIntegrator* integrator, double tout, double* t)
+{
+  double tol = 1.0e-12*fmax(1.0,fabs(tout));
+  while ((tout - integrator->t) > tol)
+  {
+    double H = integrator->H;
+    int last = 0;
+    if ((integrator->t + H) >= (tout - tol))
+    {
+      H = tout - integrator->t;
+      last = 1;
+    }
+    double err = macroStep(integrator, H);
+    double factor;
+    if (err < 0.0) factor = MR_FAILURE_FACTOR;
+    else
+    {
+      factor = (err > 0.0) ? MR_SAFETY*pow(err,-0.5) : MR_MAX_FACTOR;
+      if (err <= 1.0)
+      {
+        memcpy(integrator->y, integrator->y1, sizeof(double)*integrator->n);
+        integrator->t = last ? tout : (integrator->t + H);
+        integrator->haveRates = 0;
+        integrator->stats.nSteps++;
+        if (factor > MR_MAX_FACTOR) factor = MR_MAX_FACTOR;
+        /* don't let the truncated last step limit the next step */
+        if (last && (H*factor < integrator->H)) factor = integrator->H/H;
+      }
+      else
+      {
+        integrator->stats.nErrTestFails++;
+        if (factor < MR_MIN_FACTOR) factor = MR_MIN_FACTOR;
+      }
+    }
+    integrator->H = H*factor;
+    if (integrator->H > integrator->maxStep) integrator->H = integrator->maxStep;
+    if (integrator->H < 1.0e-14*fmax(1.0,fabs(integrator->t)))
+    {
+      ERROR("multirateIntegrate","Step size too small at t = " REAL_FORMAT "\n",integrator->t);
+      *t = integrator->t;
+      return(ERR);
+    }
+  }
+  /* make sure the executable model is consistent with the solution at t */
+  if (!integrator->haveRates ||
+      (memcmp(integrator->em->states,integrator->y,sizeof(double)*integrator->n) != 0))
+  {
+    evaluateRates(integrator,integrator->t,integrator->y,integrator->f0);
+    integrator->haveRates = 1;
+  }
+  *t = integrator->t;
+  return(OK);
+}
+
+int multirateIntegratorGetStatistics(struct MultirateIntegrator* integrator,
+  struct IntegratorStatistics* stats)
+{
+  if (!(integrator && stats)) return(ERR);
+  memcpy(stats,&(integrator->stats),sizeof(struct IntegratorStatistics));
+  return(OK);
+}
+
+int multirateIntegratorGetFastStates(struct MultirateIntegrator* integrator, int* fast)
+{
+  if (!integrator) return(-1);
+  if (fast) memcpy(fast, integrator->fast, sizeof(int)*integrator->nFast);
+  return(integrator->nFast);
+}
@@ -0,0 +1,41 @@
+
+#ifndef _MULTIRATE_HPP_
+#define _MULTIRATE_HPP_
+
+/*
+ * Multirate integration for models coupling fast and slow processes (the MULTIRATE integration
+ * scheme). The state variables are partitioned into fast and slow states, either as given in the
+ * simulation (simulationSetFastStates) or by splitting the time scales estimated from the diagonal
+ * of the Jacobian at the largest gap. Each macro step advances the slow states explicitly (Heun's
+ * method, with the step size controlled by the difference from the Euler predictor) while the fast
+ * states are integrated over the macro step with adaptive substeps of an L-stable two stage SDIRK
+ * method, seeing the slow states move along their predictor. Only the fast block of the Jacobian is
+ * needed for the implicit stages. Used by the main integrator (integrator.hpp), it is not expected
+ * to be used directly.
+ */
+
+/* Private structure */
+struct Simulation;
+struct MultirateIntegrator;
+struct IntegratorStatistics;
+class ExecutableModel;
+
+struct MultirateIntegrator* CreateMultirateIntegrator(struct Simulation* simulation,
+  class ExecutableModel* em);
+int DestroyMultirateIntegrator(struct MultirateIntegrator** integrator);
+
+/* restart the integration from the executable model's current states at the bound variable
+   value t, keeping the partition of the state variables */
+int multirateIntegratorReinitialise(struct MultirateIntegrator* integrator, double t);
+
+/* advance the executable model's states to tout, on return the executable model's rates and
+   algebraic variables are consistent with the states at tout */
+int multirateIntegrate(struct MultirateIntegrator* integrator, double tout, double* t);
+
+int multirateIntegratorGetStatistics(struct MultirateIntegrator* integrator,
+  struct IntegratorStatistics* stats);
+
+/* the number of fast state variables, and their indices in fast (may be NULL) */
+int multirateIntegratorGetFastStates(struct MultirateIntegrator* integrator, int* fast);
+
+#endif /* _MULTIRATE_HPP_ */
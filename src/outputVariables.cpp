@@ -26,6 +26,7 @@ public:
 		column = -1;
 		codeArray = UNKNOWN_ARRAY;
 		codeIndex = -1;
+		absoluteTolerance = 0.0;
 	}
 	// the name of the component in the top level model to output
 	std::string component;
@@ -37,6 +38,9 @@ public:
 	enum VariableCodeArray codeArray;
 	// the index of this variable in the codeArray
 	int codeIndex;
+	// the absolute tolerance to integrate this variable with, if it is a state variable (zero to use
+	// the simulation's tolerance)
+	double absoluteTolerance;
 };
 
 typedef std::vector<OutputVariable> OutputVariables;
@@ -77,7 +81,9 @@ void outputVariablesPrint(void* outputVariables, FILE* f, const char* indent)
 	fprintf(f, "%s  OutputVariables:\n", indent);
 	while (iter < list->end())
 	{
-		fprintf(f, "%s    %d) %s/%s\n", indent, iter->column, iter->component.c_str(), iter->variable.c_str());
+		fprintf(f, "%s    %d) %s/%s", indent, iter->column, iter->component.c_str(), iter->variable.c_str());
+		if (iter->absoluteTolerance > 0.0) fprintf(f, " (absolute tolerance: %g)", iter->absoluteTolerance);
+		fprintf(f, "\n");
 		++iter;
 	}
 }
@@ -129,3 +135,15 @@ void outputVariablesSetCodeIndex(void* outputVariables, int index, int codeIndex
 	OutputVariables* list = static_cast<OutputVariables*>(outputVariables);
 	(*list)[index].codeIndex = codeIndex;
 }
+
+double outputVariablesGetAbsoluteTolerance(void* outputVariables, int index)
+{
+	OutputVariables* list = static_cast<OutputVariables*>(outputVariables);
+	return (*list)[index].absoluteTolerance;
+}
+
+void outputVariablesSetAbsoluteTolerance(void* outputVariables, int index, double tolerance)
+{
+	OutputVariables* list = static_cast<OutputVariables*>(outputVariables);
+	(*list)[index].absoluteTolerance = tolerance;
+}
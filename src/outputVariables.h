@@ -37,5 +37,8 @@ enum VariableCodeArray outputVariablesGetCodeArray(void* outputVariables, int in
 void outputVariablesSetCodeArray(void* outputVariables, int index, enum VariableCodeArray array);
 int outputVariablesGetCodeIndex(void* outputVariables, int index);
 void outputVariablesSetCodeIndex(void* outputVariables, int index, int codeIndex);
+// The absolute tolerance for a state variable, zero if the simulation's tolerance is to be used
+double outputVariablesGetAbsoluteTolerance(void* outputVariables, int index);
+void outputVariablesSetAbsoluteTolerance(void* outputVariables, int index, double tolerance);
 
 #endif /* OUTPUTVARIABLES_H_ */
@@ -0,0 +1,620 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <atomic>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#include "linear-algebra.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "parameter-estimation.hpp"
+#include "experimental-data.hpp"
+#include "integrator.hpp"
+#include "thread-pool.hpp"
+#include "ExecutableModel.hpp"
+
+#ifndef M_PI
+#  define M_PI 3.14159265358979323846
+#endif
+
+/* The number of times a CMA-ES sample outside the bounds is redrawn before it is moved onto them */
+#define MAX_RESAMPLES 10
+
+/* The estimation shared by all the threads, the trial values are claimed from next */
+struct Estimation
+{
+  struct Simulation* simulation;
+  ExecutableModel* em;
+  struct ExperimentalData* data;
+  int nParameters;
+  const struct SensitivityParameter* parameters;
+  const double* lower;
+  const double* upper;
+  double t0;
+  /* a model instance and integrator for each thread */
+  int nThreads;
+  ExecutableModel** instances;
+  struct Integrator** integrators;
+  /* the trial values being evaluated (nTrials rows of nParameters values), their sums of squares and
+     the sum of squares at which they are rejected */
+  int nTrials;
+  const double* trials;
+  double* costs;
+  double maxSumOfSquares;
+  std::atomic<int> next;
+  std::atomic<long int> nEvaluations;
+  std::atomic<long int> nRejected;
+  std::atomic<long int> nFailures;
+};
+
+/* splitmix64, as for the Latin hypercube samples of a parameter sweep */
+static uint64_t nextRandom(uint64_t* state)
+{
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return(z ^ (z >> 31));
+}
+
+/* standard normal, by the Box-Muller transform */
+static double normalRandom(uint64_t* state)
+{
+  double u = ((double)(nextRandom(state) >> 11) + 1.0) * (1.0 / 9007199254740993.0);
+  double v = (double)(nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+  return(sqrt(-2.0*log(u)) * cos(2.0*M_PI*v));
+}
+
+static double lowerBound(const struct Estimation* e, int j)
+{
+  return(e->lower ? e->lower[j] : -INFINITY);
+}
+
+static double upperBound(const struct Estimation* e, int j)
+{
+  return(e->upper ? e->upper[j] : INFINITY);
+}
+
+static double clampValue(const struct Estimation* e, int j, double x)
+{
+  if (x < lowerBound(e,j)) return(lowerBound(e,j));
+  if (x > upperBound(e,j)) return(upperBound(e,j));
+  return(x);
+}
+
+static void destroyEstimation(struct Estimation* e)
+{
+  int i;
+  for (i=0;i<e->nThreads;i++)
+  {
+    if (e->integrators[i]) DestroyIntegrator(&(e->integrators[i]));
+    if (e->instances[i]) delete e->instances[i];
+  }
+  free(e->integrators);
+  free(e->instances);
+}
+
+/* check the arguments and set up the model instances, moving the initial values onto the bounds */
+static int setupEstimation(struct Estimation* e, struct Simulation* simulation,
+  ExecutableModel* em, struct ExperimentalData* data, int nParameters,
+  const struct SensitivityParameter* parameters, const double* lower, const double* upper,
+  double* values, int nThreads)
+{
+  int i;
+  if (!(simulation && em && data && (experimentalDataNumObservations(data) > 0) &&
+        (nParameters > 0) && parameters && values && (nThreads > 0)))
+  {
+    ERROR("parameterEstimation","Invalid arguments\n");
+    return(ERR);
+  }
+  for (i=0;i<nParameters;i++)
+  {
+    int n = parameters[i].isState ? em->nRates : em->nConstants;
+    if ((parameters[i].index < 0) || (parameters[i].index >= n))
+    {
+      ERROR("parameterEstimation","Invalid index for parameter %d: %d\n",i,parameters[i].index);
+      return(ERR);
+    }
+    if (lower && upper && !(lower[i] <= upper[i]))
+    {
+      ERROR("parameterEstimation","Invalid bounds for parameter %d\n",i);
+      return(ERR);
+    }
+  }
+  e->simulation = simulation;
+  e->em = em;
+  e->data = data;
+  e->nParameters = nParameters;
+  e->parameters = parameters;
+  e->lower = lower;
+  e->upper = upper;
+  e->t0 = simulationGetBvarStart(simulation);
+  e->nThreads = nThreads;
+  e->instances = (ExecutableModel**)calloc(nThreads,sizeof(ExecutableModel*));
+  e->integrators = (struct Integrator**)calloc(nThreads,sizeof(struct Integrator*));
+  e->nEvaluations = 0;
+  e->nRejected = 0;
+  e->nFailures = 0;
+  for (i=0;i<nParameters;i++) values[i] = clampValue(e,i,values[i]);
+  for (i=0;i<nThreads;i++)
+  {
+    e->instances[i] = em->clone();
+    e->integrators[i] = e->instances[i] ? CreateIntegrator(simulation,e->instances[i]) : NULL;
+    if (!e->integrators[i])
+    {
+      ERROR("parameterEstimation","Unable to create the integrator for worker %d\n",i);
+      destroyEstimation(e);
+      return(ERR);
+    }
+  }
+  return(OK);
+}
+
+/* the base model's values with the given parameter values, at the start of the simulation */
+static void setParameters(struct Estimation* e, ExecutableModel* instance, const double* values)
+{
+  int i;
+  instance->copyValues(e->em);
+  for (i=0;i<e->nParameters;i++)
+  {
+    if (e->parameters[i].isState) instance->states[e->parameters[i].index] = values[i];
+    else instance->constants[e->parameters[i].index] = values[i];
+  }
+  instance->bound[0] = e->t0;
+}
+
+/* the sum of squares with the given parameter values on the worker's instance, infinite if the
+   simulation is rejected or fails */
+static double evaluate(struct Estimation* e, int worker, const double* values,
+  double maxSumOfSquares)
+{
+  double sumOfSquares = NAN;
+  setParameters(e,e->instances[worker],values);
+  int code = experimentalDataResidualsBounded(e->data,e->integrators[worker],e->instances[worker],
+    e->t0,maxSumOfSquares,NULL,&sumOfSquares);
+  e->nEvaluations++;
+  if ((code == OK) && !isnan(sumOfSquares)) return(sumOfSquares);
+  if (isnan(sumOfSquares)) e->nFailures++;
+  else e->nRejected++;
+  return(INFINITY);
+}
+
+/* ThreadPoolTask: one thread's share of the trial values */
+static void evaluateThread(int thread, void* data)
+{
+  struct Estimation* e = static_cast<struct Estimation*>(data);
+  int i;
+  for (i=e->next++;i<e->nTrials;i=e->next++)
+    e->costs[i] = evaluate(e,thread,e->trials + (long int)i * e->nParameters,e->maxSumOfSquares);
+}
+
+static void evaluateTrials(struct Estimation* e, int nTrials, const double* trials, double* costs,
+  double maxSumOfSquares, ThreadPool* pool)
+{
+  e->nTrials = nTrials;
+  e->trials = trials;
+  e->costs = costs;
+  e->maxSumOfSquares = maxSumOfSquares;
+  e->next = 0;
+  if (pool) pool->run(e->nThreads,evaluateThread,e);
+  else evaluateThread(0,e);
+}
+
+static void setStatistics(const struct Estimation* e, int nIterations, struct Timer* timer,
+  struct ParameterEstimationStatistics* stats)
+{
+  stopTimer(timer);
+  if (stats)
+  {
+    stats->nThreads = e->nThreads;
+    stats->nIterations = nIterations;
+    stats->nEvaluations = e->nEvaluations;
+    stats->nRejected = e->nRejected;
+    stats->nFailures = e->nFailures;
+    stats->wallTime = getWallTime(timer);
+  }
+}
+
+/* the residuals and their Jacobian (from the forward sensitivities), with the normal equations
+   A = J'J and g = J'r */
+static int evaluateJacobian(struct Estimation* e, struct Integrator* integrator,
+  const double* values, int nObservations, double* residuals, double* jacobian, double* A,
+  double* g, double* sumOfSquares)
+{
+  int n = e->nParameters;
+  int i,j,k;
+  setParameters(e,e->instances[0],values);
+  e->nEvaluations++;
+  if ((experimentalDataJacobian(e->data,integrator,e->instances[0],e->t0,residuals,sumOfSquares,
+         jacobian) != OK) || isnan(*sumOfSquares))
+  {
+    e->nFailures++;
+    return(ERR);
+  }
+  for (j=0;j<n;j++)
+  {
+    g[j] = 0.0;
+    for (k=0;k<n;k++) A[j*n+k] = 0.0;
+  }
+  for (i=0;i<nObservations;i++)
+  {
+    const double* row = jacobian + (long int)i * n;
+    for (j=0;j<n;j++)
+    {
+      g[j] += row[j] * residuals[i];
+      for (k=0;k<=j;k++) A[j*n+k] += row[j] * row[k];
+    }
+  }
+  for (j=0;j<n;j++)
+    for (k=0;k<j;k++) A[k*n+j] = A[j*n+k];
+  return(OK);
+}
+
+int parameterEstimationLevenbergMarquardt(struct Simulation* simulation, class ExecutableModel* em,
+  struct ExperimentalData* data, int nParameters, const struct SensitivityParameter* parameters,
+  const double* lower, const double* upper, int maxIterations, double* values, double* sumOfSquares,
+  struct ParameterEstimationStatistics* stats)
+{
+  struct Estimation e;
+  if (setupEstimation(&e,simulation,em,data,nParameters,parameters,lower,upper,values,1) != OK)
+    return(ERR);
+  if (maxIterations <= 0) maxIterations = PARAMETER_ESTIMATION_MAX_ITERATIONS;
+  struct Timer* timer = CreateTimer();
+  startTimer(timer);
+  /* a second integrator on the instance for the Jacobian, with the forward sensitivities */
+  setParameters(&e,e.instances[0],values);
+  struct Integrator* sensitivities = CreateIntegrator(simulation,e.instances[0]);
+  if (!sensitivities ||
+      (integratorEnableSensitivities(sensitivities,nParameters,parameters) != OK))
+  {
+    ERROR("parameterEstimationLevenbergMarquardt","Unable to enable the forward sensitivities, "
+      "which need the CVODE integration scheme\n");
+    if (sensitivities) DestroyIntegrator(&sensitivities);
+    destroyEstimation(&e);
+    DestroyTimer(&timer);
+    return(ERR);
+  }
+  int n = nParameters;
+  int m = experimentalDataNumObservations(data);
+  double* residuals = (double*)malloc(sizeof(double)*m);
+  double* jacobian = (double*)malloc(sizeof(double)*m*n);
+  double* A = (double*)malloc(sizeof(double)*n*n);
+  double* M = (double*)malloc(sizeof(double)*n*n);
+  double* g = (double*)malloc(sizeof(double)*n);
+  double* step = (double*)malloc(sizeof(double)*n);
+  double* trial = (double*)malloc(sizeof(double)*n);
+  int* pivots = (int*)malloc(sizeof(int)*n);
+  double cost = NAN;
+  int code = evaluateJacobian(&e,sensitivities,values,m,residuals,jacobian,A,g,&cost);
+  if (code != OK)
+    ERROR("parameterEstimationLevenbergMarquardt","Unable to simulate the model with the initial "
+      "parameter values\n");
+  int i,j,iteration = 0;
+  int converged = (code != OK);
+  /* Nielsen's damping strategy, starting from a small multiple of the largest diagonal of J'J */
+  double maxDiagonal = 0.0;
+  for (j=0;j<n;j++) maxDiagonal = fmax(maxDiagonal,A[j*n+j]);
+  if (!(maxDiagonal > 0.0)) converged = 1;
+  double lambda = 1.0e-3, nu = 2.0;
+  while (!converged && (iteration < maxIterations))
+  {
+    iteration++;
+    int accepted = 0;
+    while (!accepted && !converged)
+    {
+      /* Marquardt's scaling of the damping by the diagonal, kept positive for parameters which
+         currently have no effect */
+      memcpy(M,A,sizeof(double)*n*n);
+      for (j=0;j<n;j++)
+      {
+        M[j*n+j] += lambda * fmax(A[j*n+j],1.0e-12*maxDiagonal);
+        step[j] = -g[j];
+      }
+      if (denseLUFactor(n,M,pivots) != OK)
+      {
+        lambda *= nu;
+        nu *= 2.0;
+        continue;
+      }
+      denseLUSolve(n,M,pivots,step);
+      double stepNorm = 0.0, norm = 0.0, predicted = 0.0;
+      for (j=0;j<n;j++)
+      {
+        trial[j] = clampValue(&e,j,values[j] + step[j]);
+        step[j] = trial[j] - values[j];
+        stepNorm += step[j]*step[j];
+        norm += values[j]*values[j];
+      }
+      if (sqrt(stepNorm) <= PARAMETER_ESTIMATION_TOLERANCE*(sqrt(norm) +
+                                                              PARAMETER_ESTIMATION_TOLERANCE))
+      {
+        converged = 1;
+        break;
+      }
+      /* the reduction in the sum of squares predicted by the linearisation, -(2g'd + d'Ad), for the
+         step actually taken (i.e., after projecting onto the bounds) */
+      for (j=0;j<n;j++)
+      {
+        double Ad = 0.0;
+        for (i=0;i<n;i++) Ad += A[j*n+i]*step[i];
+        predicted -= 2.0*g[j]*step[j] + step[j]*Ad;
+      }
+      /* no use carrying on with a trial which is already worse */
+      double trialCost = evaluate(&e,0,trial,cost);
+      if ((trialCost < cost) && (predicted > 0.0))
+      {
+        double rho = (cost - trialCost) / predicted;
+        if (cost - trialCost <= PARAMETER_ESTIMATION_TOLERANCE*cost) converged = 1;
+        memcpy(values,trial,sizeof(double)*n);
+        cost = trialCost;
+        accepted = 1;
+        lambda *= fmax(1.0/3.0,1.0 - pow(2.0*rho - 1.0,3));
+        nu = 2.0;
+        if (!converged &&
+            (evaluateJacobian(&e,sensitivities,values,m,residuals,jacobian,A,g,&cost) != OK))
+        {
+          WARNING("parameterEstimationLevenbergMarquardt","Unable to evaluate the Jacobian, "
+            "stopping\n");
+          converged = 1;
+        }
+        maxDiagonal = 0.0;
+        for (j=0;j<n;j++) maxDiagonal = fmax(maxDiagonal,A[j*n+j]);
+      }
+      else
+      {
+        lambda *= nu;
+        nu *= 2.0;
+        /* no step in any direction reduces the sum of squares */
+        if (lambda > 1.0e16) converged = 1;
+      }
+    }
+  }
+  if (sumOfSquares) *sumOfSquares = (code == OK) ? cost : NAN;
+  setStatistics(&e,iteration,timer,stats);
+  DEBUG(0,"parameterEstimationLevenbergMarquardt","%d iterations, %ld simulations (%ld rejected), "
+    "sum of squares %g\n",iteration,(long int)e.nEvaluations,(long int)e.nRejected,cost);
+  free(residuals);
+  free(jacobian);
+  free(A);
+  free(M);
+  free(g);
+  free(step);
+  free(trial);
+  free(pivots);
+  DestroyIntegrator(&sensitivities);
+  destroyEstimation(&e);
+  DestroyTimer(&timer);
+  return(code);
+}
+
+/* a population member's sum of squares and position, for ranking them */
+struct RankedMember
+{
+  double cost;
+  int k;
+};
+
+static int compareMembers(const void* a, const void* b)
+{
+  const struct RankedMember* x = (const struct RankedMember*)a;
+  const struct RankedMember* y = (const struct RankedMember*)b;
+  if (x->cost < y->cost) return(-1);
+  if (x->cost > y->cost) return(1);
+  return(x->k - y->k);
+}
+
+int parameterEstimationCMAES(struct Simulation* simulation, class ExecutableModel* em,
+  struct ExperimentalData* data, int nParameters, const struct SensitivityParameter* parameters,
+  const double* lower, const double* upper, int maxIterations, int nThreads, unsigned long seed,
+  double* values, double* sumOfSquares, struct ParameterEstimationStatistics* stats)
+{
+  int n = nParameters;
+  int lambda = 4 + (int)(3.0*log((double)((n > 0) ? n : 1)));
+  int mu = lambda / 2;
+  /* no point having more threads than population members */
+  if (nThreads > lambda) nThreads = lambda;
+  struct Estimation e;
+  if (setupEstimation(&e,simulation,em,data,nParameters,parameters,lower,upper,values,nThreads)
+      != OK)
+    return(ERR);
+  if (maxIterations <= 0) maxIterations = PARAMETER_ESTIMATION_MAX_ITERATIONS * n;
+  struct Timer* timer = CreateTimer();
+  startTimer(timer);
+  double bestCost = evaluate(&e,0,values,INFINITY);
+  if (isinf(bestCost))
+  {
+    ERROR("parameterEstimationCMAES","Unable to simulate the model with the initial parameter "
+      "values\n");
+    setStatistics(&e,0,timer,stats);
+    if (sumOfSquares) *sumOfSquares = NAN;
+    destroyEstimation(&e);
+    DestroyTimer(&timer);
+    return(ERR);
+  }
+
+  /* the strategy parameters (Hansen, 2016, table 1) */
+  int i,j,k,l;
+  double* weights = (double*)malloc(sizeof(double)*mu);
+  double sum = 0.0, sumSquares = 0.0;
+  for (i=0;i<mu;i++)
+  {
+    weights[i] = log(mu + 0.5) - log(i + 1.0);
+    sum += weights[i];
+  }
+  for (i=0;i<mu;i++)
+  {
+    weights[i] /= sum;
+    sumSquares += weights[i]*weights[i];
+  }
+  double mueff = 1.0 / sumSquares;
+  double cc = (4.0 + mueff/n) / (n + 4.0 + 2.0*mueff/n);
+  double cs = (mueff + 2.0) / (n + mueff + 5.0);
+  double c1 = 2.0 / ((n + 1.3)*(n + 1.3) + mueff);
+  double cmu = fmin(1.0 - c1,2.0*(mueff - 2.0 + 1.0/mueff) / ((n + 2.0)*(n + 2.0) + mueff));
+  double damps = 1.0 + 2.0*fmax(0.0,sqrt((mueff - 1.0)/(n + 1.0)) - 1.0) + cs;
+  double chiN = sqrt((double)n) * (1.0 - 1.0/(4.0*n) + 1.0/(21.0*n*n));
+
+  /* the search works on the parameters divided by their scales, so that the initial step size is
+     the same for each */
+  double* scales = (double*)malloc(sizeof(double)*n);
+  double* mean = (double*)malloc(sizeof(double)*n);
+  double* pc = (double*)calloc(n,sizeof(double));
+  double* ps = (double*)calloc(n,sizeof(double));
+  double* C = (double*)calloc(n*n,sizeof(double));
+  double* B = (double*)calloc(n*n,sizeof(double));
+  double* D = (double*)malloc(sizeof(double)*n);
+  double* work = (double*)malloc(sizeof(double)*n*n);
+  double* yw = (double*)malloc(sizeof(double)*n);
+  double* z = (double*)malloc(sizeof(double)*n);
+  double* y = (double*)malloc(sizeof(double)*lambda*n);
+  double* trials = (double*)malloc(sizeof(double)*lambda*n);
+  double* costs = (double*)malloc(sizeof(double)*lambda);
+  double* best = (double*)malloc(sizeof(double)*n);
+  struct RankedMember* ranked = (struct RankedMember*)malloc(sizeof(struct RankedMember)*lambda);
+  for (j=0;j<n;j++)
+  {
+    double range = upperBound(&e,j) - lowerBound(&e,j);
+    if (isfinite(range) && (range > 0.0)) scales[j] = range;
+    else scales[j] = (fabs(values[j]) > 0.0) ? fabs(values[j]) : 1.0;
+    mean[j] = values[j] / scales[j];
+    C[j*n+j] = 1.0;
+    B[j*n+j] = 1.0;
+    D[j] = 1.0;
+  }
+  memcpy(best,values,sizeof(double)*n);
+  double sigma = PARAMETER_ESTIMATION_INITIAL_STEP;
+  double maxSumOfSquares = PARAMETER_ESTIMATION_REJECTION_FACTOR * bestCost;
+  uint64_t state = (uint64_t)seed;
+  ThreadPool* pool = (nThreads > 1) ? new ThreadPool(nThreads) : NULL;
+  int generation = 0;
+  while (generation < maxIterations)
+  {
+    generation++;
+    /* sample the population, x = mean + sigma B D z, redrawing samples outside the bounds */
+    for (k=0;k<lambda;k++)
+    {
+      double* yk = y + k*n;
+      double* xk = trials + k*n;
+      int attempt, inside = 0;
+      for (attempt=0;(attempt<=MAX_RESAMPLES) && !inside;attempt++)
+      {
+        for (j=0;j<n;j++) z[j] = D[j] * normalRandom(&state);
+        inside = 1;
+        for (i=0;i<n;i++)
+        {
+          yk[i] = 0.0;
+          for (j=0;j<n;j++) yk[i] += B[i*n+j] * z[j];
+          xk[i] = (mean[i] + sigma*yk[i]) * scales[i];
+          if ((xk[i] < lowerBound(&e,i)) || (xk[i] > upperBound(&e,i))) inside = 0;
+        }
+      }
+      if (!inside)
+      {
+        /* move it onto the bounds, with the step that was actually taken used in the update */
+        for (i=0;i<n;i++)
+        {
+          xk[i] = clampValue(&e,i,xk[i]);
+          yk[i] = (xk[i]/scales[i] - mean[i]) / sigma;
+        }
+      }
+    }
+    evaluateTrials(&e,lambda,trials,costs,maxSumOfSquares,pool);
+    for (k=0;k<lambda;k++)
+    {
+      ranked[k].cost = costs[k];
+      ranked[k].k = k;
+    }
+    qsort(ranked,lambda,sizeof(struct RankedMember),compareMembers);
+    if (ranked[0].cost < bestCost)
+    {
+      bestCost = ranked[0].cost;
+      memcpy(best,trials + ranked[0].k*n,sizeof(double)*n);
+    }
+    maxSumOfSquares = PARAMETER_ESTIMATION_REJECTION_FACTOR * ranked[lambda/2].cost;
+
+    /* move the mean towards the best mu members */
+    for (i=0;i<n;i++)
+    {
+      yw[i] = 0.0;
+      for (l=0;l<mu;l++) yw[i] += weights[l] * y[ranked[l].k*n+i];
+      mean[i] += sigma * yw[i];
+    }
+    /* the evolution paths, with C^-1/2 yw = B D^-1 B' yw */
+    for (j=0;j<n;j++)
+    {
+      z[j] = 0.0;
+      for (i=0;i<n;i++) z[j] += B[i*n+j] * yw[i];
+      z[j] /= D[j];
+    }
+    double psNorm = 0.0;
+    for (i=0;i<n;i++)
+    {
+      double invSqrtCyw = 0.0;
+      for (j=0;j<n;j++) invSqrtCyw += B[i*n+j] * z[j];
+      ps[i] = (1.0 - cs)*ps[i] + sqrt(cs*(2.0 - cs)*mueff) * invSqrtCyw;
+      psNorm += ps[i]*ps[i];
+    }
+    psNorm = sqrt(psNorm);
+    int hsig = (psNorm / sqrt(1.0 - pow(1.0 - cs,2.0*generation)) / chiN) < (1.4 + 2.0/(n + 1.0));
+    for (i=0;i<n;i++) pc[i] = (1.0 - cc)*pc[i] + hsig*sqrt(cc*(2.0 - cc)*mueff) * yw[i];
+    /* the rank-one and rank-mu updates of the covariance */
+    for (i=0;i<n;i++)
+    {
+      for (j=0;j<=i;j++)
+      {
+        double rankMu = 0.0;
+        for (l=0;l<mu;l++) rankMu += weights[l] * y[ranked[l].k*n+i] * y[ranked[l].k*n+j];
+        C[i*n+j] = (1.0 - c1 - cmu)*C[i*n+j] +
+          c1*(pc[i]*pc[j] + (1 - hsig)*cc*(2.0 - cc)*C[i*n+j]) + cmu*rankMu;
+        C[j*n+i] = C[i*n+j];
+      }
+    }
+    sigma *= exp((cs/damps) * (psNorm/chiN - 1.0));
+    memcpy(work,C,sizeof(double)*n*n);
+    if (denseSymmetricEigen(n,work,D,B) != OK)
+      WARNING("parameterEstimationCMAES","The covariance eigenvalues didn't converge\n");
+    double maxD = 0.0;
+    for (j=0;j<n;j++)
+    {
+      D[j] = sqrt(fmax(D[j],1.0e-20));
+      maxD = fmax(maxD,D[j]);
+    }
+    if (sigma*maxD < PARAMETER_ESTIMATION_TOLERANCE) break;
+  }
+  memcpy(values,best,sizeof(double)*n);
+  if (sumOfSquares) *sumOfSquares = bestCost;
+  setStatistics(&e,generation,timer,stats);
+  DEBUG(0,"parameterEstimationCMAES","%d generations of %d on %d threads, %ld simulations (%ld "
+    "rejected), sum of squares %g\n",generation,lambda,nThreads,(long int)e.nEvaluations,
+    (long int)e.nRejected,bestCost);
+  if (pool) delete pool;
+  free(weights);
+  free(scales);
+  free(mean);
+  free(pc);
+  free(ps);
+  free(C);
+  free(B);
+  free(D);
+  free(work);
+  free(yw);
+  free(z);
+  free(y);
+  free(trials);
+  free(costs);
+  free(best);
+  free(ranked);
+  destroyEstimation(&e);
+  DestroyTimer(&timer);
+  return(OK);
+}
@@ -0,0 +1,73 @@
+
+#ifndef _PARAMETER_ESTIMATION_HPP_
+#define _PARAMETER_ESTIMATION_HPP_
+
+/*
+ * Estimating model parameters (constants or the initial values of state variables) by fitting the
+ * model to experimental data, i.e., minimising the sum of squares of the weighted residuals (see
+ * experimental-data.hpp). Every evaluation runs in this process on an instance of the compiled model
+ * (see ExecutableModel::clone), so the model is only compiled once. Two methods are available:
+ * Levenberg-Marquardt, with the Jacobian of the residuals from the forward sensitivities, for fast
+ * local convergence from a reasonable starting point; and CMA-ES (Hansen, 2016), derivative free and
+ * much more robust to poor starting points and rough objectives, with each generation's population
+ * evaluated in parallel. Both keep the parameters within the given bounds, and trial parameter values
+ * which are clearly worse than those already found are rejected part way through their simulation.
+ */
+
+/* Private structure */
+struct Simulation;
+struct SensitivityParameter;
+struct ExperimentalData;
+class ExecutableModel;
+
+struct ParameterEstimationStatistics
+{
+  int nThreads;
+  /* Levenberg-Marquardt iterations or CMA-ES generations */
+  int nIterations;
+  /* the number of simulations, and how many of them were rejected early or failed */
+  long int nEvaluations;
+  long int nRejected;
+  long int nFailures;
+  double wallTime;
+};
+
+/* The most iterations when none is given (for CMA-ES, generations per parameter) */
+#define PARAMETER_ESTIMATION_MAX_ITERATIONS 100
+/* Converged once the relative change in the parameters (or for CMA-ES the search distribution's
+   spread, relative to the parameter scales) is below this */
+#define PARAMETER_ESTIMATION_TOLERANCE 1.0e-8
+/* CMA-ES trial values are rejected once their sum of squares passes this multiple of the median of
+   the previous generation */
+#define PARAMETER_ESTIMATION_REJECTION_FACTOR 10.0
+/* The initial CMA-ES step size, relative to the range of each parameter (or its initial value if it
+   isn't bounded) */
+#define PARAMETER_ESTIMATION_INITIAL_STEP 0.3
+
+/*
+ * Fit the given parameters of the executable model to the data, whose observations must all have
+ * been set to one of the model's outputs. Each simulation starts from the model's current values at
+ * the start of the simulation's interval, with the parameters set. values holds the initial values of
+ * the parameters and on return the best values found, with *sumOfSquares the sum of squares of the
+ * weighted residuals there. lower and upper give the bounds on the parameters (either may be NULL,
+ * and any bound may be infinite). maxIterations <= 0 uses PARAMETER_ESTIMATION_MAX_ITERATIONS. The
+ * executable model is only read. stats may be NULL. Returns ERR if the model can't be simulated with
+ * the initial values.
+ */
+
+/* Levenberg-Marquardt with Marquardt's diagonal scaling, the steps projected onto the bounds. Needs
+   the CVODE integration scheme for the forward sensitivities. Only the calling thread is used. */
+int parameterEstimationLevenbergMarquardt(struct Simulation* simulation, class ExecutableModel* em,
+  struct ExperimentalData* data, int nParameters, const struct SensitivityParameter* parameters,
+  const double* lower, const double* upper, int maxIterations, double* values, double* sumOfSquares,
+  struct ParameterEstimationStatistics* stats);
+
+/* CMA-ES with the default population size, 4 + 3 ln(nParameters), each generation evaluated on
+   nThreads threads (including the calling thread). Samples outside the bounds are redrawn a few times
+   and then moved onto the bounds. The same seed gives the same result, no matter how many threads. */
+int parameterEstimationCMAES(struct Simulation* simulation, class ExecutableModel* em,
+  struct ExperimentalData* data, int nParameters, const struct SensitivityParameter* parameters,
+  const double* lower, const double* upper, int maxIterations, int nThreads, unsigned long seed,
+  double* values, double* sumOfSquares, struct ParameterEstimationStatistics* stats);
+
+#endif /* _PARAMETER_ESTIMATION_HPP_ */
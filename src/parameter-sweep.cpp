@@ -0,0 +1,670 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <atomic>
+#include <new>
+#ifndef WIN32
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/wait.h>
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "timer.h"
+#include "ensemble-statistics.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "parameter-sweep.hpp"
+#include "integrator.hpp"
+#include "thread-pool.hpp"
+#include "batch-integrator.hpp"
+#include "ExecutableModel.hpp"
+
+/* The sweep shared by all the threads, the simulations are claimed from next */
+struct ParameterSweep
+{
+  struct Simulation* simulation;
+  ExecutableModel* em;
+  int nParameters;
+  const struct SensitivityParameter* parameters;
+  int nSimulations;
+  const double* values;
+  int nPoints;
+  double* results;
+  int* status;
+  /* the simulation each worker process is running (or -1), NULL for threads */
+  int* running;
+  /* the number of threads and each thread's statistics for an ensemble, whose outputs aren't kept */
+  int nThreads;
+  struct EnsembleStatistics** ensembles;
+  /* the snapshot each simulation continues from, if any */
+  const struct IntegratorSnapshot* snapshot;
+  std::atomic<int> next;
+  std::atomic<int> nFailures;
+  std::atomic<long int> nSteps;
+  std::atomic<long int> nRhsEvals;
+};
+
+/* splitmix64, a small and good enough generator for the sample positions */
+static uint64_t nextRandom(uint64_t* state)
+{
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return(z ^ (z >> 31));
+}
+
+/* uniform on [0,1) */
+static double uniformRandom(uint64_t* state)
+{
+  return((double)(nextRandom(state) >> 11) * (1.0 / 9007199254740992.0));
+}
+
+long int parameterSweepGridSize(int nParameters, const int* levels)
+{
+  long int size = 1;
+  int j;
+  if ((nParameters < 1) || !levels) return(0);
+  for (j=0;j<nParameters;j++)
+  {
+    if (levels[j] < 1) return(0);
+    size *= levels[j];
+  }
+  return(size);
+}
+
+int parameterSweepGrid(int nParameters, const double* lower, const double* upper, const int* levels,
+  double* values)
+{
+  long int size = parameterSweepGridSize(nParameters,levels);
+  long int i;
+  int j;
+  if (!(lower && upper && values && (size > 0)))
+  {
+    ERROR("parameterSweepGrid","Invalid arguments\n");
+    return(ERR);
+  }
+  for (i=0;i<size;i++)
+  {
+    long int index = i;
+    for (j=nParameters-1;j>=0;j--)
+    {
+      int level = (int)(index % levels[j]);
+      index /= levels[j];
+      if (levels[j] == 1) values[i*nParameters+j] = lower[j];
+      else values[i*nParameters+j] = lower[j] + (upper[j] - lower[j]) * level / (levels[j] - 1);
+    }
+  }
+  return(OK);
+}
+
+int parameterSweepLatinHypercube(int nParameters, const double* lower, const double* upper,
+  int nSamples, unsigned long seed, double* values)
+{
+  int i,j;
+  if (!(lower && upper && values && (nParameters > 0) && (nSamples > 0)))
+  {
+    ERROR("parameterSweepLatinHypercube","Invalid arguments\n");
+    return(ERR);
+  }
+  int* strata = (int*)malloc(sizeof(int)*nSamples);
+  uint64_t state = (uint64_t)seed;
+  for (j=0;j<nParameters;j++)
+  {
+    /* a random permutation of the strata for this parameter */
+    for (i=0;i<nSamples;i++) strata[i] = i;
+    for (i=nSamples-1;i>0;i--)
+    {
+      int k = (int)(nextRandom(&state) % (uint64_t)(i+1));
+      int s = strata[i];
+      strata[i] = strata[k];
+      strata[k] = s;
+    }
+    for (i=0;i<nSamples;i++)
+      values[i*nParameters+j] = lower[j] + (upper[j] - lower[j]) *
+        (strata[i] + uniformRandom(&state)) / nSamples;
+  }
+  free(strata);
+  return(OK);
+}
+
+int parameterSweepNumOutputPoints(struct Simulation* simulation)
+{
+  double tStart = simulationGetBvarStart(simulation);
+  double tEnd = simulationGetBvarEnd(simulation);
+  double tabT = simulationGetBvarTabStep(simulation);
+  int n = 1;
+  if (!(tabT > 0.0)) return(0);
+  double tout = tStart;
+  while (fabs(tEnd - tout) >= ZERO_TOL)
+  {
+    tout += tabT;
+    if (tout > tEnd) tout = tEnd;
+    n++;
+  }
+  return(n);
+}
+
+/* the values of the base model with the parameters of simulation s */
+static void sweepSetParameters(struct ParameterSweep* sweep, ExecutableModel* em, int s)
+{
+  const double* values = sweep->values + (long int)s * sweep->nParameters;
+  int i;
+  em->copyValues(sweep->em);
+  for (i=0;i<sweep->nParameters;i++)
+  {
+    if (sweep->parameters[i].isState) em->states[sweep->parameters[i].index] = values[i];
+    else em->constants[sweep->parameters[i].index] = values[i];
+  }
+}
+
+/* one simulation on the thread's own instance and integrator, writing its outputs at each point to
+   results */
+static int sweepSimulation(struct ParameterSweep* sweep, ExecutableModel* em,
+  struct Integrator* integrator, int s, double* results)
+{
+  double tStart = simulationGetBvarStart(sweep->simulation);
+  double tEnd = simulationGetBvarEnd(sweep->simulation);
+  double tabT = simulationGetBvarTabStep(sweep->simulation);
+  int i,p = 0;
+  int code = OK;
+  if (sweep->snapshot)
+  {
+    /* carry on from the snapshot with the parameters set, restarting the integration if any of
+       the states have been changed */
+    const double* values = sweep->values + (long int)s * sweep->nParameters;
+    int changedStates = 0;
+    code = integratorRestore(integrator,sweep->snapshot);
+    for (i=0;i<sweep->nParameters;i++)
+    {
+      if (sweep->parameters[i].isState) em->states[sweep->parameters[i].index] = values[i];
+      else em->constants[sweep->parameters[i].index] = values[i];
+      changedStates = changedStates || sweep->parameters[i].isState;
+    }
+    if ((code == OK) && changedStates) code = integratorReinitialise(integrator,tStart);
+  }
+  else sweepSetParameters(sweep,em,s);
+  em->bound[0] = tStart;
+  em->computeRates(tStart);
+  em->evaluateVariables(tStart);
+  em->getOutputs(tStart);
+  memcpy(results, em->outputs, sizeof(double)*em->nOutputs);
+  p++;
+  if (!sweep->snapshot && (integratorReinitialise(integrator,tStart) != OK)) code = ERR;
+  double tout = tStart;
+  while ((code == OK) && (p < sweep->nPoints))
+  {
+    double t;
+    tout += tabT;
+    if (tout > tEnd) tout = tEnd;
+    code = integrate(integrator,tout,&t);
+    if (code != OK) break;
+    em->getOutputs(t);
+    memcpy(results + (long int)p * em->nOutputs, em->outputs, sizeof(double)*em->nOutputs);
+    p++;
+  }
+  for (;p<sweep->nPoints;p++)
+    for (i=0;i<em->nOutputs;i++) results[(long int)p * em->nOutputs + i] = NAN;
+  struct IntegratorStatistics stats;
+  if (integratorGetStatistics(integrator,&stats) == OK)
+  {
+    sweep->nSteps += stats.nSteps;
+    sweep->nRhsEvals += stats.nRhsEvals;
+  }
+  return(code);
+}
+
+/* CreateIntegrator writes the maximum step size it uses back to the simulation it is given, so each
+   thread creates its integrator from its own copy of the sweep's simulation */
+static struct Integrator* createSweepIntegrator(struct ParameterSweep* sweep, ExecutableModel* em)
+{
+  if (!em) return(NULL);
+  struct Simulation* simulation = simulationClone(sweep->simulation);
+  struct Integrator* integrator = simulation ? CreateIntegrator(simulation,em) : NULL;
+  if (simulation) DestroySimulation(&simulation);
+  return(integrator);
+}
+
+/* one thread's or worker process's share of the sweep, starting with the given simulation (if any)
+   and then claiming simulations until there are none left */
+static void sweepSimulations(struct ParameterSweep* sweep, int worker, int first)
+{
+  ExecutableModel* em = sweep->em->clone();
+  struct Integrator* integrator = createSweepIntegrator(sweep,em);
+  if (!integrator)
+    ERROR("parameterSweepRun","Unable to create the integrator for worker %d\n",worker);
+  int s;
+  for (s=(first >= 0) ? first : sweep->next++;s<sweep->nSimulations;s=sweep->next++)
+  {
+    if (sweep->running) sweep->running[worker] = s;
+    int code = integrator ? sweepSimulation(sweep,em,integrator,s,
+      sweep->results + (long int)s * sweep->nPoints * sweep->em->nOutputs) : ERR;
+    if (!integrator)
+    {
+      double* results = sweep->results + (long int)s * sweep->nPoints * sweep->em->nOutputs;
+      long int i;
+      for (i=0;i<(long int)sweep->nPoints * sweep->em->nOutputs;i++) results[i] = NAN;
+    }
+    if (sweep->status) sweep->status[s] = code;
+    if (code != OK) sweep->nFailures++;
+    if (sweep->running) sweep->running[worker] = -1;
+  }
+  if (integrator) DestroyIntegrator(&integrator);
+  if (em) delete em;
+}
+
+/* ThreadPoolTask: one thread's share of the sweep */
+static void sweepThread(int thread, void* data)
+{
+  sweepSimulations(static_cast<struct ParameterSweep*>(data),thread,-1);
+}
+
+/* ThreadPoolTask: one thread's share of an ensemble, each simulation's outputs are folded into the
+   thread's statistics and then discarded. The simulations are shared out in a fixed way (every
+   nThreads'th one) so that the merged statistics are the same each time. */
+static void sweepEnsembleThread(int thread, void* data)
+{
+  struct ParameterSweep* sweep = static_cast<struct ParameterSweep*>(data);
+  struct EnsembleStatistics* statistics = sweep->ensembles[thread];
+  ExecutableModel* em = sweep->em->clone();
+  struct Integrator* integrator = createSweepIntegrator(sweep,em);
+  double* results = (double*)malloc(sizeof(double) * sweep->nPoints * sweep->em->nOutputs);
+  if (!integrator)
+    ERROR("parameterSweepRun","Unable to create the integrator for worker %d\n",thread);
+  int s;
+  for (s=thread;s<sweep->nSimulations;s+=sweep->nThreads)
+  {
+    int code = integrator ? sweepSimulation(sweep,em,integrator,s,results) : ERR;
+    /* failed simulations are left out of the statistics */
+    if (code == OK) ensembleStatisticsAdd(statistics,results);
+    if (sweep->status) sweep->status[s] = code;
+    if (code != OK) sweep->nFailures++;
+  }
+  free(results);
+  if (integrator) DestroyIntegrator(&integrator);
+  if (em) delete em;
+}
+
+/* BatchJobQueue callbacks, the jobs are the sweep's simulations */
+static int sweepNextJob(void* userData, ExecutableModel* em)
+{
+  struct ParameterSweep* sweep = static_cast<struct ParameterSweep*>(userData);
+  int s = sweep->next++;
+  if (s >= sweep->nSimulations) return(-1);
+  sweepSetParameters(sweep,em,s);
+  /* the outputs are NaN from any point at which the simulation fails */
+  double* results = sweep->results + (long int)s * sweep->nPoints * em->nOutputs;
+  long int i;
+  for (i=0;i<(long int)sweep->nPoints * em->nOutputs;i++) results[i] = NAN;
+  return(s);
+}
+
+static void sweepJobOutput(void* userData, int s, int point, ExecutableModel* em)
+{
+  struct ParameterSweep* sweep = static_cast<struct ParameterSweep*>(userData);
+  if (point >= sweep->nPoints) return;
+  memcpy(sweep->results + ((long int)s * sweep->nPoints + point) * em->nOutputs, em->outputs,
+    sizeof(double)*em->nOutputs);
+}
+
+static void sweepJobFinished(void* userData, int s, int status)
+{
+  struct ParameterSweep* sweep = static_cast<struct ParameterSweep*>(userData);
+  if (sweep->status) sweep->status[s] = status;
+  if (status != OK) sweep->nFailures++;
+}
+
+/* ThreadPoolTask: one thread's share of the sweep with a batch integrator, which takes simulations
+   from the sweep whenever one of its lanes becomes free */
+static void sweepBatchedThread(int thread, void* data)
+{
+  struct ParameterSweep* sweep = static_cast<struct ParameterSweep*>(data);
+  struct BatchIntegrator* integrator = CreateBatchIntegrator(sweep->simulation,sweep->em);
+  struct BatchJobQueue queue;
+  queue.next = sweepNextJob;
+  queue.output = sweepJobOutput;
+  queue.finished = sweepJobFinished;
+  queue.userData = sweep;
+  if (!integrator)
+  {
+    ERROR("parameterSweepRunBatched","Unable to create the batch integrator for thread %d\n",thread);
+    ExecutableModel* em = sweep->em->clone();
+    int s;
+    while ((s = sweepNextJob(sweep,em)) >= 0) sweepJobFinished(sweep,s,ERR);
+    delete em;
+    return;
+  }
+  struct BatchIntegratorStatistics stats;
+  batchIntegratorRun(integrator,&queue,&stats);
+  sweep->nSteps += stats.nSteps;
+  sweep->nRhsEvals += stats.nBatchRhsEvals * batchIntegratorWidth(integrator);
+  DestroyBatchIntegrator(&integrator);
+}
+
+#ifndef WIN32
+/* The status of a simulation which no worker process has finished */
+#define SWEEP_NOT_RUN (-1)
+
+/* fork a worker process for the shared sweep, returning its process ID or -1 */
+static pid_t startWorker(struct ParameterSweep* sweep, int worker, int first)
+{
+  /* don't let the workers repeat anything still buffered */
+  fflush(NULL);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    sweepSimulations(sweep,worker,first);
+    /* skip the parent's exit handlers and destructors */
+    _exit(0);
+  }
+  if (pid < 0) ERROR("parameterSweepRun","Unable to start worker process %d\n",worker);
+  return(pid);
+}
+
+/*
+ * Run the sweep on worker processes forked from this one, so that they share the compiled model's
+ * code (and all the other pages they don't write to) copy-on-write. The workers claim simulations
+ * from a counter in shared memory and write their outputs and status straight into shared memory;
+ * the parent only waits for them. A simulation whose worker dies is retried on a new worker up to
+ * PARAMETER_SWEEP_MAX_RETRIES times before it is marked as failed.
+ */
+static int runProcesses(struct ParameterSweep* sweep, int nProcesses)
+{
+  int nSimulations = sweep->nSimulations;
+  long int nResults = (long int)nSimulations * sweep->nPoints * sweep->em->nOutputs;
+  size_t headerSize = (sizeof(struct ParameterSweep) + 63) & ~(size_t)63;
+  size_t intsSize = ((sizeof(int) * (nProcesses + nSimulations)) + 63) & ~(size_t)63;
+  size_t size = headerSize + intsSize + sizeof(double) * nResults;
+  void* region = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANONYMOUS,-1,0);
+  if (region == MAP_FAILED)
+  {
+    ERROR("parameterSweepRun","Unable to map %lu bytes of shared memory\n",(unsigned long)size);
+    return(ERR);
+  }
+  /* the shared copy of the sweep, whose atomics work across the processes as they are lock free */
+  struct ParameterSweep* shared = new(region) struct ParameterSweep;
+  shared->simulation = sweep->simulation;
+  shared->em = sweep->em;
+  shared->nParameters = sweep->nParameters;
+  shared->parameters = sweep->parameters;
+  shared->nSimulations = nSimulations;
+  shared->values = sweep->values;
+  shared->nPoints = sweep->nPoints;
+  shared->snapshot = sweep->snapshot;
+  shared->running = (int*)((char*)region + headerSize);
+  shared->status = shared->running + nProcesses;
+  shared->results = (double*)((char*)region + headerSize + intsSize);
+  shared->next = 0;
+  shared->nFailures = 0;
+  shared->nSteps = 0;
+  shared->nRhsEvals = 0;
+  int i,w;
+  for (i=0;i<nSimulations;i++) shared->status[i] = SWEEP_NOT_RUN;
+
+  pid_t* workers = (pid_t*)malloc(sizeof(pid_t)*nProcesses);
+  int* attempts = (int*)calloc(nSimulations,sizeof(int));
+  int nRunning = 0, nRestarts = 0;
+  for (w=0;w<nProcesses;w++)
+  {
+    shared->running[w] = -1;
+    workers[w] = startWorker(shared,w,-1);
+    if (workers[w] > 0) nRunning++;
+  }
+  while (nRunning > 0)
+  {
+    int wstatus;
+    pid_t pid = waitpid(-1,&wstatus,0);
+    if (pid < 0) break;
+    for (w=0;(w<nProcesses) && (workers[w] != pid);w++);
+    if (w == nProcesses) continue;
+    workers[w] = -1;
+    nRunning--;
+    if (WIFEXITED(wstatus) && (WEXITSTATUS(wstatus) == 0)) continue;
+    int s = shared->running[w];
+    shared->running[w] = -1;
+    if (WIFSIGNALED(wstatus))
+      WARNING("parameterSweepRun","Worker %d was killed by signal %d while running simulation %d\n",w,
+        WTERMSIG(wstatus),s);
+    else WARNING("parameterSweepRun","Worker %d died while running simulation %d\n",w,s);
+    if ((s >= 0) && (++attempts[s] > PARAMETER_SWEEP_MAX_RETRIES))
+    {
+      /* give up on this simulation, but keep going with the rest */
+      double* results = shared->results + (long int)s * shared->nPoints * shared->em->nOutputs;
+      long int j;
+      for (j=0;j<(long int)shared->nPoints * shared->em->nOutputs;j++) results[j] = NAN;
+      shared->status[s] = ERR;
+      shared->nFailures++;
+      s = -1;
+    }
+    /* retry the simulation, or replace the worker if there are simulations left (a worker which
+       keeps dying outside of any simulation is only replaced so many times) */
+    if ((s >= 0) || ((shared->next < nSimulations) && (nRestarts++ < nProcesses)))
+    {
+      workers[w] = startWorker(shared,w,s);
+      if (workers[w] > 0) nRunning++;
+    }
+  }
+  if (shared->next < nSimulations)
+  {
+    /* no workers could be started (or all were lost), the rest are run here */
+    ERROR("parameterSweepRun","Lost all the worker processes, running the remaining simulations "
+      "in this process\n");
+    sweepSimulations(shared,0,-1);
+  }
+  /* a worker can die after claiming a simulation but before recording that it is running it, so
+     those simulations are never retried; they are run here */
+  for (i=0;i<nSimulations;i++)
+  {
+    if (shared->status[i] != SWEEP_NOT_RUN) continue;
+    WARNING("parameterSweepRun","Simulation %d was lost with its worker, running it in this process\n",i);
+    sweepSimulations(shared,0,i);
+  }
+
+  /* the only copy of the outputs, once all the workers have finished */
+  memcpy(sweep->results,shared->results,sizeof(double)*nResults);
+  if (sweep->status) memcpy(sweep->status,shared->status,sizeof(int)*nSimulations);
+  sweep->nFailures = (int)shared->nFailures;
+  sweep->nSteps = (long int)shared->nSteps;
+  sweep->nRhsEvals = (long int)shared->nRhsEvals;
+  shared->~ParameterSweep();
+  munmap(region,size);
+  free(workers);
+  free(attempts);
+  return(OK);
+}
+#endif
+
+/* the ways the sweep can be run */
+enum SweepMode
+{
+  SWEEP_THREADS,
+  SWEEP_BATCHED,
+  SWEEP_PROCESSES,
+  SWEEP_ENSEMBLE
+};
+
+/* the sweep, with CVODE or the batch integrator on each thread, or on worker processes, keeping
+   either all the outputs or just their statistics */
+static int runSweep(enum SweepMode mode, struct Simulation* simulation,
+  class ExecutableModel* em, int nParameters, const struct SensitivityParameter* parameters,
+  int nSimulations, const double* values, int nThreads, double* results, int* status,
+  struct EnsembleStatistics* ensemble, const struct IntegratorSnapshot* snapshot,
+  struct ParameterSweepStatistics* stats)
+{
+  int i;
+  if (!(simulation && em && (results || ((mode == SWEEP_ENSEMBLE) && ensemble)) &&
+        (nSimulations > 0) && (nThreads > 0) && ((nParameters == 0) || (parameters && values))))
+  {
+    ERROR("parameterSweepRun","Invalid arguments\n");
+    return(ERR);
+  }
+  for (i=0;i<nParameters;i++)
+  {
+    int n = parameters[i].isState ? em->nRates : em->nConstants;
+    if ((parameters[i].index < 0) || (parameters[i].index >= n))
+    {
+      ERROR("parameterSweepRun","Invalid index for parameter %d: %d\n",i,parameters[i].index);
+      return(ERR);
+    }
+  }
+  int nPoints = parameterSweepNumOutputPoints(simulation);
+  if (nPoints < 1)
+  {
+    ERROR("parameterSweepRun","Invalid simulation interval\n");
+    return(ERR);
+  }
+  if (snapshot && ((mode == SWEEP_BATCHED) ||
+                   (fabs(integratorSnapshotTime(snapshot) - simulationGetBvarStart(simulation)) >
+                    ZERO_TOL)))
+  {
+    ERROR("parameterSweepRun","Simulations from a snapshot must start at the snapshot's time (%g) "
+      "and use CVODE\n",integratorSnapshotTime(snapshot));
+    return(ERR);
+  }
+  if (ensemble && ((ensembleStatisticsNumPoints(ensemble) != nPoints) ||
+                   (ensembleStatisticsNumOutputs(ensemble) != em->nOutputs)))
+  {
+    ERROR("parameterSweepRun","The ensemble statistics need to be for %d points of %d outputs\n",
+      nPoints,em->nOutputs);
+    return(ERR);
+  }
+  struct ParameterSweep sweep;
+  sweep.simulation = simulation;
+  sweep.em = em;
+  sweep.nParameters = nParameters;
+  sweep.parameters = parameters;
+  sweep.nSimulations = nSimulations;
+  sweep.values = values;
+  sweep.nPoints = nPoints;
+  sweep.results = results;
+  sweep.status = status;
+  sweep.running = NULL;
+  sweep.ensembles = NULL;
+  sweep.snapshot = snapshot;
+  sweep.next = 0;
+  sweep.nFailures = 0;
+  sweep.nSteps = 0;
+  sweep.nRhsEvals = 0;
+  /* no point having more threads than simulations */
+  if (nThreads > nSimulations) nThreads = nSimulations;
+  sweep.nThreads = nThreads;
+  if (mode == SWEEP_ENSEMBLE)
+  {
+    /* the calling thread's statistics are the caller's, the others are merged into them */
+    sweep.ensembles = (struct EnsembleStatistics**)malloc(sizeof(struct EnsembleStatistics*)*nThreads);
+    sweep.ensembles[0] = ensemble;
+    for (i=1;i<nThreads;i++)
+      sweep.ensembles[i] = CreateEnsembleStatistics(nPoints,em->nOutputs,
+        ensembleStatisticsCompression(ensemble));
+  }
+  struct Timer* timer = CreateTimer();
+  startTimer(timer);
+  if (mode == SWEEP_PROCESSES)
+  {
+#ifdef WIN32
+    WARNING("parameterSweepRun","Worker processes are not available, using threads instead\n");
+    mode = SWEEP_THREADS;
+#else
+    if (runProcesses(&sweep,nThreads) != OK)
+    {
+      WARNING("parameterSweepRun","Unable to use worker processes, using threads instead\n");
+      mode = SWEEP_THREADS;
+    }
+#endif
+  }
+  if (mode != SWEEP_PROCESSES)
+  {
+    ThreadPoolTask task = sweepThread;
+    if (mode == SWEEP_BATCHED) task = sweepBatchedThread;
+    else if (mode == SWEEP_ENSEMBLE) task = sweepEnsembleThread;
+    if (nThreads == 1) task(0,&sweep);
+    else
+    {
+      ThreadPool pool(nThreads);
+      pool.run(nThreads,task,&sweep);
+    }
+  }
+  if (sweep.ensembles)
+  {
+    /* always merged in the same order */
+    for (i=1;i<nThreads;i++)
+    {
+      ensembleStatisticsMerge(ensemble,sweep.ensembles[i]);
+      DestroyEnsembleStatistics(&(sweep.ensembles[i]));
+    }
+    free(sweep.ensembles);
+  }
+  stopTimer(timer);
+  if (stats)
+  {
+    stats->nThreads = nThreads;
+    stats->nFailures = sweep.nFailures;
+    stats->nSteps = sweep.nSteps;
+    stats->nRhsEvals = sweep.nRhsEvals;
+    stats->wallTime = getWallTime(timer);
+  }
+  DestroyTimer(&timer);
+  DEBUG(0,"parameterSweepRun","%d simulations on %d %s, %d failed\n",nSimulations,nThreads,
+    (mode == SWEEP_PROCESSES) ? "processes" : ((mode == SWEEP_BATCHED) ? "batched threads" : "threads"),
+    (int)sweep.nFailures);
+  return((sweep.nFailures == 0) ? OK : ERR);
+}
+
+int parameterSweepRun(struct Simulation* simulation, class ExecutableModel* em, int nParameters,
+  const struct SensitivityParameter* parameters, int nSimulations, const double* values,
+  int nThreads, double* results, int* status, struct ParameterSweepStatistics* stats)
+{
+  return(runSweep(SWEEP_THREADS,simulation,em,nParameters,parameters,
+    nSimulations,values,nThreads,results,status,NULL,NULL,stats));
+}
+
+int parameterSweepRunBatched(struct Simulation* simulation, class ExecutableModel* em,
+  int nParameters, const struct SensitivityParameter* parameters, int nSimulations,
+  const double* values, int nThreads, double* results, int* status,
+  struct ParameterSweepStatistics* stats)
+{
+  return(runSweep(SWEEP_BATCHED,simulation,em,nParameters,
+    parameters,nSimulations,values,nThreads,results,status,NULL,NULL,stats));
+}
+
+int parameterSweepRunProcesses(struct Simulation* simulation, class ExecutableModel* em,
+  int nParameters, const struct SensitivityParameter* parameters, int nSimulations,
+  const double* values, int nProcesses, double* results, int* status,
+  struct ParameterSweepStatistics* stats)
+{
+  return(runSweep(SWEEP_PROCESSES,simulation,em,nParameters,parameters,nSimulations,values,
+    nProcesses,results,status,NULL,NULL,stats));
+}
+
+int parameterSweepRunEnsemble(struct Simulation* simulation, class ExecutableModel* em,
+  int nParameters, const struct SensitivityParameter* parameters, int nSimulations,
+  const double* values, int nThreads, struct EnsembleStatistics* statistics, int* status,
+  struct ParameterSweepStatistics* stats)
+{
+  return(runSweep(SWEEP_ENSEMBLE,simulation,em,nParameters,parameters,nSimulations,values,
+    nThreads,NULL,status,statistics,NULL,stats));
+}
+
+int parameterSweepRunFromSnapshot(struct Simulation* simulation, class ExecutableModel* em,
+  const struct IntegratorSnapshot* snapshot, int nParameters,
+  const struct SensitivityParameter* parameters, int nSimulations, const double* values,
+  int nThreads, double* results, int* status, struct ParameterSweepStatistics* stats)
+{
+  if (!snapshot)
+  {
+    ERROR("parameterSweepRun","Invalid arguments\n");
+    return(ERR);
+  }
+  return(runSweep(SWEEP_THREADS,simulation,em,nParameters,parameters,nSimulations,values,
+    nThreads,results,status,NULL,snapshot,stats));
+}
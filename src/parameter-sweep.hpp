@@ -0,0 +1,122 @@
+
+#ifndef _PARAMETER_SWEEP_HPP_
+#define _PARAMETER_SWEEP_HPP_
+
+/*
+ * Running the same simulation for many combinations of parameter values, each simulation on its own
+ * instance of the compiled model (see ExecutableModel::clone) with one integrator per thread. The
+ * simulations are claimed one at a time by the threads as they become free, since the cost of each
+ * simulation can vary a lot with the parameter values (e.g., stiff vs. nonstiff), and the outputs are
+ * written straight into the caller's preallocated results array.
+ */
+
+/* Private structure */
+struct Simulation;
+struct SensitivityParameter;
+struct EnsembleStatistics;
+struct IntegratorSnapshot;
+class ExecutableModel;
+
+struct ParameterSweepStatistics
+{
+  int nThreads;
+  int nFailures;
+  /* totals over all the simulations */
+  long int nSteps;
+  long int nRhsEvals;
+  double wallTime;
+};
+
+/* The number of points in the grid with the given number of levels for each parameter */
+long int parameterSweepGridSize(int nParameters, const int* levels);
+
+/*
+ * Fill values with the points of the full factorial grid, levels[j] evenly spaced values from lower[j]
+ * to upper[j] for each parameter j, one row of nParameters values for each point with the last
+ * parameter varying fastest. values must have parameterSweepGridSize() rows.
+ */
+int parameterSweepGrid(int nParameters, const double* lower, const double* upper, const int* levels,
+  double* values);
+
+/*
+ * Fill values with a Latin hypercube sample of nSamples points from the box lower to upper, i.e., the
+ * range of each parameter is split into nSamples equal strata and each stratum is sampled exactly once
+ * at a random position, one row of nParameters values for each point. The same seed gives the same
+ * sample.
+ */
+int parameterSweepLatinHypercube(int nParameters, const double* lower, const double* upper,
+  int nSamples, unsigned long seed, double* values);
+
+/* The number of output points for each simulation: the start of the simulation's interval and every
+   tabulation step after that up to and including the end */
+int parameterSweepNumOutputPoints(struct Simulation* simulation);
+
+/*
+ * Run nSimulations simulations of the executable model's simulation interval, each starting from the
+ * model's current values with the given parameters (constants or the initial values of state
+ * variables) set to one row of nParameters values, using nThreads threads (including the calling
+ * thread). The outputs at each output point are written to results, as nSimulations blocks of
+ * parameterSweepNumOutputPoints() rows of nOutputs values, and the status of each simulation (OK or
+ * ERR) to status; the outputs of a failed simulation are NaN from the point at which it failed. The
+ * executable model is only read. status and stats may be NULL. Returns OK if all the simulations
+ * succeeded.
+ */
+int parameterSweepRun(struct Simulation* simulation, class ExecutableModel* em, int nParameters,
+  const struct SensitivityParameter* parameters, int nSimulations, const double* values,
+  int nThreads, double* results, int* status, struct ParameterSweepStatistics* stats);
+
+/*
+ * As parameterSweepRun, but each thread runs its simulations in lock-step batches with a batch
+ * integrator (see batch-integrator.hpp) rather than one at a time with CVODE, which is much faster for
+ * large ensembles of small models. nRhsEvals in stats counts every lane of each batched evaluation.
+ */
+int parameterSweepRunBatched(struct Simulation* simulation, class ExecutableModel* em,
+  int nParameters, const struct SensitivityParameter* parameters, int nSimulations,
+  const double* values, int nThreads, double* results, int* status,
+  struct ParameterSweepStatistics* stats);
+
+/* The number of times a simulation is retried when the worker process running it dies */
+#define PARAMETER_SWEEP_MAX_RETRIES 2
+
+/*
+ * As parameterSweepRun, but on nProcesses worker processes forked from this one rather than threads,
+ * for models whose code isn't thread safe (e.g., external functions with global state) and for
+ * isolating simulations which might crash. The workers share the compiled model copy-on-write and
+ * write their outputs into shared memory, and a simulation whose worker dies is retried on a new
+ * worker (see PARAMETER_SWEEP_MAX_RETRIES) before being marked as failed. Only the calling thread is
+ * copied into the workers, so no other threads should be busy at the time. Falls back to threads where
+ * fork() isn't available.
+ */
+int parameterSweepRunProcesses(struct Simulation* simulation, class ExecutableModel* em,
+  int nParameters, const struct SensitivityParameter* parameters, int nSimulations,
+  const double* values, int nProcesses, double* results, int* status,
+  struct ParameterSweepStatistics* stats);
+
+/*
+ * As parameterSweepRun, but rather than keeping every simulation's outputs they are folded into the
+ * given ensemble statistics (see ensemble-statistics.h), which must be for
+ * parameterSweepNumOutputPoints() points of the model's outputs, so the memory used doesn't grow with
+ * the number of simulations. Each thread has its own statistics, merged into the given ones at the
+ * end; the simulations are shared out among the threads in a fixed way so that the statistics are
+ * the same for the same number of threads. Failed simulations are left out of the statistics.
+ */
+int parameterSweepRunEnsemble(struct Simulation* simulation, class ExecutableModel* em,
+  int nParameters, const struct SensitivityParameter* parameters, int nSimulations,
+  const double* values, int nThreads, struct EnsembleStatistics* statistics, int* status,
+  struct ParameterSweepStatistics* stats);
+
+/*
+ * As parameterSweepRun, but each simulation continues from the snapshot (see integratorSnapshot) with
+ * the parameters set, rather than starting from the executable model's values, e.g., for many
+ * protocols which share a long prefix (pre-pacing) and only differ after it. The prefix is simulated
+ * once and its snapshot shared (read only) by all the threads. The executable model must be an
+ * instance of the same compiled model as the snapshot, and the simulation's interval must start at
+ * the snapshot's time. Changing the value of a state variable restarts the integration rather than
+ * carrying on with the snapshot's step size.
+ */
+int parameterSweepRunFromSnapshot(struct Simulation* simulation, class ExecutableModel* em,
+  const struct IntegratorSnapshot* snapshot, int nParameters,
+  const struct SensitivityParameter* parameters, int nSimulations, const double* values,
+  int nThreads, double* results, int* status, struct ParameterSweepStatistics* stats);
+
+#endif /* _PARAMETER_SWEEP_HPP_ */
@@ -14,9 +14,11 @@
 #  define strcasecmp _stricmp
 #endif
 
+#define INVALID_IS_STRING "invalid Integration Scheme"
 #define INVALID_MM_STRING "invalid Multistep Method"
 #define INVALID_IM_STRING "invalid Iteration Method"
 #define INVALID_LS_STRING "invalid Linear Solver"
+#define INVALID_TS_STRING "invalid Tolerance Scaling"
 
 struct Simulation
 {
@@ -37,14 +39,24 @@ struct Simulation
   double maxStep; /* maximum step size */
   int maxStepSet;
   /* Numerical solution methods to use */
+  enum IntegrationScheme scheme;
   enum MultistepMethod lmm;
   enum IterationMethod iter;
   enum LinearSolver solver;
   /* Numerical tolerances to use */
   double* aTol;
   int aTolLength;
+  enum ToleranceScaling aTolScaling;
   double rTol;
   int rTolSet;
+  /* Locate the discontinuities in the model during integration? */
+  int rootFinding;
+  /* Maximum number of integrator steps between output points */
+  long int maxNumSteps;
+  int maxNumStepsSet;
+  /* the fast state variables for the multirate integration scheme */
+  int* fastStates;
+  int fastStatesLength;
   /* the output variables for this simulation */
   void* outputVariables;
 };
@@ -69,13 +81,20 @@ struct Simulation* CreateSimulation()
   sim->maxStep = 0;
   sim->maxStepSet = 0;
   /* useful default? */
+  sim->scheme = CVODE;
   sim->lmm = ADAMS;
   sim->iter = FUNCTIONAL;
   sim->solver = NONE;
   sim->aTol = (double*)NULL;
   sim->aTolLength = 0;
+  sim->aTolScaling = NO_SCALING;
   sim->rTol = 0;
   sim->rTolSet = 0;
+  sim->rootFinding = 1;
+  sim->maxNumSteps = 0;
+  sim->maxNumStepsSet = 0;
+  sim->fastStates = (int*)NULL;
+  sim->fastStatesLength = 0;
 
   /* Until this gets added to the metadata set the default tolerances here */
   simulationSetRTol(sim,rtol);
@@ -102,6 +121,7 @@ struct Simulation* simulationClone(const struct Simulation* src)
     sim->endSet = src->endSet;
     sim->tabStepSet = src->tabStepSet;
     sim->maxStepSet = src->maxStepSet;
+    sim->scheme = src->scheme;
     sim->lmm = src->lmm;
     sim->iter = src->iter;
     sim->solver = src->solver;
@@ -109,7 +129,12 @@ struct Simulation* simulationClone(const struct Simulation* src)
     {
       simulationSetATol(sim,src->aTolLength,src->aTol);
     }
+    sim->aTolScaling = src->aTolScaling;
     sim->rTol = src->rTol;
+    sim->rootFinding = src->rootFinding;
+    sim->maxNumSteps = src->maxNumSteps;
+    sim->maxNumStepsSet = src->maxNumStepsSet;
+    simulationSetFastStates(sim,src->fastStatesLength,src->fastStates);
     sim->outputVariables = outputVariablesClone(src->outputVariables);
     return(sim);
   }
@@ -127,6 +152,7 @@ int DestroySimulation(struct Simulation** sim_ptr)
     if (sim->modelURI) free(sim->modelURI);
     if (sim->bVarURI) free(sim->bVarURI);
     if (sim->aTol) free(sim->aTol);
+    if (sim->fastStates) free(sim->fastStates);
     outputVariablesDestroy(sim->outputVariables);
     free(sim);
     *sim_ptr = (struct Simulation*)NULL;
@@ -288,6 +314,17 @@ int simulationSetBvarMaxStep(struct Simulation* sim,double value)
   return(ERR);
 }
 
+int simulationSetIntegrationScheme(struct Simulation* sim,
+  enum IntegrationScheme scheme)
+{
+  if (sim)
+  {
+    sim->scheme = scheme;
+    return(OK);
+  }
+  return(ERR);
+}
+
 int simulationSetMultistepMethod(struct Simulation* sim,
   enum MultistepMethod lmm)
 {
@@ -333,6 +370,60 @@ int simulationSetATol(struct Simulation* sim,int n,double* tol)
   return(ERR);
 }
 
+int simulationApplyVariableATol(struct Simulation* sim,int nStates)
+{
+  void* list;
+  double *tol,t;
+  int i,n,index,code,nVariable = 0;
+  if (!(sim && (nStates >= 0))) return(ERR);
+  list = sim->outputVariables;
+  n = list ? outputVariablesGetLength(list) : 0;
+  for (i=0;i<n;i++) if (outputVariablesGetAbsoluteTolerance(list,i) > 0.0) nVariable++;
+  if (nVariable == 0) return(OK);
+  if ((sim->aTolLength != 1) && (sim->aTolLength != nStates))
+  {
+    ERROR("simulationApplyVariableATol","Need either one absolute tolerance or one for each of the "
+      "%d state variables, but %d were given\n",nStates,sim->aTolLength);
+    return(ERR);
+  }
+  /* the state variables without their own tolerance keep the simulation's */
+  tol = (double*)malloc(sizeof(double)*nStates);
+  for (i=0;i<nStates;i++) tol[i] = sim->aTol[(sim->aTolLength == 1) ? 0 : i];
+  for (i=0;i<n;i++)
+  {
+    t = outputVariablesGetAbsoluteTolerance(list,i);
+    if (!(t > 0.0)) continue;
+    index = outputVariablesGetCodeIndex(list,i);
+    if ((outputVariablesGetCodeArray(list,i) != STATE_ARRAY) || (index < 0) || (index >= nStates))
+    {
+      WARNING("simulationApplyVariableATol","Ignoring the absolute tolerance for %s/%s, it is not a "
+        "state variable\n",outputVariablesGetComponent(list,i),outputVariablesGetVariable(list,i));
+      continue;
+    }
+    tol[index] = t;
+  }
+  code = (nStates > 0) ? simulationSetATol(sim,nStates,tol) : OK;
+  free(tol);
+  return(code);
+}
+
+int simulationSetFastStates(struct Simulation* sim,int n,const int* states)
+{
+  if (sim && (n >= 0) && (states || (n == 0)))
+  {
+    if (sim->fastStates) free(sim->fastStates);
+    sim->fastStates = (int*)NULL;
+    if (n > 0)
+    {
+      sim->fastStates = (int*)malloc(sizeof(int)*n);
+      memcpy(sim->fastStates,states,sizeof(int)*n);
+    }
+    sim->fastStatesLength = n;
+    return(OK);
+  }
+  return(ERR);
+}
+
 int simulationSetRTol(struct Simulation* sim,double tol)
 {
   if (sim)
@@ -344,6 +435,38 @@ int simulationSetRTol(struct Simulation* sim,double tol)
   return(ERR);
 }
 
+int simulationSetATolScaling(struct Simulation* sim,
+  enum ToleranceScaling scaling)
+{
+  if (sim)
+  {
+    sim->aTolScaling = scaling;
+    return(OK);
+  }
+  return(ERR);
+}
+
+int simulationSetMaxNumSteps(struct Simulation* sim,long int steps)
+{
+  if (sim && (steps >= 0))
+  {
+    sim->maxNumSteps = steps;
+    sim->maxNumStepsSet = (steps > 0);
+    return(OK);
+  }
+  return(ERR);
+}
+
+int simulationSetRootFinding(struct Simulation* sim,int flag)
+{
+  if (sim)
+  {
+    sim->rootFinding = flag ? 1 : 0;
+    return(OK);
+  }
+  return(ERR);
+}
+
 double simulationGetBvarStart(struct Simulation* sim)
 {
   if (sim) return(sim->start);
@@ -368,6 +491,12 @@ double simulationGetBvarMaxStep(struct Simulation* sim)
   return(0.0);
 }
 
+enum IntegrationScheme simulationGetIntegrationScheme(struct Simulation* sim)
+{
+  if (sim) return(sim->scheme);
+  return(INVALID_IS);
+}
+
 enum MultistepMethod simulationGetMultistepMethod(struct Simulation* sim)
 {
   if (sim) return(sim->lmm);
@@ -404,20 +533,71 @@ int simulationGetATolLength(struct Simulation* sim)
   return(-1);
 }
 
+int* simulationGetFastStates(struct Simulation* sim)
+{
+  if (sim && sim->fastStates && ((sim->fastStatesLength)>0))
+  {
+    size_t l = sizeof(int)*(sim->fastStatesLength);
+    int* states = (int*)malloc(l);
+    memcpy(states,sim->fastStates,l);
+    return(states);
+  }
+  return((int*)NULL);
+}
+
+int simulationGetFastStatesLength(struct Simulation* sim)
+{
+  if (sim) return(sim->fastStatesLength);
+  return(-1);
+}
+
+enum ToleranceScaling simulationGetATolScaling(struct Simulation* sim)
+{
+  if (sim) return(sim->aTolScaling);
+  return(INVALID_TS);
+}
+
+long int simulationGetMaxNumSteps(struct Simulation* sim)
+{
+  if (sim) return(sim->maxNumSteps);
+  return(0);
+}
+
 double simulationGetRTol(struct Simulation* sim)
 {
   if (sim) return(sim->rTol);
   return(0.0);
 }
 
+int simulationGetRootFinding(struct Simulation* sim)
+{
+  if (sim) return(sim->rootFinding);
+  return(0);
+}
+
 /* convenience methods */
+const char* integrationSchemeToString(enum IntegrationScheme scheme)
+{
+  switch (scheme)
+  {
+    case CVODE: return "CVODE";
+    case EULER: return "Euler";
+    case RK4: return "RK4";
+    case RK45: return "RK45";
+    case RUSH_LARSEN: return "RushLarsen";
+    case RUSH_LARSEN2: return "RushLarsen2";
+    case MULTIRATE: return "Multirate";
+    default: return INVALID_IS_STRING;
+  }
+}
+
 const char* multistepMethodToString(enum MultistepMethod lmm)
 {
   switch (lmm)
   {
-    /*case EULER: return "Euler";*/
     case ADAMS: return "Adams";
     case BDF: return "BDF";
+    case ADAMS_BDF: return "Adams-BDF";
     default: return INVALID_MM_STRING;
   }
 }
@@ -447,10 +627,34 @@ const char* linearSolverToString(enum LinearSolver solver)
   }
 }
 
+const char* toleranceScalingToString(enum ToleranceScaling scaling)
+{
+  switch (scaling)
+  {
+    case NO_SCALING: return "None";
+    case INITIAL_MAGNITUDE: return "Initial";
+    case RUNNING_MAGNITUDE: return "Running";
+    default: return INVALID_TS_STRING;
+  }
+}
+
+enum IntegrationScheme integrationSchemeFromString(const char* scheme)
+{
+  if (strcasecmp(scheme,"CVODE") == 0) return(CVODE);
+  else if (strcasecmp(scheme,"Euler") == 0) return(EULER);
+  else if (strcasecmp(scheme,"RK4") == 0) return(RK4);
+  else if (strcasecmp(scheme,"RK45") == 0) return(RK45);
+  else if (strcasecmp(scheme,"RushLarsen") == 0) return(RUSH_LARSEN);
+  else if (strcasecmp(scheme,"RushLarsen2") == 0) return(RUSH_LARSEN2);
+  else if (strcasecmp(scheme,"Multirate") == 0) return(MULTIRATE);
+  return(INVALID_IS);
+}
+
 enum MultistepMethod multistepMethodFromString(const char* lmm)
 {
   if (strcasecmp(lmm,"Adams") == 0) return(ADAMS);
   else if (strcasecmp(lmm,"BDF") == 0) return(BDF);
+  else if ((strcasecmp(lmm,"Adams-BDF") == 0) || (strcasecmp(lmm,"Auto") == 0)) return(ADAMS_BDF);
   return(INVALID_MM);
 }
 
@@ -473,6 +677,14 @@ enum LinearSolver linearSolverFromString(const char* solver)
   return(INVALID_LS);
 }
 
+enum ToleranceScaling toleranceScalingFromString(const char* scaling)
+{
+  if (strcasecmp(scaling,"None") == 0) return(NO_SCALING);
+  else if (strcasecmp(scaling,"Initial") == 0) return(INITIAL_MAGNITUDE);
+  else if (strcasecmp(scaling,"Running") == 0) return(RUNNING_MAGNITUDE);
+  return(INVALID_TS);
+}
+
 int simulationPrint(struct Simulation* s,FILE* f,const char* indent)
 {
   int i,code = ERR;
@@ -484,12 +696,15 @@ int simulationPrint(struct Simulation* s,FILE* f,const char* indent)
     fprintf(f,"%s  name: %s\n",indent,(s->name)?s->name:"UNSET");
     fprintf(f,"%s  CellML model: %s\n",indent,
       (s->modelURI)?s->modelURI:"UNSET");
+    fprintf(f,"%s  integration scheme: %s\n",indent,
+      integrationSchemeToString(s->scheme));
     fprintf(f,"%s  multistep method: %s\n",indent,
       multistepMethodToString(s->lmm));
     fprintf(f,"%s  iteration method: %s\n",indent,
       iterationMethodToString(s->iter));
     fprintf(f,"%s  linear solver: %s\n",indent,
       linearSolverToString(s->solver));
+    fprintf(f,"%s  root finding: %s\n",indent,(s->rootFinding)?"on":"off");
     fprintf(f,"%s  bound variable interval:\n",indent);
     fprintf(f,"%s    variable: %s\n",indent,
       (s->bVarURI)?s->bVarURI:"UNSET");
@@ -519,6 +734,16 @@ int simulationPrint(struct Simulation* s,FILE* f,const char* indent)
       " "REAL_FORMAT,s->aTol[i]);
     else fprintf(f,"UNSET");
     fprintf(f,"\n");
+    fprintf(f,"%s    absolute scaling: %s\n",indent,
+      toleranceScalingToString(s->aTolScaling));
+    fprintf(f,"%s  maximum number of steps: ",indent);
+    if (s->maxNumStepsSet) fprintf(f,"%ld",s->maxNumSteps);
+    else fprintf(f,"UNSET");
+    fprintf(f,"\n");
+    fprintf(f,"%s  fast states:",indent);
+    if (s->fastStates) for(i=0;i<s->fastStatesLength;i++) fprintf(f," %d",s->fastStates[i]);
+    else fprintf(f," automatic");
+    fprintf(f,"\n");
     if (s->outputVariables) outputVariablesPrint(s->outputVariables, f, indent);
     fprintf(f,"%sSimulation end\n",indent);
     code = OK;
@@ -556,6 +781,12 @@ int simulationIsRTolSet(struct Simulation* sim)
   return(0);
 }
 
+int simulationIsMaxNumStepsSet(struct Simulation* sim)
+{
+  if (sim && sim->maxNumStepsSet) return(1);
+  return(0);
+}
+
 int simulationIsValidDescription(struct Simulation* simulation)
 {
   if (simulation)
@@ -571,7 +802,13 @@ int simulationIsValidDescription(struct Simulation* simulation)
     if (!simulationIsBvarTabStepSet(simulation)) return(0);
     if (!simulationIsRTolSet(simulation)) return(0);
     if (simulationGetATolLength(simulation) < 1) return(0);
+    if (strcmp(
+          toleranceScalingToString(simulationGetATolScaling(simulation)),
+          INVALID_TS_STRING) == 0) return(0);
     im = simulationGetIterationMethod(simulation);
+    if (strcmp(
+          integrationSchemeToString(simulationGetIntegrationScheme(simulation)),
+          INVALID_IS_STRING) == 0) return(0);
     if (strcmp(
           multistepMethodToString(simulationGetMultistepMethod(simulation)),
           INVALID_MM_STRING) == 0) return(0);
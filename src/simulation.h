@@ -4,18 +4,53 @@
 
 /* The simulation metadata */
 
+/*
+ * The integration scheme used to solve the model. CVODE is the general
+ * purpose variable step, variable order CVODES integrator and should be
+ * used for stiff models. The explicit Runge-Kutta schemes avoid the CVODES
+ * bookkeeping overhead and can be much faster for non-stiff models or
+ * where a fixed step is wanted (e.g., real-time use). EULER and RK4 are
+ * fixed step schemes using the maximum step size, RK45 is the adaptive
+ * Dormand-Prince scheme using the simulation's tolerances. The Rush-Larsen
+ * schemes are fixed step schemes for cardiac electrophysiology models, the
+ * Hodgkin-Huxley gates (dy/dt = (inf - y)/tau) are updated exactly with
+ * inf and tau held constant over the step, and the other state variables
+ * use forward Euler (RUSH_LARSEN) or the explicit midpoint rule
+ * (RUSH_LARSEN2, evaluating inf and tau at the midpoint). MULTIRATE is
+ * for models coupling fast and slow processes (e.g., channel gating and
+ * ionic concentration drift): the state variables are split into fast and
+ * slow states, either as given (simulationSetFastStates) or from estimates
+ * of their time scales, and the fast states are integrated implicitly with
+ * small substeps inside each explicit macro step of the slow states.
+ */
+enum IntegrationScheme
+{
+  CVODE=1,
+  EULER=2,
+  RK4=3,
+  RK45=4,
+  RUSH_LARSEN=5,
+  RUSH_LARSEN2=6,
+  MULTIRATE=7,
+  INVALID_IS=-1
+};
+
 /*
  * The user of the CVODES package specifies whether to use
  * the ADAMS or BDF (backward differentiation formula)
  * linear multistep method. The BDF method is recommended
  * for stiff problems, and the ADAMS method is recommended
- * for nonstiff problems.
+ * for nonstiff problems. With ADAMS_BDF the integrator monitors
+ * the stiffness of the problem as it goes and switches between
+ * ADAMS with FUNCTIONAL iteration while the problem is nonstiff and
+ * BDF with the given iteration method and linear solver while it is
+ * stiff (as in LSODA).
  */
 enum MultistepMethod
 {
-  /*EULER,IMPROVED_EULER,RK4?? is it worth it? */
   ADAMS=1,
   BDF=2,
+  ADAMS_BDF=3,
   INVALID_MM=-1
 };
 
@@ -58,18 +93,39 @@ enum LinearSolver
   INVALID_LS=-1
 };
 
+/*
+ * How the absolute tolerance(s) are applied to the state variables. With
+ * NO_SCALING the absolute tolerances are used as given. Otherwise the given
+ * absolute tolerances are relative to the magnitude of each state variable,
+ * either its initial magnitude (INITIAL_MAGNITUDE) or the largest magnitude
+ * seen so far during the integration (RUNNING_MAGNITUDE). This lets a single
+ * tolerance be used with models mixing, for example, membrane potentials
+ * and concentrations.
+ */
+enum ToleranceScaling
+{
+  NO_SCALING=0,
+  INITIAL_MAGNITUDE=1,
+  RUNNING_MAGNITUDE=2,
+  INVALID_TS=-1
+};
+
 /* private type */
 struct Simulation;
 struct IntegratorUserData;
 struct CellMLCodeManager;
 
 /* convenience methods */
+const char* integrationSchemeToString(enum IntegrationScheme scheme);
 const char* multistepMethodToString(enum MultistepMethod lmm);
 const char* iterationMethodToString(enum IterationMethod iter);
 const char* linearSolverToString(enum LinearSolver solver);
+const char* toleranceScalingToString(enum ToleranceScaling scaling);
+enum IntegrationScheme integrationSchemeFromString(const char* scheme);
 enum MultistepMethod multistepMethodFromString(const char* lmm);
 enum IterationMethod iterationMethodFromString(const char* iter);
 enum LinearSolver linearSolverFromString(const char* solver);
+enum ToleranceScaling toleranceScalingFromString(const char* scaling);
 
 int simulationPrint(struct Simulation* sim,FILE* file,const char* indent);
 
@@ -98,35 +154,63 @@ int simulationSetBvarEnd(struct Simulation* sim,double value);
 int simulationSetBvarTabStep(struct Simulation* sim,double value);
 int simulationSetBvarMaxStep(struct Simulation* sim,double value);
 
+int simulationSetIntegrationScheme(struct Simulation* sim,
+  enum IntegrationScheme scheme);
 int simulationSetMultistepMethod(struct Simulation* sim,
   enum MultistepMethod lmm);
 int simulationSetIterationMethod(struct Simulation* sim,
   enum IterationMethod iter);
 int simulationSetLinearSolver(struct Simulation* sim,enum LinearSolver solver);
 
-/* Absolute tolerance(s) */
+/* Absolute tolerance(s), either a single value for all state variables or one
+   value per state variable */
 int simulationSetATol(struct Simulation* sim,int n,double* tol);
+int simulationSetATolScaling(struct Simulation* sim,
+  enum ToleranceScaling scaling);
+/* Apply the absolute tolerances given for individual output variables (see
+   outputVariablesSetAbsoluteTolerance), once the model code has been generated
+   and the variables located in it, expanding the absolute tolerances to one
+   value for each of the nStates state variables if any are given */
+int simulationApplyVariableATol(struct Simulation* sim,int nStates);
 /* Relative tolerance */
 int simulationSetRTol(struct Simulation* sim,double tol);
+/* Locate the discontinuities in the model (non-zero, the default) or simply
+   integrate through them (0) */
+int simulationSetRootFinding(struct Simulation* sim,int flag);
+/* Maximum number of steps the integrator may take to reach the next output
+   point, if not set (or set to zero) a guess is made based on the maximum and
+   tabulation step sizes */
+int simulationSetMaxNumSteps(struct Simulation* sim,long int steps);
+/* The state variables (indices into the states array) to treat as fast
+   states with the MULTIRATE integration scheme. If none are given (n = 0) the
+   partition is chosen from the time scales of the state variables */
+int simulationSetFastStates(struct Simulation* sim,int n,const int* states);
 
 double simulationGetBvarStart(struct Simulation* sim);
 double simulationGetBvarEnd(struct Simulation* sim);
 double simulationGetBvarTabStep(struct Simulation* sim);
 double simulationGetBvarMaxStep(struct Simulation* sim);
 
+enum IntegrationScheme simulationGetIntegrationScheme(struct Simulation* sim);
 enum MultistepMethod simulationGetMultistepMethod(struct Simulation* sim);
 enum IterationMethod simulationGetIterationMethod(struct Simulation* sim);
 enum LinearSolver simulationGetLinearSolver(struct Simulation* sim);
 
 double* simulationGetATol(struct Simulation* sim);
 int simulationGetATolLength(struct Simulation* sim);
+enum ToleranceScaling simulationGetATolScaling(struct Simulation* sim);
 double simulationGetRTol(struct Simulation* sim);
+int simulationGetRootFinding(struct Simulation* sim);
+long int simulationGetMaxNumSteps(struct Simulation* sim);
+int* simulationGetFastStates(struct Simulation* sim);
+int simulationGetFastStatesLength(struct Simulation* sim);
 
 int simulationIsBvarStartSet(struct Simulation* sim);
 int simulationIsBvarEndSet(struct Simulation* sim);
 int simulationIsBvarMaxStepSet(struct Simulation* sim);
 int simulationIsBvarTabStepSet(struct Simulation* sim);
 int simulationIsRTolSet(struct Simulation* sim);
+int simulationIsMaxNumStepsSet(struct Simulation* sim);
 
 /* Is the simulation a valid description? Returns non-zero if valid,
    0 otherwise */
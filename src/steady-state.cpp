@@ -0,0 +1,269 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+#include "common.h"
+#include "utils.h"
+#include "simulation.h"
+#include "linear-algebra.h"
+#ifdef __cplusplus
+}
+#endif
+
+#include "steady-state.hpp"
+#include "ExecutableModel.hpp"
+
+/* Limits on the number of iterations */
+#define NEWTON_MAX_ITERATIONS 50
+#define CONTINUATION_NEWTON_ITERATIONS 10
+#define CONTINUATION_MAX_STEPS 1000
+/* Newton has converged when a full step is this small in the weighted RMS norm, i.e., well
+   within the tolerances */
+#define NEWTON_STEP_TOL 1.0e-3
+/* The smallest damping factor tried in the line search and the sufficient decrease required */
+#define LINE_SEARCH_MIN_LAMBDA 1.0e-4
+#define LINE_SEARCH_ALPHA 1.0e-4
+/* Limits on the change in the continuation step size, and the reduction in the residual needed
+   before Newton is tried again */
+#define CONTINUATION_MIN_FACTOR 0.5
+#define CONTINUATION_MAX_FACTOR 10.0
+#define CONTINUATION_NEWTON_REDUCTION 0.1
+
+/* Private type */
+struct SteadyStateSolver
+{
+  ExecutableModel* em;
+  int n;
+  double t;
+  double rtol;
+  double* atol;
+  /* the current estimate and its rates */
+  double* y;
+  double* f;
+  double* dx;
+  double* ytrial;
+  double* ftrial;
+  double* yBackup;
+  double* fBackup;
+  double* jacobian;
+  int* pivots;
+  /* single allocation for all the arrays above */
+  double* workspace;
+  struct SteadyStateStatistics stats;
+};
+
+/* evaluate the rates at y into f, returns ERR if they are not all finite */
+static int evaluateRates(struct SteadyStateSolver* solver, const double* y, double* f)
+{
+  ExecutableModel* em = solver->em;
+  memcpy(em->states, y, sizeof(double)*solver->n);
+  em->computeRates(solver->t);
+  memcpy(f, em->rates, sizeof(double)*solver->n);
+  solver->stats.nRhsEvals++;
+  int i;
+  for (i=0;i<solver->n;i++) if (!isfinite(f[i])) return(ERR);
+  return(OK);
+}
+
+/* the weighted RMS norm of v, with the weights given by the tolerances at y */
+static double weightedNorm(struct SteadyStateSolver* solver, const double* v, const double* y)
+{
+  double sum = 0.0;
+  int i;
+  for (i=0;i<solver->n;i++)
+  {
+    double e = v[i] / (solver->atol[i] + solver->rtol*fabs(y[i]));
+    sum += e*e;
+  }
+  return sqrt(sum / solver->n);
+}
+
+/* difference quotient approximation to the Jacobian at (y,f), using the same increments as the
+   CVODES dense linear solver */
+static int computeJacobian(struct SteadyStateSolver* solver)
+{
+  int n = solver->n;
+  double srur = sqrt(DBL_EPSILON);
+  int i,j;
+  memcpy(solver->ytrial, solver->y, sizeof(double)*n);
+  for (j=0;j<n;j++)
+  {
+    double yj = solver->y[j];
+    double inc = srur*fmax(fabs(yj), solver->atol[j] + solver->rtol*fabs(yj));
+    solver->ytrial[j] = yj + inc;
+    inc = solver->ytrial[j] - yj;
+    int code = evaluateRates(solver, solver->ytrial, solver->ftrial);
+    solver->ytrial[j] = yj;
+    if (code != OK) return(ERR);
+    for (i=0;i<n;i++) solver->jacobian[i*n+j] = (solver->ftrial[i] - solver->f[i]) / inc;
+  }
+  solver->stats.nJacobianEvals++;
+  return(OK);
+}
+
+/* damped Newton iteration from the current estimate, with a backtracking line search on the
+   weighted norm of the rates */
+static int newtonSolve(struct SteadyStateSolver* solver, int maxIterations)
+{
+  int n = solver->n;
+  int iteration,i;
+  for (iteration=0;iteration<maxIterations;iteration++)
+  {
+    double fnorm = weightedNorm(solver, solver->f, solver->y);
+    if (fnorm == 0.0) return(OK);
+    solver->stats.nNewtonIterations++;
+    if (computeJacobian(solver) != OK) return(ERR);
+    if (denseLUFactor(n, solver->jacobian, solver->pivots) != OK)
+    {
+      DEBUG(2,"newtonSolve","Singular Jacobian\n");
+      return(ERR);
+    }
+    for (i=0;i<n;i++) solver->dx[i] = -solver->f[i];
+    denseLUSolve(n, solver->jacobian, solver->pivots, solver->dx);
+    double stepNorm = weightedNorm(solver, solver->dx, solver->y);
+    double lambda = 1.0;
+    while (1)
+    {
+      for (i=0;i<n;i++) solver->ytrial[i] = solver->y[i] + lambda*solver->dx[i];
+      if ((evaluateRates(solver, solver->ytrial, solver->ftrial) == OK) &&
+          (weightedNorm(solver, solver->ftrial, solver->y) <= (1.0 - LINE_SEARCH_ALPHA*lambda)*fnorm))
+        break;
+      lambda *= 0.5;
+      if (lambda < LINE_SEARCH_MIN_LAMBDA)
+      {
+        DEBUG(2,"newtonSolve","Line search failed at iteration %d\n",iteration);
+        return(ERR);
+      }
+    }
+    memcpy(solver->y, solver->ytrial, sizeof(double)*n);
+    memcpy(solver->f, solver->ftrial, sizeof(double)*n);
+    if ((lambda == 1.0) && (stepNorm <= NEWTON_STEP_TOL)) return(OK);
+  }
+  DEBUG(2,"newtonSolve","No convergence after %d iterations\n",maxIterations);
+  return(ERR);
+}
+
+/* pseudo-transient continuation: backward Euler steps (I/dt - J) dx = f with the step size grown as
+   the rates decrease (switched evolution relaxation), trying Newton each time the rates have been
+   reduced enough */
+static int continuationSolve(struct SteadyStateSolver* solver, double dt)
+{
+  int n = solver->n;
+  int step,i;
+  double fnorm = weightedNorm(solver, solver->f, solver->y);
+  double fnormNewton = fnorm;
+  solver->stats.usedContinuation = 1;
+  for (step=0;step<CONTINUATION_MAX_STEPS;step++)
+  {
+    solver->stats.nContinuationSteps++;
+    if (computeJacobian(solver) != OK) return(ERR);
+    for (i=0;i<n*n;i++) solver->jacobian[i] = -solver->jacobian[i];
+    for (i=0;i<n;i++) solver->jacobian[i*n+i] += 1.0/dt;
+    if (denseLUFactor(n, solver->jacobian, solver->pivots) != OK)
+    {
+      dt *= CONTINUATION_MIN_FACTOR;
+      continue;
+    }
+    memcpy(solver->dx, solver->f, sizeof(double)*n);
+    denseLUSolve(n, solver->jacobian, solver->pivots, solver->dx);
+    for (i=0;i<n;i++) solver->ytrial[i] = solver->y[i] + solver->dx[i];
+    if (evaluateRates(solver, solver->ytrial, solver->ftrial) != OK)
+    {
+      dt *= CONTINUATION_MIN_FACTOR;
+      continue;
+    }
+    double fnormNew = weightedNorm(solver, solver->ftrial, solver->y);
+    memcpy(solver->y, solver->ytrial, sizeof(double)*n);
+    memcpy(solver->f, solver->ftrial, sizeof(double)*n);
+    if (fnormNew == 0.0) return(OK);
+    dt *= fmin(fmax(fnorm/fnormNew, CONTINUATION_MIN_FACTOR), CONTINUATION_MAX_FACTOR);
+    fnorm = fnormNew;
+    if (fnorm <= CONTINUATION_NEWTON_REDUCTION*fnormNewton)
+    {
+      memcpy(solver->yBackup, solver->y, sizeof(double)*n);
+      memcpy(solver->fBackup, solver->f, sizeof(double)*n);
+      if (newtonSolve(solver, CONTINUATION_NEWTON_ITERATIONS) == OK) return(OK);
+      memcpy(solver->y, solver->yBackup, sizeof(double)*n);
+      memcpy(solver->f, solver->fBackup, sizeof(double)*n);
+      fnormNewton = fnorm;
+    }
+  }
+  DEBUG(2,"continuationSolve","No convergence after %d steps\n",CONTINUATION_MAX_STEPS);
+  return(ERR);
+}
+
+int steadyStateSolve(struct Simulation* simulation, class ExecutableModel* em, double t,
+  double* residualNorm, struct SteadyStateStatistics* stats)
+{
+  if (!(simulation && em && residualNorm))
+  {
+    ERROR("steadyStateSolve","Invalid arguments\n");
+    return(ERR);
+  }
+  int n = em->nRates;
+  int atolLength = simulationGetATolLength(simulation);
+  if ((atolLength != 1) && (atolLength != n))
+  {
+    ERROR("steadyStateSolve","Need either one absolute tolerance or one for each of the %d state "
+      "variables, but %d were given\n",n,atolLength);
+    return(ERR);
+  }
+  struct SteadyStateSolver solver;
+  memset(&solver, 0, sizeof(struct SteadyStateSolver));
+  solver.em = em;
+  solver.n = n;
+  solver.t = t;
+  solver.rtol = simulationGetRTol(simulation);
+  int code = OK;
+  if (n > 0)
+  {
+    solver.workspace = (double*)malloc(sizeof(double)*((size_t)n*(n+8)));
+    solver.pivots = (int*)malloc(sizeof(int)*n);
+    solver.atol = solver.workspace;
+    solver.y = solver.atol + n;
+    solver.f = solver.y + n;
+    solver.dx = solver.f + n;
+    solver.ytrial = solver.dx + n;
+    solver.ftrial = solver.ytrial + n;
+    solver.yBackup = solver.ftrial + n;
+    solver.fBackup = solver.yBackup + n;
+    solver.jacobian = solver.fBackup + n;
+    double* atol = simulationGetATol(simulation);
+    int i;
+    for (i=0;i<n;i++) solver.atol[i] = atol[(atolLength == 1) ? 0 : i];
+    free(atol);
+    memcpy(solver.y, em->states, sizeof(double)*n);
+    memcpy(solver.yBackup, em->states, sizeof(double)*n);
+    code = evaluateRates(&solver, solver.y, solver.f);
+    if (code != OK) ERROR("steadyStateSolve","Rates are not finite at the initial states\n");
+    else if (newtonSolve(&solver, NEWTON_MAX_ITERATIONS) != OK)
+    {
+      DEBUG(1,"steadyStateSolve","Newton failed, trying pseudo-transient continuation\n");
+      /* restart from the initial states, the failed Newton iterates may be a poor starting point */
+      memcpy(solver.y, solver.yBackup, sizeof(double)*n);
+      double dt = simulationIsBvarMaxStepSet(simulation) ? simulationGetBvarMaxStep(simulation) :
+        simulationGetBvarTabStep(simulation);
+      if (!(dt > 0.0)) dt = 1.0;
+      code = evaluateRates(&solver, solver.y, solver.f);
+      if (code == OK) code = continuationSolve(&solver, dt);
+    }
+  }
+  /* leave the model consistent with the final estimate */
+  if (n > 0) memcpy(em->states, solver.y, sizeof(double)*n);
+  em->computeRates(t);
+  em->evaluateVariables(t);
+  double sum = 0.0;
+  int i;
+  for (i=0;i<n;i++) sum += em->rates[i]*em->rates[i];
+  *residualNorm = sqrt(sum);
+  if (stats) *stats = solver.stats;
+  if (solver.workspace) free(solver.workspace);
+  if (solver.pivots) free(solver.pivots);
+  return(code);
+}
@@ -0,0 +1,37 @@
+
+#ifndef _STEADY_STATE_HPP_
+#define _STEADY_STATE_HPP_
+
+/*
+ * Direct steady state solver, finding the state variable values for which all the rates are zero
+ * (at a fixed value of the bound variable). A damped Newton iteration is tried first and if that
+ * fails we fall back to pseudo-transient continuation, which follows the trajectory of the model
+ * with increasing step sizes (backward Euler) until it is close enough to the steady state for
+ * Newton to take over. The Jacobian is approximated by difference quotients, in the same way as the
+ * CVODES dense linear solver, and the convergence tests use the simulation's tolerances.
+ */
+
+/* Private structure */
+struct Simulation;
+class ExecutableModel;
+
+struct SteadyStateStatistics
+{
+  int nNewtonIterations;
+  int nContinuationSteps;
+  long int nRhsEvals;
+  long int nJacobianEvals;
+  /* non-zero if the pseudo-transient continuation was needed */
+  int usedContinuation;
+};
+
+/*
+ * Find a steady state of the executable model starting from its current states, with the bound
+ * variable held at t. On success the executable model's states are the steady state (with the
+ * rates and algebraic variables consistent with them) and *residualNorm is the 2-norm of the rates.
+ * On failure the states are left as the best estimate found. stats may be NULL.
+ */
+int steadyStateSolve(struct Simulation* simulation, class ExecutableModel* em, double t,
+  double* residualNorm, struct SteadyStateStatistics* stats);
+
+#endif /* _STEADY_STATE_HPP_ */
@@ -0,0 +1,86 @@
+#include "thread-pool.hpp"
+
+/* The number of times a thread checks for new work (or for the batch to finish) before sleeping */
+#define SPIN_COUNT 20000
+
+ThreadPool::ThreadPool(int nThreads) :
+    mBatch(0), mNextTask(0), mFinishedWorkers(0), mStop(false), mTaskCount(0), mTask(0), mData(0)
+{
+    for (int i = 1; i < nThreads; ++i) mWorkers.push_back(std::thread(&ThreadPool::worker, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mStart.notify_all();
+    for (size_t i = 0; i < mWorkers.size(); ++i) mWorkers[i].join();
+}
+
+int ThreadPool::size() const
+{
+    return (int)mWorkers.size() + 1;
+}
+
+void ThreadPool::run(int nTasks, ThreadPoolTask task, void* data)
+{
+    if (nTasks <= 0) return;
+    if (mWorkers.empty() || (nTasks == 1))
+    {
+        for (int i = 0; i < nTasks; ++i) task(i, data);
+        return;
+    }
+    // every worker has finished with the previous batch, so this is safe to set up
+    mTask = task;
+    mData = data;
+    mTaskCount = nTasks;
+    mNextTask.store(0);
+    mFinishedWorkers.store(0);
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBatch.fetch_add(1);
+    }
+    mStart.notify_all();
+    work();
+    // wait for every worker to be done with this batch, not just for the tasks to finish, so that
+    // none of them can still be looking at it when the next batch is set up
+    int nWorkers = (int)mWorkers.size();
+    for (int spin = 0; (spin < SPIN_COUNT) && (mFinishedWorkers.load() < nWorkers); ++spin)
+        std::this_thread::yield();
+    if (mFinishedWorkers.load() < nWorkers)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDone.wait(lock, [this, nWorkers] { return mFinishedWorkers.load() == nWorkers; });
+    }
+}
+
+void ThreadPool::work()
+{
+    int i;
+    while ((i = mNextTask.fetch_add(1)) < mTaskCount) mTask(i, mData);
+}
+
+void ThreadPool::worker()
+{
+    unsigned long batch = 0;
+    while (true)
+    {
+        for (int spin = 0; (spin < SPIN_COUNT) && (mBatch.load() == batch) && !mStop; ++spin)
+            std::this_thread::yield();
+        if ((mBatch.load() == batch) && !mStop)
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mStart.wait(lock, [this, batch] { return (mBatch.load() != batch) || mStop; });
+        }
+        if (mStop) return;
+        batch = mBatch.load();
+        work();
+        if (mFinishedWorkers.fetch_add(1) + 1 == (int)mWorkers.size())
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mDone.notify_all();
+        }
+    }
+}
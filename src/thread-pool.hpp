@@ -0,0 +1,53 @@
+
+#ifndef _THREAD_POOL_HPP_
+#define _THREAD_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A fixed pool of worker threads for running many short batches of independent tasks, e.g., the
+ * tasks in one stage of a parallel rates evaluation. The calling thread takes part in each batch,
+ * and the tasks are claimed one at a time from a shared counter so that threads finishing early
+ * pick up the remaining work. Between batches the workers spin briefly before going to sleep, since
+ * the next batch usually follows within microseconds.
+ */
+
+typedef void (*ThreadPoolTask)(int task, void* data);
+
+class ThreadPool
+{
+public:
+    /* A pool using nThreads threads in total, including the calling thread (so nThreads - 1
+       workers are created). */
+    explicit ThreadPool(int nThreads);
+    ~ThreadPool();
+
+    /* The number of threads used to run each batch, including the calling thread */
+    int size() const;
+
+    /* Run task(i, data) for i = 0 to nTasks - 1, returning once they have all finished. Only one
+       thread may run batches on the pool at a time. */
+    void run(int nTasks, ThreadPoolTask task, void* data);
+
+private:
+    void worker();
+    void work();
+
+    std::vector<std::thread> mWorkers;
+    std::mutex mMutex;
+    std::condition_variable mStart;
+    std::condition_variable mDone;
+    std::atomic<unsigned long> mBatch;
+    std::atomic<int> mNextTask;
+    std::atomic<int> mFinishedWorkers;
+    std::atomic<bool> mStop;
+    int mTaskCount;
+    ThreadPoolTask mTask;
+    void* mData;
+};
+
+#endif /* _THREAD_POOL_HPP_ */
@@ -164,6 +164,16 @@ void* XmlDoc::getCSimOutputVariables()
                 }
                 xmlFree(column);
                 outputVariablesAppendVariable(list, component, variable, c);
+                // the optional absolute tolerance for this (state) variable
+                char* tolerance = (char*)xmlGetProp(node, BAD_CAST "absoluteTolerance");
+                if (tolerance)
+                {
+                    double t;
+                    if ((sscanf(tolerance, "%lf", &t) == 1) && (t > 0.0))
+                        outputVariablesSetAbsoluteTolerance(list, outputVariablesGetLength(list) - 1, t);
+                    else ERROR("getOutputVariables", "found an absolute tolerance, but its not a positive number: \"%s\"\n", tolerance);
+                    xmlFree(tolerance);
+                }
                 xmlFree(component);
                 xmlFree(variable);
             }
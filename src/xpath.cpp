@@ -7,6 +7,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <string>
+#include <sstream>
+#include <vector>
 #include <map>
 
 #include <libxml/parser.h>
@@ -63,6 +65,25 @@ struct Simulation* getSimulation(const char* uri)
 	simulationSetMultistepMethod(simulation, BDF);
 	simulationSetIterationMethod(simulation, NEWTON);
 	simulationSetLinearSolver(simulation, DENSE);
+	value = doc.getTextContent("//csim:simulation/csim:integrator/@scheme");
+	if (!value.empty())
+	{
+		enum IntegrationScheme scheme = integrationSchemeFromString(value.c_str());
+		if (scheme == INVALID_IS) WARNING("getSimulation", "Invalid integration scheme: %s\n", value.c_str());
+		simulationSetIntegrationScheme(simulation, scheme);
+	}
+	value = doc.getTextContent("//csim:simulation/csim:integrator/@method");
+	if (!value.empty())
+	{
+		enum MultistepMethod method = multistepMethodFromString(value.c_str());
+		if (method == INVALID_MM) WARNING("getSimulation", "Invalid multistep method: %s\n", value.c_str());
+		else
+		{
+			simulationSetMultistepMethod(simulation, method);
+			// Adams is intended for nonstiff problems, so no need for the Newton iteration
+			if (method == ADAMS) simulationSetIterationMethod(simulation, FUNCTIONAL);
+		}
+	}
 
     value = doc.getTextContent("//csim:simulation/@id");
     if (!value.empty())
@@ -88,6 +109,26 @@ struct Simulation* getSimulation(const char* uri)
 	else WARNING("getSimulation", "Missing simulation bvar tab step\n");
 	DEBUG(99, "getSimulation", "Got the double type input parameters for the simulation.\n");
 
+	// the integration tolerances are optional, the defaults from CreateSimulation are used otherwise
+    if (doc.getDoubleContent("//csim:simulation/csim:tolerances/@relative", &number))
+		simulationSetRTol(simulation, number);
+    value = doc.getTextContent("//csim:simulation/csim:tolerances/@absolute");
+    if (!value.empty())
+	{
+		// a single value, or a whitespace separated list with one value per state variable
+		std::vector<double> tolerances;
+		std::istringstream is(value);
+		while (is >> number) tolerances.push_back(number);
+		if (!tolerances.empty() && is.eof())
+			simulationSetATol(simulation, tolerances.size(), &(tolerances[0]));
+		else WARNING("getSimulation", "Invalid absolute tolerances: %s\n", value.c_str());
+	}
+    value = doc.getTextContent("//csim:simulation/csim:tolerances/@absoluteScaling");
+    if (!value.empty())
+		simulationSetATolScaling(simulation, toleranceScalingFromString(value.c_str()));
+    if (doc.getDoubleContent("//csim:simulation/csim:tolerances/@maxSteps", &number))
+		simulationSetMaxNumSteps(simulation, (long int)number);
+
     variableList = doc.getCSimOutputVariables();
 	if (variableList)
 	{
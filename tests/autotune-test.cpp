@@ -0,0 +1,41 @@
+#include <cstdio>
+
+extern "C"
+{
+#include "common.h"
+}
+
+#include "autotune.hpp"
+
+#include "gtest/gtest.h"
+
+TEST(Autotune, Fnv1aHash) {
+    // the published test vectors
+    EXPECT_EQ(14695981039346656037ULL, fnv1aHash("", 0, FNV1A_OFFSET_BASIS));
+    EXPECT_EQ(0xaf63dc4c8601ec8cULL, fnv1aHash("a", 1, FNV1A_OFFSET_BASIS));
+    EXPECT_EQ(0x85944171f73967e8ULL, fnv1aHash("foobar", 6, FNV1A_OFFSET_BASIS));
+    // and continuing a hash is the same as hashing all the data at once
+    EXPECT_EQ(fnv1aHash("foobar", 6, FNV1A_OFFSET_BASIS), fnv1aHash("bar", 3, fnv1aHash("foo", 3, FNV1A_OFFSET_BASIS)));
+}
+
+TEST(Autotune, CacheLookupAndStore) {
+    const char* cacheFile = "autotune-test.txt";
+    remove(cacheFile);
+    struct SolverConfiguration configuration;
+    EXPECT_EQ(ERR, autotuneCacheLookup(cacheFile, 42, &configuration));
+    struct SolverConfiguration first = { BDF, NEWTON, SPGMR }, second = { ADAMS, FUNCTIONAL, NONE };
+    EXPECT_EQ(OK, autotuneCacheStore(cacheFile, 42, &first));
+    EXPECT_EQ(OK, autotuneCacheStore(cacheFile, 7, &second));
+    EXPECT_EQ(OK, autotuneCacheLookup(cacheFile, 42, &configuration));
+    EXPECT_EQ(BDF, configuration.lmm);
+    EXPECT_EQ(NEWTON, configuration.iter);
+    EXPECT_EQ(SPGMR, configuration.solver);
+    EXPECT_EQ(ERR, autotuneCacheLookup(cacheFile, 43, &configuration));
+    // later entries override earlier ones
+    EXPECT_EQ(OK, autotuneCacheStore(cacheFile, 42, &second));
+    EXPECT_EQ(OK, autotuneCacheLookup(cacheFile, 42, &configuration));
+    EXPECT_EQ(ADAMS, configuration.lmm);
+    EXPECT_EQ(FUNCTIONAL, configuration.iter);
+    EXPECT_EQ(NONE, configuration.solver);
+    remove(cacheFile);
+}
@@ -0,0 +1,104 @@
+#include <cmath>
+#include <vector>
+
+#include "test-models.hpp"
+#include "batch-integrator.hpp"
+
+#include "gtest/gtest.h"
+
+// y' = c, or NaN once y reaches 0.5 if c is negative
+static void rampRates(double, double* states, double* rates, double* constants, double*)
+{
+    if (constants[0] >= 0.0) rates[0] = constants[0];
+    else rates[0] = (states[0] < 0.5) ? 1.0 : NAN;
+}
+
+static void rampOutputs(double voi, double*, double* states, double*, double* outputs)
+{
+    outputs[0] = voi;
+    outputs[1] = states[0];
+}
+
+// the jobs have c = 0, 1, 2, ... except for the given failing job
+struct RampJobs
+{
+    int nJobs;
+    int failingJob;
+    int next;
+    std::vector<std::vector<double> > times;
+    std::vector<std::vector<double> > values;
+    std::vector<int> status;
+};
+
+static int rampNext(void* userData, ExecutableModel* em)
+{
+    RampJobs* jobs = static_cast<RampJobs*>(userData);
+    if (jobs->next >= jobs->nJobs) return -1;
+    int job = jobs->next++;
+    em->constants[0] = (job == jobs->failingJob) ? -1.0 : (double)job;
+    em->states[0] = 0.0;
+    return job;
+}
+
+static void rampOutput(void* userData, int job, int point, ExecutableModel* em)
+{
+    RampJobs* jobs = static_cast<RampJobs*>(userData);
+    EXPECT_EQ((int)jobs->times[job].size(), point);
+    jobs->times[job].push_back(em->outputs[0]);
+    jobs->values[job].push_back(em->outputs[1]);
+}
+
+static void rampFinished(void* userData, int job, int status)
+{
+    static_cast<RampJobs*>(userData)->status[job] = status;
+}
+
+static int runRamps(struct Simulation* simulation, RampJobs& jobs)
+{
+    ExecutableModel em;
+    em.initialise(testCompiledModel(1, 1, 0, NULL, rampRates, 2, rampOutputs), 0.0);
+    jobs.next = 0;
+    jobs.times.assign(jobs.nJobs, std::vector<double>());
+    jobs.values.assign(jobs.nJobs, std::vector<double>());
+    jobs.status.assign(jobs.nJobs, -1);
+    struct BatchIntegrator* integrator = CreateBatchIntegrator(simulation, &em);
+    struct BatchJobQueue queue = {rampNext, rampOutput, rampFinished, &jobs};
+    int code = batchIntegratorRun(integrator, &queue, NULL);
+    DestroyBatchIntegrator(&integrator);
+    return code;
+}
+
+TEST(BatchIntegrator, OutputsAtTheOutputTimes) {
+    // a maximum step much larger than the tabulation step
+    struct Simulation* simulation = testSimulation(0.0, 1000.0, 0.1, 10.0, CVODE, 1.0e-6, 1.0e-6);
+    RampJobs jobs;
+    jobs.nJobs = 11;
+    jobs.failingJob = -1;
+    EXPECT_EQ(OK, runRamps(simulation, jobs));
+    for (int job = 0; job < jobs.nJobs; ++job)
+    {
+        EXPECT_EQ(OK, jobs.status[job]);
+        ASSERT_EQ(10001u, jobs.times[job].size());
+        for (size_t point = 0; point < jobs.times[job].size(); point += 97)
+        {
+            EXPECT_NEAR(0.1*point, jobs.times[job][point], 1.0e-9);
+            EXPECT_NEAR(job*0.1*point, jobs.values[job][point], 1.0e-9*(1.0 + job*point));
+        }
+    }
+    DestroySimulation(&simulation);
+}
+
+TEST(BatchIntegrator, NaNRatesFailTheJob) {
+    struct Simulation* simulation = testSimulation(0.0, 1.0, 0.1, 0.1, CVODE, 1.0e-6, 1.0e-6);
+    RampJobs jobs;
+    jobs.nJobs = 12;
+    jobs.failingJob = 3;
+    // must fail the one job, not loop forever
+    EXPECT_EQ(ERR, runRamps(simulation, jobs));
+    for (int job = 0; job < jobs.nJobs; ++job)
+    {
+        EXPECT_EQ((job == jobs.failingJob) ? ERR : OK, jobs.status[job]);
+        if (job != jobs.failingJob) EXPECT_EQ(11u, jobs.times[job].size());
+    }
+    DestroySimulation(&simulation);
+}
@@ -0,0 +1,96 @@
+#include <string>
+#include <vector>
+
+#include "code-transforms.hpp"
+
+#include "gtest/gtest.h"
+
+TEST(CodeTransforms, RelationalMarkers) {
+    std::vector<std::wstring> roots;
+    std::wstring code = rewriteRelationalMarkers(
+        L"RATES[0] = (CSIM_ROOT_LT(VOI, CONSTANTS[0]) ? 1.0 : 0.0);\n"
+        L"RATES[1] = (CSIM_ROOT_GEQ( pow(STATES[0], 2.0) , f(a, b) ) ? 1.0 : 0.0);\n"
+        L"ALGEBRAIC[0] = (CSIM_ROOT_LT(VOI, CONSTANTS[0]) ? 2.0 : 3.0);\n", &roots);
+    EXPECT_EQ(std::wstring(
+        L"RATES[0] = (((VOI) < (CONSTANTS[0])) ? 1.0 : 0.0);\n"
+        L"RATES[1] = (((pow(STATES[0], 2.0)) >= (f(a, b))) ? 1.0 : 0.0);\n"
+        L"ALGEBRAIC[0] = (((VOI) < (CONSTANTS[0])) ? 2.0 : 3.0);\n"), code);
+    // in the order they appear, without duplicates
+    ASSERT_EQ(2u, roots.size());
+    EXPECT_EQ(std::wstring(L"(VOI) - (CONSTANTS[0])"), roots[0]);
+    EXPECT_EQ(std::wstring(L"(pow(STATES[0], 2.0)) - (f(a, b))"), roots[1]);
+}
+
+TEST(CodeTransforms, NestedRelationalMarkers) {
+    std::vector<std::wstring> roots;
+    std::wstring code = rewriteRelationalMarkers(
+        L"x = CSIM_ROOT_GT(CSIM_ROOT_LEQ(a, b) ? c : d, e);", &roots);
+    EXPECT_EQ(std::wstring(L"x = ((((a) <= (b)) ? c : d) > (e));"), code);
+    ASSERT_EQ(2u, roots.size());
+    EXPECT_EQ(std::wstring(L"(((a) <= (b)) ? c : d) - (e)"), roots[0]);
+    EXPECT_EQ(std::wstring(L"(a) - (b)"), roots[1]);
+}
+
+TEST(CodeTransforms, NaryRelationalMarkers) {
+    std::vector<std::wstring> roots;
+    std::wstring code = rewriteRelationalMarkers(L"x = CSIM_ROOT_LT(a, b, c);", &roots);
+    // a < b < c holds if each consecutive pair is in order, none of the arguments are dropped
+    EXPECT_EQ(std::wstring(L"x = (((a) < (b)) && ((b) < (c)));"), code);
+    ASSERT_EQ(2u, roots.size());
+    EXPECT_EQ(std::wstring(L"(a) - (b)"), roots[0]);
+    EXPECT_EQ(std::wstring(L"(b) - (c)"), roots[1]);
+}
+
+TEST(CodeTransforms, OtherCodeUnchanged) {
+    std::wstring code(L"x = CSIM_ROOT_NEQ(a, b) + CSIM_ROOT_LT(a);\ny = a < b;");
+    std::vector<std::wstring> roots;
+    EXPECT_EQ(code, rewriteRelationalMarkers(code, &roots));
+    EXPECT_TRUE(roots.empty());
+    // roots are optional
+    EXPECT_EQ(std::wstring(L"((a) > (b))"), rewriteRelationalMarkers(L"CSIM_ROOT_GT(a,b)", NULL));
+}
+
+TEST(CodeTransforms, AdjointOfPower) {
+    std::wstring adjoint;
+    // a fixed exponent only has a derivative wrt the base, with no log(a) that isn't finite for a <= 0
+    ASSERT_TRUE(generateAdjointCode(L"RATES[0] = pow(STATES[0], 2.0);", &adjoint));
+    EXPECT_NE(std::wstring::npos, adjoint.find(L"ADJOINT_STATES[0] += seed*2.0*pow(STATES[0], 2.0 - 1.0);"));
+    EXPECT_EQ(std::wstring::npos, adjoint.find(L"log("));
+    // a variable exponent is only differentiated where the base is positive
+    ASSERT_TRUE(generateAdjointCode(L"RATES[0] = pow(STATES[0], CONSTANTS[1]);", &adjoint));
+    EXPECT_NE(std::wstring::npos, adjoint.find(
+        L"ADJOINT_CONSTANTS[1] += ((STATES[0] > 0.0) ? seed*pow(STATES[0], CONSTANTS[1])*log(STATES[0]) : 0.0);"));
+}
+
+TEST(CodeTransforms, GatingVariables) {
+    std::vector<GatingVariable> gates;
+    findGatingVariables(
+        L"ALGEBRAIC[0] = exp(-STATES[0]/10.0);\n"
+        L"RATES[0] = CONSTANTS[0]*STATES[1];\n"
+        L"RATES[1] = (ALGEBRAIC[0] - STATES[1])/CONSTANTS[1];\n"
+        L"RATES[2] = ALGEBRAIC[0]*(1.0 - STATES[2]) - CONSTANTS[2]*STATES[2];\n", &gates);
+    ASSERT_EQ(2u, gates.size());
+    EXPECT_EQ(1, gates[0].stateIndex);
+    EXPECT_EQ(std::wstring(L"ALGEBRAIC[0]"), gates[0].inf);
+    EXPECT_EQ(std::wstring(L"CONSTANTS[1]"), gates[0].tau);
+    EXPECT_EQ(2, gates[1].stateIndex);
+    EXPECT_EQ(std::wstring(L"(ALGEBRAIC[0])/((ALGEBRAIC[0]) + (CONSTANTS[2]))"), gates[1].inf);
+    EXPECT_EQ(std::wstring(L"1.0/((ALGEBRAIC[0]) + (CONSTANTS[2]))"), gates[1].tau);
+}
+
+TEST(CodeTransforms, GatesDependingOnThemselves) {
+    std::vector<GatingVariable> gates;
+    // directly, through a chain of algebraic variables and through the opening rate
+    findGatingVariables(
+        L"ALGEBRAIC[0] = 2.0*STATES[1];\n"
+        L"ALGEBRAIC[1] = ALGEBRAIC[0] + 1.0;\n"
+        L"ALGEBRAIC[2] = exp(STATES[2]);\n"
+        L"RATES[0] = (STATES[0] - STATES[0])/CONSTANTS[0];\n"
+        L"RATES[0] = (CONSTANTS[1] - STATES[0])/STATES[0];\n"
+        L"RATES[1] = (CONSTANTS[1] - STATES[1])/ALGEBRAIC[1];\n"
+        L"RATES[2] = ALGEBRAIC[2]*(1.0 - STATES[2]) - CONSTANTS[2]*STATES[2];\n"
+        L"RATES[3] = (ALGEBRAIC[1] - STATES[3])/CONSTANTS[3];\n", &gates);
+    // only STATES[3] is a gate, its inf depends on another state
+    ASSERT_EQ(1u, gates.size());
+    EXPECT_EQ(3, gates[0].stateIndex);
+}
@@ -0,0 +1,134 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+extern "C"
+{
+#include "common.h"
+#include "ensemble-statistics.h"
+}
+
+#include "gtest/gtest.h"
+
+static const int nPoints = 2;
+static const int nOutputs = 3;
+
+// a reproducible sample of simulation outputs, each output with a different distribution
+static std::vector<std::vector<double> > sampleOutputs(int nSimulations)
+{
+    std::vector<std::vector<double> > outputs(nSimulations, std::vector<double>(nPoints*nOutputs));
+    unsigned long long state = 12345;
+    for (int s = 0; s < nSimulations; ++s)
+    {
+        for (int i = 0; i < nPoints*nOutputs; ++i)
+        {
+            state = state*6364136223846793005ULL + 1442695040888963407ULL;
+            double u = (double)(state >> 11)/9007199254740992.0;
+            if (i % 3 == 0) outputs[s][i] = 1.0e6 + u; // large mean, small spread
+            else if (i % 3 == 1) outputs[s][i] = -std::log(1.0 - u); // skewed
+            else outputs[s][i] = (i + 1)*(u - 0.5);
+        }
+    }
+    return outputs;
+}
+
+// the simulations shared out over nThreads accumulators as the ensemble sweep does, and merged in the
+// given order
+static struct EnsembleStatistics* mergedStatistics(const std::vector<std::vector<double> >& outputs, int nThreads,
+                                                   bool reverse)
+{
+    std::vector<struct EnsembleStatistics*> threads(nThreads);
+    for (int t = 0; t < nThreads; ++t) threads[t] = CreateEnsembleStatistics(nPoints, nOutputs, 0);
+    for (size_t s = 0; s < outputs.size(); ++s) ensembleStatisticsAdd(threads[s % nThreads], &(outputs[s][0]));
+    struct EnsembleStatistics* statistics = CreateEnsembleStatistics(nPoints, nOutputs, 0);
+    for (int t = 0; t < nThreads; ++t)
+        EXPECT_EQ(OK, ensembleStatisticsMerge(statistics, threads[reverse ? nThreads - 1 - t : t]));
+    for (int t = 0; t < nThreads; ++t) DestroyEnsembleStatistics(&(threads[t]));
+    return statistics;
+}
+
+TEST(EnsembleStatistics, MeanAndVarianceIndependentOfMerging) {
+    std::vector<std::vector<double> > outputs = sampleOutputs(1001);
+    int n = nPoints*nOutputs;
+    // two pass reference
+    std::vector<double> mean(n, 0.0), variance(n, 0.0);
+    for (size_t s = 0; s < outputs.size(); ++s)
+        for (int i = 0; i < n; ++i) mean[i] += outputs[s][i]/outputs.size();
+    for (size_t s = 0; s < outputs.size(); ++s)
+        for (int i = 0; i < n; ++i) variance[i] += (outputs[s][i] - mean[i])*(outputs[s][i] - mean[i]);
+    for (int i = 0; i < n; ++i) variance[i] /= outputs.size() - 1;
+
+    int threads[] = {1, 2, 3, 7, 16};
+    for (size_t k = 0; k < sizeof(threads)/sizeof(threads[0]); ++k)
+    {
+        for (int reverse = 0; reverse < 2; ++reverse)
+        {
+            struct EnsembleStatistics* statistics = mergedStatistics(outputs, threads[k], reverse != 0);
+            std::vector<double> count(n), m(n), v(n);
+            ensembleStatisticsCount(statistics, &(count[0]));
+            ensembleStatisticsMean(statistics, &(m[0]));
+            ensembleStatisticsVariance(statistics, &(v[0]));
+            for (int i = 0; i < n; ++i)
+            {
+                EXPECT_EQ((double)outputs.size(), count[i]);
+                EXPECT_NEAR(mean[i], m[i], 1.0e-12*std::fabs(mean[i]));
+                EXPECT_NEAR(variance[i], v[i], 1.0e-9*variance[i]);
+            }
+            DestroyEnsembleStatistics(&statistics);
+        }
+    }
+}
+
+TEST(EnsembleStatistics, QuantilesMatchSortedValues) {
+    std::vector<std::vector<double> > outputs = sampleOutputs(20000);
+    int n = nPoints*nOutputs;
+    double qs[] = {0.0, 0.001, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999, 1.0};
+    for (int nThreads = 1; nThreads <= 4; nThreads += 3)
+    {
+        struct EnsembleStatistics* statistics = mergedStatistics(outputs, nThreads, false);
+        std::vector<double> minimum(n), maximum(n);
+        ensembleStatisticsRange(statistics, &(minimum[0]), &(maximum[0]));
+        for (int i = 0; i < n; ++i)
+        {
+            std::vector<double> sorted(outputs.size());
+            for (size_t s = 0; s < outputs.size(); ++s) sorted[s] = outputs[s][i];
+            std::sort(sorted.begin(), sorted.end());
+            EXPECT_EQ(sorted.front(), minimum[i]);
+            EXPECT_EQ(sorted.back(), maximum[i]);
+        }
+        for (size_t k = 0; k < sizeof(qs)/sizeof(qs[0]); ++k)
+        {
+            std::vector<double> quantile(n);
+            ensembleStatisticsQuantile(statistics, qs[k], &(quantile[0]));
+            for (int i = 0; i < n; ++i)
+            {
+                std::vector<double> sorted(outputs.size());
+                for (size_t s = 0; s < outputs.size(); ++s) sorted[s] = outputs[s][i];
+                std::sort(sorted.begin(), sorted.end());
+                // the fraction of the values below the estimate should be close to q, closer in the tails
+                double rank = (std::lower_bound(sorted.begin(), sorted.end(), quantile[i]) - sorted.begin())/
+                              (double)sorted.size();
+                double tolerance = 0.002 + 0.02*qs[k]*(1.0 - qs[k]);
+                EXPECT_NEAR(qs[k], rank, tolerance) << "q = " << qs[k] << ", output " << i;
+            }
+        }
+        DestroyEnsembleStatistics(&statistics);
+    }
+}
+
+TEST(EnsembleStatistics, NaNsAreLeftOut) {
+    struct EnsembleStatistics* statistics = CreateEnsembleStatistics(1, 2, 0);
+    double values[][2] = {{1.0, NAN}, {2.0, 5.0}, {3.0, NAN}};
+    for (int s = 0; s < 3; ++s) ensembleStatisticsAdd(statistics, values[s]);
+    double count[2], mean[2], variance[2];
+    ensembleStatisticsCount(statistics, count);
+    ensembleStatisticsMean(statistics, mean);
+    ensembleStatisticsVariance(statistics, variance);
+    EXPECT_EQ(3.0, count[0]);
+    EXPECT_EQ(1.0, count[1]);
+    EXPECT_DOUBLE_EQ(2.0, mean[0]);
+    EXPECT_DOUBLE_EQ(5.0, mean[1]);
+    EXPECT_DOUBLE_EQ(1.0, variance[0]);
+    EXPECT_TRUE(std::isnan(variance[1]));
+    DestroyEnsembleStatistics(&statistics);
+}
@@ -0,0 +1,72 @@
+#include <cstdio>
+#include <string>
+
+extern "C"
+{
+#include "common.h"
+}
+
+#include "experimental-data.hpp"
+
+#include "gtest/gtest.h"
+
+static void writeFile(const char* filename, const char* contents)
+{
+    FILE* file = fopen(filename, "w");
+    ASSERT_TRUE(file != NULL);
+    fputs(contents, file);
+    fclose(file);
+}
+
+TEST(ExperimentalData, ReadCSV) {
+    const char* filename = "experimental-data-test.csv";
+    // a header, quoted fields, white space, a blank line, the weight only given for some lines and no
+    // newline at the end
+    writeFile(filename,
+        "time,variable,value,weight\n"
+        "0.0, \"model/V\" ,-85.0\n"
+        "\n"
+        "1.5,model/Cai,1.0e-4,2.5\r\n"
+        "2,model/V,-80");
+    struct ExperimentalData* data = experimentalDataReadCSV(filename);
+    ASSERT_TRUE(data != NULL);
+    ASSERT_EQ(3, experimentalDataNumObservations(data));
+    EXPECT_EQ(std::string("model/V"), experimentalDataVariableId(data, 0));
+    EXPECT_EQ(std::string("model/Cai"), experimentalDataVariableId(data, 1));
+    EXPECT_EQ(std::string("model/V"), experimentalDataVariableId(data, 2));
+    EXPECT_EQ(OK, experimentalDataSetOutput(data, 2, 0));
+    EXPECT_EQ(ERR, experimentalDataSetOutput(data, 3, 0));
+    DestroyExperimentalData(&data);
+    EXPECT_TRUE(data == NULL);
+    remove(filename);
+}
+
+TEST(ExperimentalData, InvalidCSV) {
+    const char* filename = "experimental-data-test.csv";
+    // only the first line can be a header
+    writeFile(filename, "0.0,model/V,-85.0\ntime,variable,value\n");
+    EXPECT_TRUE(experimentalDataReadCSV(filename) == NULL);
+    // a missing value, a missing variable, a weight which isn't a number and a negative weight
+    const char* invalid[] = { "0.0,model/V\n", "0.0,,-85.0\n", "0.0,model/V,-85.0,heavy\n",
+        "0.0,model/V,-85.0,-1\n" };
+    for (size_t i = 0; i < sizeof(invalid)/sizeof(invalid[0]); ++i)
+    {
+        writeFile(filename, invalid[i]);
+        EXPECT_TRUE(experimentalDataReadCSV(filename) == NULL) << invalid[i];
+    }
+    remove(filename);
+    EXPECT_TRUE(experimentalDataReadCSV(filename) == NULL);
+}
+
+TEST(ExperimentalData, AddObservations) {
+    struct ExperimentalData* data = CreateExperimentalData();
+    EXPECT_EQ(OK, experimentalDataAdd(data, 1.0, "model/V", -80.0, 1.0));
+    EXPECT_EQ(OK, experimentalDataAdd(data, 0.5, "model/V", -85.0, 0.0));
+    EXPECT_EQ(ERR, experimentalDataAdd(data, 1.0, "model/V", -80.0, -1.0));
+    EXPECT_EQ(ERR, experimentalDataAdd(data, 1.0, NULL, -80.0, 1.0));
+    // enough to grow the storage
+    for (int i = 0; i < 100; ++i) EXPECT_EQ(OK, experimentalDataAdd(data, 2.0 + i, "model/Cai", 1.0e-4, 1.0));
+    EXPECT_EQ(102, experimentalDataNumObservations(data));
+    EXPECT_EQ(std::string("model/Cai"), experimentalDataVariableId(data, 101));
+    DestroyExperimentalData(&data);
+}
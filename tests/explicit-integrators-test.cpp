@@ -0,0 +1,90 @@
+#include <cmath>
+
+#include "test-models.hpp"
+#include "integrator.hpp"
+#include "explicit-integrators.hpp"
+
+#include "gtest/gtest.h"
+
+// y' = -k y, y(0) = 1
+static void decaySetup(double* constants, double*, double* states)
+{
+    constants[0] = 1.0;
+    states[0] = 1.0;
+}
+
+static void decayRates(double, double* states, double* rates, double* constants, double*)
+{
+    rates[0] = -constants[0]*states[0];
+}
+
+// y' = 1 from y(0) = 0, until the rate becomes NaN at y = 0.5
+static void nanRates(double, double* states, double* rates, double*, double*)
+{
+    rates[0] = (states[0] < 0.5) ? 1.0 : NAN;
+}
+
+// the error in integrating the decay to t = 1 with the given scheme and maximum step size
+static double decayError(enum IntegrationScheme scheme, double maxStep)
+{
+    ExecutableModel em;
+    em.initialise(testCompiledModel(1, 1, 0, decaySetup, decayRates), 0.0);
+    struct Simulation* simulation = testSimulation(0.0, 1.0, 1.0, maxStep, scheme, 1.0e-10, 1.0e-8);
+    struct ExplicitIntegrator* integrator = CreateExplicitIntegrator(simulation, &em);
+    double t = 0.0;
+    EXPECT_EQ(OK, explicitIntegrate(integrator, 1.0, &t));
+    EXPECT_DOUBLE_EQ(1.0, t);
+    double error = std::fabs(em.states[0] - std::exp(-1.0));
+    DestroyExplicitIntegrator(&integrator);
+    DestroySimulation(&simulation);
+    return error;
+}
+
+TEST(ExplicitIntegrators, Accuracy) {
+    // first order
+    EXPECT_LT(decayError(EULER, 0.01), 2.0e-3);
+    EXPECT_GT(decayError(EULER, 0.01), 1.0e-3);
+    EXPECT_LT(decayError(EULER, 0.005)/decayError(EULER, 0.01), 0.55);
+    // fourth order
+    EXPECT_LT(decayError(RK4, 0.1), 1.0e-6);
+    EXPECT_LT(decayError(RK4, 0.05)/decayError(RK4, 0.1), 0.07);
+    // adaptive
+    EXPECT_LT(decayError(RK45, 1.0), 1.0e-7);
+}
+
+TEST(ExplicitIntegrators, NaNRatesFail) {
+    enum IntegrationScheme schemes[] = {EULER, RK4, RK45, RUSH_LARSEN, RUSH_LARSEN2};
+    for (size_t i = 0; i < sizeof(schemes)/sizeof(schemes[0]); ++i)
+    {
+        ExecutableModel em;
+        em.initialise(testCompiledModel(1, 0, 0, NULL, nanRates), 0.0);
+        struct Simulation* simulation = testSimulation(0.0, 1.0, 1.0, 0.01, schemes[i]);
+        struct ExplicitIntegrator* integrator = CreateExplicitIntegrator(simulation, &em);
+        double t = 0.0;
+        // must fail, not loop forever
+        EXPECT_EQ(ERR, explicitIntegrate(integrator, 1.0, &t)) << integrationSchemeToString(schemes[i]);
+        EXPECT_LT(t, 0.6);
+        DestroyExplicitIntegrator(&integrator);
+        DestroySimulation(&simulation);
+    }
+}
+
+TEST(ExplicitIntegrators, MaxNumSteps) {
+    ExecutableModel em;
+    em.initialise(testCompiledModel(1, 1, 0, decaySetup, decayRates), 0.0);
+    struct Simulation* simulation = testSimulation(0.0, 1.0, 1.0, 0.001, EULER);
+    simulationSetMaxNumSteps(simulation, 100);
+    struct ExplicitIntegrator* integrator = CreateExplicitIntegrator(simulation, &em);
+    double t = 0.0;
+    EXPECT_EQ(ERR, explicitIntegrate(integrator, 1.0, &t));
+    EXPECT_NEAR(0.1, t, 1.0e-12);
+    // the limit is on the steps to reach each output time
+    EXPECT_EQ(OK, explicitIntegrate(integrator, 0.2, &t));
+    DestroyExplicitIntegrator(&integrator);
+    simulationSetMaxNumSteps(simulation, 2000);
+    em.states[0] = 1.0;
+    integrator = CreateExplicitIntegrator(simulation, &em);
+    EXPECT_EQ(OK, explicitIntegrate(integrator, 1.0, &t));
+    DestroyExplicitIntegrator(&integrator);
+    DestroySimulation(&simulation);
+}
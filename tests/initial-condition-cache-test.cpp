@@ -0,0 +1,83 @@
+#include <cstdio>
+
+#include "test-models.hpp"
+#include "initial-condition-cache.hpp"
+
+#include "gtest/gtest.h"
+
+static void cacheSetup(double* constants, double*, double* states)
+{
+    constants[0] = 2.0;
+    states[0] = 1.0;
+    states[1] = -1.0;
+}
+
+static void cacheRates(double, double*, double* rates, double*, double*)
+{
+    rates[0] = 0.0;
+    rates[1] = 0.0;
+}
+
+TEST(InitialConditionCache, KeyCoversTheSettings) {
+    ExecutableModel em;
+    em.initialise(testCompiledModel(2, 1, 0, cacheSetup, cacheRates), 0.0);
+    struct Simulation* simulation = testSimulation(0.0, 1000.0, 1.0, 0.5, CVODE);
+    uint64_t key = initialConditionCacheKey(1, simulation, &em, 0.0, 1000.0, 1.0e-6);
+    EXPECT_EQ(key, initialConditionCacheKey(1, simulation, &em, 0.0, 1000.0, 1.0e-6));
+    // the model, protocol, constants and states
+    EXPECT_NE(key, initialConditionCacheKey(2, simulation, &em, 0.0, 1000.0, 1.0e-6));
+    EXPECT_NE(key, initialConditionCacheKey(1, simulation, &em, 0.0, 500.0, 1.0e-6));
+    em.constants[0] = 3.0;
+    EXPECT_NE(key, initialConditionCacheKey(1, simulation, &em, 0.0, 1000.0, 1.0e-6));
+    em.constants[0] = 2.0;
+    em.states[1] = 0.0;
+    EXPECT_NE(key, initialConditionCacheKey(1, simulation, &em, 0.0, 1000.0, 1.0e-6));
+    em.states[1] = -1.0;
+    ASSERT_EQ(key, initialConditionCacheKey(1, simulation, &em, 0.0, 1000.0, 1.0e-6));
+    // and each of the integration settings
+    simulationSetMultistepMethod(simulation, ADAMS);
+    uint64_t adams = initialConditionCacheKey(1, simulation, &em, 0.0, 1000.0, 1.0e-6);
+    simulationSetMultistepMethod(simulation, BDF);
+    uint64_t bdf = initialConditionCacheKey(1, simulation, &em, 0.0, 1000.0, 1.0e-6);
+    EXPECT_NE(adams, bdf);
+    simulationSetRootFinding(simulation, !simulationGetRootFinding(simulation));
+    EXPECT_NE(bdf, initialConditionCacheKey(1, simulation, &em, 0.0, 1000.0, 1.0e-6));
+    simulationSetRootFinding(simulation, !simulationGetRootFinding(simulation));
+    ASSERT_EQ(bdf, initialConditionCacheKey(1, simulation, &em, 0.0, 1000.0, 1.0e-6));
+    simulationSetMaxNumSteps(simulation, 1000);
+    EXPECT_NE(bdf, initialConditionCacheKey(1, simulation, &em, 0.0, 1000.0, 1.0e-6));
+    simulationSetMaxNumSteps(simulation, 0);
+    EXPECT_EQ(bdf, initialConditionCacheKey(1, simulation, &em, 0.0, 1000.0, 1.0e-6));
+    simulationSetRTol(simulation, 1.0e-4);
+    EXPECT_NE(bdf, initialConditionCacheKey(1, simulation, &em, 0.0, 1000.0, 1.0e-6));
+    DestroySimulation(&simulation);
+}
+
+TEST(InitialConditionCache, LookupAndStore) {
+    const char* cacheFile = "initial-condition-cache-test.txt";
+    remove(cacheFile);
+    double states[2] = {1.5, -2.5}, found[2], pacedTime;
+    EXPECT_EQ(ERR, initialConditionCacheLookup(cacheFile, 42, 2, found, &pacedTime));
+    EXPECT_EQ(OK, initialConditionCacheStore(cacheFile, 42, 2, states, 1000.0));
+    // a second store of the same key is ignored
+    double other[2] = {0.0, 0.0};
+    EXPECT_EQ(OK, initialConditionCacheStore(cacheFile, 42, 2, other, 2000.0));
+    EXPECT_EQ(OK, initialConditionCacheLookup(cacheFile, 42, 2, found, &pacedTime));
+    EXPECT_EQ(1.5, found[0]);
+    EXPECT_EQ(-2.5, found[1]);
+    EXPECT_EQ(1000.0, pacedTime);
+    // the key and number of states must both match
+    EXPECT_EQ(ERR, initialConditionCacheLookup(cacheFile, 43, 2, found, &pacedTime));
+    EXPECT_EQ(ERR, initialConditionCacheLookup(cacheFile, 42, 3, found, &pacedTime));
+    // a partly written entry left by a writer which crashed is skipped
+    FILE* file = fopen(cacheFile, "a");
+    fputs("000000000000002b 2 1000 1.0", file);
+    fclose(file);
+    EXPECT_EQ(ERR, initialConditionCacheLookup(cacheFile, 43, 2, found, &pacedTime));
+    EXPECT_EQ(OK, initialConditionCacheStore(cacheFile, 43, 2, other, 2000.0));
+    EXPECT_EQ(OK, initialConditionCacheLookup(cacheFile, 43, 2, found, &pacedTime));
+    EXPECT_EQ(2000.0, pacedTime);
+    EXPECT_EQ(OK, initialConditionCacheLookup(cacheFile, 42, 2, found, &pacedTime));
+    EXPECT_EQ(1000.0, pacedTime);
+    remove(cacheFile);
+}
@@ -0,0 +1,108 @@
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+extern "C"
+{
+#include "common.h"
+#include "linear-algebra.h"
+}
+
+#include "gtest/gtest.h"
+
+// a reproducible, diagonally dominant n by n matrix
+static std::vector<double> testMatrix(int n, unsigned long long seed)
+{
+    std::vector<double> a(n*n);
+    for (int i = 0; i < n*n; ++i)
+    {
+        seed = seed*6364136223846793005ULL + 1442695040888963407ULL;
+        a[i] = (double)(seed >> 11)/9007199254740992.0 - 0.5;
+    }
+    for (int i = 0; i < n; ++i) a[i*n+i] += n;
+    return a;
+}
+
+TEST(LinearAlgebra, LUSolve) {
+    int n = 5;
+    std::vector<double> a = testMatrix(n, 1), lu(a);
+    std::vector<double> x(n), b(n, 0.0);
+    for (int i = 0; i < n; ++i) x[i] = i - 2.0;
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) b[i] += a[i*n+j]*x[j];
+    std::vector<int> pivots(n);
+    ASSERT_EQ(OK, denseLUFactor(n, &(lu[0]), &(pivots[0])));
+    denseLUSolve(n, &(lu[0]), &(pivots[0]), &(b[0]));
+    for (int i = 0; i < n; ++i) EXPECT_NEAR(x[i], b[i], 1.0e-13);
+}
+
+TEST(LinearAlgebra, LUSingular) {
+    double a[] = {1.0, 2.0, 2.0, 4.0};
+    int pivots[2];
+    EXPECT_EQ(ERR, denseLUFactor(2, a, pivots));
+}
+
+TEST(LinearAlgebra, BatchedLUMatchesScalar) {
+    int n = 4, width = 5;
+    std::vector<double> a(n*n*width), b(n*width), scalar(n*width);
+    for (int l = 0; l < width; ++l)
+    {
+        std::vector<double> system = testMatrix(n, l + 10);
+        // one of the systems is singular
+        if (l == 3) for (int j = 0; j < n; ++j) system[n+j] = 2.0*system[j];
+        std::vector<double> rhs(n);
+        for (int i = 0; i < n; ++i) rhs[i] = l + i;
+        for (int i = 0; i < n*n; ++i) a[i*width+l] = system[i];
+        for (int i = 0; i < n; ++i) b[i*width+l] = rhs[i];
+        std::vector<int> pivots(n);
+        if (denseLUFactor(n, &(system[0]), &(pivots[0])) == OK)
+        {
+            denseLUSolve(n, &(system[0]), &(pivots[0]), &(rhs[0]));
+            for (int i = 0; i < n; ++i) scalar[i*width+l] = rhs[i];
+        }
+    }
+    std::vector<int> pivots(n*width), singular(width);
+    EXPECT_EQ(ERR, denseLUFactorBatch(n, width, &(a[0]), &(pivots[0]), &(singular[0])));
+    denseLUSolveBatch(n, width, &(a[0]), &(pivots[0]), &(b[0]));
+    for (int l = 0; l < width; ++l)
+    {
+        EXPECT_EQ((l == 3) ? 1 : 0, singular[l]);
+        if (singular[l]) continue;
+        for (int i = 0; i < n; ++i) EXPECT_NEAR(scalar[i*width+l], b[i*width+l], 1.0e-13);
+    }
+}
+
+TEST(LinearAlgebra, SymmetricEigen) {
+    int n = 6;
+    std::vector<double> a = testMatrix(n, 7);
+    for (int i = 0; i < n; ++i)
+        for (int j = 0; j < i; ++j) a[i*n+j] = a[j*n+i];
+    std::vector<double> work(a), eigenvalues(n), eigenvectors(n*n);
+    ASSERT_EQ(OK, denseSymmetricEigen(n, &(work[0]), &(eigenvalues[0]), &(eigenvectors[0])));
+    for (int k = 0; k < n; ++k)
+    {
+        // a v = lambda v
+        for (int i = 0; i < n; ++i)
+        {
+            double av = 0.0;
+            for (int j = 0; j < n; ++j) av += a[i*n+j]*eigenvectors[j*n+k];
+            EXPECT_NEAR(eigenvalues[k]*eigenvectors[i*n+k], av, 1.0e-12);
+        }
+        // and the eigenvectors are orthonormal
+        for (int l = 0; l < n; ++l)
+        {
+            double dot = 0.0;
+            for (int i = 0; i < n; ++i) dot += eigenvectors[i*n+k]*eigenvectors[i*n+l];
+            EXPECT_NEAR((k == l) ? 1.0 : 0.0, dot, 1.0e-12);
+        }
+    }
+}
+
+TEST(LinearAlgebra, SymmetricEigenKnownValues) {
+    double a[] = {2.0, 1.0, 1.0, 2.0};
+    double eigenvalues[2], eigenvectors[4];
+    ASSERT_EQ(OK, denseSymmetricEigen(2, a, eigenvalues, eigenvectors));
+    double smallest = std::min(eigenvalues[0], eigenvalues[1]), largest = std::max(eigenvalues[0], eigenvalues[1]);
+    EXPECT_NEAR(1.0, smallest, 1.0e-14);
+    EXPECT_NEAR(3.0, largest, 1.0e-14);
+}
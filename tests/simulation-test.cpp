@@ -0,0 +1,56 @@
+#include <cstdlib>
+#include <cstdio>
+
+extern "C"
+{
+#include "common.h"
+#include "simulation.h"
+#include "outputVariables.h"
+}
+
+#include "gtest/gtest.h"
+
+TEST(Simulation, MaxNumStepsCanBeCleared) {
+    struct Simulation* simulation = CreateSimulation();
+    EXPECT_FALSE(simulationIsMaxNumStepsSet(simulation));
+    EXPECT_EQ(OK, simulationSetMaxNumSteps(simulation, 100));
+    EXPECT_TRUE(simulationIsMaxNumStepsSet(simulation));
+    EXPECT_EQ(100, simulationGetMaxNumSteps(simulation));
+    // back to the integrator's default
+    EXPECT_EQ(OK, simulationSetMaxNumSteps(simulation, 0));
+    EXPECT_FALSE(simulationIsMaxNumStepsSet(simulation));
+    EXPECT_EQ(ERR, simulationSetMaxNumSteps(simulation, -1));
+    DestroySimulation(&simulation);
+}
+
+TEST(Simulation, VariableAbsoluteTolerances) {
+    struct Simulation* simulation = CreateSimulation();
+    double aTol = 1.0e-6;
+    simulationSetATol(simulation, 1, &aTol);
+    void* list = outputVariablesCreate();
+    // as located in the generated code: a state variable, a constant and a state with no tolerance
+    outputVariablesAppendVariable(list, "c", "x", 1);
+    outputVariablesSetCodeArray(list, 0, STATE_ARRAY);
+    outputVariablesSetCodeIndex(list, 0, 2);
+    outputVariablesSetAbsoluteTolerance(list, 0, 1.0e-9);
+    outputVariablesAppendVariable(list, "c", "k", 2);
+    outputVariablesSetCodeArray(list, 1, CONSTANT_ARRAY);
+    outputVariablesSetCodeIndex(list, 1, 0);
+    outputVariablesSetAbsoluteTolerance(list, 1, 1.0e-3);
+    outputVariablesAppendVariable(list, "c", "y", 3);
+    outputVariablesSetCodeArray(list, 2, STATE_ARRAY);
+    outputVariablesSetCodeIndex(list, 2, 0);
+    simulationSetOutputVariables(simulation, list);
+
+    EXPECT_EQ(OK, simulationApplyVariableATol(simulation, 4));
+    ASSERT_EQ(4, simulationGetATolLength(simulation));
+    double* tolerances = simulationGetATol(simulation);
+    EXPECT_EQ(1.0e-6, tolerances[0]);
+    EXPECT_EQ(1.0e-6, tolerances[1]);
+    EXPECT_EQ(1.0e-9, tolerances[2]);
+    EXPECT_EQ(1.0e-6, tolerances[3]);
+    free(tolerances);
+    // the tolerances no longer match the number of state variables
+    EXPECT_EQ(ERR, simulationApplyVariableATol(simulation, 3));
+    DestroySimulation(&simulation);
+}
@@ -0,0 +1,63 @@
+#ifndef _TEST_MODELS_HPP_
+#define _TEST_MODELS_HPP_
+
+/*
+ * Small models with hand written code in place of the code generated from a CellML model, so the
+ * numerical routines can be tested without a model to compile.
+ */
+#include <memory>
+
+extern "C"
+{
+#include "common.h"
+#include "simulation.h"
+}
+
+#include "CompiledModel.hpp"
+#include "ExecutableModel.hpp"
+
+static void testModelNoConstants(double*, double*, double*)
+{
+}
+
+static void testModelNoVariables(double, double*, double*, double*, double*)
+{
+}
+
+/*
+ * A compiled model with the given numbers of variables, initial values (setup may be NULL to start
+ * from zero) and rates. The outputs (if any) are set by outputs, which may be NULL to leave them alone.
+ */
+static inline std::shared_ptr<CompiledModel> testCompiledModel(int nRates, int nConstants, int nAlgebraic,
+    SetupFixedConstantsFunction setup, ComputeRatesFunction rates, int nOutputs = 0, GetOutputsFunction outputs = 0)
+{
+    std::shared_ptr<CompiledModel> model(new CompiledModel());
+    model->nBound = 1;
+    model->nRates = nRates;
+    model->nConstants = nConstants;
+    model->nAlgebraic = nAlgebraic;
+    model->nOutputs = nOutputs;
+    model->setupFixedConstants = setup ? setup : testModelNoConstants;
+    model->computeRates = rates;
+    model->evaluateVariables = testModelNoVariables;
+    model->getOutputs = outputs ? outputs : testModelNoVariables;
+    return model;
+}
+
+/* A simulation of the bound variable from start to end with the given tabulation and maximum step
+   sizes, integration scheme and (scalar) tolerances */
+static inline struct Simulation* testSimulation(double start, double end, double tabStep, double maxStep,
+    enum IntegrationScheme scheme, double aTol = 1.0e-8, double rTol = 1.0e-6)
+{
+    struct Simulation* simulation = CreateSimulation();
+    simulationSetBvarStart(simulation, start);
+    simulationSetBvarEnd(simulation, end);
+    simulationSetBvarTabStep(simulation, tabStep);
+    simulationSetBvarMaxStep(simulation, maxStep);
+    simulationSetIntegrationScheme(simulation, scheme);
+    simulationSetATol(simulation, 1, &aTol);
+    simulationSetRTol(simulation, rTol);
+    return simulation;
+}
+
+#endif /* _TEST_MODELS_HPP_ */